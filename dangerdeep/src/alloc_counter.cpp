@@ -0,0 +1,78 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// counting of heap allocations for profiling
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "alloc_counter.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <new>
+#include <cstdlib>
+
+static volatile unsigned long nr_allocations = 0;
+
+// operator new may be called from several threads at once.
+static inline void count_allocation()
+{
+#ifdef __GNUC__
+	__sync_fetch_and_add(&nr_allocations, 1);
+#else
+	++nr_allocations;	// not exact with threads, but good enough for profiling
+#endif
+}
+
+static void* counted_alloc(std::size_t sz)
+{
+	count_allocation();
+	void* p = std::malloc(sz ? sz : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(std::size_t sz) throw(std::bad_alloc) { return counted_alloc(sz); }
+void* operator new[](std::size_t sz) throw(std::bad_alloc) { return counted_alloc(sz); }
+void operator delete(void* p) throw() { std::free(p); }
+void operator delete[](void* p) throw() { std::free(p); }
+
+bool alloc_counter::enabled()
+{
+	return true;
+}
+
+unsigned long alloc_counter::get_count()
+{
+	return nr_allocations;
+}
+
+#else
+
+bool alloc_counter::enabled()
+{
+	return false;
+}
+
+unsigned long alloc_counter::get_count()
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// counting of heap allocations for profiling
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+///\brief Counts calls to global operator new, for profiling of heap traffic.
+/** Counting is only compiled in when COUNT_ALLOCATIONS is defined (build with
+    countallocs=1), otherwise the counter always stays zero.
+*/
+class alloc_counter
+{
+ public:
+	/// is counting compiled in?
+	static bool enabled();
+
+	/// get number of allocations since program start
+	static unsigned long get_count();
+};
+
+#endif
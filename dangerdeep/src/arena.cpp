@@ -0,0 +1,155 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// per-tick arena allocator
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "arena.h"
+#include <cstdlib>
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+static THREAD_LOCAL arena* current_arena = 0;
+
+/* Every allocation made with allocate_current() is preceded by a header that
+   stores the arena it came from, or NULL for heap memory. So memory can be
+   freed from any thread, also when it was allocated while another or no arena
+   was bound. The header has the size of the alignment.
+*/
+static const std::size_t alignment = 16;
+
+static inline std::size_t align_size(std::size_t sz)
+{
+	return (sz + alignment - 1) & ~(alignment - 1);
+}
+
+
+
+arena::arena(std::size_t blocksize_)
+	: blocksize(align_size(blocksize_)), curblock(0), offset(0), used(0)
+{
+}
+
+
+
+arena::~arena()
+{
+	reset();
+	for (unsigned i = 0; i < blocks.size(); ++i)
+		std::free(blocks[i]);
+}
+
+
+
+void* arena::allocate(std::size_t sz)
+{
+	sz = align_size(sz);
+	used += sz;
+	if (sz > blocksize) {
+		large_blocks.push_back(0);
+		char* p = static_cast<char*>(std::malloc(sz));
+		if (!p) throw std::bad_alloc();
+		large_blocks.back() = p;
+		return p;
+	}
+	if (curblock < blocks.size() && offset + sz > blocksize) {
+		++curblock;
+		offset = 0;
+	}
+	if (curblock == blocks.size()) {
+		blocks.push_back(0);
+		char* p = static_cast<char*>(std::malloc(blocksize));
+		if (!p) throw std::bad_alloc();
+		blocks.back() = p;
+		offset = 0;
+	}
+	void* result = blocks[curblock] + offset;
+	offset += sz;
+	return result;
+}
+
+
+
+void arena::reset()
+{
+	for (unsigned i = 0; i < large_blocks.size(); ++i)
+		std::free(large_blocks[i]);
+	large_blocks.clear();
+	curblock = 0;
+	offset = 0;
+	used = 0;
+}
+
+
+
+std::size_t arena::get_capacity() const
+{
+	return blocks.size() * blocksize;
+}
+
+
+
+arena* arena::current()
+{
+	return current_arena;
+}
+
+
+
+void* arena::allocate_current(std::size_t sz)
+{
+	arena* a = current_arena;
+	char* p;
+	if (a) {
+		p = static_cast<char*>(a->allocate(sz + alignment));
+	} else {
+		p = static_cast<char*>(::operator new(sz + alignment));
+	}
+	*reinterpret_cast<arena**>(p) = a;
+	return p + alignment;
+}
+
+
+
+void arena::deallocate_current(void* p)
+{
+	if (!p) return;
+	char* base = static_cast<char*>(p) - alignment;
+	if (*reinterpret_cast<arena**>(base) == 0)
+		::operator delete(base);
+}
+
+
+
+arena::binder::binder(arena& a)
+	: previous(current_arena)
+{
+	current_arena = &a;
+}
+
+
+
+arena::binder::~binder()
+{
+	current_arena = previous;
+}
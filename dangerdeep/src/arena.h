@@ -0,0 +1,136 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// per-tick arena allocator
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <list>
+#include <cstddef>
+#include <new>
+
+///\brief Bump allocator for temporary data of one simulation step.
+/** Memory is taken from large blocks by increasing an offset, freeing single
+    allocations does nothing, reset() makes all memory available again but
+    keeps the blocks. So after the first steps a simulation step does no calls
+    to the global allocator for its temporaries.
+    Each thread that simulates has its own arena that it binds as current
+    arena with the binder class. arena_allocator takes its memory from the
+    current arena of the calling thread, or from the heap if there is none,
+    so the same containers can be used outside of the simulation as well.
+    Everything allocated in an arena must be destroyed before it is reset.
+*/
+class arena
+{
+ public:
+	/// create arena, blocks have the given size in bytes
+	arena(std::size_t blocksize = 256*1024);
+	~arena();
+
+	/// allocate memory from the arena, aligned to 16 bytes
+	void* allocate(std::size_t sz);
+
+	/// make all memory available again, keeps allocated blocks
+	void reset();
+
+	/// get number of bytes allocated since last reset
+	std::size_t get_used() const { return used; }
+
+	/// get number of bytes allocated from heap for blocks
+	std::size_t get_capacity() const;
+
+	/// get arena bound to calling thread, or NULL
+	static arena* current();
+
+	/// allocate from current arena or from heap, free with deallocate_current
+	static void* allocate_current(std::size_t sz);
+
+	/// free memory from allocate_current, does nothing if it came from an arena
+	static void deallocate_current(void* p);
+
+	/// binds an arena to the calling thread during its lifetime
+	class binder
+	{
+		arena* previous;
+		binder(const binder& );
+		binder& operator= (const binder& );
+	 public:
+		binder(arena& a);
+		~binder();
+	};
+
+ protected:
+	std::size_t blocksize;
+	std::vector<char*> blocks;
+	std::vector<char*> large_blocks;	// allocations larger than blocksize, freed on reset
+	unsigned curblock;
+	std::size_t offset;
+	std::size_t used;
+
+ private:
+	arena(const arena& );
+	arena& operator= (const arena& );
+};
+
+
+
+///\brief STL allocator that takes memory from the current arena of the calling thread.
+/** Use it only for containers that live no longer than a simulation step.
+*/
+template <class T>
+class arena_allocator
+{
+ public:
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef T value_type;
+	template <class U> struct rebind { typedef arena_allocator<U> other; };
+
+	arena_allocator() {}
+	arena_allocator(const arena_allocator& ) {}
+	template <class U> arena_allocator(const arena_allocator<U>& ) {}
+
+	pointer address(reference x) const { return &x; }
+	const_pointer address(const_reference x) const { return &x; }
+	pointer allocate(size_type n, const void* = 0) {
+		return static_cast<pointer>(arena::allocate_current(n * sizeof(T)));
+	}
+	void deallocate(pointer p, size_type ) { arena::deallocate_current(p); }
+	size_type max_size() const { return size_type(-1) / sizeof(T); }
+	void construct(pointer p, const T& val) { new(static_cast<void*>(p)) T(val); }
+	void destroy(pointer p) { p->~T(); }
+};
+
+template <class T, class U>
+inline bool operator== (const arena_allocator<T>& , const arena_allocator<U>& ) { return true; }
+template <class T, class U>
+inline bool operator!= (const arena_allocator<T>& , const arena_allocator<U>& ) { return false; }
+
+/// container types using the arena
+template <class T> struct arena_vector { typedef std::vector<T, arena_allocator<T> > type; };
+template <class T> struct arena_list { typedef std::list<T, arena_allocator<T> > type; };
+
+#endif
@@ -32,6 +32,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include <cstdlib>
 #include <algorithm>
 #include <sstream>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 //#include <iostream>
 
@@ -85,6 +88,8 @@ class bivector
 	const vector2i& size() const { return datasize; }
 	void resize(const vector2i& newsz, const T& v = T());
 	bivector<T> sub_area(const vector2i& offset, const vector2i& sz) const;
+	/// sub_area without allocating a new bivector, result's storage is reused
+	void sub_area(const vector2i& offset, const vector2i& sz, bivector<T>& result) const;
 	///@note bivector must have power of two dimensions for this!
 	bivector<T> shifted(const vector2i& offset) const;
 	bivector<T> transposed() const;
@@ -104,6 +109,9 @@ class bivector
 	// special operations
 	bivector<T> upsampled(bool wrap = false) const;
 	bivector<T> downsampled(bool force_even_size = false) const;
+	/// versions that store to result and reuse its storage
+	void upsampled(bivector<T>& result, bool wrap = false) const;
+	void downsampled(bivector<T>& result, bool force_even_size = false) const;
 	T get_min() const;
 	T get_max() const;
 	T get_min_abs() const;
@@ -112,6 +120,10 @@ class bivector
 	bivector<T>& operator+= (const T& v);
 	bivector<T>& operator+= (const bivector<T>& v);
 	bivector<T> smooth_upsampled(bool wrap = false) const;
+	/// compute only an area of smooth_upsampled(wrap), same as
+	/// smooth_upsampled(wrap).sub_area(offset, sz) but without the full size temporary
+	void smooth_upsampled(const vector2i& offset, const vector2i& sz, bivector<T>& result,
+			      bool wrap = false) const;
 
 	// algebraic operations, omponent-wise add, sub, multiply (of same datasize)
 	// sum of square of differences etc.
@@ -125,6 +137,12 @@ class bivector
 	bivector<T>& insert(const bivector<T>& other, const vector2i& offset);
 		
 		template<class U> friend class bivector;
+
+ protected:
+	void set_size(const vector2i& sz) { datasize = sz; data.resize(sz.x*sz.y); }
+	/// row kernel: dst[i] = a[i]*c[0] + b[i]*c[1] + c[i]*c[2] + d[i]*c[3]
+	static void combine4(const T* a, const T* b, const T* c, const T* d, const float* coeff,
+			     T* dst, int n);
 };
 
 template <class T>
@@ -213,13 +231,23 @@ bivector<T> bivector<T>::sub_area(const vector2i& offset, const vector2i& sz) co
 {
 	if (offset.y + sz.y > datasize.y) throw std::invalid_argument("bivector::sub_area, offset.y invalid");
 	if (offset.x + sz.x > datasize.x) throw std::invalid_argument("bivector::sub_area, offset.x invalid");
-	bivector<T> result(sz);
-	for (int y=0; y < result.datasize.y; ++y)
-		for (int x=0; x < result.datasize.x; ++x)
-			result.at(x,y) = at(offset.x+x, offset.y+y);
+	bivector<T> result;
+	sub_area(offset, sz, result);
 	return result;
 }
 
+template <class T>
+void bivector<T>::sub_area(const vector2i& offset, const vector2i& sz, bivector<T>& result) const
+{
+	if (offset.y + sz.y > datasize.y) throw std::invalid_argument("bivector::sub_area, offset.y invalid");
+	if (offset.x + sz.x > datasize.x) throw std::invalid_argument("bivector::sub_area, offset.x invalid");
+	result.set_size(sz);
+	for (int y=0; y < sz.y; ++y) {
+		typename std::vector<T>::const_iterator src = data.begin() + (offset.y+y)*datasize.x + offset.x;
+		std::copy(src, src + sz.x, result.data.begin() + y*sz.x);
+	}
+}
+
 template <class T>
 bivector<T> bivector<T>::shifted(const vector2i& offset) const
 {
@@ -256,6 +284,14 @@ bivector<U> bivector<T>::convert(const T& minv, const T& maxv) const
 
 template <class T>
 bivector<T> bivector<T>::upsampled(bool wrap) const
+{
+	bivector<T> result;
+	upsampled(result, wrap);
+	return result;
+}
+
+template <class T>
+void bivector<T>::upsampled(bivector<T>& result, bool wrap) const
 {
 	/* upsampling generates 3 new values out of the 4 surrounding
 	   values like this: (x - surrounding values, numbers: generated)
@@ -272,7 +308,7 @@ bivector<T> bivector<T>::upsampled(bool wrap) const
 	*/
 	if (datasize.x < 1 || datasize.y < 1) throw std::invalid_argument("bivector::upsampled base size invalid");
 	vector2i resultsize = wrap ? datasize*2 : datasize*2 - vector2i(1,1);
-	bivector<T> result(resultsize);
+	result.set_size(resultsize);
 	// copy values that are kept and interpolate missing values on even rows
 	for (int y=0; y < datasize.y; ++y) {
 		for (int x=0; x < datasize.x-1; ++x) {
@@ -306,11 +342,18 @@ bivector<T> bivector<T>::upsampled(bool wrap) const
 			result.at(x, resultsize.y-1) = T((result.at(x, resultsize.y-2) + result.at(x, 0)) * 0.5);
 		}
 	}
-	return result;
 }
 
 template <class T>
 bivector<T> bivector<T>::downsampled(bool force_even_size) const
+{
+	bivector<T> result;
+	downsampled(result, force_even_size);
+	return result;
+}
+
+template <class T>
+void bivector<T>::downsampled(bivector<T>& result, bool force_even_size) const
 {
 	/* downsampling builds the average of 2x2 pixels.
 	   if "force_even_size" is false:
@@ -329,7 +372,9 @@ bivector<T> bivector<T>::downsampled(bool force_even_size) const
 		resultsize.x += datasize.x & 1;
 		resultsize.y += datasize.x & 1;
 	}
-	bivector<T> result(resultsize);
+	// not all values are written for some odd sizes
+	result.datasize = resultsize;
+	result.data.assign(resultsize.x*resultsize.y, T());
 	for (int y=0; y < newsize.y; ++y)
 		for (int x=0; x < newsize.x; ++x)
 			result.at(x,y) = T((at(2*x, 2*y) + at(2*x+1, 2*y) + at(2*x, 2*y+1) + at(2*x+1, 2*y+1)) * 0.25);
@@ -348,7 +393,6 @@ bivector<T> bivector<T>::downsampled(bool force_even_size) const
 			result.at(newsize.x, newsize.y) = at(datasize.x-1, datasize.y-1);
 		}
 	}
-	return result;
 }
 
 template <class T>
@@ -461,6 +505,95 @@ bivector<T> bivector<T>::smooth_upsampled(bool wrap) const
 	return result;
 }
 
+template <class T>
+void bivector<T>::combine4(const T* a, const T* b, const T* c, const T* d, const float* coeff,
+			   T* dst, int n)
+{
+	for (int i = 0; i < n; ++i)
+		dst[i] = T(a[i] * coeff[0] + b[i] * coeff[1] + c[i] * coeff[2] + d[i] * coeff[3]);
+}
+
+#ifdef __SSE__
+template <>
+inline void bivector<float>::combine4(const float* a, const float* b, const float* c, const float* d,
+				      const float* coeff, float* dst, int n)
+{
+	// same order of operations as the generic version, so results are equal
+	__m128 c0 = _mm_set1_ps(coeff[0]), c1 = _mm_set1_ps(coeff[1]);
+	__m128 c2 = _mm_set1_ps(coeff[2]), c3 = _mm_set1_ps(coeff[3]);
+	int i = 0;
+	for ( ; i + 4 <= n; i += 4) {
+		__m128 t = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + i), c0), _mm_mul_ps(_mm_loadu_ps(b + i), c1));
+		t = _mm_add_ps(t, _mm_mul_ps(_mm_loadu_ps(c + i), c2));
+		t = _mm_add_ps(t, _mm_mul_ps(_mm_loadu_ps(d + i), c3));
+		_mm_storeu_ps(dst + i, t);
+	}
+	for ( ; i < n; ++i)
+		dst[i] = a[i] * coeff[0] + b[i] * coeff[1] + c[i] * coeff[2] + d[i] * coeff[3];
+}
+#endif
+
+template <class T>
+void bivector<T>::smooth_upsampled(const vector2i& offset, const vector2i& sz, bivector<T>& result,
+				   bool wrap) const
+{
+	/* The same computation as smooth_upsampled, but only rows and columns of the
+	   area are generated, row by row. The special cases at the borders are the
+	   same as using neighbours that are clamped to the border or wrapped.
+	   Even result rows are horizontally upsampled source rows, they are computed
+	   once for all needed source rows. Odd result rows are interpolated from
+	   four of them.
+	*/
+	static const float c1[4] = { -1.0f/16, 9.0f/16, 9.0f/16, -1.0f/16 };
+	if (datasize.x < 3 || datasize.y < 3) throw std::invalid_argument("bivector::smooth_upsampled base size invalid");
+	vector2i resultsize = wrap ? datasize*2 : datasize*2 - vector2i(1,1);
+	if (offset.x < 0 || offset.x + sz.x > resultsize.x || offset.y < 0 || offset.y + sz.y > resultsize.y)
+		throw std::invalid_argument("bivector::smooth_upsampled, area invalid");
+	result.set_size(sz);
+	if (sz.x <= 0 || sz.y <= 0)
+		return;
+
+	// odd columns x*2+1 that are needed
+	int odd_first = offset.x / 2, odd_last = (offset.x + sz.x - 2) / 2;
+	int nr_odd = std::max(odd_last - odd_first + 1, 0);
+	// source rows that are needed, index with neighbours
+	int row_first = offset.y / 2 - 1, row_last = (offset.y + sz.y - 1) / 2 + 2;
+	std::vector<T> hrows((row_last - row_first + 1) * sz.x);
+	std::vector<char> hrow_done(row_last - row_first + 1, 0);
+	std::vector<T> padded(datasize.x + 3), odd(nr_odd);
+	// map row/column index of source to valid one
+	#define bivector_NEIGHBOUR(k, n) (wrap ? ((k) + (n)) % (n) : std::max(0, std::min((k), (n) - 1)))
+	for (int Y = offset.y; Y < offset.y + sz.y; ++Y) {
+		int y = (Y & 1) ? (Y - 1) / 2 : Y / 2;
+		const T* rows[4];
+		for (int j = 0; j < 4; ++j) {
+			if ((Y & 1) == 0 && j != 1)
+				continue;
+			int k = y - 1 + j;
+			T* h = &hrows[(k - row_first) * sz.x];
+			rows[j] = h;
+			if (hrow_done[k - row_first])
+				continue;
+			hrow_done[k - row_first] = 1;
+			// upsample source row horizontally
+			const T* src = &data[bivector_NEIGHBOUR(k, datasize.y) * datasize.x];
+			for (int i = 0; i < datasize.x + 3; ++i)
+				padded[i] = src[bivector_NEIGHBOUR(i - 1, datasize.x)];
+			if (nr_odd > 0)
+				combine4(&padded[odd_first], &padded[odd_first+1], &padded[odd_first+2],
+					 &padded[odd_first+3], c1, &odd[0], nr_odd);
+			for (int X = offset.x; X < offset.x + sz.x; ++X)
+				h[X - offset.x] = (X & 1) ? odd[(X - 1) / 2 - odd_first] : padded[X / 2 + 1];
+		}
+		T* dst = &result.data[(Y - offset.y) * sz.x];
+		if (Y & 1)
+			combine4(rows[0], rows[1], rows[2], rows[3], c1, dst, sz.x);
+		else
+			std::copy(rows[1], rows[1] + sz.x, dst);
+	}
+	#undef bivector_NEIGHBOUR
+}
+
 #ifndef M_PI
 #define M_PI 3.1415927
 #endif
@@ -492,7 +625,18 @@ bivector<T>& bivector<T>::add_tiled(const bivector<T>& other, const T& scal)
 template <class T>
 bivector<T>& bivector<T>::add_shifted(const bivector<T>& other, const vector2i& offset)
 {
-	bivector_FOREACH_XY(at(x,y) += other.at((x+offset.x) & (other.datasize.x-1), (y+offset.y) & (other.datasize.y-1));)
+	// add rows in runs that don't wrap in other
+	for (int y=0; y < datasize.y; ++y) {
+		T* dst = &data[y*datasize.x];
+		const T* src = &other.data[((y+offset.y) & (other.datasize.y-1)) * other.datasize.x];
+		for (int x=0; x < datasize.x; ) {
+			int ox = (x+offset.x) & (other.datasize.x-1);
+			int n = std::min(datasize.x - x, other.datasize.x - ox);
+			for (int i = 0; i < n; ++i)
+				dst[x+i] += src[ox+i];
+			x += n;
+		}
+	}
 	return *this;
 }
 
@@ -1,6 +1,9 @@
 #include "bivector.h"
+#include "morton_bivector.h"
 #include <fstream>
+#include <iostream>
 #include <stdint.h>
+#include <ctime>
 using namespace std;
 
 void save(const bivector<uint8_t>& b, const char* n)
@@ -26,6 +29,130 @@ bivector<uint8_t> load(const char* n)
 	return result;
 }
 
+bool equal(const bivector<float>& a, const bivector<float>& b)
+{
+	if (!(a.size() == b.size()))
+		return false;
+	for (int i = 0; i < a.size().x * a.size().y; ++i)
+		if (a.data_ptr()[i] != b.data_ptr()[i])
+			return false;
+	return true;
+}
+
+// compare area versions of upsampling with full upsampling and sub_area
+bool test_area_upsampling(random_generator& rg)
+{
+	bool ok = true;
+	bivector<float> area;
+	for (int t = 0; t < 200; ++t) {
+		bool wrap = (t & 1) != 0;
+		vector2i sz(3 + int(rg.rnd() % 40), 3 + int(rg.rnd() % 40));
+		bivector<float> src(sz);
+		src.add_gauss_noise(100.0f, rg);
+		bivector<float> full = src.smooth_upsampled(wrap);
+		vector2i asz(1 + int(rg.rnd() % unsigned(full.size().x)), 1 + int(rg.rnd() % unsigned(full.size().y)));
+		vector2i off(int(rg.rnd() % unsigned(full.size().x - asz.x + 1)), int(rg.rnd() % unsigned(full.size().y - asz.y + 1)));
+		src.smooth_upsampled(off, asz, area, wrap);
+		if (!equal(full.sub_area(off, asz), area)) {
+			cout << "smooth_upsampled area " << off << " " << asz << " of " << sz << " wrap " << wrap << " FAILED\n";
+			ok = false;
+		}
+	}
+	// add_shifted against per sample computation
+	bivector<float> noise(vector2i(64, 32)), x(vector2i(100, 70)), y;
+	noise.add_gauss_noise(1.0f, rg);
+	x.add_gauss_noise(1.0f, rg);
+	y = x;
+	vector2i offset(-1234, 567);
+	x.add_shifted(noise, offset);
+	for (int yy = 0; yy < y.size().y; ++yy)
+		for (int xx = 0; xx < y.size().x; ++xx)
+			y.at(xx, yy) += noise.at((xx+offset.x) & 63, (yy+offset.y) & 31);
+	if (!equal(x, y)) {
+		cout << "add_shifted FAILED\n";
+		ok = false;
+	}
+	// timing with a terrain patch like chain
+	bivector<float> coarse(vector2i(133, 133)), patch;
+	coarse.add_gauss_noise(100.0f, rg);
+	const int nr = 200;
+	clock_t c0 = clock();
+	for (int i = 0; i < nr; ++i)
+		patch = coarse.smooth_upsampled(true).sub_area(vector2i(3, 2), vector2i(257, 257));
+	clock_t c1 = clock();
+	for (int i = 0; i < nr; ++i)
+		coarse.smooth_upsampled(vector2i(3, 2), vector2i(257, 257), patch, true);
+	clock_t c2 = clock();
+	cout << "smooth upsampling of 257x257 area: " << double(c1 - c0) * 1000 / CLOCKS_PER_SEC / nr
+	     << "ms, area version " << double(c2 - c1) * 1000 / CLOCKS_PER_SEC / nr << "ms\n";
+	return ok;
+}
+
+// compare bulk access of morton_bivector with per sample access and time row major copying
+bool test_morton_bulk_access(random_generator& rg)
+{
+	bool ok = true;
+	const int sz = 512;
+	morton_bivector<int16_t> m(sz);
+	for (int y = 0; y < sz; ++y)
+		for (int x = 0; x < sz; ++x)
+			m.at(x, y) = int16_t(rg.rnd());
+	vector<int16_t> rect(sz * sz);
+	for (int t = 0; t < 100; ++t) {
+		vector2i off(rg.rnd() % sz, rg.rnd() % sz);
+		vector2i asz(1 + rg.rnd() % (sz - off.x), 1 + rg.rnd() % (sz - off.y));
+		m.get_rect(off, asz, &rect[0], asz.x);
+		for (int y = 0; y < asz.y; ++y)
+			for (int x = 0; x < asz.x; ++x)
+				if (rect[y*asz.x+x] != m.at(off.x+x, off.y+y))
+					ok = false;
+		morton_bivector<int16_t> m2(sz);
+		m2.set_rect(off, asz, &rect[0], asz.x);
+		for (int y = 0; y < asz.y; ++y)
+			for (int x = 0; x < asz.x; ++x)
+				if (m2.at(off.x+x, off.y+y) != m.at(off.x+x, off.y+y))
+					ok = false;
+	}
+	bivector<int16_t> b;
+	m.to_bivector(b);
+	morton_bivector<int16_t> m3(b);
+	for (int y = 0; y < sz; ++y)
+		for (int x = 0; x < sz; ++x)
+			if (b.at(x, y) != m.at(x, y) || m3.at(x, y) != m.at(x, y))
+				ok = false;
+	// the computed Z-order index must be the one of the morton tables, with and without BMI2
+	for (int y = 0; y < sz; ++y)
+		for (int x = 0; x < sz; ++x) {
+			unsigned long idx = &m.at(x, y) - m.data_ptr();
+			if (morton_bivector<int16_t>::morton_index(x, y) != idx
+			    || morton_bivector<int16_t>::morton_index_generic(x, y) != idx
+			    || !(morton_bivector<int16_t>::morton_coord(idx) == vector2i(x, y))
+			    || !(morton_bivector<int16_t>::morton_coord_generic(idx) == vector2i(x, y)))
+				ok = false;
+		}
+	if (!ok)
+		cout << "morton_bivector bulk access FAILED\n";
+
+	const int nr = 100;
+	clock_t c0 = clock();
+	for (int i = 0; i < nr; ++i)
+		for (int y = 0; y < sz; ++y)
+			for (int x = 0; x < sz; ++x)
+				rect[y*sz+x] = m.at(x, y);
+	clock_t c1 = clock();
+	for (int i = 0; i < nr; ++i)
+		for (int y = 0; y < sz; ++y)
+			m.get_row(0, y, sz, &rect[y*sz]);
+	clock_t c2 = clock();
+	for (int i = 0; i < nr; ++i)
+		m.get_rect(vector2i(0, 0), vector2i(sz, sz), &rect[0], sz);
+	clock_t c3 = clock();
+	double f = 1e9 / CLOCKS_PER_SEC / (double(nr) * sz * sz);
+	cout << "morton to row major copy per sample: at() " << (c1 - c0) * f << "ns, get_row "
+	     << (c2 - c1) * f << "ns, get_rect " << (c3 - c2) * f << "ns\n";
+	return ok;
+}
+
 int main(int, char**)
 {
 	/*
@@ -61,6 +188,8 @@ int main(int, char**)
 	*/
 
 	random_generator rg;
+	bool ok = test_area_upsampling(rg);
+	ok = test_morton_bulk_access(rg) && ok;
 	bivector<float> y(vector2i(256,256));
 	y.add_gauss_noise(1.0, rg);
 	y *= 128;
@@ -88,5 +217,6 @@ int main(int, char**)
 	x *= 128;
 	x += 128;
 	save(x.convert<uint8_t>(0, 255), "testgauss2.pgm");
-	return 0;
+	cout << (ok ? "OK" : "FAILED") << "\n";
+	return ok ? 0 : 1;
 }
@@ -283,6 +283,77 @@ bool bv_tree::collides(const param& p, const spheref& sp)
 
 
 
+bool bv_tree::closest_segment_hit(const param& p, const vector3f& start, const vector3f& end,
+				  float& fraction, leaf_data& triangle)
+{
+	vector3f dir = end - start;
+	if (dir.square_length() < 1e-12f)
+		return false;
+	fraction = 1.0f;
+	return closest_segment_hit_rec(p, start, dir, fraction, triangle);
+}
+
+
+
+bool bv_tree::closest_segment_hit_rec(const param& p, const vector3f& start, const vector3f& dir,
+				      float& fraction, leaf_data& triangle)
+{
+	// intersect segment start + t * dir with bounding sphere, abort if the
+	// segment enters the sphere behind the closest hit found so far.
+	spheref transformed_volume = p.get_transformed_sphere();
+	vector3f f = start - transformed_volume.center;
+	float a = dir * dir;
+	float b = f * dir;
+	float c = f * f - transformed_volume.radius * transformed_volume.radius;
+	if (c > 0.0f) {
+		// start is outside the sphere
+		if (b >= 0.0f)
+			return false;	// moving away from sphere
+		float disc = b * b - a * c;
+		if (disc < 0.0f)
+			return false;
+		float t_enter = (-b - sqrt(disc)) / a;
+		if (t_enter > fraction)
+			return false;
+	}
+
+	if (p.tree.is_leaf()) {
+		// segment to triangle intersection (Moeller/Trumbore), both sides count
+		vector3f v0 = p.transform.mul4vec3xlat(p.vertices[p.tree.leafdata.tri_idx[0]]);
+		vector3f v1 = p.transform.mul4vec3xlat(p.vertices[p.tree.leafdata.tri_idx[1]]);
+		vector3f v2 = p.transform.mul4vec3xlat(p.vertices[p.tree.leafdata.tri_idx[2]]);
+		vector3f e1 = v1 - v0, e2 = v2 - v0;
+		vector3f pv = dir.cross(e2);
+		float det = e1 * pv;
+		if (fabs(det) < 1e-12f)
+			return false;	// segment parallel to triangle plane
+		float det_rcp = 1.0f / det;
+		vector3f tv = start - v0;
+		float u = (tv * pv) * det_rcp;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+		vector3f qv = tv.cross(e1);
+		float v = (dir * qv) * det_rcp;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+		float t = (e2 * qv) * det_rcp;
+		if (t < 0.0f || t > fraction)
+			return false;
+		fraction = t;
+		triangle = p.tree.leafdata;
+		return true;
+	}
+
+	// check closer child first, the other one only can give a closer hit
+	// if the segment enters its volume before the hit found so far.
+	unsigned i = p.get_index_of_closer_child(start);
+	bool hit0 = closest_segment_hit_rec(p.children(i), start, dir, fraction, triangle);
+	bool hit1 = closest_segment_hit_rec(p.children(1-i), start, dir, fraction, triangle);
+	return hit0 || hit1;
+}
+
+
+
 void bv_tree::transform(const matrix4f& mat)
 {
 	volume.center = mat.mul4vec3xlat(volume.center);
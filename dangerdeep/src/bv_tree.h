@@ -87,6 +87,14 @@ class bv_tree
 	static bool closest_collision(const param& p0, const param& p1, vector3f& contact_point);
 	/** determine if two bv_trees intersect each other (are colliding). */
 	static bool collides(const param& p, const spheref& sp);
+	/** determine first intersection of line segment start->end with the triangles of a bv_tree.
+	    Start and end are given in the coordinate system that p.transform maps to.
+	    @param fraction position of hit on segment [0...1], start + (end-start) * fraction
+	    @param triangle indices of the triangle that was hit
+	    @return true if segment hits a triangle
+	*/
+	static bool closest_segment_hit(const param& p, const vector3f& start, const vector3f& end,
+					float& fraction, leaf_data& triangle);
 	void transform(const matrix4f& mat);
 	void compute_min_max(vector3f& minv, vector3f& maxv) const;
 	void debug_dump(unsigned level = 0) const;
@@ -99,6 +107,9 @@ class bv_tree
 	leaf_data leafdata;
 	std::auto_ptr<bv_tree> children[2];
 
+	static bool closest_segment_hit_rec(const param& p, const vector3f& start, const vector3f& dir,
+					    float& fraction, leaf_data& triangle);
+
  private:
 	bv_tree();
 	bv_tree(const bv_tree& );
@@ -26,6 +26,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "system.h"
 #include "log.h"
 #include <sstream>
+#include <vector>
 #include "xml.h"
 using namespace std;
 
@@ -91,11 +92,45 @@ bool cfg::set_str(const string& name, const string& value)
 			}
 		}
 	}
+	notify(name);
 	return true;
 }
 
 
 
+void cfg::notify(const string& name)
+{
+	// copy list first, listeners may remove themselves while being called
+	vector<listener*> ls;
+	for (multimap<string, listener*>::const_iterator it = listeners.lower_bound(name);
+	     it != listeners.end() && it->first == name; ++it)
+		ls.push_back(it->second);
+	for (unsigned i = 0; i < ls.size(); ++i)
+		ls[i]->option_changed(name);
+}
+
+
+
+void cfg::add_listener(const string& name, listener* l)
+{
+	listeners.insert(make_pair(name, l));
+}
+
+
+
+void cfg::remove_listener(const string& name, listener* l)
+{
+	for (multimap<string, listener*>::iterator it = listeners.lower_bound(name);
+	     it != listeners.end() && it->first == name; ++it) {
+		if (it->second == l) {
+			listeners.erase(it);
+			return;
+		}
+	}
+}
+
+
+
 void cfg::load(const string& filename)
 {
 	xml_doc doc(filename);
@@ -208,9 +243,10 @@ void cfg::register_key(const string& name, SDLKey keysym, bool ctrl, bool alt, b
 void cfg::set(const string& name, bool value)
 {
 	map<string, bool>::iterator it = valb.find(name);
-	if (it != valb.end())
+	if (it != valb.end()) {
 		it->second = value;
-	else
+		notify(name);
+	} else
 		throw error(string("cfg: set(), name not registered: ") + name);
 }
 
@@ -219,9 +255,10 @@ void cfg::set(const string& name, bool value)
 void cfg::set(const string& name, int value)
 {
 	map<string, int>::iterator it = vali.find(name);
-	if (it != vali.end())
+	if (it != vali.end()) {
 		it->second = value;
-	else
+		notify(name);
+	} else
 		throw error(string("cfg: set(), name not registered: ") + name);
 }
 
@@ -230,9 +267,10 @@ void cfg::set(const string& name, int value)
 void cfg::set(const string& name, float value)
 {
 	map<string, float>::iterator it = valf.find(name);
-	if (it != valf.end())
+	if (it != valf.end()) {
 		it->second = value;
-	else
+		notify(name);
+	} else
 		throw error(string("cfg: set(), name not registered: ") + name);
 }
 
@@ -241,9 +279,10 @@ void cfg::set(const string& name, float value)
 void cfg::set(const string& name, const string& value)
 {
 	map<string, string>::iterator it = vals.find(name);
-	if (it != vals.end())
+	if (it != vals.end()) {
 		it->second = value;
-	else
+		notify(name);
+	} else
 		throw error(string("cfg: set(), name not registered: ") + name);
 }
 
@@ -262,6 +301,9 @@ void cfg::set_key(unsigned nr, SDLKey keysym, bool ctrl, bool alt, bool shift)
 
 bool cfg::getb(const string& name) const
 {
+#ifdef DEBUG
+	count_lookup(name);
+#endif
 	map<string, bool>::const_iterator it = valb.find(name);
 	if (it != valb.end())
 		return it->second;
@@ -274,6 +316,9 @@ bool cfg::getb(const string& name) const
 
 int cfg::geti(const string& name) const
 {
+#ifdef DEBUG
+	count_lookup(name);
+#endif
 	map<string, int>::const_iterator it = vali.find(name);
 	if (it != vali.end())
 		return it->second;
@@ -286,6 +331,9 @@ int cfg::geti(const string& name) const
 
 float cfg::getf(const string& name) const
 {
+#ifdef DEBUG
+	count_lookup(name);
+#endif
 	map<string, float>::const_iterator it = valf.find(name);
 	if (it != valf.end())
 		return it->second;
@@ -298,6 +346,9 @@ float cfg::getf(const string& name) const
 
 string cfg::gets(const string& name) const
 {
+#ifdef DEBUG
+	count_lookup(name);
+#endif
 	map<string, string>::const_iterator it = vals.find(name);
 	if (it != vals.end())
 		return it->second;
@@ -308,6 +359,59 @@ string cfg::gets(const string& name) const
 
 
 
+void cfg::lookup(const string& name, const bool*& value) const
+{
+	map<string, bool>::const_iterator it = valb.find(name);
+	if (it == valb.end())
+		throw error(string("cfg: handle, name not registered: ") + name);
+	value = &it->second;
+}
+
+
+
+void cfg::lookup(const string& name, const int*& value) const
+{
+	map<string, int>::const_iterator it = vali.find(name);
+	if (it == vali.end())
+		throw error(string("cfg: handle, name not registered: ") + name);
+	value = &it->second;
+}
+
+
+
+void cfg::lookup(const string& name, const float*& value) const
+{
+	map<string, float>::const_iterator it = valf.find(name);
+	if (it == valf.end())
+		throw error(string("cfg: handle, name not registered: ") + name);
+	value = &it->second;
+}
+
+
+
+void cfg::lookup(const string& name, const string*& value) const
+{
+	map<string, string>::const_iterator it = vals.find(name);
+	if (it == vals.end())
+		throw error(string("cfg: handle, name not registered: ") + name);
+	value = &it->second;
+}
+
+
+
+#ifdef DEBUG
+void cfg::count_lookup(const string& name) const
+{
+	// warn once when an option is looked up by name so often that it is
+	// likely done in a loop or per frame.
+	unsigned& c = lookup_count[name];
+	if (++c == 1000)
+		log_warning("cfg: option " << name << " looked up by name " << c << " times, use cfg::handle");
+}
+#endif
+
+
+
 cfg::key cfg::getkey(unsigned nr) const
 {
 	map<unsigned, key>::const_iterator it = valk.find(nr);
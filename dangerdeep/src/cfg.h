@@ -50,6 +50,37 @@ public:
 		std::string get_name() const; // uses SDLK_GetKeyName
 		bool equal(const SDL_keysym& ks) const;
 	};
+
+	///\brief Interface for objects that want to know when an option changes.
+	/** Listeners are called from set(), load() and parse_value() after the
+	    new value has been stored.
+	*/
+	class listener
+	{
+	public:
+		virtual ~listener() {}
+		virtual void option_changed(const std::string& name) = 0;
+	};
+
+	///\brief Typed reference to a registered option, resolved once.
+	/** Reading a handle costs one pointer dereference, use handles instead of
+	    the string based get functions in code that is run often.
+	    The handle always gives the current value, even if it was changed by
+	    set() or load() after the handle was created.
+	    The option must be registered before, and the handle must not be used
+	    after the cfg instance has been destroyed.
+	*/
+	template<class T>
+	class handle
+	{
+	public:
+		handle(const std::string& name) : value(0) { cfg::instance().lookup(name, value); }
+		const T& get() const { return *value; }
+		operator const T& () const { return *value; }
+	private:
+		const T* value;
+	};
+
 private:
 	cfg(const cfg& );
 	cfg& operator= (const cfg& );
@@ -59,6 +90,12 @@ private:
 	std::map<std::string, float> valf;
 	std::map<std::string, std::string> vals;
 	std::map<unsigned, key> valk;
+	std::multimap<std::string, listener*> listeners;
+#ifdef DEBUG
+	// number of string based lookups per name, to find lookups that should be handles
+	mutable std::map<std::string, unsigned> lookup_count;
+	void count_lookup(const std::string& name) const;
+#endif
 	
 	static cfg* myinst;
 	
@@ -68,6 +105,15 @@ private:
 	// is unknown
 	bool set_str(const std::string& name, const std::string& value);
 
+	// call all listeners of an option
+	void notify(const std::string& name);
+
+	// resolve option for handles, throws error if name is not registered
+	void lookup(const std::string& name, const bool*& value) const;
+	void lookup(const std::string& name, const int*& value) const;
+	void lookup(const std::string& name, const float*& value) const;
+	void lookup(const std::string& name, const std::string*& value) const;
+
 public:
 	~cfg();
 	
@@ -93,6 +139,10 @@ public:
 	float getf(const std::string& name) const;
 	std::string gets(const std::string& name) const;
 	key getkey(unsigned nr) const;
+
+	// listeners must be removed before they are destroyed
+	void add_listener(const std::string& name, listener* l);
+	void remove_listener(const std::string& name, listener* l);
 	
 	void parse_value(const std::string& s);	// give elements of command line array to it!
 };
@@ -24,6 +24,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #define DEPTH_CHARGE_H
 
 #include "sea_object.h"
+#include "object_pool.h"
 
 // fixme: these values depend on depth charge type.
 #define DEPTH_CHARGE_SINK_SPEED 4	// m/sec
@@ -34,7 +35,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 ///\brief Represents a depth charge with simulation of it.
 /** At the moment there are no specialisations for various types of depth charges */
-class depth_charge : public sea_object
+class depth_charge : public sea_object, public pooled<depth_charge>
 {
  private:
 	depth_charge();
@@ -0,0 +1,362 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// DXT/BC block compression and DDS file writing
+// (C)+(W) by Thorsten Jordan. See LICENSE
+
+#include "dxt_compressor.h"
+#include "error.h"
+#include <fstream>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+using std::vector;
+using std::string;
+
+
+
+unsigned dxt_compressor::nr_of_levels(unsigned w, unsigned h)
+{
+	unsigned n = 1;
+	while (w > 1 || h > 1) {
+		w = std::max(w/2, 1U);
+		h = std::max(h/2, 1U);
+		++n;
+	}
+	return n;
+}
+
+
+
+vector<Uint8> dxt_compressor::scale_half(const vector<Uint8>& src, unsigned w, unsigned h,
+					  unsigned bpp)
+{
+	unsigned nw = std::max(w/2, 1U), nh = std::max(h/2, 1U);
+	vector<Uint8> dst(nw*nh*bpp);
+	unsigned ptr = 0;
+	for (unsigned y = 0; y < nh; ++y) {
+		unsigned y0 = std::min(2*y, h-1), y1 = std::min(2*y+1, h-1);
+		for (unsigned x = 0; x < nw; ++x) {
+			unsigned x0 = std::min(2*x, w-1), x1 = std::min(2*x+1, w-1);
+			for (unsigned b = 0; b < bpp; ++b) {
+				dst[ptr++] = Uint8((unsigned(src[(y0*w+x0)*bpp+b]) +
+						    unsigned(src[(y0*w+x1)*bpp+b]) +
+						    unsigned(src[(y1*w+x0)*bpp+b]) +
+						    unsigned(src[(y1*w+x1)*bpp+b]) + 2) / 4);
+			}
+		}
+	}
+	return dst;
+}
+
+
+
+void dxt_compressor::fetch_block(const vector<Uint8>& src, unsigned w, unsigned h,
+				 unsigned bpp, unsigned bx, unsigned by, Uint8 (*rgba)[4])
+{
+	// pixels outside the image (w,h not multiples of four) replicate the border
+	for (unsigned j = 0; j < 4; ++j) {
+		unsigned y = std::min(by*4 + j, h-1);
+		for (unsigned i = 0; i < 4; ++i) {
+			unsigned x = std::min(bx*4 + i, w-1);
+			const Uint8* s = &src[(y*w+x)*bpp];
+			Uint8* d = rgba[j*4+i];
+			switch (bpp) {
+			case 1:
+				d[0] = d[1] = d[2] = s[0]; d[3] = 255;
+				break;
+			case 2:
+				d[0] = d[1] = d[2] = s[0]; d[3] = s[1];
+				break;
+			case 3:
+				d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = 255;
+				break;
+			default:
+				d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = s[3];
+				break;
+			}
+		}
+	}
+}
+
+
+
+static inline Uint16 pack_565(const float* c)
+{
+	int r = int(c[0] * 31.0f / 255.0f + 0.5f);
+	int g = int(c[1] * 63.0f / 255.0f + 0.5f);
+	int b = int(c[2] * 31.0f / 255.0f + 0.5f);
+	r = std::max(0, std::min(r, 31));
+	g = std::max(0, std::min(g, 63));
+	b = std::max(0, std::min(b, 31));
+	return Uint16((r << 11) | (g << 5) | b);
+}
+
+
+
+static inline void unpack_565(Uint16 c, int* rgb)
+{
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+
+
+void dxt_compressor::compress_color_block(const Uint8 (*rgba)[4], Uint8* dst)
+{
+	// find principal axis of the colors (covariance + power iteration),
+	// and use the extreme projections as end points.
+	float mean[3] = { 0, 0, 0 };
+	for (unsigned i = 0; i < 16; ++i)
+		for (unsigned c = 0; c < 3; ++c)
+			mean[c] += rgba[i][c];
+	for (unsigned c = 0; c < 3; ++c)
+		mean[c] *= 1.0f/16;
+	float cov[6] = { 0, 0, 0, 0, 0, 0 };
+	for (unsigned i = 0; i < 16; ++i) {
+		float r = rgba[i][0] - mean[0], g = rgba[i][1] - mean[1], b = rgba[i][2] - mean[2];
+		cov[0] += r*r; cov[1] += r*g; cov[2] += r*b;
+		cov[3] += g*g; cov[4] += g*b; cov[5] += b*b;
+	}
+	float axis[3] = { 1, 1, 1 };
+	for (unsigned k = 0; k < 4; ++k) {
+		float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+		float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+		float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+		float l = std::max(std::max(fabsf(x), fabsf(y)), fabsf(z));
+		if (l < 1e-6f) break;
+		axis[0] = x/l; axis[1] = y/l; axis[2] = z/l;
+	}
+	float l2 = axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2];
+	float tmin = 0, tmax = 0;
+	if (l2 > 1e-12f) {
+		tmin = 1e30f; tmax = -1e30f;
+		for (unsigned i = 0; i < 16; ++i) {
+			float t = ((rgba[i][0] - mean[0]) * axis[0] +
+				   (rgba[i][1] - mean[1]) * axis[1] +
+				   (rgba[i][2] - mean[2]) * axis[2]) / l2;
+			tmin = std::min(tmin, t);
+			tmax = std::max(tmax, t);
+		}
+	}
+	float e0[3], e1[3];
+	for (unsigned c = 0; c < 3; ++c) {
+		e0[c] = mean[c] + axis[c] * tmax;
+		e1[c] = mean[c] + axis[c] * tmin;
+	}
+	Uint16 c0 = pack_565(e0), c1 = pack_565(e1);
+	// four color mode needs c0 > c1
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	Uint32 indices = 0;
+	if (c0 != c1) {
+		int pal[4][3];
+		unpack_565(c0, pal[0]);
+		unpack_565(c1, pal[1]);
+		for (unsigned c = 0; c < 3; ++c) {
+			pal[2][c] = (2*pal[0][c] + pal[1][c]) / 3;
+			pal[3][c] = (pal[0][c] + 2*pal[1][c]) / 3;
+		}
+		for (unsigned i = 0; i < 16; ++i) {
+			unsigned best = 0;
+			int bestdist = 0x7fffffff;
+			for (unsigned p = 0; p < 4; ++p) {
+				int dr = rgba[i][0] - pal[p][0];
+				int dg = rgba[i][1] - pal[p][1];
+				int db = rgba[i][2] - pal[p][2];
+				int d = dr*dr + dg*dg + db*db;
+				if (d < bestdist) {
+					bestdist = d;
+					best = p;
+				}
+			}
+			indices |= Uint32(best) << (2*i);
+		}
+	}
+	dst[0] = Uint8(c0 & 0xff);
+	dst[1] = Uint8(c0 >> 8);
+	dst[2] = Uint8(c1 & 0xff);
+	dst[3] = Uint8(c1 >> 8);
+	for (unsigned i = 0; i < 4; ++i)
+		dst[4+i] = Uint8(indices >> (8*i));
+}
+
+
+
+void dxt_compressor::compress_alpha_block(const Uint8* values, Uint8* dst)
+{
+	Uint8 a0 = 0, a1 = 255;
+	for (unsigned i = 0; i < 16; ++i) {
+		a0 = std::max(a0, values[i]);
+		a1 = std::min(a1, values[i]);
+	}
+	Uint64 indices = 0;
+	if (a0 != a1) {
+		// eight value mode (a0 > a1)
+		int pal[8];
+		pal[0] = a0;
+		pal[1] = a1;
+		for (int p = 2; p < 8; ++p)
+			pal[p] = ((8-p)*a0 + (p-1)*a1) / 7;
+		for (unsigned i = 0; i < 16; ++i) {
+			unsigned best = 0;
+			int bestdist = 0x7fffffff;
+			for (unsigned p = 0; p < 8; ++p) {
+				int d = abs(int(values[i]) - pal[p]);
+				if (d < bestdist) {
+					bestdist = d;
+					best = p;
+				}
+			}
+			indices |= Uint64(best) << (3*i);
+		}
+	}
+	dst[0] = a0;
+	dst[1] = a1;
+	for (unsigned i = 0; i < 6; ++i)
+		dst[2+i] = Uint8(indices >> (8*i));
+}
+
+
+
+vector<Uint8> dxt_compressor::compress(const vector<Uint8>& src, unsigned w, unsigned h,
+				       unsigned bpp, format fmt)
+{
+	if (bpp < 1 || bpp > 4 || src.size() < w*h*bpp)
+		throw error("dxt_compressor: invalid source data");
+	if (fmt == BC5 && bpp < 2)
+		throw error("dxt_compressor: BC5 needs at least two channels");
+	unsigned bw = (w + 3) / 4, bh = (h + 3) / 4;
+	unsigned bs = block_size(fmt);
+	vector<Uint8> dst(bw * bh * bs);
+	Uint8 rgba[16][4];
+	Uint8 channel[16];
+	Uint8* d = &dst[0];
+	for (unsigned by = 0; by < bh; ++by) {
+		for (unsigned bx = 0; bx < bw; ++bx) {
+			switch (fmt) {
+			case BC1:
+				fetch_block(src, w, h, bpp, bx, by, rgba);
+				compress_color_block(rgba, d);
+				break;
+			case BC3:
+				fetch_block(src, w, h, bpp, bx, by, rgba);
+				for (unsigned i = 0; i < 16; ++i)
+					channel[i] = rgba[i][3];
+				compress_alpha_block(channel, d);
+				compress_color_block(rgba, d + 8);
+				break;
+			case BC5:
+				// use raw first two channels of the source, not expanded luminance
+				for (unsigned c = 0; c < 2; ++c) {
+					for (unsigned j = 0; j < 4; ++j) {
+						unsigned y = std::min(by*4 + j, h-1);
+						for (unsigned i = 0; i < 4; ++i) {
+							unsigned x = std::min(bx*4 + i, w-1);
+							channel[j*4+i] = src[(y*w+x)*bpp+c];
+						}
+					}
+					compress_alpha_block(channel, d + 8*c);
+				}
+				break;
+			}
+			d += bs;
+		}
+	}
+	return dst;
+}
+
+
+
+vector<Uint8> dxt_compressor::compress_mipmapped(const vector<Uint8>& src, unsigned w,
+						 unsigned h, unsigned bpp, format fmt,
+						 unsigned& nr_of_levels_generated)
+{
+	nr_of_levels_generated = nr_of_levels(w, h);
+	unsigned total = 0;
+	for (unsigned l = 0, lw = w, lh = h; l < nr_of_levels_generated; ++l) {
+		total += level_size(lw, lh, fmt);
+		lw = std::max(lw/2, 1U);
+		lh = std::max(lh/2, 1U);
+	}
+	vector<Uint8> result;
+	result.reserve(total);
+	vector<Uint8> level = src;
+	for (unsigned l = 0; l < nr_of_levels_generated; ++l) {
+		vector<Uint8> c = compress(level, w, h, bpp, fmt);
+		result.insert(result.end(), c.begin(), c.end());
+		if (l + 1 < nr_of_levels_generated) {
+			level = scale_half(level, w, h, bpp);
+			w = std::max(w/2, 1U);
+			h = std::max(h/2, 1U);
+		}
+	}
+	return result;
+}
+
+
+
+static void write_le32(std::ostream& out, Uint32 v)
+{
+	char b[4] = { char(v & 0xff), char((v >> 8) & 0xff), char((v >> 16) & 0xff), char(v >> 24) };
+	out.write(b, 4);
+}
+
+
+
+void dxt_compressor::write_dds(const string& filename, const vector<Uint8>& data,
+			       unsigned w, unsigned h, unsigned nr_of_levels, format fmt)
+{
+	// DDS constants, see DirectX SDK
+	const Uint32 DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4,
+		DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+	const Uint32 DDPF_FOURCC = 0x4;
+	const Uint32 DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+	const char* fourcc[3] = { "DXT1", "DXT5", "ATI2" };
+
+	std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary);
+	if (!out.good())
+		throw error(string("can't open file for writing: ") + filename);
+	bool mipmapped = nr_of_levels > 1;
+	out.write("DDS ", 4);
+	write_le32(out, 124);	// size of header
+	write_le32(out, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE
+		   | (mipmapped ? DDSD_MIPMAPCOUNT : 0));
+	write_le32(out, h);
+	write_le32(out, w);
+	write_le32(out, level_size(w, h, fmt));
+	write_le32(out, 0);	// depth
+	write_le32(out, nr_of_levels);
+	for (unsigned i = 0; i < 11; ++i)
+		write_le32(out, 0);	// reserved
+	write_le32(out, 32);	// size of pixel format
+	write_le32(out, DDPF_FOURCC);
+	out.write(fourcc[fmt], 4);
+	for (unsigned i = 0; i < 5; ++i)
+		write_le32(out, 0);	// bit count and masks
+	write_le32(out, DDSCAPS_TEXTURE | (mipmapped ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0));
+	for (unsigned i = 0; i < 4; ++i)
+		write_le32(out, 0);	// caps2-4, reserved
+	out.write((const char*)&data[0], data.size());
+	if (!out.good())
+		throw error(string("error writing file: ") + filename);
+}
@@ -0,0 +1,91 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// DXT/BC block compression and DDS file writing
+// (C)+(W) by Thorsten Jordan. See LICENSE
+
+#ifndef DXT_COMPRESSOR_H
+#define DXT_COMPRESSOR_H
+
+#include <SDL_types.h>
+#include <vector>
+#include <string>
+
+///\brief Compresses plain texel data to DXT/BC blocks and writes DDS files.
+/** This is done on the CPU, so no GL context is needed and the result is
+    the same on every driver. Input data is given as plain texels with
+    1 (L), 2 (LA), 3 (RGB) or 4 (RGBA) bytes per pixel, like the data
+    that class texture uploads to OpenGL.
+*/
+class dxt_compressor
+{
+ public:
+	enum format {
+		BC1,	///< DXT1, RGB with 4:1 (RGB) / 8:1 (RGBA source) ratio
+		BC3,	///< DXT5, RGB + interpolated alpha, 4:1
+		BC5	///< ATI2/3Dc, two channels (e.g. normal XY), 2:1
+	};
+
+	/// choose a matching format for given number of bytes per pixel, BC5 is
+	/// never chosen, as it only fits data like normal maps.
+	static format choose_format(unsigned bpp) { return (bpp == 2 || bpp == 4) ? BC3 : BC1; }
+
+	/// get number of channels that are stored in given format
+	static unsigned nr_of_components(format fmt) { return (fmt == BC1) ? 3 : ((fmt == BC3) ? 4 : 2); }
+
+	/// get size in bytes of a 4x4 block
+	static unsigned block_size(format fmt) { return (fmt == BC1) ? 8 : 16; }
+
+	/// get size in bytes of one compressed level with given dimensions
+	static unsigned level_size(unsigned w, unsigned h, format fmt) {
+		return ((w + 3) / 4) * ((h + 3) / 4) * block_size(fmt);
+	}
+
+	/// get number of mipmap levels down to 1x1 for given dimensions
+	static unsigned nr_of_levels(unsigned w, unsigned h);
+
+	/// compress one image level, w,h need not be multiples of four
+	static std::vector<Uint8> compress(const std::vector<Uint8>& src, unsigned w, unsigned h,
+					   unsigned bpp, format fmt);
+
+	/// compress image and all its mipmap levels down to 1x1, levels are stored
+	/// consecutively like in a DDS file.
+	static std::vector<Uint8> compress_mipmapped(const std::vector<Uint8>& src, unsigned w,
+						     unsigned h, unsigned bpp, format fmt,
+						     unsigned& nr_of_levels_generated);
+
+	/// scale image to half size with box filter, odd sizes are handled
+	static std::vector<Uint8> scale_half(const std::vector<Uint8>& src, unsigned w, unsigned h,
+					     unsigned bpp);
+
+	/// write compressed data (as generated by compress_mipmapped) to DDS file
+	static void write_dds(const std::string& filename, const std::vector<Uint8>& data,
+			      unsigned w, unsigned h, unsigned nr_of_levels, format fmt);
+
+ protected:
+	static void compress_color_block(const Uint8 (*rgba)[4], Uint8* dst);
+	static void compress_alpha_block(const Uint8* values, Uint8* dst);
+	static void fetch_block(const std::vector<Uint8>& src, unsigned w, unsigned h,
+				unsigned bpp, unsigned bx, unsigned by, Uint8 (*rgba)[4]);
+
+ private:
+	dxt_compressor();
+};
+
+#endif
@@ -25,13 +25,17 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 class user_interface;
 #include "vector3.h"
+#include "arena.h"
 
 /// interface for any event that needs special handling by user interface
+/// events live for one simulation step only, so they are taken from the arena.
 class event
 {
  public:
 	virtual ~event() {}
 	virtual void evaluate(user_interface& ui) = 0;
+	static void* operator new(std::size_t sz) { return arena::allocate_current(sz); }
+	static void operator delete(void* p) { arena::deallocate_current(p); }
 };
 
 /// torpedo dud because range was too short
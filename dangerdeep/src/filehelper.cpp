@@ -24,6 +24,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "error.h"
 #include <vector>
 #include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 using namespace std;
 
 #ifdef WIN32
@@ -169,3 +171,13 @@ bool is_file(const string& filename)
 	}
 	return false;
 }
+
+
+
+time_t get_file_modification_time(const string& filename)
+{
+	struct stat fileinfo;
+	if (stat(filename.c_str(), &fileinfo) != 0)
+		return 0;
+	return fileinfo.st_mtime;
+}
@@ -35,6 +35,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #endif
 
 #include <string>
+#include <ctime>
 
 /// directory reading/writing encapsulated for compatibility and ease of use
 class directory
@@ -81,4 +82,7 @@ bool is_directory(const std::string& filename);
 ///\brief Test if the given filename is a file (can be read by fopen())
 bool is_file(const std::string& filename);
 
+///\brief Get time of last modification of a file, returns 0 if there is no such file.
+time_t get_file_modification_time(const std::string& filename);
+
 #endif
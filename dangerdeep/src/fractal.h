@@ -83,6 +83,35 @@ public:
 		return result;
 	}
 
+	/// compute get_value_hybrid for n points (x[i], y[i], z[i]) at once in float precision.
+	/// Each octave is computed for all points in one batch.
+	void get_values_hybrid(const float* x, const float* y, const float* z, float* result,
+			       unsigned n, int octave) const {
+		if (n == 0) return;
+		std::vector<float> signal(n), weight(n);
+		double frequency = 1.0;
+		// like get_value_hybrid, the first octave is always computed
+		for (int i = 0; i < octave || i == 0; i++) {
+			simplex_noise::noise_row(x, y, z, frequency, &signal[0], n);
+			float off = float(offset), e = float(exponent_array[i]);
+			if (i == 0) {
+				for (unsigned k = 0; k < n; ++k) {
+					result[k] = (signal[k] + off) * e;
+					weight[k] = result[k];
+				}
+			} else {
+				for (unsigned k = 0; k < n; ++k) {
+					float w = (weight[k] > 1.0f) ? 1.0f : weight[k];
+					float sg = (signal[k] + off) * e;
+					result[k] += w * sg;
+					weight[k] = w * sg;
+				}
+			}
+			frequency *= lacunarity;
+		}
+		// the remainder of get_value_hybrid is always zero, as octaves is an integer
+	}
+
 	double get_value_ridged(vector3 point, int octave) {
 
 		int i;
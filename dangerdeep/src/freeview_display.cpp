@@ -43,6 +43,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "postprocessor.h"
 #include <fstream>
 #include <algorithm>
+#include <map>
 using std::vector;
 
 
@@ -227,11 +228,45 @@ struct alpha_cmp : public std::binary_function<water_splash*, water_splash*, boo
 
 
 
+// objects with the same model, skin and level of detail, drawn together.
+// This only groups the render state changes, each instance is still drawn
+// with its own draw calls.
+struct model_batch
+{
+	model* mdl;
+	const std::string* skin;
+	unsigned lod;
+	std::vector<matrix4> transforms;
+	model_batch(model* m, const std::string* s, unsigned l) : mdl(m), skin(s), lod(l) {}
+	bool operator< (const model_batch& other) const {
+		if (mdl != other.mdl) return mdl < other.mdl;
+		if (lod != other.lod) return lod < other.lod;
+		return *skin < *other.skin;
+	}
+};
+
+// batches are kept in the order of their first object, the map gives the index of a batch
+static void add_to_batch(std::vector<model_batch>& batches, std::map<model_batch, unsigned>& batch_index,
+			 const sea_object* obj, unsigned lod, const matrix4& transform)
+{
+	model_batch key(&obj->get_model(), &obj->get_skin_layout(), lod);
+	std::map<model_batch, unsigned>::iterator it = batch_index.find(key);
+	if (it == batch_index.end()) {
+		it = batch_index.insert(std::make_pair(key, unsigned(batches.size()))).first;
+		batches.push_back(key);
+	}
+	batches[it->second].transforms.push_back(transform);
+}
+
+
+
 void freeview_display::draw_objects(game& gm, const vector3& viewpos,
 				    const vector<sea_object*>& objects,
 				    const colorf& light_color,
 				    const bool under_water,
-				    bool mirrorclip) const
+				    bool mirrorclip,
+				    const frustum& viewfrustum,
+				    double lod_scale) const
 {
 	// simulate horizon: d is distance to object (on perimeter of earth)
 	// z is additional height (negative!), r is earth radius
@@ -239,6 +274,15 @@ void freeview_display::draw_objects(game& gm, const vector3& viewpos,
 	// d = PI/2*r - r*arcsin(z/r+1), fixme implement
 
 	sea_object* player = gm.get_player();
+	double max_view_dist = gm.get_max_view_distance();
+	// objects of a convoy often share their model. They are drawn together
+	// after culling, so each mesh sets up its render state once for all of them.
+	// It is still one draw call per instance and mesh, only state changes are saved.
+	// Water and terrain are drawn before this function and everything else after it,
+	// so only the order of the objects among each other changes. Batches are drawn
+	// in the order of their first object.
+	std::vector<model_batch> batches;
+	std::map<model_batch, unsigned> batch_index;
 
 	for (vector<sea_object*>::const_iterator it = objects.begin(); it != objects.end(); ++it) {
 		bool istorp = (dynamic_cast<const torpedo*>(*it) != 0);
@@ -246,6 +290,31 @@ void freeview_display::draw_objects(game& gm, const vector3& viewpos,
 			continue;
 
 		if (aboard && *it == player) continue;
+
+		// cull objects by bounding sphere. The mirrored scene is seen through
+		// the same frustum, with the object mirrored at the z=0 plane.
+		// Waves distort the reflection, so the sphere is enlarged for it.
+		vector3 relpos = (*it)->get_pos() - viewpos;
+		if (mirrorclip)
+			relpos.z = -relpos.z;
+		double radius = (*it)->get_bounding_radius() * (mirrorclip ? 1.5 : 1.0);
+		double dist = relpos.length();
+		if (dist - radius > max_view_dist || !viewfrustum.is_sphere_visible(relpos, radius))
+			continue;
+		// level of detail by size on screen
+		unsigned lod = (dist > radius) ? model::get_lod_for_screen_size(radius * lod_scale / dist) : 0;
+
+		if (!mirrorclip) {
+			if ((*it)->has_model()) {
+				matrix4 transform = matrix4::trans(relpos);
+				const ship* shp = dynamic_cast<const ship*>(*it);
+				if (shp)
+					transform = transform * shp->get_orientation().rotmat4();
+				add_to_batch(batches, batch_index, *it, lod, transform);
+			}
+			continue;
+		}
+
 		glPushMatrix();
 
 		if (mirrorclip && !istorp) {
@@ -275,25 +344,26 @@ void freeview_display::draw_objects(game& gm, const vector3& viewpos,
 		if (shp) {
 			shp->get_orientation().rotmat4().multiply_gl();
 		}
-		if (mirrorclip) {
-			// torpedoes are normally fully underwater and thus need not to get
-			// rendered for mirror images
-			if (!istorp) {
-				// finished modifying tex#1 matrix
-				glMatrixMode(GL_MODELVIEW);
-				(*it)->display_mirror_clip();
-			}
-			// cleanup
-			glActiveTexture(GL_TEXTURE1);
-			glMatrixMode(GL_TEXTURE);
-			glLoadIdentity();
+		// torpedoes are normally fully underwater and thus need not to get
+		// rendered for mirror images
+		if (!istorp) {
+			// finished modifying tex#1 matrix
 			glMatrixMode(GL_MODELVIEW);
-		} else {
-			(*it)->display(under_water ? ui.get_caustics().get_map() : NULL);
+			(*it)->display_mirror_clip(lod);
 		}
+		// cleanup
+		glActiveTexture(GL_TEXTURE1);
+		glMatrixMode(GL_TEXTURE);
+		glLoadIdentity();
+		glMatrixMode(GL_MODELVIEW);
 		glPopMatrix();
 	}
 
+	for (std::vector<model_batch>::iterator it = batches.begin(); it != batches.end(); ++it) {
+		it->mdl->set_layout(*it->skin);
+		it->mdl->display_instances(it->transforms, under_water ? ui.get_caustics().get_map() : NULL, it->lod);
+	}
+
 #if 0
 	double tt = myfmod(gm.get_time(), 10.0);
 	water_splash wsp(vector3(), gm.get_time() - tt);
@@ -328,6 +398,8 @@ void freeview_display::draw_objects(game& gm, const vector3& viewpos,
 		glPopMatrix();
 	}
 
+	gm.get_particle_system().display(viewpos, player->get_pos().xy(), gm.get_max_view_distance(),
+					 light_color);
 	vector<particle*> particles = gm.visible_particles(player);
 	particle::display_all(particles, viewpos, gm, light_color);
 	
@@ -378,6 +450,17 @@ void freeview_display::draw_view(game& gm, const vector3& viewpos) const
 	// *************** compute and set player pos ****************************************
 	set_modelview_matrix(gm, viewpos);
 
+	// frustum of scene relative to viewpos, used to cull objects in both passes
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	sys().gl_perspective_fovx(pd.fov_x, double(pd.w)/double(pd.h), pd.near_z, pd.far_z);
+	frustum objects_frustum = frustum::from_opengl();
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	// pixels per meter at 1m distance, to choose level of detail of objects
+	double lod_scale = pd.w * 0.5 / tan(pd.fov_x * 0.5 * M_PI / 180.0);
+
 	// **************** prepare drawing ***************************************************
 
 	GLfloat horizon_color[4] = {0.050980392156862744f,0.054901960784313725f,0.27450980392156865f,0.0f/*this is bad*/};
@@ -488,7 +571,8 @@ void freeview_display::draw_view(game& gm, const vector3& viewpos) const
 				objects_mirror.push_back(*it);
 			}
 		}
-		draw_objects(gm, viewpos_mirror, objects_mirror, lightcol, false /* under_water */, true /* mirror */);
+		draw_objects(gm, viewpos_mirror, objects_mirror, lightcol, false /* under_water */, true /* mirror */,
+			     objects_frustum, lod_scale);
 
 		glCullFace(GL_BACK);
 
@@ -686,7 +770,8 @@ void freeview_display::draw_view(game& gm, const vector3& viewpos) const
 //	cout << "mv trans pos " << matrix4::get_gl(GL_MODELVIEW_MATRIX).column(3) << "\n";
 
 	// substract player pos.
-	draw_objects(gm, viewpos, objects, lightcol, (above_water < 0) ? true : false /* under water */, false /* mirrorclip */);
+	draw_objects(gm, viewpos, objects, lightcol, (above_water < 0) ? true : false /* under water */, false /* mirrorclip */,
+		     objects_frustum, lod_scale);
 
 	// ******************** draw the bridge in higher detail
 	if (aboard && drawbridge) {
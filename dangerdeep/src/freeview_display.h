@@ -61,12 +61,15 @@ protected:
 	virtual void set_modelview_matrix(class game& gm, const vector3& viewpos) const;
 	virtual void post_display(class game& gm) const;
 
-	// draw all sea_objects
+	// draw all sea_objects that are inside the view frustum (relative to viewpos),
+	// lod_scale is the size in pixels of one meter at one meter distance.
 	virtual void draw_objects(class game& gm, const vector3& viewpos,
 				  const std::vector<sea_object*>& objects,
 				  const colorf& light_color,
 				  const bool underwater,
-				  bool mirrorclip) const;
+				  bool mirrorclip,
+				  const class frustum& viewfrustum,
+				  double lod_scale) const;
 
 	// draw the whole view
 	virtual void draw_view(class game& gm, const vector3& viewpos) const;
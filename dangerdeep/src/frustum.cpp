@@ -44,6 +44,15 @@ polygon frustum::clip(polygon p) const
 	return result;
 }
 
+bool frustum::is_sphere_visible(const vector3& center, double radius) const
+{
+	// inside is on the positive side of all planes
+	for (unsigned i = 0; i < planes.size(); ++i)
+		if (planes[i].distance(center) < -radius)
+			return false;
+	return true;
+}
+
 /*
 void frustum::draw() const
 {
@@ -40,6 +40,8 @@ public:
 	frustum(polygon viewwindow, const vector3& viewp, double znear);
 	/// clip polygon to frustum and return intersecting polygon
 	polygon clip(polygon p) const;
+	/// check if sphere is (partly) inside the frustum, near and far plane are not tested
+	bool is_sphere_visible(const vector3& center, double radius) const;
 	/*
 	/// render frustum as test
 	void draw() const;
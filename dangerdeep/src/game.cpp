@@ -63,6 +63,7 @@ double log2( double n )
 #include "cfg.h"
 #include "log.h"
 #include "terrain.h"
+#include "alloc_counter.h"
 using std::ostringstream;
 using std::pair;
 using std::make_pair;
@@ -192,6 +193,7 @@ game::game()
 	// empty, so that heirs can construct a game object. Needed for editor
 	freezetime = 0;
 	freezetime_start = 0;
+	last_step_allocations = 0;
 
 	mywater.reset(new water(0.0));
 	//myheightgen.reset(new height_generator_map("default.xml"));
@@ -348,6 +350,7 @@ game::game(const string& subtype, unsigned cvsize, unsigned cvesc, unsigned time
 
 	freezetime = 0;
 	freezetime_start = 0;
+	last_step_allocations = 0;
 }
 
 
@@ -358,7 +361,7 @@ game::game(const string& subtype, unsigned cvsize, unsigned cvesc, unsigned time
 game::game(const string& filename)
 	: my_run_state(running), player(0),
 	  time(0), last_trail_time(0), max_view_dist(0), networktype(0), servercon(0),
-	  freezetime(0), freezetime_start(0)
+	  freezetime(0), freezetime_start(0), last_step_allocations(0)
 {
 	xml_doc doc(filename);
 	doc.load();
@@ -457,6 +460,8 @@ game::game(const string& filename)
 
 	// fixme: handle water splashes too.
 
+	update_all_ships();
+
 #if 0
 	if (sg.has_child("particles")) {
 		xml_elem pt = sg.child("particles");
@@ -555,6 +560,8 @@ game::game(const string& filename)
 
 game::~game()
 {
+	// events may use memory of the worker's arena
+	events.clear();
 	for (list<pair<double, job*> >::iterator it = jobs.begin(); it != jobs.end(); ++it)
 		delete it->second;
 }
@@ -728,14 +735,17 @@ void game::compute_max_view_dist()
 
 
 
-template<class T> void cleanup(ptrvector<T>& s)
+template<class T> bool cleanup(ptrvector<T>& s)
 {
+	bool removed = false;
 	for (unsigned i = 0; i < s.size(); ++i) {
 		if (s[i] && s[i]->is_defunct()) {
 			s.reset(i);
+			removed = true;
 		}
 	}
 	s.compact();
+	return removed;
 }
 
 
@@ -765,6 +775,14 @@ void game::simulate(double delta_t)
 	// kill events left over from last run
 	events.clear();
 
+	// now no temporary data of the last step is left, reuse the memory.
+	// the worker is idle here, so its arena can be reset as well.
+	sim_arena.reset();
+	if (myworker.get())
+		myworker->reset_arena();
+	arena::binder arena_binder(sim_arena);
+	unsigned long allocations_at_start = alloc_counter::get_count();
+
 	// check if jobs are to be run
 	for (list<pair<double, job*> >::iterator it = jobs.begin(); it != jobs.end(); ++it) {
 		it->first += delta_t;
@@ -828,14 +846,25 @@ void game::simulate(double delta_t)
 	// step 1: check for invalidity of every object and remove
 	// defunct objects. do NOT mix simulate() calls with real
 	// calls to delete an object.
-	cleanup(ships);
-	cleanup(submarines);
+	bool ships_removed = cleanup(ships);
+	ships_removed = cleanup(submarines) || ships_removed;
 	cleanup(airplanes);
-	cleanup(torpedoes);
+	ships_removed = cleanup(torpedoes) || ships_removed;
+	if (ships_removed)
+		update_all_ships();
 	cleanup(depth_charges);
 	cleanup(gun_shells);
 	cleanup(water_splashes);
 
+	// step 1b: build spatial index for torpedo and shell hit tests
+	build_unit_grid(delta_t);
+
+	// step 1c: choose full or kinematic physics for every ship
+	update_physics_lod();
+
+	// step 1d: redetect other objects for objects whose sensors are due
+	schedule_redetection(delta_t);
+
 	// step 2: simulate all objects, possibly setting state to dead/defunct.
 	if (myworker.get()) {
 		// Multi-Threading code path (2 cores)
@@ -863,6 +892,8 @@ void game::simulate(double delta_t)
 	// must not be done multithreaded.
 	convoys.compact();
 	particles.compact();
+	// mass particles are simulated in the background, while the next frame is rendered
+	particle_sys.simulate(delta_t);
 
 	// Now check for collisions. As a result objects could be set to dead state.
 	// If we would call this before simulate() an object could go from alive
@@ -898,6 +929,8 @@ void game::simulate(double delta_t)
 			my_run_state = contact_lost;
 		}
 	}
+
+	last_step_allocations = alloc_counter::get_count() - allocations_at_start;
 }
 
 
@@ -1049,14 +1082,13 @@ void game::add_logbook_entry(const string& s)
 	
 ******************************************************************************************/
 
-template <class T> inline vector<T*> visible_obj(const game* gm, const ptrvector<T>& v, const sea_object* o)
+template <class T, class U> inline void append_visible(const game* gm, const ptrvector<T>& v, const sea_object* o,
+							 vector<U*>& result)
 {
-	vector<T*> result;
 	const sensor* s = o->get_sensor(o->lookout_system);
-	if (!s) return result;
+	if (!s) return;
 	const lookout_sensor* ls = dynamic_cast<const lookout_sensor*>(s);
-	if (!ls) return result;
-	result.reserve(v.size());
+	if (!ls) return;
 	for (unsigned i = 0; i < v.size(); ++i) {
 		// do not handle dead or defunct objects!
 		if (v[i] && v[i]->is_reference_ok()) {
@@ -1064,6 +1096,26 @@ template <class T> inline vector<T*> visible_obj(const game* gm, const ptrvector
 				result.push_back(v[i]);
 		}
 	}
+}
+
+template <class T, class U> inline void append_radar(const game* gm, const ptrvector<T>& v, const sea_object* o,
+						       vector<U*>& result)
+{
+	const sensor* s = o->get_sensor ( o->radar_system );
+	if (!s) return;
+	const radar_sensor* ls = dynamic_cast<const radar_sensor*> ( s );
+	if (!ls) return;
+	for (unsigned k = 0; k < v.size(); ++k) {
+		if ( ls->is_detected ( gm, o, v[k] ) )
+			result.push_back (v[k]);
+	}
+}
+
+template <class T> inline vector<T*> visible_obj(const game* gm, const ptrvector<T>& v, const sea_object* o)
+{
+	vector<T*> result;
+	result.reserve(v.size());
+	append_visible(gm, v, o, result);
 	return result;
 }
 
@@ -1083,6 +1135,15 @@ vector<airplane*> game::visible_airplanes(const sea_object* o) const
 	return visible_obj<airplane>(this, airplanes, o);
 }
 
+template <class U> void game::append_all_torpedoes(std::vector<U*>& result) const
+{
+	for (unsigned k = 0; k < torpedoes.size(); ++k) {
+		if (torpedoes[k] && torpedoes[k]->is_reference_ok()) {
+			result.push_back(torpedoes[k]);
+		}
+	}
+}
+
 vector<torpedo*> game::visible_torpedoes(const sea_object* o) const
 {
 //testing: draw all torpedoes
@@ -1095,11 +1156,7 @@ vector<torpedo*> game::visible_torpedoes(const sea_object* o) const
 	// torpedoes.compress() should remove any null pointers before display
 	// is rendered, but it crashes when drawing trails because of null
 	// pointers...
-	for (unsigned k = 0; k < torpedoes.size(); ++k) {
-		if (torpedoes[k] && torpedoes[k]->is_reference_ok()) {
-			result.push_back(torpedoes[k]);
-		}
-	}
+	append_all_torpedoes(result);
 	return result;
 //	return visible_obj<torpedo>(this, torpedoes, o);
 }
@@ -1145,15 +1202,21 @@ vector<particle*> game::visible_particles(const sea_object* o ) const
 vector<sonar_contact> game::sonar_ships (const sea_object* o ) const
 {
 	vector<sonar_contact> result;
+	append_sonar_ships(o, result);
+	return result;
+}
+
+void game::append_sonar_ships(const sea_object* o, vector<sonar_contact>& result) const
+{
 	const sensor* s = o->get_sensor ( o->passive_sonar_system );
-	if (!s) return result;
+	if (!s) return;
 	const passive_sonar_sensor* pss = dynamic_cast<const passive_sonar_sensor*> ( s );
-	if (!pss) return result;
-
-	result.reserve(ships.size());
+	if (!pss) return;
 
 	// collect the nearest contacts, limited to some value!
-	vector<pair<double, ship*> > contacts ( MAX_ACUSTIC_CONTACTS, make_pair ( 1e30, (ship*) 0 ) );
+	pair<double, ship*> contacts[MAX_ACUSTIC_CONTACTS];
+	for (unsigned i = 0; i < MAX_ACUSTIC_CONTACTS; ++i)
+		contacts[i] = make_pair ( 1e30, (ship*) 0 );
 	for (unsigned k = 0; k < ships.size(); ++k) {
 		// do not handle dead/defunct objects
 		if (!ships[k]->is_reference_ok()) continue;
@@ -1164,21 +1227,20 @@ vector<sonar_contact> game::sonar_ships (const sea_object* o ) const
 
 		double d = ships[k]->get_pos ().xy ().square_distance ( o->get_pos ().xy () );
 		unsigned i = 0;
-		for ( ; i < contacts.size (); ++i ) {
+		for ( ; i < MAX_ACUSTIC_CONTACTS; ++i ) {
 			if ( contacts[i].first > d )
 				break;
 		}
 
-		if ( i < contacts.size () ) {
-			for ( unsigned j = contacts.size ()-1; j > i; --j )
+		if ( i < MAX_ACUSTIC_CONTACTS ) {
+			for ( unsigned j = MAX_ACUSTIC_CONTACTS-1; j > i; --j )
 				contacts[j] = contacts[j-1];
 
 			contacts[i] = make_pair ( d, ships[k] );
 		}
 	}
 
-	unsigned size = contacts.size ();
-	for (unsigned i = 0; i < size; i++ ) {
+	for (unsigned i = 0; i < MAX_ACUSTIC_CONTACTS; i++ ) {
 		ship* sh = contacts[i].second;
 		if ( sh == 0 )
 			break;
@@ -1186,17 +1248,22 @@ vector<sonar_contact> game::sonar_ships (const sea_object* o ) const
 		if ( pss->is_detected ( this, o, sh ) )
 			result.push_back(sonar_contact(sh->get_pos().xy(), sh->get_class()));
 	}
-	return result;
 }
 
 vector<sonar_contact> game::sonar_submarines (const sea_object* o ) const
 {
 	vector<sonar_contact> result;
+	result.reserve(submarines.size());
+	append_sonar_submarines(o, result);
+	return result;
+}
+
+void game::append_sonar_submarines(const sea_object* o, vector<sonar_contact>& result) const
+{
 	const sensor* s = o->get_sensor ( o->passive_sonar_system );
-	if (!s) return result;
+	if (!s) return;
 	const passive_sonar_sensor* pss = dynamic_cast<const passive_sonar_sensor*> ( s );
-	if (!pss) return result;
-	result.reserve(submarines.size());
+	if (!pss) return;
 	for (unsigned k = 0; k < submarines.size(); ++k) {
 		// do not handle dead/defunct objects
 		if (!submarines[k]->is_reference_ok()) continue;
@@ -1209,57 +1276,37 @@ vector<sonar_contact> game::sonar_submarines (const sea_object* o ) const
 		if ( pss->is_detected ( this, o, submarines[k] ) )
 			result.push_back(sonar_contact(submarines[k]->get_pos().xy(), submarines[k]->get_class()));
 	}
-	return result;
 }
 
 vector<sonar_contact> game::sonar_sea_objects(const sea_object* o) const
 {
-	vector<sonar_contact> sships = sonar_ships(o);
-	vector<sonar_contact> ssubmarines = sonar_submarines(o);
-	sships.reserve(sships.size() + ssubmarines.size());
-	for (unsigned i = 0; i < ssubmarines.size(); ++i)
-		sships.push_back(ssubmarines[i]);
-	return sships;
+	vector<sonar_contact> result;
+	append_sonar_ships(o, result);
+	append_sonar_submarines(o, result);
+	return result;
 }
 
 vector<submarine*> game::radar_submarines(const sea_object* o) const
 {
 	vector<submarine*> result;
-	const sensor* s = o->get_sensor ( o->radar_system );
-	if (!s) return result;
-	const radar_sensor* ls = dynamic_cast<const radar_sensor*> ( s );
-	if (!ls) return result;
 	result.reserve(submarines.size());
-	for (unsigned k = 0; k < submarines.size(); ++k) {
-		if ( ls->is_detected ( this, o, submarines[k] ) )
-			result.push_back (submarines[k]);
-	}
+	append_radar(this, submarines, o, result);
 	return result;
 }
 
 vector<ship*> game::radar_ships(const sea_object* o) const
 {
 	vector<ship*> result;
-	const sensor* s = o->get_sensor ( o->radar_system );
-	if (!s) return result;
-	const radar_sensor* ls = dynamic_cast<const radar_sensor*> ( s );
-	if (!ls) return result;
 	result.reserve(ships.size());
-	for (unsigned k = 0; k < ships.size(); ++k) {
-		if ( ls->is_detected ( this, o, ships[k] ) )
-			result.push_back (ships[k]);
-	}
+	append_radar(this, ships, o, result);
 	return result;
 }
 
 vector<sea_object*> game::radar_sea_objects(const sea_object* o) const
 {
-	vector<ship*> rships = radar_ships(o);
-	vector<submarine*> rsubmarines = radar_submarines(o);
 	vector<sea_object*> result;
-	result.reserve(rships.size() + rsubmarines.size());
-	append_vec(result, rships);
-	append_vec(result, rsubmarines);
+	append_radar(this, ships, o, result);
+	append_radar(this, submarines, o, result);
 	return result;
 }
 
@@ -1279,7 +1326,7 @@ pair<double, noise> game::sonar_listen_ships(const ship* listener,
 					angle rel_listening_dir) const
 {
 	// collect all ships for sound strength measurement
-	vector<const ship*> tmpships;
+	arena_vector<const ship*>::type tmpships;
 	tmpships.reserve(ships.size() + submarines.size() /* + torpedoes.size() */ - 1);
 	for (unsigned i = 0; i < ships.size(); ++i)
 		if (ships[i] != listener)
@@ -1400,11 +1447,13 @@ pair<double, noise> game::sonar_listen_ships(const ship* listener,
 void game::spawn_ship(ship* s)
 {
 	ships.push_back(s);
+	all_ships.push_back(s);
 }
 
 void game::spawn_submarine(submarine* u)
 {
 	submarines.push_back(u);
+	all_ships.insert(all_ships.begin() + torpedoes.size() + submarines.size() - 1, u);
 }
 
 void game::spawn_airplane(airplane* a)
@@ -1415,6 +1464,7 @@ void game::spawn_airplane(airplane* a)
 void game::spawn_torpedo(torpedo* t)
 {
 	torpedoes.push_back(t);
+	all_ships.insert(all_ships.begin() + torpedoes.size() - 1, t);
 }
 
 void game::spawn_gun_shell(gun_shell* s, const double &calibre)
@@ -1455,6 +1505,13 @@ void game::spawn_particle(particle* pt)
 
 
 
+unsigned game::spawn_particle(particle_system::type t, const vector3& pos, const vector3& velo)
+{
+	return particle_sys.spawn(t, pos, velo);
+}
+
+
+
 void game::dc_explosion(const depth_charge& dc)
 {
 	// Create water splash.
@@ -1559,8 +1616,7 @@ void game::unregister_job(job* j)
 	throw error("[game::unregister_job] job not found in list");
 }
 
-template<class C>
-ship* game::check_units ( torpedo* t, const ptrvector<C>& units )
+ship* game::check_units ( torpedo* t, const ship_grid::result_list& units )
 {
 	const vector3& t_pos = t->get_pos();
 	bv_tree::param p0 = t->compute_bv_tree_params();
@@ -1584,10 +1640,19 @@ ship* game::check_units ( torpedo* t, const ptrvector<C>& units )
 
 bool game::check_torpedo_hit(torpedo* t, bool runlengthfailure)
 {
-	ship* s = check_units ( t, ships );
+	// only units whose bounding circle overlaps the torpedo's are candidates,
+	// ships are checked before submarines like before.
+	const vector2 t_pos = t->get_pos().xy();
+	double r = compute_grid_radius(t);
+	ship_grid::result_list candidates;
+	unit_grid.query_circle(t_pos, r, ship_grid::ships, candidates);
+	ship* s = check_units ( t, candidates );
 
-	if ( !s )
-		s = check_units ( t, submarines );
+	if ( !s ) {
+		candidates.clear();
+		unit_grid.query_circle(t_pos, r, ship_grid::submarines, candidates);
+		s = check_units ( t, candidates );
+	}
 
 	if ( s ) {
 		if (runlengthfailure) {
@@ -1611,7 +1676,7 @@ bool game::check_torpedo_hit(torpedo* t, bool runlengthfailure)
 			}
 			
 			// explosion of torpedo
-			spawn_particle(new explosion_particle(s->get_pos() + vector3(0, 0, 5)));
+			spawn_particle(particle_system::explosion, s->get_pos() + vector3(0, 0, 5));
 			torp_explode ( t );
 		}
 		return true;
@@ -1791,39 +1856,26 @@ double game::get_depth_factor ( const vector3& sub ) const
 
 vector<sea_object*> game::visible_surface_objects(const sea_object* o) const
 {
-	vector<ship*> vships = visible_ships(o);
-	vector<submarine*> vsubmarines = visible_submarines(o);
-	vector<airplane*> vairplanes = visible_airplanes(o);
+	vector<sea_object*> result;
+	append_visible(this, ships, o, result);
+	append_visible(this, submarines, o, result);
+	append_visible(this, airplanes, o, result);
 
 	// fixme: adding RADAR-detected ships to a VISIBLE-objects function is a bit weird...
 	// this leads to wrong results if radar detected objects are handled differently,
 	// like different display on map, or drawing (not visible!), or for AI!
-	vector<ship*> rships = radar_ships(o);
-	vector<submarine*> rsubmarines = radar_submarines(o);
-	
-	vector<sea_object*> result;
-	result.reserve(vships.size() + vsubmarines.size() + vairplanes.size() +
-		       rships.size() + rsubmarines.size());
-	append_vec(result, vships);
-	append_vec(result, vsubmarines);
-	append_vec(result, vairplanes);
-	append_vec(result, rships);
-	append_vec(result, rsubmarines);
+	append_radar(this, ships, o, result);
+	append_radar(this, submarines, o, result);
 	return result;
 }
 
 vector<sea_object*> game::visible_sea_objects(const sea_object* o) const
 {
-	vector<ship*> vships = visible_ships(o);
-	vector<submarine*> vsubmarines = visible_submarines(o);
-	vector<airplane*> vairplanes = visible_airplanes(o);
-	vector<torpedo*> vtorpedoes = visible_torpedoes(o);
 	vector<sea_object*> result;
-	result.reserve(vships.size() + vsubmarines.size() + vairplanes.size() + vtorpedoes.size());
-	append_vec(result, vships);
-	append_vec(result, vsubmarines);
-	append_vec(result, vairplanes);
-	append_vec(result, vtorpedoes);
+	append_visible(this, ships, o, result);
+	append_visible(this, submarines, o, result);
+	append_visible(this, airplanes, o, result);
+	append_all_torpedoes(result);
 	return result;
 }
 
@@ -1838,22 +1890,17 @@ ship* game::sonar_acoustical_torpedo_target ( const torpedo* o ) const
 		pss = dynamic_cast<const passive_sonar_sensor*> ( s );
 
 	if ( pss ) {
-		for (unsigned k = 0; k < ships.size(); ++k) {
+		// units out of sensor range are never detected, so only units near
+		// the torpedo are candidates. Ships before submarines like before.
+		ship_grid::result_list candidates;
+		unit_grid.query_circle(o->get_pos().xy(), pss->get_range(), ship_grid::ships, candidates);
+		unit_grid.query_circle(o->get_pos().xy(), pss->get_range(), ship_grid::submarines, candidates);
+		for (unsigned k = 0; k < candidates.size(); ++k) {
 			double sf = 0.0f;
-			if ( pss->is_detected ( sf, this, o, ships[k] ) ) {
+			if ( pss->is_detected ( sf, this, o, candidates[k] ) ) {
 				if ( sf > loudest_object_sf ) {
 					loudest_object_sf = sf;
-					loudest_object = ships[k];
-				}
-			}
-		}
-
-		for (unsigned k = 0; k < submarines.size(); ++k) {
-			double sf = 0.0f;
-			if ( pss->is_detected ( sf, this, o, submarines[k] ) ) {
-				if ( sf > loudest_object_sf ) {
-					loudest_object_sf = sf;
-					loudest_object = submarines[k];
+					loudest_object = candidates[k];
 				}
 			}
 		}
@@ -1943,19 +1990,232 @@ void game::send(command* cmd)
 
 
 
-//fixme: it would be better to keep such a vector around and not recompute it for every object that needs it
-//it must be recomputed only when spawn is called or compress removes objects
-vector<ship*> game::get_all_ships() const
+// rebuild view of all ships. spawn_* insert objects into the view, so this
+// is needed only when objects are removed or loaded.
+void game::update_all_ships()
 {
-	vector<ship*> allships(torpedoes.size() + submarines.size() + ships.size());
-	unsigned k = 0;
-	for (unsigned i = 0; i < torpedoes.size(); ++i, ++k)
-		allships[k] = torpedoes[i];
-	for (unsigned i = 0; i < submarines.size(); ++i, ++k)
-		allships[k] = submarines[i];
-	for (unsigned i = 0; i < ships.size(); ++i, ++k)
-		allships[k] = ships[i];
-	return allships;
+	all_ships.clear();
+	all_ships.reserve(torpedoes.size() + submarines.size() + ships.size());
+	for (unsigned i = 0; i < torpedoes.size(); ++i)
+		all_ships.push_back(torpedoes[i]);
+	for (unsigned i = 0; i < submarines.size(); ++i)
+		all_ships.push_back(submarines[i]);
+	for (unsigned i = 0; i < ships.size(); ++i)
+		all_ships.push_back(ships[i]);
+}
+
+
+
+double game::compute_grid_radius(const ship* s)
+{
+	// bv_tree root sphere relative to object position, transformed sphere
+	// center is relative to the position as well.
+	spheref sph = s->compute_bv_tree_params().get_transformed_sphere();
+	return std::max(s->get_bounding_radius(), double(sph.center.length() + sph.radius));
+}
+
+
+
+void game::build_unit_grid(double delta_t)
+{
+	// Objects move while the step is simulated, so enlarge the circles by
+	// the distance they can travel in this step (with some safety margin).
+	// Same order as get_all_ships, so shell hits are tested in the same order.
+	unit_grid.clear();
+	for (unsigned i = 0; i < torpedoes.size(); ++i)
+		unit_grid.add(torpedoes[i], ship_grid::torpedoes, torpedoes[i]->get_pos().xy(),
+			      compute_grid_radius(torpedoes[i])
+			      + 2.0 * torpedoes[i]->get_velocity().length() * delta_t + 1.0);
+	for (unsigned i = 0; i < submarines.size(); ++i)
+		unit_grid.add(submarines[i], ship_grid::submarines, submarines[i]->get_pos().xy(),
+			      compute_grid_radius(submarines[i])
+			      + 2.0 * submarines[i]->get_velocity().length() * delta_t + 1.0);
+	for (unsigned i = 0; i < ships.size(); ++i)
+		unit_grid.add(ships[i], ship_grid::ships, ships[i]->get_pos().xy(),
+			      compute_grid_radius(ships[i])
+			      + 2.0 * ships[i]->get_velocity().length() * delta_t + 1.0);
+	unit_grid.build();
+}
+
+
+
+void game::update_physics_lod()
+{
+	// Ships are promoted to full physics when they come closer than the
+	// near distances and demoted again when they are farther away than the
+	// far distances, so they don't toggle every step at the border.
+	// Inactive (sinking) ships need the full model for flooding.
+	const double player_near_dist = 5000.0, player_far_dist = 6000.0;
+	const double threat_near_dist = 2000.0, threat_far_dist = 2500.0;
+	vector<vector2> threats;
+	threats.reserve(torpedoes.size() + depth_charges.size() + gun_shells.size());
+	for (unsigned i = 0; i < torpedoes.size(); ++i)
+		threats.push_back(torpedoes[i]->get_pos().xy());
+	for (unsigned i = 0; i < depth_charges.size(); ++i)
+		threats.push_back(depth_charges[i]->get_pos().xy());
+	for (unsigned i = 0; i < gun_shells.size(); ++i)
+		threats.push_back(gun_shells[i]->get_pos().xy());
+	for (unsigned i = 0; i < ships.size(); ++i) {
+		ship* s = ships[i];
+		bool is_far = s->has_far_physics();
+		bool full = (s == player) || !player || !s->is_alive() || s->is_inactive();
+		vector2 p = s->get_pos().xy();
+		if (!full) {
+			double d = is_far ? player_near_dist : player_far_dist;
+			full = p.square_distance(player->get_pos().xy()) < d*d;
+		}
+		double td = is_far ? threat_near_dist : threat_far_dist;
+		for (unsigned j = 0; !full && j < threats.size(); ++j)
+			full = p.square_distance(threats[j]) < td*td;
+		s->set_far_physics(!full);
+	}
+}
+
+
+
+template <class T> inline void queue_due_detectors(const ptrvector<T>& v, double delta_t,
+						   vector<pair<double, sea_object*> >& queue)
+{
+	for (unsigned i = 0; i < v.size(); ++i)
+		if (v[i] && v[i]->count_down_redetection(delta_t))
+			queue.push_back(make_pair(v[i]->get_redetect_time(), (sea_object*)v[i]));
+}
+
+static bool more_overdue(const pair<double, sea_object*>& a, const pair<double, sea_object*>& b)
+{
+	return a.first < b.first;
+}
+
+void game::schedule_redetection(double delta_t)
+{
+	// Every detecting object checks all other objects with its sensors, that
+	// are N^2 sensor tests per redetection interval. When done by each object
+	// in its own simulate() all objects created together redetect in the same
+	// step, giving periodic spikes. So limit the number of redetections per
+	// step to a bit more than the average need, most overdue objects first.
+	// Objects left over stay in the queue and are handled in the next steps,
+	// which spreads the redetections evenly over the steps.
+	redetect_queue.clear();
+	queue_due_detectors(ships, delta_t, redetect_queue);
+	queue_due_detectors(submarines, delta_t, redetect_queue);
+	queue_due_detectors(airplanes, delta_t, redetect_queue);
+	if (redetect_queue.empty())
+		return;
+	// shortest interval is one second
+	unsigned nr_detectors = ships.size() + submarines.size() + airplanes.size();
+	unsigned budget = unsigned(ceil(2.0 * nr_detectors * delta_t)) + 1;
+	unsigned nr_jobs = std::min(budget, unsigned(redetect_queue.size()));
+	std::stable_sort(redetect_queue.begin(), redetect_queue.end(), more_overdue);
+	redetect_batch(nr_jobs);
+}
+
+
+
+double game::compute_redetect_interval(const sea_object* o) const
+{
+	// objects far out of the player's view range matter only for AI,
+	// their interval grows up to three times the normal interval.
+	double iv = o->get_redetect_interval();
+	if (!player || o == player || max_view_dist <= 0)
+		return iv;
+	double d = o->get_pos().xy().distance(player->get_pos().xy());
+	return iv * (1.0 + 2.0 * myclamp((d - max_view_dist) / max_view_dist, 0.0, 1.0));
+}
+
+
+
+void game::redetect_batch(unsigned nr_jobs)
+{
+	// Test every possible target against all detectors due in this step, so
+	// each target is fetched once. Results are in the same order as given by
+	// visible_sea_objects, radar_sea_objects and sonar_sea_objects.
+	if (detection_jobs.size() < nr_jobs)
+		detection_jobs.resize(nr_jobs);
+	for (unsigned j = 0; j < nr_jobs; ++j) {
+		detection_job& dj = detection_jobs[j];
+		dj.detector = redetect_queue[j].second;
+		dj.ls = dynamic_cast<const lookout_sensor*>(dj.detector->get_sensor(sea_object::lookout_system));
+		dj.rs = dynamic_cast<const radar_sensor*>(dj.detector->get_sensor(sea_object::radar_system));
+		dj.pss = dynamic_cast<const passive_sonar_sensor*>(dj.detector->get_sensor(sea_object::passive_sonar_system));
+		dj.visible.clear();
+		dj.radar.clear();
+		dj.sonar.clear();
+		dj.nearest_ships.assign(MAX_ACUSTIC_CONTACTS, make_pair(1e30, (ship*)0));
+	}
+
+	// ships: lookout, radar, and collect nearest ships for sonar
+	for (unsigned k = 0; k < ships.size(); ++k) {
+		ship* t = ships[k];
+		bool ok = t && t->is_reference_ok();
+		for (unsigned j = 0; j < nr_jobs; ++j) {
+			detection_job& dj = detection_jobs[j];
+			if (ok && dj.ls && dj.ls->is_detected(this, dj.detector, t))
+				dj.visible.push_back(t);
+			if (dj.rs && dj.rs->is_detected(this, dj.detector, t))
+				dj.radar.push_back(t);
+			if (ok && dj.pss && t != dj.detector) {
+				double d = t->get_pos().xy().square_distance(dj.detector->get_pos().xy());
+				vector<pair<double, ship*> >& nc = dj.nearest_ships;
+				unsigned i = 0;
+				while (i < nc.size() && nc[i].first <= d)
+					++i;
+				if (i < nc.size()) {
+					for (unsigned m = nc.size() - 1; m > i; --m)
+						nc[m] = nc[m-1];
+					nc[i] = make_pair(d, t);
+				}
+			}
+		}
+	}
+	// sonar: only the nearest ships can be heard
+	for (unsigned j = 0; j < nr_jobs; ++j) {
+		detection_job& dj = detection_jobs[j];
+		for (unsigned i = 0; i < dj.nearest_ships.size() && dj.nearest_ships[i].second; ++i) {
+			ship* sh = dj.nearest_ships[i].second;
+			if (dj.pss->is_detected(this, dj.detector, sh))
+				dj.sonar.push_back(sonar_contact(sh->get_pos().xy(), sh->get_class()));
+		}
+	}
+
+	// submarines: lookout, radar, sonar
+	for (unsigned k = 0; k < submarines.size(); ++k) {
+		submarine* t = submarines[k];
+		bool ok = t && t->is_reference_ok();
+		for (unsigned j = 0; j < nr_jobs; ++j) {
+			detection_job& dj = detection_jobs[j];
+			if (ok && dj.ls && dj.ls->is_detected(this, dj.detector, t))
+				dj.visible.push_back(t);
+			if (dj.rs && dj.rs->is_detected(this, dj.detector, t))
+				dj.radar.push_back(t);
+			if (ok && dj.pss && t != dj.detector && dj.pss->is_detected(this, dj.detector, t))
+				dj.sonar.push_back(sonar_contact(t->get_pos().xy(), t->get_class()));
+		}
+	}
+
+	// airplanes: lookout only
+	for (unsigned k = 0; k < airplanes.size(); ++k) {
+		airplane* t = airplanes[k];
+		if (!t || !t->is_reference_ok()) continue;
+		for (unsigned j = 0; j < nr_jobs; ++j) {
+			detection_job& dj = detection_jobs[j];
+			if (dj.ls && dj.ls->is_detected(this, dj.detector, t))
+				dj.visible.push_back(t);
+		}
+	}
+
+	// torpedoes are always visible, see visible_torpedoes
+	for (unsigned k = 0; k < torpedoes.size(); ++k) {
+		torpedo* t = torpedoes[k];
+		if (!t || !t->is_reference_ok()) continue;
+		for (unsigned j = 0; j < nr_jobs; ++j)
+			detection_jobs[j].visible.push_back(t);
+	}
+
+	for (unsigned j = 0; j < nr_jobs; ++j) {
+		detection_job& dj = detection_jobs[j];
+		dj.detector->set_detected_objects(dj.visible, dj.radar, dj.sonar,
+						  compute_redetect_interval(dj.detector));
+	}
 }
 
 
@@ -1963,7 +2223,7 @@ vector<ship*> game::get_all_ships() const
 void game::check_collisions()
 {
 	// torpedoes are special... check collision only for impact fuse?
-	vector<ship*> allships = get_all_ships();
+	const vector<ship*>& allships = get_all_ships();
 	unsigned m = torpedoes.size();
 
 	// now check for collisions for all ships idx i with partner index > max(m,i)
@@ -2189,6 +2449,14 @@ double game::compute_water_height(const vector2& pos) const
 
 
 
+void game::compute_water_heights(const vector2& origin, const float* x, const float* y,
+				 float* heights, unsigned n) const
+{
+	mywater->get_heights(origin, x, y, heights, n);
+}
+
+
+
 sea_object* game::load_ptr(unsigned nr) const
 {
 	if (nr == 0)
@@ -2331,7 +2599,10 @@ void game::simulate_worker::loop()
 		if (abort_requested())
 			return;
 	}
-	gm.simulate_objects_mt(delta_t, idxoff, idxmod, record, nearest_contact);
+	{
+		arena::binder arena_binder(myarena);
+		gm.simulate_objects_mt(delta_t, idxoff, idxmod, record, nearest_contact);
+	}
 	{
 		mutex_locker ml(mtx);
 		done = true;
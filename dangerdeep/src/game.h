@@ -67,6 +67,9 @@ class height_generator;
 #include "sonar.h"
 #include "event.h"
 #include "ptrlist.h"
+#include "ship_grid.h"
+#include "particle.h"
+#include "arena.h"
 
 // Note! do NOT include user_interface here, class game MUST NOT call any method
 // of class user_interface or its heirs.
@@ -166,9 +169,14 @@ protected:
 	ptrvector<convoy> convoys;
 	ptrvector<particle> particles;
 	// end [SAVE]
+	particle_system particle_sys;	// smoke, fire etc., not saved
 	run_state my_run_state;
 
-	ptrlist<event> events;
+	// memory for temporary data of a simulation step, see class arena.
+	// must be declared before anything that is allocated in it.
+	arena sim_arena;
+
+	ptrlist<event, arena_allocator<event*> > events;
 	
 	std::list<std::pair<double, job*> > jobs;	// generated by interface construction, no gameplay data
 	
@@ -190,6 +198,7 @@ protected:
 	std::list<ping> pings;	// [SAVE]
 	
 	// network game type (0 = single player, 1 = server, 2 = client)
+	// multiplayer games should run in lockstep, see net_lockstep.h
 	unsigned networktype;	// [SAVE] later!
 	// the connection to the server (zero if this is the server)
 	network_connection* servercon;	// [SAVE] later!
@@ -200,12 +209,54 @@ protected:
 	// for small pauses to compensate long image loading times
 	unsigned freezetime, freezetime_start;
 
+	// heap allocations of last simulation step, for profiling
+	unsigned long last_step_allocations;
+
 	// water height data, and everything around it.
 	std::auto_ptr<water> mywater;
 
 	// terrain height data
 	std::auto_ptr<height_generator> myheightgen;
 
+	// spatial index of torpedoes, submarines and ships, rebuilt every step before
+	// simulation, read-only while objects are simulated.
+	ship_grid unit_grid;
+	void build_unit_grid(double delta_t);
+	static double compute_grid_radius(const ship* s);
+
+	// physics level of detail: ships far away from the player and from
+	// torpedoes, depth charges and shells use a kinematic model only.
+	void update_physics_lod();
+
+	// view of torpedoes, submarines and ships (see get_all_ships)
+	std::vector<ship*> all_ships;
+	void update_all_ships();
+
+	// helper functions for the sensor queries, they append to result.
+	template <class U> void append_all_torpedoes(std::vector<U*>& result) const;
+	void append_sonar_ships(const sea_object* o, std::vector<sonar_contact>& result) const;
+	void append_sonar_submarines(const sea_object* o, std::vector<sonar_contact>& result) const;
+
+	// sensor redetection scheduling. Objects due for redetection are queued,
+	// a limited number of them is handled per step in one batched pass
+	// over all possible targets.
+	struct detection_job
+	{
+		sea_object* detector;
+		const lookout_sensor* ls;
+		const radar_sensor* rs;
+		const passive_sonar_sensor* pss;
+		std::vector<sea_object*> visible, radar;
+		std::vector<sonar_contact> sonar;
+		std::vector<std::pair<double, ship*> > nearest_ships;	// for sonar
+		detection_job() : detector(0), ls(0), rs(0), pss(0) {}
+	};
+	std::vector<detection_job> detection_jobs;	// kept to reuse memory
+	std::vector<std::pair<double, sea_object*> > redetect_queue;
+	void schedule_redetection(double delta_t);
+	void redetect_batch(unsigned nr_jobs);
+	double compute_redetect_interval(const sea_object* o) const;
+
 	// multi-threading helper for simulation
 	void simulate_objects_mt(double delta_t, unsigned idxoff, unsigned idxmod, bool record,
 				 double& nearest_contact);
@@ -222,10 +273,13 @@ protected:
 		bool record;
 		double nearest_contact;
 		bool done;
+		arena myarena;	// temporary data of the worker's part of the step
 	public:
 		simulate_worker(game& gm_);
 		void loop();
 		void request_abort();
+		// call only between sync() and work()
+		void reset_arena() { myarena.reset(); }
 		void work(double dt, unsigned io, unsigned im, bool record);
 		double sync();
 	};
@@ -349,6 +403,7 @@ public:
 	void spawn_water_splash(water_splash* ws);
 	void spawn_convoy(convoy* cv);
 	void spawn_particle(particle* pt);
+	unsigned spawn_particle(particle_system::type t, const vector3& pos, const vector3& velo = vector3());
 
 	// simulation events
 	void dc_explosion(const depth_charge& dc);	// depth charge exploding
@@ -364,7 +419,8 @@ public:
 	void unregister_job(job* j);
 	const std::list<ping>& get_pings() const { return pings; };	// fixme: maybe vector not list
 
-	template<class C> ship* check_units ( torpedo* t, const ptrvector<C>& units );
+	/// check torpedo against candidate units, return first hit unit
+	ship* check_units ( torpedo* t, const ship_grid::result_list& units );
 
 	/// check if torpedo t hits any ship/sub and in that case spawn events
 	bool check_torpedo_hit(torpedo* t, bool runlengthfailure);
@@ -391,6 +447,10 @@ public:
 	/// compute height of water at given world space position.
 	double compute_water_height(const vector2& pos) const;
 
+	/// compute height of water at n world space positions origin + (x[i], y[i]).
+	void compute_water_heights(const vector2& origin, const float* x, const float* y,
+				   float* heights, unsigned n) const;
+
 	// Translate pointers to numbers and vice versa. Used for load/save
 	sea_object* load_ptr(unsigned nr) const;
 	ship* load_ship_ptr(unsigned nr) const;
@@ -402,12 +462,18 @@ public:
 	void unfreeze_time();
 
 	void add_event(event* e) { events.push_back(e); }
-	const ptrlist<event>& get_events() const { return events; }
+	typedef ptrlist<event, arena_allocator<event*> > event_list;
+	const event_list& get_events() const { return events; }
+	/// number of heap allocations in last simulation step (needs countallocs build)
+	unsigned long get_last_step_allocations() const { return last_step_allocations; }
 	run_state get_run_state() const { return my_run_state; }
 	unsigned get_freezetime() const { return freezetime; }
 	unsigned get_freezetime_start() const { return freezetime_start; }
 	unsigned process_freezetime() { unsigned f = freezetime; freezetime = 0; return f; }
 
+	particle_system& get_particle_system() { return particle_sys; }
+	const particle_system& get_particle_system() const { return particle_sys; }
+
 	water& get_water() { return *mywater.get(); }
 	const water& get_water() const { return *mywater.get(); }
 
@@ -415,7 +481,11 @@ public:
 	const height_generator& get_height_gen() const { return *myheightgen.get(); }
 
 	/// get pointers to all ships for collision tests.
-	std::vector<ship*> get_all_ships() const;
+	/// torpedoes, submarines and ships in that order, kept up to date on spawn and cleanup
+	const std::vector<ship*>& get_all_ships() const { return all_ships; }
+
+	/// get spatial index of all ships, valid during simulation step.
+	const ship_grid& get_unit_grid() const { return unit_grid; }
 
 	virtual const player_info& get_player_info() const { return playerinfo; }
 
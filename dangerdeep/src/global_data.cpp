@@ -193,6 +193,16 @@ vector2f transform_real_to_geo(vector2f& pos)
 	return coord;
 }
 
+float transform_real_to_geo_row(float pos_y, double& x_factor)
+{
+	double sn, cn, r;
+	
+	jacobi_amp(pos_y/WGS84_A, WGS84_K, sn, cn);
+	r = sqrt((WGS84_B*WGS84_B)/(1.0-WGS84_K*WGS84_K*cn*cn));
+	x_factor = 180.0/(M_PI*r);
+	return (asin(sn)*180.0)/M_PI;
+}
+
 static double transform_nautic_coord_to_real(const string& s, char minus, char plus, int degmax)
 {
 	if (s.length() < 2)
@@ -138,6 +138,9 @@ double transform_nautic_posy_to_real(const std::string& s);
 
 void jacobi_amp(double u, double k, double& sn, double& cn);
 vector2f transform_real_to_geo(vector2f& pos);
+// geo latitude of real y coordinate, and factor so that geo longitude = real x * x_factor.
+// Use it for rows of positions with equal y instead of transform_real_to_geo.
+float transform_real_to_geo_row(float pos_y, double& x_factor);
 std::list<std::string> string_split(const std::string& src, char splitter = ',');
 
 // save a PGM (for debugging mostly)
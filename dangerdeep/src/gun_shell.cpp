@@ -84,8 +84,6 @@ void gun_shell::save(xml_elem& parent) const
 
 void gun_shell::check_collision()
 {
-	// fixme use bv trees for this: tree/sphere with ray intersection
-
 	/* For gun shells we need to check for intersection of a line to all ships.
 	   The line is determined by the movement of the shell between two simulation
 	   steps. Let it be b + t * d, where b, d are vectors and d has length 1.
@@ -97,22 +95,11 @@ void gun_shell::check_collision()
 	   intersect. Where q = length of the line, i.e. length of d before
 	   normalizing it. Additionally if t1,2 have a different sign, the whole
 	   part of the line is inside the sphere.
-	   To check for line<->bbox intersection we cut the line by the six planes
-	   defining the bbox, plane a*x+b*y+c*z+d=0 and line bv + t * dv
-	   then solve t = ((a,b,c)*bv-d) / ((a,b,c)*dv).
-	   If we can't solve it, the line does not intersect the plane.
-	   Depending on wether bv is left or right of the plane, t gives new upper
-	   or lower bound. Keep two values u0,u1 defining total upper and lower bound,
-	   and compute min/max of them and t. If the resulting lower bound is >= upper
-	   bound, the line does not intersect the box.
-	   For finer check (voxel<->line) we can again compute line<->sphere
-	   intersections. With that we can compute shell hits very precisely.
-	   On the other hand we can compute which voxels intersect the line because we
-	   know the position and order of the voxels, without checking every voxel...
-	   We know where the ray enters the object and thus the entry voxel, from that
-	   we can follow by raycasting through the voxels without the need to check
-	   for intersection between every voxel and the ray. This is maybe more code
-	   but it is much more efficient.
+	   For every ship whose sphere is hit, the line is tested against the
+	   ship's bv_tree, giving the first triangle that is hit. Because the whole
+	   line of the step is tested, fast shells can't pass through thin hulls,
+	   and the cost depends on the tree depth, not on the length of the line.
+	   The closest hit of all ships is used.
 	   We need to check for intersection of shell with water surface too.
 	   It is sufficient to compute wether the new position is below water surface.
 	   That is, get the water height at its xy pos and compare to its z pos.
@@ -127,7 +114,11 @@ void gun_shell::check_collision()
 		return;
 	dvl = sqrt(dvl);
 	vector3 dv = dv2 * (1.0/dvl);
-	std::vector<ship*> allships = gm.get_all_ships();
+	// only ships near the segment are candidates, in the same order as get_all_ships()
+	ship_grid::result_list allships;
+	gm.get_unit_grid().query_segment(oldpos.xy(), position.xy(), 0.0, ship_grid::all, allships);
+	ship* hit_ship = 0;
+	float hit_fraction = 1.0f;
 	for (unsigned i = 0; i < allships.size(); ++i) {
 		ship* s = allships[i];
 		vector3 k = s->get_pos() - oldpos;
@@ -140,11 +131,39 @@ void gun_shell::check_collision()
 		double t0 = -kd + tmp, t1 = -kd - tmp;
 		if (t0*t1 < 0.0 || (t0 >= 0.0 && t0 <= dvl) || (t1 >= 0.0 && t1 <= dvl)) {
 			//log_debug("gun_shell "<<this<<" intersects bsphere of "<<s);
-			check_collision_precise(*s, -k, dv2 - k);
-			if (alive_stat == dead) return; // no more checks after hit
+			// segment relative to ship's position, that is the space of its bv_tree params
+			float fraction;
+			bv_tree::leaf_data triangle;
+			if (bv_tree::closest_segment_hit(s->compute_bv_tree_params(), vector3f(-k),
+							 vector3f(dv2 - k), fraction, triangle)
+			    && fraction < hit_fraction) {
+				hit_ship = s;
+				hit_fraction = fraction;
+			}
 		}
 	}
 
+	if (hit_ship) {
+		// move gun shell pos to hit position to let the explosion be at right position
+		vector3 impactpos = oldpos + dv2 * double(hit_fraction);
+		position = impactpos;
+		log_debug("Hit object at real world pos " << impactpos);
+		log_debug("that is relative: " << hit_ship->get_pos()-impactpos);
+		// now damage the ship
+		if (hit_ship->damage(impactpos, int(damage_amount))) { // fixme, crude
+			gm.ship_sunk(hit_ship);
+		} else {
+			hit_ship->ignite();
+		}
+#if 0
+		//spawn some location marker object for testing
+		//at exact impact position
+		gm.spawn_particle(new marker_particle(impactpos));
+#endif
+		gm.add_event(new event_shell_explosion(get_pos()));
+		kill(); // grenade is used and dead
+	}
+
 	// now check for water impact if not dead yet (when impact to object was found)
 	// we check agains maximum water z, or a rather crude, but satisfying replacement (10m)
 	if (alive_stat != dead && position.z < 10.0) {
@@ -162,116 +181,6 @@ void gun_shell::check_collision()
 
 
 
-void gun_shell::check_collision_precise(ship& s, const vector3& oldrelpos,
-					const vector3& newrelpos)
-{
-	// transform positions to s' local bbox space
-	quaternion qco = s.get_orientation().conj();
-	vector3f oldrelbbox = vector3f(qco.rotate(oldrelpos));
-	vector3f newrelbbox = vector3f(qco.rotate(newrelpos));
-	// now the model::get_min/get_max values can be used to compute the axis aligned bbox
-	float tmin = 0.0f, tmax = 1.0f;
-	// clip the line oldrelbbox->newrelbbox with the bbox
-	vector3f d = newrelbbox - oldrelbbox;
-	const vector3f& b = oldrelbbox;
-	vector3f bmin = s.get_model().get_min();
-	vector3f bmax = s.get_model().get_max();
-
-	if (fabs(d.x) > 1e-5) {
-		float t0 = (bmin.x - b.x) / d.x;
-		float t1 = (bmax.x - b.x) / d.x;
-		float ta = std::min(t0, t1);
-		float tb = std::max(t0, t1);
-		tmax = std::min(tmax, tb);
-		tmin = std::max(tmin, ta);
-	}
-	if (fabs(d.y) > 1e-5) {
-		float t0 = (bmin.y - b.y) / d.y;
-		float t1 = (bmax.y - b.y) / d.y;
-		float ta = std::min(t0, t1);
-		float tb = std::max(t0, t1);
-		tmax = std::min(tmax, tb);
-		tmin = std::max(tmin, ta);
-	}
-	if (fabs(d.z) > 1e-5) {
-		float t0 = (bmin.z - b.z) / d.z;
-		float t1 = (bmax.z - b.z) / d.z;
-		float ta = std::min(t0, t1);
-		float tb = std::max(t0, t1);
-		tmax = std::min(tmax, tb);
-		tmin = std::max(tmin, ta);
-	}
-
-	if (tmin <= tmax) {
-		//log_debug("shell hit object?!");
-		vector3f d = newrelbbox - oldrelbbox;
-		check_collision_voxel(s, oldrelbbox + d * tmin, oldrelbbox + d * tmax);
-		if (alive_stat == dead) return; // no more checks after hit
-	}
-}
-
-
-
-void gun_shell::check_collision_voxel(ship& s, const vector3f& oldrelpos, const vector3f& newrelpos)
-{
-	// positions are relative to bbox of s.
-	matrix4f obj2voxel = s.get_model().get_base_mesh_transformation().inverse();
-	vector3f oldvoxpos = obj2voxel * oldrelpos, newvoxpos = obj2voxel * newrelpos;
-	vector3f diffvoxpos = newvoxpos - oldvoxpos;
-	// now iterate in 8 steps between oldvoxpos to newvoxpos,
-	// transform both to voxel coordinates (0...N)
-	// and determine voxel number by pos.
-	// if coordinate is invalid, no hit, otherwise check voxel state (volume > 0.25 or similar)
-	// if the voxel is filled.
-	vector3f voxel_size_rcp = s.get_model().get_voxel_size().rcp();
-	const vector3i& vres = s.get_model().get_voxel_resolution();
-	vector3i vidxmax = vres - vector3i(1, 1, 1);
-	vector3f voxel_pos_trans = vector3f(vres) * 0.5f;
-	int lastvn = -1;
-	log_debug("check collision voxel");
-	for (unsigned k = 0; k <= 10; ++k) {
-		float kf = k/10.0f;
-		vector3f voxpos = oldvoxpos + diffvoxpos * kf;
-		vector3i v = vector3i(voxpos.coeff_mul(voxel_size_rcp) + voxel_pos_trans);
-		v = v.max(vector3i(0,0,0)).min(vidxmax);
-		int vn = (v.z * vres.y + v.y)*vres.x + v.x;
-		if (vn != lastvn) {
-			lastvn = vn;
-			log_debug("voxel hit k="<<k<<" voxpos="<<voxpos<<" v="<<v<<" vn="<<vn);
-			const model::voxel* vox = s.get_model().get_voxel_by_pos(v);
-			if (vox) {
-				// we hit a part of the object!
-				log_debug("..... Object hit! .....");
-				// first compute exact real word position of impact
-				vector3 impactpos = s.get_pos()
-					+ s.get_orientation().rotate(s.get_model().
-						get_base_mesh_transformation() * voxpos);
-				// move gun shell pos to hit position to
-				// let the explosion be at right position
-				position = impactpos;
-				log_debug("Hit object at real world pos " << impactpos);
-				log_debug("that is relative: " << s.get_pos()-impactpos);
-				// now damage the ship
-				if (s.damage(impactpos, int(damage_amount))) { // fixme, crude
-					gm.ship_sunk(&s);
-				} else {
-					s.ignite();
-				}
-#if 0
-				//spawn some location marker object for testing
-				//at exact impact position
-				gm.spawn_particle(new marker_particle(impactpos));
-#endif
-				gm.add_event(new event_shell_explosion(get_pos()));
-				kill(); // grenade is used and dead
-				return; // no more checks
-			}
-		}
-	}
-}
-
-
-
 void gun_shell::simulate(double delta_time)
 {
 	check_collision();
@@ -24,12 +24,13 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #define GUN_SHELL_H
 
 #include "sea_object.h"
+#include "object_pool.h"
 
 #define AIR_RESISTANCE 0.05	// factor of velocity that gets subtracted
 				// from it to slow the shell down
 
 ///\brief Represents a gun shell with simulation of it.
-class gun_shell : public sea_object
+class gun_shell : public sea_object, public pooled<gun_shell>
 {
  private:
 	gun_shell();
@@ -40,8 +41,6 @@ class gun_shell : public sea_object
 	double damage_amount;
 
 	void check_collision();
-	void check_collision_precise(ship& s, const vector3& oldrelpos, const vector3& newrelpos);
-	void check_collision_voxel(ship& s, const vector3f& oldrelpos, const vector3f& newrelpos);
 
  public:
 	gun_shell(game& gm_);	// for loading
@@ -125,8 +125,8 @@ bivector<float> height_generator_map::generate_patch(int detail, const vector2i&
 		vector2i coord2_tr(((coord_tr.x+1) >> 1) + 1, ((coord_tr.y+1) >> 1) + 1);
 		vector2i coord2_sz = coord2_tr - coord2_bl + vector2i(1, 1);
 		vector2i offset(2 + (coord_bl.x & 1), 2 + (coord_bl.y & 1));
-		// giving smooth_upsample the subarea already would be handy...
-		bivector<float> v = generate_patch(detail + 1, coord2_bl, coord2_sz).smooth_upsampled().sub_area(offset, coord_sz);
+		bivector<float> v;
+		generate_patch(detail + 1, coord2_bl, coord2_sz).smooth_upsampled(offset, coord_sz, v);
 		v.add_shifted(noisemaps[detail+3], coord_bl);
 		return v;
 	} else if (detail == int(subdivision_steps)) {
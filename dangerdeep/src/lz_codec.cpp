@@ -0,0 +1,156 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// fast LZ77 compression (LZ4 block format)
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "lz_codec.h"
+#include "error.h"
+#include <string.h>
+
+/* A sequence is a token byte (literal length in high nibble, match length - 4
+   in low nibble, 15 means more length bytes follow), the literals, a 16 bit
+   little endian match offset and the extra length bytes of the match.
+   The last sequence has only literals. As in LZ4, the last match starts at
+   least 12 bytes before the end and the last 5 bytes are always literals.
+*/
+
+namespace {
+
+const unsigned hash_bits = 12;
+const unsigned min_match = 4;
+const unsigned last_literals = 5;
+const unsigned match_limit = 12;
+const unsigned max_offset = 65535;
+
+inline Uint32 read32(const Uint8* p)
+{
+	Uint32 v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+inline unsigned hash(Uint32 v)
+{
+	return (v * 2654435761U) >> (32 - hash_bits);
+}
+
+inline void write_length(std::vector<Uint8>& out, unsigned len)
+{
+	for ( ; len >= 255; len -= 255)
+		out.push_back(255);
+	out.push_back(Uint8(len));
+}
+
+void write_sequence(std::vector<Uint8>& out, const Uint8* literals, unsigned nr_literals,
+		    unsigned offset, unsigned match_length)
+{
+	unsigned ml = (match_length > 0) ? match_length - min_match : 0;
+	out.push_back(Uint8(((nr_literals < 15 ? nr_literals : 15) << 4) | (ml < 15 ? ml : 15)));
+	if (nr_literals >= 15)
+		write_length(out, nr_literals - 15);
+	out.insert(out.end(), literals, literals + nr_literals);
+	if (match_length > 0) {
+		out.push_back(Uint8(offset & 0xff));
+		out.push_back(Uint8(offset >> 8));
+		if (ml >= 15)
+			write_length(out, ml - 15);
+	}
+}
+
+unsigned read_length(const Uint8*& src, const Uint8* src_end)
+{
+	unsigned len = 0;
+	Uint8 b;
+	do {
+		if (src == src_end)
+			throw error("lz_codec: truncated length");
+		b = *src++;
+		len += b;
+	} while (b == 255);
+	return len;
+}
+
+}
+
+
+
+void lz_codec::compress(const Uint8* src, unsigned n, std::vector<Uint8>& out)
+{
+	std::vector<int> table(1 << hash_bits, -1);
+	unsigned anchor = 0, ip = 0;
+	while (ip + match_limit <= n) {
+		Uint32 seq = read32(src + ip);
+		unsigned h = hash(seq);
+		int ref = table[h];
+		table[h] = int(ip);
+		if (ref >= 0 && ip - unsigned(ref) <= max_offset && read32(src + ref) == seq) {
+			unsigned len = min_match;
+			while (ip + len < n - last_literals && src[ref + len] == src[ip + len])
+				++len;
+			write_sequence(out, src + anchor, ip - anchor, ip - unsigned(ref), len);
+			ip += len;
+			anchor = ip;
+		} else {
+			++ip;
+		}
+	}
+	write_sequence(out, src + anchor, n - anchor, 0, 0);
+}
+
+
+
+void lz_codec::decompress(const Uint8* src, unsigned n, Uint8* dest, unsigned dest_size)
+{
+	const Uint8* src_end = src + n;
+	Uint8* dp = dest;
+	Uint8* dest_end = dest + dest_size;
+	while (true) {
+		if (src == src_end)
+			throw error("lz_codec: truncated data");
+		Uint8 token = *src++;
+		unsigned nr_literals = token >> 4;
+		if (nr_literals == 15)
+			nr_literals += read_length(src, src_end);
+		if (unsigned(src_end - src) < nr_literals || unsigned(dest_end - dp) < nr_literals)
+			throw error("lz_codec: literals exceed buffer");
+		memcpy(dp, src, nr_literals);
+		src += nr_literals;
+		dp += nr_literals;
+		if (src == src_end)
+			break;	// last sequence has no match
+		if (src_end - src < 2)
+			throw error("lz_codec: truncated offset");
+		unsigned offset = src[0] | (unsigned(src[1]) << 8);
+		src += 2;
+		unsigned len = token & 15;
+		if (len == 15)
+			len += read_length(src, src_end);
+		len += min_match;
+		if (offset == 0 || offset > unsigned(dp - dest) || unsigned(dest_end - dp) < len)
+			throw error("lz_codec: invalid match");
+		// copy bytewise, source and destination may overlap
+		const Uint8* mp = dp - offset;
+		for (unsigned i = 0; i < len; ++i)
+			dp[i] = mp[i];
+		dp += len;
+	}
+	if (dp != dest_end)
+		throw error("lz_codec: size mismatch");
+}
@@ -0,0 +1,45 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// fast LZ77 compression (LZ4 block format)
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#ifndef LZ_CODEC_H
+#define LZ_CODEC_H
+
+#include <SDL_types.h>
+#include <vector>
+
+///\brief Fast LZ77 byte compression, compatible to the LZ4 block format.
+/** Compresses much worse than bzip2, but decompression is an order of magnitude
+    faster, so it is suited for data that is loaded while the game runs.
+    The compressed data does not store the uncompressed size, the caller must know it.
+*/
+class lz_codec
+{
+ public:
+	/// compress n bytes of src, appending the compressed data to out
+	static void compress(const Uint8* src, unsigned n, std::vector<Uint8>& out);
+
+	/// decompress n bytes of src to dest, which must have exactly dest_size bytes.
+	///@note throws error if the data is corrupt or doesn't have the given size
+	static void decompress(const Uint8* src, unsigned n, Uint8* dest, unsigned dest_size);
+};
+
+#endif
@@ -96,7 +96,7 @@ void map_display::draw_trail(sea_object* so, const vector2& offset) const
 	// we draw trails in both functions.
 	ship* shp = dynamic_cast<ship*>(so);
 	if (shp) {
-		const list<ship::prev_pos>& l = shp->get_previous_positions();
+		const trail_buffer& l = shp->get_previous_positions();
 		if (l.empty()) return;
 		vector2 p = (shp->get_pos().xy() + offset)*mapzoom;
 		primitives tr(GL_LINE_STRIP, l.size() + 1);
@@ -105,13 +105,16 @@ void map_display::draw_trail(sea_object* so, const vector2& offset) const
 		tr.colors[0] = colorf(1,1,1,1);
 		float la = 1.0/float(l.size()), lc = 0;
 		unsigned trc = 1;
-		for (list<ship::prev_pos>::const_iterator it = l.begin(); it != l.end(); ++it) {
-			tr.colors[trc] = colorf(1,1,1,1-lc);
-			vector2 p = (it->pos + offset)*mapzoom;
-			tr.vertices[trc].x = 512+p.x;
-			tr.vertices[trc].y = 384-p.y;
-			lc += la;
-			++trc;
+		for (unsigned s = 0; s < l.get_nr_of_spans(); ++s) {
+			trail_buffer::span sp = l.get_span(s);
+			for (unsigned i = 0; i < sp.size; ++i) {
+				tr.colors[trc] = colorf(1,1,1,1-lc);
+				vector2 p = (sp.pos[i] + offset)*mapzoom;
+				tr.vertices[trc].x = 512+p.x;
+				tr.vertices[trc].y = 384-p.y;
+				lc += la;
+				++trc;
+			}
 		}
 		tr.render();
 	}
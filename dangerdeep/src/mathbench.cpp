@@ -0,0 +1,150 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+// micro benchmark and test of matrix/quaternion fast paths against generic code
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "quaternion.h"
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+using namespace std;
+
+// the generic code of the templates, for comparison
+template<class D>
+matrix4t<D> multiply_generic(const matrix4t<D>& a, const matrix4t<D>& b)
+{
+	matrix4t<D> r;
+	for (unsigned i = 0; i < 4; ++i)
+		for (unsigned j = 0; j < 4; ++j)
+			r.elem(j, i) = a.elem(0, i) * b.elem(j, 0) + a.elem(1, i) * b.elem(j, 1)
+				+ a.elem(2, i) * b.elem(j, 2) + a.elem(3, i) * b.elem(j, 3);
+	return r;
+}
+
+template<class D>
+vector3t<D> rotate_generic(const quaterniont<D>& q, const vector3t<D>& p)
+{
+	return (q * quaterniont<D>::vec(p) * q.conj()).v;
+}
+
+template<class D>
+matrix4t<D> random_matrix()
+{
+	matrix4t<D> m;
+	for (unsigned i = 0; i < 16; ++i)
+		m.elemarray()[i] = D(rand() % 2000 - 1000) / D(100);
+	return m;
+}
+
+template<class D>
+bool test_matrix_product(const char* name, unsigned nr)
+{
+	vector<matrix4t<D> > m(64);
+	for (unsigned i = 0; i < m.size(); ++i)
+		m[i] = random_matrix<D>();
+	bool ok = true;
+	for (unsigned i = 0; i + 1 < m.size(); ++i) {
+		matrix4t<D> a = m[i] * m[i+1], b = multiply_generic(m[i], m[i+1]);
+		for (unsigned j = 0; j < 16; ++j)
+			if (a.elemarray()[j] != b.elemarray()[j])
+				ok = false;
+	}
+	vector<matrix4t<D> > r(m.size());
+	clock_t c0 = clock();
+	for (unsigned k = 0; k < nr; ++k)
+		r[k & 63] = m[k & 63] * m[(k >> 6) & 63];
+	clock_t c1 = clock();
+	for (unsigned k = 0; k < nr; ++k)
+		r[k & 63] = multiply_generic(m[k & 63], m[(k >> 6) & 63]);
+	clock_t c2 = clock();
+	cout << name << " product: " << double(c1 - c0) * 1e9 / CLOCKS_PER_SEC / nr << "ns, generic "
+	     << double(c2 - c1) * 1e9 / CLOCKS_PER_SEC / nr << "ns (" << r[0].elem(0,0) << ")\n";
+	return ok;
+}
+
+template<class D>
+bool test_transform(const char* name, unsigned nr)
+{
+	matrix4t<D> m = random_matrix<D>();
+	vector<vector3t<D> > src(1023), dst(src.size()), ref(src.size());
+	for (unsigned i = 0; i < src.size(); ++i)
+		src[i] = vector3t<D>(D(rand() % 1000), D(rand() % 1000), D(rand() % 1000)) * D(0.1);
+	clock_t c0 = clock();
+	for (unsigned k = 0; k < nr; ++k)
+		m.transform_points(&src[0], &dst[0], src.size());
+	clock_t c1 = clock();
+	for (unsigned k = 0; k < nr; ++k)
+		for (unsigned i = 0; i < src.size(); ++i)
+			ref[i] = m.mul4vec3xlat(src[i]);
+	clock_t c2 = clock();
+	bool ok = true;
+	for (unsigned i = 0; i < src.size(); ++i)
+		if (!(dst[i] == ref[i]))
+			ok = false;
+	// in place
+	m.transform_points(&src[0], &src[0], src.size());
+	for (unsigned i = 0; i < src.size(); ++i)
+		if (!(src[i] == ref[i]))
+			ok = false;
+	double n = double(nr) * src.size();
+	cout << name << " transform_points: " << double(c1 - c0) * 1e9 / CLOCKS_PER_SEC / n << "ns per point, single "
+	     << double(c2 - c1) * 1e9 / CLOCKS_PER_SEC / n << "ns\n";
+	return ok;
+}
+
+template<class D>
+bool test_rotate(const char* name, unsigned nr)
+{
+	quaterniont<D> q = quaterniont<D>::rot(D(37), vector3t<D>(1, 2, 3).normal());
+	vector<vector3t<D> > p(1024);
+	for (unsigned i = 0; i < p.size(); ++i)
+		p[i] = vector3t<D>(D(rand() % 1000), D(rand() % 1000), D(rand() % 1000)) * D(0.1);
+	bool ok = true;
+	for (unsigned i = 0; i < p.size(); ++i)
+		if (q.rotate(p[i]).distance(rotate_generic(q, p[i])) > D(1e-3))
+			ok = false;
+	vector3t<D> sum, sum2;
+	clock_t c0 = clock();
+	for (unsigned k = 0; k < nr; ++k)
+		sum += q.rotate(p[k & 1023]);
+	clock_t c1 = clock();
+	for (unsigned k = 0; k < nr; ++k)
+		sum2 += rotate_generic(q, p[k & 1023]);
+	clock_t c2 = clock();
+	cout << name << " rotate: " << double(c1 - c0) * 1e9 / CLOCKS_PER_SEC / nr << "ns, generic "
+	     << double(c2 - c1) * 1e9 / CLOCKS_PER_SEC / nr << "ns (" << (sum - sum2).length() << ")\n";
+	return ok;
+}
+
+int main(int, char**)
+{
+	bool ok = true;
+	ok = test_matrix_product<float>("float", 4000000) && ok;
+	ok = test_matrix_product<double>("double", 4000000) && ok;
+	ok = test_transform<float>("float", 4000) && ok;
+	ok = test_transform<double>("double", 4000) && ok;
+	ok = test_rotate<float>("float", 4000000) && ok;
+	ok = test_rotate<double>("double", 4000000) && ok;
+	cout << (ok ? "OK" : "FAILED") << "\n";
+	return ok ? 0 : 1;
+}
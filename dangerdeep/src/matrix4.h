@@ -27,6 +27,12 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "matrix3.h"
 #include "oglext/OglExt.h"
 #include <string.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /// a 4x4 matrix, reimplemented for 4x4 case for speed issues
 template<class D>
@@ -301,10 +307,92 @@ class matrix4t
 	/// multiply matrix with vector3
 	vector3t<D> operator* (const vector3t<D>& v) const { return mul4vec3xlat(v); }
 
+	/// transform n points like mul4vec3xlat, src and dst may be the same
+	void transform_points(const vector3t<D>* src, vector3t<D>* dst, unsigned n) const {
+		for (unsigned i = 0; i < n; ++i)
+			dst[i] = mul4vec3xlat(src[i]);
+	}
+
 	D& elem(unsigned col, unsigned row) { return values[col + row * 4]; }
 	const D& elem(unsigned col, unsigned row) const { return values[col + row * 4]; }
 };
 
+/* Specializations with SSE. The sums are computed in the same order as in the
+   generic code, so results are the same. They depend on what the compiler
+   targets (always SSE2 on x86-64), not on USE_SSE.
+*/
+#ifdef __SSE__
+template<> inline matrix4t<float> matrix4t<float>::operator* (const matrix4t<float>& other) const {
+	matrix4t<float> r(int(0));
+	__m128 b0 = _mm_loadu_ps(other.values), b1 = _mm_loadu_ps(other.values + 4);
+	__m128 b2 = _mm_loadu_ps(other.values + 8), b3 = _mm_loadu_ps(other.values + 12);
+	for (unsigned i = 0; i < 16; i += 4) {
+		__m128 t = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(values[i]), b0),
+				      _mm_mul_ps(_mm_set1_ps(values[i+1]), b1));
+		t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(values[i+2]), b2));
+		t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(values[i+3]), b3));
+		_mm_storeu_ps(r.values + i, t);
+	}
+	return r;
+}
+
+/// transforms four points at once, after converting them to x,y,z registers
+template<> inline void matrix4t<float>::transform_points(const vector3t<float>* src, vector3t<float>* dst, unsigned n) const {
+	__m128 m[12];
+	for (unsigned i = 0; i < 12; ++i)
+		m[i] = _mm_set1_ps(values[i]);
+	unsigned i = 0;
+	for ( ; i + 4 <= n; i += 4) {
+		// a,b,c = x0 y0 z0 x1, y1 z1 x2 y2, z2 x3 y3 z3
+		const float* s = &src[i].x;
+		__m128 a = _mm_loadu_ps(s), b = _mm_loadu_ps(s + 4), c = _mm_loadu_ps(s + 8);
+		__m128 x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0));
+		__m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1)),
+					  _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+		__m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)),
+					  _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0));
+		__m128 r[3];
+		for (unsigned j = 0; j < 3; ++j) {
+			__m128 t = _mm_add_ps(_mm_mul_ps(m[4*j], x), _mm_mul_ps(m[4*j+1], y));
+			t = _mm_add_ps(t, _mm_mul_ps(m[4*j+2], z));
+			r[j] = _mm_add_ps(t, m[4*j+3]);
+		}
+		// and back
+		a = _mm_shuffle_ps(_mm_shuffle_ps(r[0], r[1], _MM_SHUFFLE(0,0,0,0)),
+				   _mm_shuffle_ps(r[2], r[0], _MM_SHUFFLE(1,1,0,0)), _MM_SHUFFLE(2,0,2,0));
+		b = _mm_shuffle_ps(_mm_shuffle_ps(r[1], r[2], _MM_SHUFFLE(1,1,1,1)),
+				   _mm_shuffle_ps(r[0], r[1], _MM_SHUFFLE(2,2,2,2)), _MM_SHUFFLE(2,0,2,0));
+		c = _mm_shuffle_ps(_mm_shuffle_ps(r[2], r[0], _MM_SHUFFLE(3,3,2,2)),
+				   _mm_shuffle_ps(r[1], r[2], _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0));
+		float* d = &dst[i].x;
+		_mm_storeu_ps(d, a);
+		_mm_storeu_ps(d + 4, b);
+		_mm_storeu_ps(d + 8, c);
+	}
+	for ( ; i < n; ++i)
+		dst[i] = mul4vec3xlat(src[i]);
+}
+#endif
+
+#ifdef __SSE2__
+template<> inline matrix4t<double> matrix4t<double>::operator* (const matrix4t<double>& other) const {
+	matrix4t<double> r(int(0));
+	for (unsigned h = 0; h < 4; h += 2) {
+		// two columns at once
+		__m128d b0 = _mm_loadu_pd(other.values + h), b1 = _mm_loadu_pd(other.values + 4 + h);
+		__m128d b2 = _mm_loadu_pd(other.values + 8 + h), b3 = _mm_loadu_pd(other.values + 12 + h);
+		for (unsigned i = 0; i < 16; i += 4) {
+			__m128d t = _mm_add_pd(_mm_mul_pd(_mm_set1_pd(values[i]), b0),
+					       _mm_mul_pd(_mm_set1_pd(values[i+1]), b1));
+			t = _mm_add_pd(t, _mm_mul_pd(_mm_set1_pd(values[i+2]), b2));
+			t = _mm_add_pd(t, _mm_mul_pd(_mm_set1_pd(values[i+3]), b3));
+			_mm_storeu_pd(r.values + i + h, t);
+		}
+	}
+	return r;
+}
+#endif
+
 template<class D> void matrix4t<D>::set_gl(GLenum pname) {
 	GLdouble m[16];
 	for (unsigned i = 0; i < 4; ++i)
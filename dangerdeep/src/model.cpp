@@ -41,6 +41,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "triangle_intersection.h"
 #include <sstream>
 #include <map>
+#include <algorithm>
 
 using namespace std;
 
@@ -50,6 +51,10 @@ texture::mapping_mode model::mapping = texture::LINEAR_MIPMAP_LINEAR;//texture::
 
 unsigned model::init_count = 0;
 
+unsigned long model::rendered_triangles = 0;
+unsigned long model::draw_calls = 0;
+unsigned long model::state_setups = 0;
+
 /*
 fixme: possible cleanup/simplification of rendering EVERYWHERE:
 0) maybe introduce a camera class that generates projection and camera modelview matrices.
@@ -172,30 +177,30 @@ const model::object* model::object::find(const std::string& name_) const
 
 
 
-void model::object::display(const texture *caustic_map) const
+void model::object::display(const texture *caustic_map, unsigned lod) const
 {
 	glPushMatrix();
 	glTranslated(translation.x, translation.y, translation.z);
 	glRotated(rotat_angle, rotat_axis.x, rotat_axis.y, rotat_axis.z);
-	if (mymesh) mymesh->display(caustic_map);
+	if (mymesh) mymesh->display(caustic_map, lod);
 	for (vector<object>::const_iterator it = children.begin(); it != children.end(); ++it) {
-		it->display(caustic_map);
+		it->display(caustic_map, lod);
 	}
 	glPopMatrix();
 }
 
 
 
-void model::object::display_mirror_clip() const
+void model::object::display_mirror_clip(unsigned lod) const
 {
 	// matrix mode is GL_MODELVIEW and active texture is GL_TEXTURE1 here
 	glPushMatrix();
 	glTranslated(translation.x, translation.y, translation.z);
 	glRotated(rotat_angle, rotat_axis.x, rotat_axis.y, rotat_axis.z);
 
-	if (mymesh) mymesh->display_mirror_clip();
+	if (mymesh) mymesh->display_mirror_clip(lod);
 	for (vector<object>::const_iterator it = children.begin(); it != children.end(); ++it) {
-		it->display_mirror_clip();
+		it->display_mirror_clip(lod);
 	}
 
 	glPopMatrix();
@@ -225,6 +230,19 @@ matrix4f model::object::get_transformation() const
 
 
 
+void model::object::collect_meshes(const matrix4f& parenttrans,
+				   std::vector<std::pair<const mesh*, matrix4f> >& parts) const
+{
+	// same transformations as in display()
+	matrix4f m = parenttrans * get_transformation();
+	if (mymesh)
+		parts.push_back(std::make_pair(static_cast<const mesh*>(mymesh), m));
+	for (vector<object>::const_iterator it = children.begin(); it != children.end(); ++it)
+		it->collect_meshes(m, parts);
+}
+
+
+
 void model::render_init()
 {
 	// initialize shaders
@@ -344,6 +362,7 @@ model::model(const string& filename_, bool use_material)
 
 	compute_bounds();
 	compute_normals();
+	compute_lod_levels();
 	compile();
 
 	// try to read physical data file, needs min/max data etc., so call it after
@@ -750,6 +769,15 @@ model::mesh::mesh(unsigned w, unsigned h, const std::vector<float>& heights, con
 
 
 
+unsigned model::mesh::get_nr_of_triangles(unsigned lod) const
+{
+	if (lod == 0 || lod > lod_indices.size())
+		return get_nr_of_triangles();
+	return lod_indices[lod-1].size() / 3;
+}
+
+
+
 unsigned model::mesh::get_nr_of_triangles() const
 {
 	switch (indices_type) {
@@ -905,19 +933,84 @@ void model::mesh::compile()
 	// performance. OpenGL can do it for use, when we use glDrawRangeElements()
 	// later.
 	index_data.init_data(indices.size() * 4 /* index type is Uint32! */, &indices[0], GL_STATIC_DRAW);
+	lod_index_data.clear();
+	for (unsigned i = 0; i < lod_indices.size(); ++i) {
+		lod_index_data.push_back(new vertexbufferobject(true));
+		if (!lod_indices[i].empty())
+			lod_index_data[i]->init_data(lod_indices[i].size() * 4, &lod_indices[i][0], GL_STATIC_DRAW);
+	}
+}
+
+
+
+void model::mesh::compute_lod_levels(const std::vector<float>& cellsizes)
+{
+	lod_indices.clear();
+	// triangle strips are used for height fields only, they are not simplified
+	if (indices_type != pt_triangles || vertices.empty())
+		return;
+	lod_indices.resize(cellsizes.size());
+	std::vector<std::pair<Uint64, Uint32> > cells(vertices.size());
+	std::vector<Uint32> representative(vertices.size());
+	for (unsigned l = 0; l < cellsizes.size(); ++l) {
+		// sort vertices by grid cell
+		float rcs = 1.0f / cellsizes[l];
+		for (unsigned i = 0; i < vertices.size(); ++i) {
+			vector3f c = (vertices[i] - min) * rcs;
+			Uint64 key = (Uint64(c.x) << 42) | (Uint64(c.y) << 21) | Uint64(c.z);
+			cells[i] = std::make_pair(key, Uint32(i));
+		}
+		std::sort(cells.begin(), cells.end());
+		// all vertices of a cell are replaced by the one closest to their mean,
+		// so normals, texture coordinates etc. of that vertex are used.
+		for (unsigned b = 0; b < cells.size(); ) {
+			unsigned e = b + 1;
+			while (e < cells.size() && cells[e].first == cells[b].first)
+				++e;
+			vector3f mean;
+			for (unsigned j = b; j < e; ++j)
+				mean += vertices[cells[j].second];
+			mean = mean * (1.0f / (e - b));
+			Uint32 best = cells[b].second;
+			float bestdist = vertices[best].square_distance(mean);
+			for (unsigned j = b + 1; j < e; ++j) {
+				float d = vertices[cells[j].second].square_distance(mean);
+				if (d < bestdist) {
+					best = cells[j].second;
+					bestdist = d;
+				}
+			}
+			for (unsigned j = b; j < e; ++j)
+				representative[cells[j].second] = best;
+			b = e;
+		}
+		// triangles that collapsed to lines or points are dropped
+		std::vector<Uint32>& idx = lod_indices[l];
+		idx.reserve(indices.size());
+		for (unsigned t = 0; t + 2 < indices.size(); t += 3) {
+			Uint32 i0 = representative[indices[t]];
+			Uint32 i1 = representative[indices[t+1]];
+			Uint32 i2 = representative[indices[t+2]];
+			if (i0 != i1 && i1 != i2 && i0 != i2) {
+				idx.push_back(i0);
+				idx.push_back(i1);
+				idx.push_back(i2);
+			}
+		}
+	}
 }
 
 
 
 void model::mesh::transform(const matrix4f& m)
 {
-	for (unsigned i = 0; i < vertices.size(); ++i)
-		vertices[i] = m * vertices[i];
+	if (!vertices.empty())
+		m.transform_points(&vertices[0], &vertices[0], vertices.size());
 	// transform normals: only apply rotation
 	matrix4f m2 = m;
 	m2.elem(3,0) = m2.elem(3,1) = m2.elem(3,2) = 0;
-	for (unsigned j = 0; j < normals.size(); ++j)
-		normals[j] = m2 * normals[j];
+	if (!normals.empty())
+		m2.transform_points(&normals[0], &normals[0], normals.size());
 }
 
 
@@ -1714,8 +1807,32 @@ void model::material_glsl::get_all_layout_names(std::set<std::string>& result) c
 
 
 
-void model::mesh::display(const texture *caustic_map) const
+void model::mesh::draw_elements(unsigned lod) const
+{
+	// levels that are not available are drawn with full detail
+	const vertexbufferobject* idx = &index_data;
+	unsigned nr_indices = indices.size();
+	if (lod > 0 && lod <= lod_indices.size()) {
+		idx = lod_index_data[lod-1];
+		nr_indices = lod_indices[lod-1].size();
+		if (nr_indices == 0)
+			return;
+	}
+	rendered_triangles += get_nr_of_triangles(lod);
+	++draw_calls;
+
+	// render geometry, glDrawRangeElements is faster than glDrawElements.
+	idx->bind();
+	glDrawRangeElements(gl_primitive_type(), 0, vertices.size()-1, nr_indices, GL_UNSIGNED_INT, 0);
+	idx->unbind();
+}
+
+
+
+void model::mesh::begin_display(const texture *caustic_map) const
 {
+	++state_setups;
+
 	// set up material
 	if (mymaterial != 0) {
 		mymaterial->set_gl_values(caustic_map);
@@ -1769,14 +1886,12 @@ void model::mesh::display(const texture *caustic_map) const
 
 	// unbind VBOs (can't be static or we would need to define type of VBO vert/index)
 	vbo_positions.unbind();
+}
 
-	// render geometry, glDrawRangeElements is faster than glDrawElements.
-	index_data.bind();
-	glDrawRangeElements(gl_primitive_type(), 0, vertices.size()-1, indices.size(), GL_UNSIGNED_INT, 0);
-	index_data.unbind();
 
-	// maybe: add code to show normals as Lines
 
+void model::mesh::end_display() const
+{
 	// cleanup
 	glDisableVertexAttribArray(vertex_attrib_index);
 	glDisableClientState(GL_NORMAL_ARRAY);
@@ -1792,8 +1907,36 @@ void model::mesh::display(const texture *caustic_map) const
 
 
 
-void model::mesh::display_mirror_clip() const
+void model::mesh::display(const texture *caustic_map, unsigned lod) const
 {
+	begin_display(caustic_map);
+	draw_elements(lod);
+	// maybe: add code to show normals as Lines
+	end_display();
+}
+
+
+
+void model::mesh::display_instances(const std::vector<matrix4>& transforms, const matrix4f& meshtrans,
+				    const texture *caustic_map, unsigned lod) const
+{
+	// render state does not depend on the modelview matrix, so it is set once.
+	begin_display(caustic_map);
+	for (std::vector<matrix4>::const_iterator it = transforms.begin(); it != transforms.end(); ++it) {
+		glPushMatrix();
+		it->multiply_gl();
+		meshtrans.multiply_glf();
+		draw_elements(lod);
+		glPopMatrix();
+	}
+	end_display();
+}
+
+
+
+void model::mesh::display_mirror_clip(unsigned lod) const
+{
+	++state_setups;
 	// matrix mode is GL_MODELVIEW and active texture is GL_TEXTURE1 here
 	bool has_texture_u0 = false;
 	if (mymaterial != 0) {
@@ -1822,9 +1965,7 @@ void model::mesh::display_mirror_clip() const
 	vbo_positions.unbind();
 
 	// render geometry
-	index_data.bind();
-	glDrawRangeElements(gl_primitive_type(), 0, vertices.size()-1, indices.size(), GL_UNSIGNED_INT, 0);
-	index_data.unbind();
+	draw_elements(lod);
 
 	glDisableClientState(GL_NORMAL_ARRAY);
 	glDisableClientState(GL_COLOR_ARRAY);
@@ -1846,7 +1987,17 @@ void model::set_layout(const std::string& layout)
 
 
 
-void model::display(const texture *caustic_map) const
+unsigned model::get_lod_for_screen_size(double radius_pixels)
+{
+	if (radius_pixels >= 200.0) return 0;
+	if (radius_pixels >= 80.0) return 1;
+	if (radius_pixels >= 30.0) return 2;
+	return 3;
+}
+
+
+
+void model::display(const texture *caustic_map, unsigned lod) const
 {
 	if (current_layout.length() == 0) {
 		throw error(filename + ": trying to render model, but no layout was set yet");
@@ -1855,25 +2006,47 @@ void model::display(const texture *caustic_map) const
 	// default scene: no objects, just draw all meshes.
 	if (scene.children.size() == 0) {
 		for (vector<model::mesh*>::const_iterator it = meshes.begin(); it != meshes.end(); ++it) {
-			(*it)->display(caustic_map);
+			(*it)->display(caustic_map, lod);
+		}
+	} else {
+		scene.display(caustic_map, lod);
+	}
+}
+
+
+
+void model::display_instances(const std::vector<matrix4>& transforms, const texture *caustic_map,
+			      unsigned lod) const
+{
+	if (current_layout.length() == 0) {
+		throw error(filename + ": trying to render model, but no layout was set yet");
+	}
+
+	if (scene.children.size() == 0) {
+		for (vector<model::mesh*>::const_iterator it = meshes.begin(); it != meshes.end(); ++it) {
+			(*it)->display_instances(transforms, matrix4f::one(), caustic_map, lod);
 		}
 	} else {
-		scene.display(caustic_map);
+		std::vector<std::pair<const mesh*, matrix4f> > parts;
+		scene.collect_meshes(matrix4f::one(), parts);
+		for (unsigned i = 0; i < parts.size(); ++i) {
+			parts[i].first->display_instances(transforms, parts[i].second, caustic_map, lod);
+		}
 	}
 }
 
 
 
-void model::display_mirror_clip() const
+void model::display_mirror_clip(unsigned lod) const
 {
 	// set up a object->worldspace transformation matrix in tex unit#1 matrix.
 	if (scene.children.size() == 0) {
 		// default scene: no objects, just draw all meshes.
 		for (vector<model::mesh*>::const_iterator it = meshes.begin(); it != meshes.end(); ++it) {
-			(*it)->display_mirror_clip();
+			(*it)->display_mirror_clip(lod);
 		}
 	} else {
-		scene.display_mirror_clip();
+		scene.display_mirror_clip(lod);
 	}
 }
 
@@ -2027,6 +2200,31 @@ void model::read_phys_file(const string& filename)
 		for (unsigned i = 0; i < voxel_data.size(); ++i)
 			voxel_data[i].relative_mass /= mass_part_sum;
 	}
+	// copy data to struct of arrays, positions as grid coordinates
+	voxel_soa = voxel_arrays();
+	voxel_soa.grid_offset = vector3f(0.5 + bmin.x/voxel_size.x,
+					 0.5 + bmin.y/voxel_size.y,
+					 0.5 + bmin.z/voxel_size.z);
+	voxel_soa.grid_x.reserve(voxel_data.size());
+	voxel_soa.grid_y.reserve(voxel_data.size());
+	voxel_soa.grid_z.reserve(voxel_data.size());
+	voxel_soa.part_of_volume.reserve(voxel_data.size());
+	voxel_soa.relative_mass.reserve(voxel_data.size());
+	ptr = 0;
+	for (int izz = 0; izz < voxel_resolution.z; ++izz) {
+		for (int iyy = 0; iyy < voxel_resolution.y; ++iyy) {
+			for (int ixx = 0; ixx < voxel_resolution.x; ++ixx) {
+				int vi = voxel_index_by_pos[ptr++];
+				if (vi >= 0) {
+					voxel_soa.grid_x.push_back(short(ixx));
+					voxel_soa.grid_y.push_back(short(iyy));
+					voxel_soa.grid_z.push_back(short(izz));
+					voxel_soa.part_of_volume.push_back(voxel_data[vi].part_of_volume);
+					voxel_soa.relative_mass.push_back(voxel_data[vi].relative_mass);
+				}
+			}
+		}
+	}
 	// compute neighbouring information
 	ptr = 0;
 	int dx[6] = {  0, -1,  0,  1,  0,  0 };
@@ -2092,6 +2290,23 @@ void model::transform(const matrix4f& m)
 
 
 
+void model::compute_lod_levels()
+{
+	// each level has half the grid resolution of the level before,
+	// the finest grid has 96 cells along the longest side of the model.
+	vector3f sz = max - min;
+	float longest = std::max(sz.x, std::max(sz.y, sz.z));
+	if (longest <= 0.0f)
+		return;
+	std::vector<float> cellsizes;
+	for (unsigned l = 1; l < nr_of_lod_levels; ++l)
+		cellsizes.push_back(longest / float(96 >> (l - 1)));
+	for (vector<model::mesh*>::iterator it = meshes.begin(); it != meshes.end(); ++it)
+		(*it)->compute_lod_levels(cellsizes);
+}
+
+
+
 void model::compile()
 {
 	for (vector<model::mesh*>::iterator it = meshes.begin(); it != meshes.end(); ++it) {
@@ -31,6 +31,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "shader.h"
 #include "vertexbufferobject.h"
 #include "bv_tree.h"
+#include "ptrvector.h"
 #include <vector>
 #include <fstream>
 #include <memory>
@@ -206,15 +207,25 @@ public:
 		vertexbufferobject vbo_tangents_righthanded;
 		mutable vertexbufferobject vbo_colors;	// mutable because non-shader pipeline writes to it
 		vertexbufferobject index_data;
+		// simplified versions of the mesh for distant views (level 1...).
+		// only the indices differ, the vertex data is shared.
+		std::vector<std::vector<Uint32> > lod_indices;
+		ptrvector<vertexbufferobject> lod_index_data;
 		unsigned vertex_attrib_index;
 		matrix3 inertia_tensor;
 		double volume;
 
 		unsigned get_nr_of_triangles() const;
+		/// get number of triangles rendered at a level of detail
+		unsigned get_nr_of_triangles(unsigned lod) const;
 		void get_triangle(unsigned triangle, Uint32 indices[3]) const { ((*this).*(get_triangle_ptr))(triangle, indices); }
 
-		void display(const texture *caustic_map = 0) const;
-		void display_mirror_clip() const;
+		void display(const texture *caustic_map = 0, unsigned lod = 0) const;
+		void display_mirror_clip(unsigned lod = 0) const;
+		/// display mesh several times with one render state setup, each instance
+		/// is transformed by meshtrans and then by its transformation.
+		void display_instances(const std::vector<matrix4>& transforms, const matrix4f& meshtrans,
+				       const texture *caustic_map = 0, unsigned lod = 0) const;
 		void compute_vertex_bounds();
 		void compute_bounds(vector3f& totmin, vector3f& totmax, const matrix4f& transmat);
 		void compute_normals();
@@ -236,6 +247,10 @@ public:
 		// make display list if possible
 		void compile();
 
+		/// generate simplified index data for levels of detail by vertex
+		/// clustering, one level per given cell size (in vertex space).
+		void compute_lod_levels(const std::vector<float>& cellsizes);
+
 		// transform vertices by matrix
 		void transform(const matrix4f& m);
 		void write_off_file(const std::string& fn) const;
@@ -282,6 +297,9 @@ public:
 		primitive_type indices_type;
 		std::auto_ptr<bv_tree> bounding_volume_tree;
 		void (model::mesh::*get_triangle_ptr) (unsigned triangle, Uint32 indices[3]) const;
+		void draw_elements(unsigned lod) const;
+		void begin_display(const texture *caustic_map) const;
+		void end_display() const;
 
 	private:
 		mesh();
@@ -316,6 +334,18 @@ public:
 		}
 	};
 
+	/// voxel data as struct of arrays for the physics computations.
+	/// Voxel i has the relative position (grid_x[i], grid_y[i], grid_z[i]) + grid_offset,
+	/// so its transformed position is a linear combination of three delta vectors.
+	struct voxel_arrays
+	{
+		std::vector<short> grid_x, grid_y, grid_z;
+		std::vector<float> part_of_volume;
+		std::vector<float> relative_mass;
+		vector3f grid_offset;
+		unsigned size() const { return part_of_volume.size(); }
+	};
+
 protected:	
 	// a 3d object, references meshes
 	struct object
@@ -341,10 +371,13 @@ protected:
 		object* find(const std::string& name);
 		const object* find(unsigned id) const;
 		const object* find(const std::string& name) const;
-		void display(const texture *caustic_map = 0) const;
-		void display_mirror_clip() const;
+		void display(const texture *caustic_map = 0, unsigned lod = 0) const;
+		void display_mirror_clip(unsigned lod = 0) const;
 		void compute_bounds(vector3f& min, vector3f& max, const matrix4f& transmat) const;
 		matrix4f get_transformation() const;
+		/// collect meshes of object tree with their transformation to model space
+		void collect_meshes(const matrix4f& parenttrans,
+				    std::vector<std::pair<const mesh*, matrix4f> >& parts) const;
 	};
 
 	// store that for debugging purposes.
@@ -410,6 +443,8 @@ protected:
 	std::vector<voxel> voxel_data;
 	/// voxel for 3-space coordinate of it, -1 if not existing
 	std::vector<int> voxel_index_by_pos;
+	/// same data as voxel_data, as struct of arrays
+	voxel_arrays voxel_soa;
 	
 	void read_phys_file(const std::string& filename);
 	
@@ -429,6 +464,13 @@ protected:
 
 	void read_objects(const xml_elem& parent, object& parentobj);
 
+	// triangles, draw calls and render state setups of meshes, for profiling
+	static unsigned long rendered_triangles;
+	static unsigned long draw_calls;
+	static unsigned long state_setups;
+
+	void compute_lod_levels();
+
 public:
 	model();
 
@@ -440,14 +482,31 @@ public:
 	void set_layout(const std::string& layout = default_layout);
 	// extend method by matrix4(f) for additional transformation, to avoid
 	// that the user has to du glPushMatrix/manipulate/glPopMatrix
-	void display(const texture *caustic_map = 0) const;
+	/// number of levels of detail, level 0 is the full model
+	static const unsigned nr_of_lod_levels = 4;
+	/// choose level of detail by radius of bounding sphere on screen in pixels
+	static unsigned get_lod_for_screen_size(double radius_pixels);
+	/// number of triangles rendered since last reset
+	static unsigned long get_nr_of_rendered_triangles() { return rendered_triangles; }
+	/// number of draw calls since last reset
+	static unsigned long get_nr_of_draw_calls() { return draw_calls; }
+	/// number of render state setups of meshes (materials, vertex buffers) since last reset
+	static unsigned long get_nr_of_state_setups() { return state_setups; }
+	static void reset_render_statistics() { rendered_triangles = draw_calls = state_setups = 0; }
+	void display(const texture *caustic_map = 0, unsigned lod = 0) const;
+	/// display the model at several transformations (relative to the current
+	/// modelview matrix), each mesh sets up its render state only once.
+	/// Used to draw many objects with the same model, like ships of a convoy.
+	/// This is no instanced rendering, there are still draw calls per instance.
+	void display_instances(const std::vector<matrix4>& transforms, const texture *caustic_map = 0,
+			       unsigned lod = 0) const;
 	/** display model but clip away coords with z < 0 in world space.
 	    @note! set up texture matrix for unit 1 so that it contains
 	    object to world-space transformation, and set up modelview
 	    matrix so that it contains worldspace to viewer transformation
 	    with z-mirroring.
 	*/
-	void display_mirror_clip() const;
+	void display_mirror_clip(unsigned lod = 0) const;
 	mesh& get_mesh(unsigned nr);
 	const mesh& get_mesh(unsigned nr) const;
 	/// get mesh at root of object tree or first mesh if no tree defined
@@ -518,6 +577,8 @@ public:
 	float get_total_volume_by_voxels() const { return total_volume_by_voxels; }
 	/// request voxel data
 	const std::vector<voxel>& get_voxel_data() const { return voxel_data; }
+	/// request voxel data as struct of arrays, same order as get_voxel_data
+	const voxel_arrays& get_voxel_arrays() const { return voxel_soa; }
 	/// get voxel data by position, may return 0 for not existing voxels
 	const voxel* get_voxel_by_pos(const vector3i& v) const {
 		int i = voxel_index_by_pos[(v.z * voxel_resolution.y + v.y) * voxel_resolution.x + v.x];
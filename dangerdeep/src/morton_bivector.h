@@ -29,6 +29,9 @@
 #include <cstdlib>
 #include <algorithm>
 #include <sstream>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
 
 #ifdef WIN32
 #ifndef log2
@@ -59,24 +62,13 @@ private:
 public:
 	morton_bivector():datasize(0) {}
 	
-	morton_bivector(const bivector<T>& bv) {
-		resize(std::max(pow(2, ceil(log2(bv.datasize.x))), pow(2, ceil(log2(bv.datasize.y)))));
-		for(int y=0; y<bv.datasize.y; y++) {
-			for(int x=0; x<bv.datasize.x; x++) {
-				at(x,y) = bv.at(x,y);
-			}
-		}
+	morton_bivector(const bivector<T>& bv) : datasize(0) {
+		resize(long(std::max(pow(2, ceil(log2(bv.size().x))), pow(2, ceil(log2(bv.size().y))))));
+		set_rect(vector2i(0, 0), bv.size(), bv.data_ptr(), bv.size().x);
 	}
 	
-	morton_bivector(const morton_bivector<T>& bv) {
-		resize(bv.size());
-
-		for(long y=0; y<datasize; y++) {
-			for(long x=0; x<datasize; x++) {
-				at(x,y) = bv.at(x,y);
-			}
-		}
-	}
+	morton_bivector(const morton_bivector<T>& bv)
+		: morton_x(bv.morton_x), morton_y(bv.morton_y), datasize(bv.datasize), data(bv.data) {}
 	
 	morton_bivector(const long& sz, const T& v = T()) : datasize(sz), data(sz*sz, v) {
 		if(log2(sz) != (int)log2(sz)) throw "morton_bivector::morton_bivector() wrong datasize: size is not power of 2";
@@ -161,7 +153,66 @@ public:
 	morton_bivector<T>& add_shifted(const bivector<T>& other, const vector2i& offset);
 
 	morton_bivector<T>& insert(const bivector<T>& other, const vector2i& offset);
+
+	/* Bulk access. Two samples of a row and 2x2 samples of two rows are stored
+	   together in Z-order, so rows are walked in pairs of samples, without a
+	   table lookup per sample. No range checks are done here!
+	*/
+	/// copy n samples of row y starting at column x to dest
+	void get_row(int x, int y, unsigned n, T* dest) const;
+	/// store n samples from src to row y starting at column x
+	void set_row(int x, int y, unsigned n, const T* src);
+	/// copy area to row major array, stride is the number of elements per row of dest
+	void get_rect(const vector2i& offset, const vector2i& sz, T* dest, unsigned stride) const;
+	/// store area from row major array
+	void set_rect(const vector2i& offset, const vector2i& sz, const T* src, unsigned stride);
+	/// convert to row major bivector
+	void to_bivector(bivector<T>& result) const;
+
+	/// compute Z-order index of coordinate, the bulk access uses it for the first sample
+	static unsigned long morton_index(unsigned x, unsigned y) {
+#ifdef __BMI2__
+		return _pdep_u32(x, 0x55555555U) | _pdep_u32(y, 0xAAAAAAAAU);
+#else
+		return morton_index_generic(x, y);
+#endif
+	}
+	/// get coordinate of Z-order index
+	static vector2i morton_coord(unsigned long idx) {
+#ifdef __BMI2__
+		return vector2i(_pext_u32(unsigned(idx), 0x55555555U), _pext_u32(unsigned(idx), 0xAAAAAAAAU));
+#else
+		return morton_coord_generic(idx);
+#endif
+	}
+	/// morton_index without BMI2
+	static unsigned long morton_index_generic(unsigned x, unsigned y) {
+		return spread_bits(x) | (spread_bits(y) << 1);
+	}
+	/// morton_coord without BMI2
+	static vector2i morton_coord_generic(unsigned long idx) {
+		return vector2i(compact_bits(idx), compact_bits(idx >> 1));
+	}
+
 protected:
+	static unsigned long spread_bits(unsigned long v) {
+		v &= 0xFFFF;
+		v = (v | (v << 8)) & 0x00FF00FF;
+		v = (v | (v << 4)) & 0x0F0F0F0F;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	}
+	static unsigned compact_bits(unsigned long v) {
+		v &= 0x55555555;
+		v = (v | (v >> 1)) & 0x33333333;
+		v = (v | (v >> 2)) & 0x0F0F0F0F;
+		v = (v | (v >> 4)) & 0x00FF00FF;
+		v = (v | (v >> 8)) & 0x0000FFFF;
+		return unsigned(v);
+	}
+	/// index of x+2 from index of even x, the y bits are masked out
+	static unsigned long next_x_pair(unsigned long mx) { return ((mx | 0xAAAAAAABUL) + 1) & 0x55555555UL; }
 
 	inline void generate_morton_tables(std::vector<long>&, std::vector<long>&);
 	inline unsigned long coord_to_morton(vector2i& coord);
@@ -222,6 +273,127 @@ inline unsigned long morton_bivector<T>::coord_to_morton(const vector2i& coord)
 	return morton_x[coord.x] + morton_y[coord.y];
 }
 
+template <class T>
+void morton_bivector<T>::get_row(int x, int y, unsigned n, T* dest) const
+{
+	const T* d = &data[morton_index(0, y)];
+	unsigned long mx = morton_index(x, 0);
+	unsigned i = 0;
+	if ((x & 1) && n > 0) {
+		dest[i++] = d[mx];
+		mx = next_x_pair(mx - 1);
+	}
+	for ( ; i + 2 <= n; i += 2) {
+		dest[i] = d[mx];
+		dest[i+1] = d[mx+1];
+		mx = next_x_pair(mx);
+	}
+	if (i < n)
+		dest[i] = d[mx];
+}
+
+template <class T>
+void morton_bivector<T>::set_row(int x, int y, unsigned n, const T* src)
+{
+	T* d = &data[morton_index(0, y)];
+	unsigned long mx = morton_index(x, 0);
+	unsigned i = 0;
+	if ((x & 1) && n > 0) {
+		d[mx] = src[i++];
+		mx = next_x_pair(mx - 1);
+	}
+	for ( ; i + 2 <= n; i += 2) {
+		d[mx] = src[i];
+		d[mx+1] = src[i+1];
+		mx = next_x_pair(mx);
+	}
+	if (i < n)
+		d[mx] = src[i];
+}
+
+template <class T>
+void morton_bivector<T>::get_rect(const vector2i& offset, const vector2i& sz, T* dest, unsigned stride) const
+{
+	int y = 0;
+	if ((offset.y & 1) && sz.y > 0) {
+		get_row(offset.x, offset.y, sz.x, dest);
+		++y;
+	}
+	// two rows at once, 2x2 samples are consecutive
+	for ( ; y + 2 <= sz.y; y += 2) {
+		T* d0 = dest + y * stride;
+		T* d1 = d0 + stride;
+		const T* s = &data[morton_index(0, offset.y + y)];
+		unsigned long mx = morton_index(offset.x, 0);
+		int x = 0;
+		if ((offset.x & 1) && sz.x > 0) {
+			d0[0] = s[mx];
+			d1[0] = s[mx+2];
+			mx = next_x_pair(mx - 1);
+			++x;
+		}
+		for ( ; x + 2 <= sz.x; x += 2) {
+			const T* p = s + mx;
+			d0[x] = p[0];
+			d0[x+1] = p[1];
+			d1[x] = p[2];
+			d1[x+1] = p[3];
+			mx = next_x_pair(mx);
+		}
+		if (x < sz.x) {
+			d0[x] = s[mx];
+			d1[x] = s[mx+2];
+		}
+	}
+	if (y < sz.y)
+		get_row(offset.x, offset.y + y, sz.x, dest + y * stride);
+}
+
+template <class T>
+void morton_bivector<T>::set_rect(const vector2i& offset, const vector2i& sz, const T* src, unsigned stride)
+{
+	int y = 0;
+	if ((offset.y & 1) && sz.y > 0) {
+		set_row(offset.x, offset.y, sz.x, src);
+		++y;
+	}
+	for ( ; y + 2 <= sz.y; y += 2) {
+		const T* s0 = src + y * stride;
+		const T* s1 = s0 + stride;
+		T* d = &data[morton_index(0, offset.y + y)];
+		unsigned long mx = morton_index(offset.x, 0);
+		int x = 0;
+		if ((offset.x & 1) && sz.x > 0) {
+			d[mx] = s0[0];
+			d[mx+2] = s1[0];
+			mx = next_x_pair(mx - 1);
+			++x;
+		}
+		for ( ; x + 2 <= sz.x; x += 2) {
+			T* p = d + mx;
+			p[0] = s0[x];
+			p[1] = s0[x+1];
+			p[2] = s1[x];
+			p[3] = s1[x+1];
+			mx = next_x_pair(mx);
+		}
+		if (x < sz.x) {
+			d[mx] = s0[x];
+			d[mx+2] = s1[x];
+		}
+	}
+	if (y < sz.y)
+		set_row(offset.x, offset.y + y, sz.x, src + y * stride);
+}
+
+template <class T>
+void morton_bivector<T>::to_bivector(bivector<T>& result) const
+{
+	result.resize(vector2i(datasize, datasize));
+	if (datasize > 0)
+		get_rect(vector2i(0, 0), vector2i(datasize, datasize), result.data_ptr(), datasize);
+}
+
 template <class T>
 T morton_bivector<T>::get_min() const
 {
@@ -0,0 +1,376 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// lockstep multiplayer simulation with client side prediction
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "net_lockstep.h"
+#include "error.h"
+#include <algorithm>
+
+/* NETMSG_input payload (client to server):
+   varint last confirmed tick, varint number of inputs,
+   per input: varint sequence number, varint predicted tick, varint length, data.
+   NETMSG_tick payload (server to client):
+   varint tick, varint number of inputs,
+   per input: varint player, varint sequence number, varint length, data.
+   NETMSG_checksum payload: varint tick, u32 checksum.
+*/
+
+static bool input_player_less(const lockstep_input& a, const lockstep_input& b)
+{
+	return a.player < b.player;
+}
+
+
+
+static bool same_inputs(const std::vector<lockstep_input>& a, const std::vector<lockstep_input>& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (unsigned i = 0; i < a.size(); ++i)
+		if (a[i].player != b[i].player || a[i].data != b[i].data)
+			return false;
+	return true;
+}
+
+
+
+lockstep_server::lockstep_server(lockstep_simulation& sim_, double tick_length_,
+				 unsigned checksum_interval_, unsigned max_history_)
+	: sim(sim_), tick_length(tick_length_), checksum_interval(checksum_interval_),
+	  max_history(max_history_), time_left(0), tick(0), local_seq(0)
+{
+}
+
+
+
+unsigned lockstep_server::add_client(net_transport& transport)
+{
+	clients.push_back(new client(transport));
+	return clients.size();
+}
+
+
+
+void lockstep_server::local_input(const std::vector<Uint8>& input)
+{
+	inputs.push_back(lockstep_input(0, ++local_seq, tick + 1));
+	inputs.back().data = input;
+}
+
+
+
+void lockstep_server::receive()
+{
+	std::vector<Uint8> packet;
+	net_message msg;
+	for (unsigned i = 0; i < clients.size(); ++i) {
+		client& c = *clients[i];
+		while (c.transport->receive_packet(packet))
+			c.channel.receive_packet(packet);
+		while (c.channel.receive(msg)) {
+			if (msg.type != NETMSG_input)
+				continue;
+			try {
+				net_reader r(msg.data);
+				Uint32 ack = r.varint();
+				if (ack > c.acked_tick && ack <= tick)
+					c.acked_tick = ack;
+				unsigned nr = r.varint();
+				for (unsigned j = 0; j < nr; ++j) {
+					lockstep_input in(i + 1);
+					in.seq = r.varint();
+					in.tick = r.varint();
+					in.data.resize(r.varint());
+					r.bytes(in.data.empty() ? 0 : &in.data[0], in.data.size());
+					// inputs are repeated until executed, take each once and in order
+					if (in.seq == c.last_seq + 1) {
+						inputs.push_back(in);
+						c.last_seq = in.seq;
+					}
+				}
+			}
+			catch (error& ) {
+				// ignore invalid message
+			}
+		}
+	}
+}
+
+
+
+void lockstep_server::run_tick()
+{
+	receive();
+	++tick;
+
+	// execute inputs ordered by player, each player's inputs in order
+	std::stable_sort(inputs.begin(), inputs.end(), input_player_less);
+	std::vector<Uint8> payload;
+	net_writer w(payload);
+	w.varint(tick);
+	w.varint(inputs.size());
+	for (unsigned i = 0; i < inputs.size(); ++i) {
+		const lockstep_input& in = inputs[i];
+		w.varint(in.player);
+		w.varint(in.seq);
+		w.varint(in.data.size());
+		w.bytes(in.data.empty() ? 0 : &in.data[0], in.data.size());
+		sim.apply_input(in.player, in.data);
+	}
+	inputs.clear();
+	sim.step(tick_length);
+
+	history.push_back(payload);
+	if (history.size() > max_history)
+		history.pop_front();
+	if (checksum_interval > 0 && tick % checksum_interval == 0) {
+		checksums.push_back(std::make_pair(tick, sim.checksum()));
+		if (checksums.size() > max_history / checksum_interval + 1)
+			checksums.pop_front();
+	}
+
+	// send all ticks and checksums the client has not confirmed yet
+	Uint32 first_tick = tick + 1 - history.size();
+	std::vector<std::vector<Uint8> > packets;
+	for (unsigned i = 0; i < clients.size(); ++i) {
+		client& c = *clients[i];
+		for (Uint32 t = std::max(c.acked_tick + 1, first_tick); t <= tick; ++t) {
+			net_message msg(NETMSG_tick);
+			msg.data = history[t - first_tick];
+			c.channel.send(msg);
+		}
+		for (unsigned j = 0; j < checksums.size(); ++j) {
+			if (checksums[j].first <= c.acked_tick)
+				continue;
+			net_message msg(NETMSG_checksum);
+			net_writer cw(msg.data);
+			cw.varint(checksums[j].first);
+			cw.u32(checksums[j].second);
+			c.channel.send(msg);
+		}
+		packets.clear();
+		c.channel.flush(packets);
+		for (unsigned j = 0; j < packets.size(); ++j)
+			c.transport->send_packet(packets[j]);
+	}
+}
+
+
+
+unsigned lockstep_server::advance(double elapsed)
+{
+	time_left += elapsed;
+	unsigned nr_ticks = 0;
+	while (time_left >= tick_length) {
+		time_left -= tick_length;
+		run_tick();
+		++nr_ticks;
+	}
+	return nr_ticks;
+}
+
+
+
+lockstep_client::lockstep_client(lockstep_simulation& sim_, net_transport& transport_, unsigned player_,
+				 double tick_length_, unsigned max_prediction_)
+	: sim(sim_), transport(transport_), player(player_), tick_length(tick_length_),
+	  max_prediction(max_prediction_), time_left(0), confirmed_tick(0), predicted_tick(0),
+	  next_seq(1), desyncs(0), checksums_compared(0), rewinds(0)
+{
+	// the client may predict ticks before the first tick is confirmed,
+	// so the initial state is the first state to go back to.
+	sim.save_state(confirmed_state);
+}
+
+
+
+void lockstep_client::local_input(const std::vector<Uint8>& input)
+{
+	pending.push_back(lockstep_input(player, next_seq++, predicted_tick + 1));
+	pending.back().data = input;
+}
+
+
+
+bool lockstep_client::run_confirmed_tick(const std::vector<Uint8>& payload, bool& rewound)
+{
+	net_reader r(payload);
+	Uint32 t = r.varint();
+	// ticks are repeated until confirmed, take each once and in order
+	if (t != confirmed_tick + 1)
+		return false;
+	unsigned nr = r.varint();
+	std::vector<lockstep_input> inputs(nr);
+	for (unsigned i = 0; i < nr; ++i) {
+		inputs[i].player = r.varint();
+		inputs[i].seq = r.varint();
+		inputs[i].tick = t;
+		inputs[i].data.resize(r.varint());
+		r.bytes(inputs[i].data.empty() ? 0 : &inputs[i].data[0], inputs[i].data.size());
+	}
+	for (unsigned i = 0; i < nr; ++i)
+		if (inputs[i].player == player)
+			while (!pending.empty() && pending.front().seq <= inputs[i].seq)
+				pending.pop_front();
+
+	Uint32 sum = 0;
+	if (!rewound && !predictions.empty() && predictions.front().tick == t
+	    && same_inputs(predictions.front().inputs, inputs)) {
+		// prediction was right, the simulation is deterministic, so the
+		// predicted state is the confirmed state.
+		confirmed_state.swap(predictions.front().state);
+		sum = predictions.front().checksum;
+		predictions.pop_front();
+	} else {
+		if (!rewound) {
+			// go back from predicted state to last confirmed state
+			if (predicted_tick > confirmed_tick) {
+				sim.load_state(confirmed_state);
+				++rewinds;
+			}
+			predictions.clear();
+			rewound = true;
+		}
+		for (unsigned i = 0; i < nr; ++i)
+			sim.apply_input(inputs[i].player, inputs[i].data);
+		sim.step(tick_length);
+		sum = sim.checksum();
+	}
+	confirmed_tick = t;
+
+	own_checksums[t] = sum;
+	if (own_checksums.size() > 64)
+		own_checksums.erase(own_checksums.begin());
+	std::map<Uint32, Uint32>::iterator it = server_checksums.find(t);
+	if (it != server_checksums.end()) {
+		Uint32 s = it->second;
+		server_checksums.erase(server_checksums.begin(), ++it);
+		compare_checksum(t, s);
+	}
+	return true;
+}
+
+
+
+void lockstep_client::compare_checksum(Uint32 t, Uint32 server_sum)
+{
+	if (t > confirmed_tick) {
+		// compare later
+		server_checksums[t] = server_sum;
+		return;
+	}
+	std::map<Uint32, Uint32>::iterator it = own_checksums.find(t);
+	if (it == own_checksums.end())
+		return;	// compared already or too old
+	++checksums_compared;
+	if (it->second != server_sum)
+		++desyncs;
+	own_checksums.erase(it);
+}
+
+
+
+void lockstep_client::predict_tick(Uint32 t)
+{
+	// inputs that the server has not executed at their tick are executed
+	// by it later, so predict them at the first unconfirmed tick.
+	predictions.push_back(prediction(t));
+	prediction& p = predictions.back();
+	for (std::deque<lockstep_input>::const_iterator it = pending.begin(); it != pending.end(); ++it) {
+		if (it->tick == t || (it->tick < t && t == confirmed_tick + 1)) {
+			sim.apply_input(player, it->data);
+			p.inputs.push_back(*it);
+		}
+	}
+	sim.step(tick_length);
+	// kept to take it over without rewinding when the server confirms the inputs
+	p.checksum = sim.checksum();
+	sim.save_state(p.state);
+}
+
+
+
+void lockstep_client::send_inputs()
+{
+	net_message msg(NETMSG_input);
+	net_writer w(msg.data);
+	w.varint(confirmed_tick);
+	w.varint(pending.size());
+	for (std::deque<lockstep_input>::const_iterator it = pending.begin(); it != pending.end(); ++it) {
+		w.varint(it->seq);
+		w.varint(it->tick);
+		w.varint(it->data.size());
+		w.bytes(it->data.empty() ? 0 : &it->data[0], it->data.size());
+	}
+	channel.send(msg);
+	std::vector<std::vector<Uint8> > packets;
+	channel.flush(packets);
+	for (unsigned i = 0; i < packets.size(); ++i)
+		transport.send_packet(packets[i]);
+}
+
+
+
+void lockstep_client::advance(double elapsed)
+{
+	std::vector<Uint8> packet;
+	while (transport.receive_packet(packet))
+		channel.receive_packet(packet);
+	net_message msg;
+	bool rewound = false;
+	while (channel.receive(msg)) {
+		try {
+			if (msg.type == NETMSG_tick) {
+				run_confirmed_tick(msg.data, rewound);
+			} else if (msg.type == NETMSG_checksum) {
+				net_reader r(msg.data);
+				Uint32 t = r.varint();
+				compare_checksum(t, r.u32());
+			}
+		}
+		catch (error& ) {
+			// ignore invalid message
+		}
+	}
+
+	if (rewound) {
+		sim.save_state(confirmed_state);
+		// predict again from new confirmed state
+		if (predicted_tick < confirmed_tick)
+			predicted_tick = confirmed_tick;
+		for (Uint32 t = confirmed_tick + 1; t <= predicted_tick; ++t)
+			predict_tick(t);
+	}
+
+	time_left += elapsed;
+	while (time_left >= tick_length) {
+		if (predicted_tick - confirmed_tick >= max_prediction) {
+			// too far ahead of the server, wait
+			time_left = tick_length;
+			break;
+		}
+		time_left -= tick_length;
+		++predicted_tick;
+		predict_tick(predicted_tick);
+	}
+
+	send_inputs();
+}
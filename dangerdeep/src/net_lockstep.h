@@ -0,0 +1,223 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// lockstep multiplayer simulation with client side prediction
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#ifndef NET_LOCKSTEP_H
+#define NET_LOCKSTEP_H
+
+#include "net_protocol.h"
+#include "ptrvector.h"
+#include <cmath>
+
+/* The server is authoritative: it advances the simulation with a fixed
+   tick length and executes player inputs at the tick they arrive at.
+   After each tick it sends the inputs it executed to all clients, which
+   run the same ticks with the same inputs and so get the same state
+   (the simulation must be deterministic for that).
+   Clients don't wait for the server: they run ahead with their own
+   inputs (prediction). When a tick of the server arrives with the inputs
+   the client predicted for it, the predicted state is the confirmed one.
+   Otherwise the client goes back to its last confirmed state, runs the
+   confirmed tick and then runs the predicted ticks again with its own
+   inputs that the server has not executed yet (reconciliation).
+   Every few ticks the server sends a checksum of its state, the clients
+   compare it with their confirmed state to detect desynchronization.
+   Lost packets are compensated by repetition: clients send their
+   unconfirmed inputs with every tick, the server sends all ticks the
+   client has not confirmed yet.
+*/
+
+///\brief Interface of a simulation that can run in lockstep.
+class lockstep_simulation
+{
+ public:
+	virtual ~lockstep_simulation() {}
+	/// execute input of a player (0 = server player)
+	virtual void apply_input(unsigned player, const std::vector<Uint8>& input) = 0;
+	/// advance simulation by one tick
+	virtual void step(double delta_t) = 0;
+	/// checksum of simulation state, equal states must give equal checksums
+	virtual Uint32 checksum() const = 0;
+	/// store complete state, for rewinding on clients
+	virtual void save_state(std::vector<Uint8>& state) const = 0;
+	/// restore state stored by save_state
+	virtual void load_state(const std::vector<Uint8>& state) = 0;
+};
+
+
+
+///\brief Helper to compute checksums of simulation states (FNV-1a).
+class state_checksum
+{
+ public:
+	state_checksum() : value(2166136261U) {}
+	void add(Uint32 v) {
+		for (unsigned i = 0; i < 4; ++i) {
+			value = (value ^ ((v >> (i * 8)) & 0xff)) * 16777619U;
+		}
+	}
+	/// add floating point value quantized to given precision
+	void add(double v, double precision) {
+		Uint64 q = Uint64(Sint64(floor(v / precision + 0.5)));
+		add(Uint32(q));
+		add(Uint32(q >> 32));
+	}
+	Uint32 get() const { return value; }
+
+ protected:
+	Uint32 value;
+};
+
+
+
+/// an input of a player for a tick
+struct lockstep_input
+{
+	unsigned player;
+	Uint32 seq;	// per player sequence number, starting with 1
+	Uint32 tick;
+	std::vector<Uint8> data;
+	lockstep_input(unsigned p = 0, Uint32 s = 0, Uint32 t = 0) : player(p), seq(s), tick(t) {}
+};
+
+
+
+///\brief Server side of lockstep simulation.
+class lockstep_server
+{
+ public:
+	/// create server for a simulation, checksums are sent every checksum_interval ticks
+	lockstep_server(lockstep_simulation& sim, double tick_length = 1.0/30.0,
+			unsigned checksum_interval = 30, unsigned max_history = 300);
+
+	/// add connection to a client, returns player number of client
+	unsigned add_client(net_transport& transport);
+
+	/// input of server player for next tick
+	void local_input(const std::vector<Uint8>& input);
+
+	/// receive inputs of clients and run all ticks due after elapsed time,
+	/// returns number of ticks run.
+	unsigned advance(double elapsed);
+
+	/// receive inputs of clients, run one tick and send it to the clients
+	void run_tick();
+
+	Uint32 get_tick() const { return tick; }
+	double get_tick_length() const { return tick_length; }
+
+ protected:
+	struct client
+	{
+		net_transport* transport;
+		net_channel channel;
+		Uint32 acked_tick;	// last tick confirmed by client
+		Uint32 last_seq;	// last input sequence number received
+		client(net_transport& t) : transport(&t), acked_tick(0), last_seq(0) {}
+	};
+
+	lockstep_simulation& sim;
+	double tick_length;
+	unsigned checksum_interval;
+	unsigned max_history;
+	double time_left;
+	Uint32 tick;
+	Uint32 local_seq;
+	ptrvector<client> clients;
+	std::vector<lockstep_input> inputs;	// received, for next tick
+	std::deque<std::vector<Uint8> > history;	// NETMSG_tick payloads of last ticks
+	std::deque<std::pair<Uint32, Uint32> > checksums;	// tick and checksum
+
+	void receive();
+
+ private:
+	lockstep_server(const lockstep_server& );
+	lockstep_server& operator= (const lockstep_server& );
+};
+
+
+
+///\brief Client side of lockstep simulation with prediction.
+class lockstep_client
+{
+ public:
+	/// create client for a simulation and connection to the server,
+	/// player number must be the one given by the server.
+	/// The client runs at most max_prediction ticks ahead of the server.
+	lockstep_client(lockstep_simulation& sim, net_transport& transport, unsigned player,
+			double tick_length = 1.0/30.0, unsigned max_prediction = 15);
+
+	/// input of client player for next predicted tick
+	void local_input(const std::vector<Uint8>& input);
+
+	/// receive ticks of server and predict all ticks due after elapsed time
+	void advance(double elapsed);
+
+	/// last tick confirmed by server
+	Uint32 get_confirmed_tick() const { return confirmed_tick; }
+	/// last predicted tick, the simulation is at this tick
+	Uint32 get_predicted_tick() const { return predicted_tick; }
+	/// number of checksums different to the one of the server
+	unsigned get_desyncs() const { return desyncs; }
+	/// number of checksums compared
+	unsigned get_checksums_compared() const { return checksums_compared; }
+	/// number of rewinds done to reconcile prediction
+	unsigned get_rewinds() const { return rewinds; }
+
+ protected:
+	lockstep_simulation& sim;
+	net_transport& transport;
+	net_channel channel;
+	unsigned player;
+	double tick_length;
+	unsigned max_prediction;
+	double time_left;
+	Uint32 confirmed_tick;
+	Uint32 predicted_tick;
+	Uint32 next_seq;
+	std::vector<Uint8> confirmed_state;
+	std::deque<lockstep_input> pending;	// own inputs not executed by server
+
+	/// a predicted tick, with the inputs applied and the resulting state
+	struct prediction
+	{
+		Uint32 tick;
+		std::vector<lockstep_input> inputs;
+		Uint32 checksum;
+		std::vector<Uint8> state;
+		prediction(Uint32 t = 0) : tick(t), checksum(0) {}
+	};
+	std::deque<prediction> predictions;	// of ticks after confirmed_tick
+	std::map<Uint32, Uint32> own_checksums;	// of confirmed ticks
+	std::map<Uint32, Uint32> server_checksums;	// of not yet confirmed ticks
+	unsigned desyncs, checksums_compared, rewinds;
+
+	bool run_confirmed_tick(const std::vector<Uint8>& payload, bool& rewound);
+	void compare_checksum(Uint32 t, Uint32 server_sum);
+	void predict_tick(Uint32 t);
+	void send_inputs();
+
+ private:
+	lockstep_client(const lockstep_client& );
+	lockstep_client& operator= (const lockstep_client& );
+};
+
+#endif
@@ -0,0 +1,577 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// binary network protocol: messages, delta compressed states, batching
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "net_protocol.h"
+#include "error.h"
+#include <algorithm>
+
+// first byte of every packet, to sort out foreign data
+static const Uint8 packet_magic = 0xDF;
+// magic and sequence number
+static const unsigned packet_header_size = 3;
+// type, length, fragment id, message type, index and count of a fragment, at most
+static const unsigned fragment_overhead = 1 + 3 + 2 + 1 + 5 + 5;
+// incomplete fragmented messages are dropped after that many packets
+static const unsigned max_fragment_age = 64;
+
+
+
+static unsigned varint_size(Uint32 v)
+{
+	unsigned s = 1;
+	while (v >= 0x80) {
+		v >>= 7;
+		++s;
+	}
+	return s;
+}
+
+
+
+void net_writer::u16(Uint16 v)
+{
+	data.push_back(Uint8(v));
+	data.push_back(Uint8(v >> 8));
+}
+
+
+
+void net_writer::u32(Uint32 v)
+{
+	for (unsigned i = 0; i < 4; ++i)
+		data.push_back(Uint8(v >> (i * 8)));
+}
+
+
+
+void net_writer::f32(float v)
+{
+	union { float f; Uint32 u; } fu;
+	fu.f = v;
+	u32(fu.u);
+}
+
+
+
+void net_writer::varint(Uint32 v)
+{
+	while (v >= 0x80) {
+		data.push_back(Uint8(v | 0x80));
+		v >>= 7;
+	}
+	data.push_back(Uint8(v));
+}
+
+
+
+void net_writer::svarint(Sint32 v)
+{
+	// zigzag coding, so small negative values are small numbers too
+	varint((Uint32(v) << 1) ^ Uint32(v >> 31));
+}
+
+
+
+void net_writer::bytes(const Uint8* p, unsigned n)
+{
+	data.insert(data.end(), p, p + n);
+}
+
+
+
+void net_writer::str(const std::string& s)
+{
+	varint(s.length());
+	bytes(reinterpret_cast<const Uint8*>(s.data()), s.length());
+}
+
+
+
+void net_reader::need(unsigned n) const
+{
+	if (end - pos < n)
+		throw error("network message truncated");
+}
+
+
+
+Uint8 net_reader::u8()
+{
+	need(1);
+	return data[pos++];
+}
+
+
+
+Uint16 net_reader::u16()
+{
+	need(2);
+	Uint16 v = Uint16(data[pos] | (data[pos+1] << 8));
+	pos += 2;
+	return v;
+}
+
+
+
+Uint32 net_reader::u32()
+{
+	need(4);
+	Uint32 v = 0;
+	for (unsigned i = 0; i < 4; ++i)
+		v |= Uint32(data[pos+i]) << (i * 8);
+	pos += 4;
+	return v;
+}
+
+
+
+float net_reader::f32()
+{
+	union { float f; Uint32 u; } fu;
+	fu.u = u32();
+	return fu.f;
+}
+
+
+
+Uint32 net_reader::varint()
+{
+	Uint32 v = 0;
+	for (unsigned shift = 0; shift < 35; shift += 7) {
+		Uint8 b = u8();
+		v |= Uint32(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return v;
+	}
+	throw error("invalid varint in network message");
+}
+
+
+
+Sint32 net_reader::svarint()
+{
+	Uint32 u = varint();
+	return Sint32((u >> 1) ^ (0U - (u & 1)));
+}
+
+
+
+void net_reader::bytes(Uint8* p, unsigned n)
+{
+	need(n);
+	for (unsigned i = 0; i < n; ++i)
+		p[i] = data[pos + i];
+	pos += n;
+}
+
+
+
+std::string net_reader::str()
+{
+	unsigned n = varint();
+	need(n);
+	std::string s(reinterpret_cast<const char*>(data + pos), n);
+	pos += n;
+	return s;
+}
+
+
+
+/* State payload:
+   u8 flags (1 = delta to a base), varint tick, [varint tick - base tick],
+   varint number of objects, per object: varint id - previous id, u8 kind,
+   kind 0 (delta): varint mask of changed fields, svarint difference per changed field,
+   kind 1 (full): varint number of fields, svarint value per field,
+   varint number of removed objects, varint id - previous id per object.
+   Objects that did not change since the base are not written.
+*/
+enum { state_delta = 0, state_full = 1 };
+
+net_state_encoder::net_state_encoder(unsigned max_pending_)
+	: max_pending(max_pending_), base_valid(false), base_tick(0)
+{
+}
+
+
+
+void net_state_encoder::encode(Uint32 tick, const net_snapshot& snap, std::vector<Uint8>& out)
+{
+	std::vector<Uint8> objdata;
+	net_writer ow(objdata);
+	unsigned nr_objects = 0;
+	Uint32 lastid = 0;
+	for (net_snapshot::object_map::const_iterator it = snap.objects.begin(); it != snap.objects.end(); ++it) {
+		const net_snapshot::fields& f = it->second;
+		if (f.size() > net_snapshot::max_fields)
+			throw error("too many fields for network object");
+		net_snapshot::object_map::const_iterator bt = base.objects.find(it->first);
+		if (base_valid && bt != base.objects.end() && bt->second.size() == f.size()) {
+			Uint32 mask = 0;
+			for (unsigned i = 0; i < f.size(); ++i)
+				if (f[i] != bt->second[i])
+					mask |= 1U << i;
+			if (mask == 0)
+				continue;
+			ow.varint(it->first - lastid);
+			ow.u8(state_delta);
+			ow.varint(mask);
+			for (unsigned i = 0; i < f.size(); ++i)
+				if (mask & (1U << i))
+					ow.svarint(Sint32(Uint32(f[i]) - Uint32(bt->second[i])));
+		} else {
+			ow.varint(it->first - lastid);
+			ow.u8(state_full);
+			ow.varint(f.size());
+			for (unsigned i = 0; i < f.size(); ++i)
+				ow.svarint(f[i]);
+		}
+		lastid = it->first;
+		++nr_objects;
+	}
+
+	net_writer w(out);
+	w.u8(base_valid ? 1 : 0);
+	w.varint(tick);
+	if (base_valid)
+		w.varint(tick - base_tick);
+	w.varint(nr_objects);
+	w.bytes(objdata.empty() ? 0 : &objdata[0], objdata.size());
+
+	std::vector<Uint32> removed;
+	if (base_valid)
+		for (net_snapshot::object_map::const_iterator bt = base.objects.begin(); bt != base.objects.end(); ++bt)
+			if (snap.objects.find(bt->first) == snap.objects.end())
+				removed.push_back(bt->first);
+	w.varint(removed.size());
+	lastid = 0;
+	for (unsigned i = 0; i < removed.size(); ++i) {
+		w.varint(removed[i] - lastid);
+		lastid = removed[i];
+	}
+
+	pending[tick] = snap;
+	while (pending.size() > max_pending)
+		pending.erase(pending.begin());
+}
+
+
+
+void net_state_encoder::acknowledge(Uint32 tick)
+{
+	// acknowledges can arrive late or twice, the base only moves forward
+	if (base_valid && tick <= base_tick)
+		return;
+	std::map<Uint32, net_snapshot>::iterator it = pending.find(tick);
+	if (it == pending.end())
+		return;
+	base.objects.swap(it->second.objects);
+	base_tick = tick;
+	base_valid = true;
+	pending.erase(pending.begin(), ++it);
+}
+
+
+
+net_state_decoder::net_state_decoder(unsigned max_history_)
+	: max_history(max_history_), last_valid(false), last_tick(0)
+{
+}
+
+
+
+bool net_state_decoder::decode(const std::vector<Uint8>& in, Uint32& tick, net_snapshot& snap)
+{
+	net_reader r(in);
+	Uint8 flags = r.u8();
+	tick = r.varint();
+	// older states than the last one are outdated
+	if (last_valid && tick <= last_tick)
+		return false;
+	snap.objects.clear();
+	if (flags & 1) {
+		Uint32 base_tick = tick - r.varint();
+		std::map<Uint32, net_snapshot>::iterator it = history.find(base_tick);
+		if (it == history.end())
+			return false;
+		snap = it->second;
+		// the sender won't use older bases anymore
+		history.erase(history.begin(), it);
+	}
+	unsigned nr_objects = r.varint();
+	Uint32 id = 0;
+	for (unsigned i = 0; i < nr_objects; ++i) {
+		id += r.varint();
+		Uint8 kind = r.u8();
+		net_snapshot::fields& f = snap.objects[id];
+		if (kind == state_delta) {
+			Uint32 mask = r.varint();
+			for (unsigned j = 0; j < f.size(); ++j)
+				if (mask & (1U << j))
+					f[j] = Sint32(Uint32(f[j]) + Uint32(r.svarint()));
+		} else if (kind == state_full) {
+			unsigned n = r.varint();
+			if (n > net_snapshot::max_fields)
+				throw error("too many fields for network object");
+			f.resize(n);
+			for (unsigned j = 0; j < n; ++j)
+				f[j] = r.svarint();
+		} else {
+			throw error("invalid object state in network message");
+		}
+	}
+	unsigned nr_removed = r.varint();
+	id = 0;
+	for (unsigned i = 0; i < nr_removed; ++i) {
+		id += r.varint();
+		snap.objects.erase(id);
+	}
+
+	history[tick] = snap;
+	while (history.size() > max_history)
+		history.erase(history.begin());
+	last_tick = tick;
+	last_valid = true;
+	return true;
+}
+
+
+
+net_channel::net_channel(unsigned max_packet_size_)
+	: max_packet_size(max_packet_size_), next_sequence(0), next_fragment_id(0),
+	  expected_valid(false), expected_sequence(0),
+	  packets_sent(0), bytes_sent(0), packets_received(0), packets_lost(0)
+{
+	if (max_packet_size < 64)
+		throw error("network packet size too small");
+}
+
+
+
+void net_channel::send(const net_message& msg)
+{
+	outgoing.push_back(msg);
+}
+
+
+
+void net_channel::start_packet(std::vector<Uint8>& packet)
+{
+	packet.clear();
+	net_writer w(packet);
+	w.u8(packet_magic);
+	w.u16(next_sequence++);
+}
+
+
+
+void net_channel::add_to_packet(Uint8 type, const Uint8* p, unsigned n, std::vector<Uint8>& packet,
+				std::vector<std::vector<Uint8> >& packets)
+{
+	unsigned size = 1 + varint_size(n) + n;
+	if (packet.size() + size > max_packet_size && packet.size() > packet_header_size) {
+		packets.push_back(packet);
+		start_packet(packet);
+	}
+	net_writer w(packet);
+	w.u8(type);
+	w.varint(n);
+	w.bytes(p, n);
+}
+
+
+
+void net_channel::flush(std::vector<std::vector<Uint8> >& packets)
+{
+	if (outgoing.empty())
+		return;
+	unsigned first = packets.size();
+	std::vector<Uint8> packet;
+	start_packet(packet);
+	for (unsigned i = 0; i < outgoing.size(); ++i) {
+		const net_message& msg = outgoing[i];
+		const Uint8* p = msg.data.empty() ? 0 : &msg.data[0];
+		unsigned n = msg.data.size();
+		if (packet_header_size + 1 + varint_size(n) + n <= max_packet_size) {
+			add_to_packet(msg.type, p, n, packet, packets);
+			continue;
+		}
+		// too large for a packet, split it
+		unsigned chunk = max_packet_size - packet_header_size - fragment_overhead;
+		unsigned count = (n + chunk - 1) / chunk;
+		Uint16 id = next_fragment_id++;
+		std::vector<Uint8> frag;
+		for (unsigned j = 0; j < count; ++j) {
+			unsigned len = std::min(chunk, n - j * chunk);
+			frag.clear();
+			net_writer w(frag);
+			w.u16(id);
+			w.u8(msg.type);
+			w.varint(j);
+			w.varint(count);
+			w.bytes(p + j * chunk, len);
+			add_to_packet(NETMSG_fragment, &frag[0], frag.size(), packet, packets);
+		}
+	}
+	if (packet.size() > packet_header_size)
+		packets.push_back(packet);
+	outgoing.clear();
+	for (unsigned i = first; i < packets.size(); ++i) {
+		++packets_sent;
+		bytes_sent += packets[i].size();
+	}
+}
+
+
+
+void net_channel::receive_packet(const std::vector<Uint8>& packet)
+{
+	if (packet.size() < packet_header_size || packet[0] != packet_magic)
+		return;
+	net_reader r(packet);
+	r.u8();
+	Uint16 seq = r.u16();
+	++packets_received;
+	if (expected_valid) {
+		Sint16 d = Sint16(Uint16(seq - expected_sequence));
+		// packets arriving late were counted as lost already
+		if (d > 0)
+			packets_lost += d;
+		if (d >= 0)
+			expected_sequence = seq + 1;
+	} else {
+		expected_sequence = seq + 1;
+		expected_valid = true;
+	}
+
+	for (std::map<Uint16, fragment_buffer>::iterator it = fragments.begin(); it != fragments.end(); ) {
+		if (++it->second.age > max_fragment_age)
+			fragments.erase(it++);
+		else
+			++it;
+	}
+
+	try {
+		while (!r.at_end()) {
+			Uint8 type = r.u8();
+			unsigned n = r.varint();
+			if (n > r.remaining())
+				break;
+			std::vector<Uint8> payload(n);
+			r.bytes(payload.empty() ? 0 : &payload[0], n);
+			if (type == NETMSG_fragment) {
+				net_reader fr(payload);
+				parse_fragment(fr);
+			} else {
+				incoming.push_back(net_message(type));
+				incoming.back().data.swap(payload);
+			}
+		}
+	}
+	catch (error& ) {
+		// ignore rest of corrupted packet
+	}
+}
+
+
+
+void net_channel::parse_fragment(net_reader& r)
+{
+	Uint16 id = r.u16();
+	Uint8 type = r.u8();
+	unsigned index = r.varint();
+	unsigned count = r.varint();
+	if (count == 0 || index >= count || count > 65536)
+		return;
+	fragment_buffer& fb = fragments[id];
+	if (fb.parts.empty()) {
+		fb.parts.resize(count);
+		fb.type = type;
+	}
+	if (fb.parts.size() != count || fb.type != type || !fb.parts[index].empty())
+		return;
+	std::vector<Uint8>& part = fb.parts[index];
+	part.resize(r.remaining());
+	if (part.empty())
+		return;
+	r.bytes(&part[0], part.size());
+	if (++fb.nr_received < count)
+		return;
+	incoming.push_back(net_message(type));
+	std::vector<Uint8>& data = incoming.back().data;
+	for (unsigned i = 0; i < count; ++i)
+		data.insert(data.end(), fb.parts[i].begin(), fb.parts[i].end());
+	fragments.erase(id);
+}
+
+
+
+bool net_channel::receive(net_message& msg)
+{
+	if (incoming.empty())
+		return false;
+	msg.type = incoming.front().type;
+	msg.data.swap(incoming.front().data);
+	incoming.pop_front();
+	return true;
+}
+
+
+
+void net_loopback::endpoint::send_packet(const std::vector<Uint8>& packet)
+{
+	owner->transfer(packet, *out);
+}
+
+
+
+bool net_loopback::endpoint::receive_packet(std::vector<Uint8>& packet)
+{
+	if (in->empty())
+		return false;
+	packet.swap(in->front());
+	in->pop_front();
+	return true;
+}
+
+
+
+net_loopback::net_loopback()
+	: loss_interval(0), reorder_interval(0), packet_count(0), bytes_transferred(0)
+{
+	server.owner = client.owner = this;
+	server.out = client.in = &to_client;
+	server.in = client.out = &to_server;
+}
+
+
+
+void net_loopback::transfer(const std::vector<Uint8>& packet, std::deque<std::vector<Uint8> >& queue)
+{
+	++packet_count;
+	if (loss_interval > 0 && packet_count % loss_interval == 0)
+		return;
+	bytes_transferred += packet.size();
+	if (reorder_interval > 0 && packet_count % reorder_interval == 0 && !queue.empty())
+		queue.insert(queue.end() - 1, packet);
+	else
+		queue.push_back(packet);
+}
@@ -0,0 +1,301 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// binary network protocol: messages, delta compressed states, batching
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#ifndef NET_PROTOCOL_H
+#define NET_PROTOCOL_H
+
+#include <SDL_types.h>
+#include <vector>
+#include <map>
+#include <deque>
+#include <string>
+
+/* Multiplayer data is sent as compact binary messages. All messages of a
+   tick are batched into as few packets as possible by a net_channel, and
+   messages larger than a packet are split into fragments and reassembled
+   on the other side. Object states are sent as snapshots that only hold
+   the differences to the last snapshot the receiver has acknowledged, so
+   objects that did not change cost nothing. Packets are unreliable: a lost
+   state is simply replaced by the next one, which is encoded against the
+   last acknowledged state again.
+   The transport is abstract, so the protocol can be tested with an
+   in-memory loopback connection on one machine.
+*/
+
+/// types of network messages
+enum net_message_type {
+	NETMSG_command = 1,	// a player command
+	NETMSG_state = 2,	// delta compressed object states (see net_state_encoder)
+	NETMSG_ack = 3,		// receiver acknowledges a state tick
+	NETMSG_input = 4,	// lockstep: client inputs and last confirmed tick
+	NETMSG_tick = 5,	// lockstep: inputs the server executed at a tick
+	NETMSG_checksum = 6,	// lockstep: state checksum of server at a tick
+	NETMSG_fragment = 255	// part of a large message, used by net_channel only
+};
+
+
+
+///\brief Appends values in little endian binary form to a byte buffer.
+class net_writer
+{
+ public:
+	net_writer(std::vector<Uint8>& buf) : data(buf) {}
+	void u8(Uint8 v) { data.push_back(v); }
+	void u16(Uint16 v);
+	void u32(Uint32 v);
+	void f32(float v);
+	/// write unsigned value with 7 bits per byte, small values take one byte
+	void varint(Uint32 v);
+	/// write signed value as varint, small absolute values take one byte
+	void svarint(Sint32 v);
+	void bytes(const Uint8* p, unsigned n);
+	void str(const std::string& s);
+
+ protected:
+	std::vector<Uint8>& data;
+};
+
+
+
+///\brief Reads values written by net_writer, throws error on truncated data.
+class net_reader
+{
+ public:
+	net_reader(const Uint8* p, unsigned size) : data(p), pos(0), end(size) {}
+	net_reader(const std::vector<Uint8>& buf) : data(buf.empty() ? 0 : &buf[0]), pos(0), end(buf.size()) {}
+	Uint8 u8();
+	Uint16 u16();
+	Uint32 u32();
+	float f32();
+	Uint32 varint();
+	Sint32 svarint();
+	void bytes(Uint8* p, unsigned n);
+	std::string str();
+	unsigned remaining() const { return end - pos; }
+	bool at_end() const { return pos == end; }
+
+ protected:
+	const Uint8* data;
+	unsigned pos, end;
+
+	void need(unsigned n) const;
+};
+
+
+
+///\brief A network message, type and binary payload.
+struct net_message
+{
+	Uint8 type;
+	std::vector<Uint8> data;
+	net_message(Uint8 t = 0) : type(t) {}
+};
+
+
+
+///\brief States of all networked objects at one tick.
+/** Each object has an id and a small number of integer fields. The sender
+    quantizes its values (e.g. positions in centimeters, angles in 1/100
+    degrees), so unchanged values compress to nothing and the receiver gets
+    exactly the values that were sent.
+*/
+struct net_snapshot
+{
+	/// maximum number of fields per object
+	static const unsigned max_fields = 32;
+	typedef std::vector<Sint32> fields;
+	typedef std::map<Uint32, fields> object_map;
+	object_map objects;
+	bool operator== (const net_snapshot& other) const { return objects == other.objects; }
+};
+
+
+
+///\brief Encodes snapshots as difference to the last one acknowledged by the receiver.
+/** One encoder is needed per receiver. Sent snapshots are kept until they
+    are acknowledged or too old. Without an acknowledged snapshot all
+    objects are sent completely.
+*/
+class net_state_encoder
+{
+ public:
+	/// create encoder, at most max_pending sent snapshots are kept
+	net_state_encoder(unsigned max_pending = 64);
+
+	/// encode snapshot of tick (ticks must increase) to NETMSG_state payload
+	void encode(Uint32 tick, const net_snapshot& snap, std::vector<Uint8>& out);
+
+	/// receiver acknowledged the snapshot of a tick, it becomes the base for deltas
+	void acknowledge(Uint32 tick);
+
+	bool has_base() const { return base_valid; }
+	Uint32 get_base_tick() const { return base_tick; }
+
+ protected:
+	unsigned max_pending;
+	bool base_valid;
+	Uint32 base_tick;
+	net_snapshot base;
+	std::map<Uint32, net_snapshot> pending;	// sent, but not yet acknowledged
+};
+
+
+
+///\brief Decodes snapshots encoded by net_state_encoder.
+/** Decoded snapshots are kept as possible bases for later deltas, until
+    the sender uses a newer base.
+*/
+class net_state_decoder
+{
+ public:
+	/// create decoder, at most max_history decoded snapshots are kept
+	net_state_decoder(unsigned max_history = 64);
+
+	/// decode NETMSG_state payload, returns false if it is older than the
+	/// last decoded one or its base is not known anymore.
+	/// The tick should be acknowledged to the sender when true is returned.
+	bool decode(const std::vector<Uint8>& in, Uint32& tick, net_snapshot& snap);
+
+ protected:
+	unsigned max_history;
+	bool last_valid;
+	Uint32 last_tick;
+	std::map<Uint32, net_snapshot> history;
+};
+
+
+
+///\brief Batches messages into packets and splits messages larger than a packet.
+/** Messages given to send() are collected until flush() is called once per
+    tick, which packs them into as few packets as possible. Received packets
+    are parsed by receive_packet(), the complete messages can be fetched
+    with receive(). Fragments of messages are reassembled, if a fragment is
+    lost the message is dropped after a while.
+*/
+class net_channel
+{
+ public:
+	/// create channel with maximum packet size in bytes (at least 64)
+	net_channel(unsigned max_packet_size = 1200);
+
+	/// queue message to be sent with next flush
+	void send(const net_message& msg);
+
+	/// pack all queued messages to packets, they are appended to packets
+	void flush(std::vector<std::vector<Uint8> >& packets);
+
+	/// parse a received packet, invalid packets are ignored
+	void receive_packet(const std::vector<Uint8>& packet);
+
+	/// fetch next complete received message, returns false if there is none
+	bool receive(net_message& msg);
+
+	// statistics
+	unsigned get_packets_sent() const { return packets_sent; }
+	unsigned get_bytes_sent() const { return bytes_sent; }
+	unsigned get_packets_received() const { return packets_received; }
+	unsigned get_packets_lost() const { return packets_lost; }
+
+ protected:
+	struct fragment_buffer
+	{
+		Uint8 type;
+		unsigned nr_received;
+		unsigned age;	// packets received since first fragment
+		std::vector<std::vector<Uint8> > parts;
+		fragment_buffer() : type(0), nr_received(0), age(0) {}
+	};
+
+	unsigned max_packet_size;
+	std::vector<net_message> outgoing;
+	std::deque<net_message> incoming;
+	std::map<Uint16, fragment_buffer> fragments;
+	Uint16 next_sequence;
+	Uint16 next_fragment_id;
+	bool expected_valid;
+	Uint16 expected_sequence;
+	unsigned packets_sent, bytes_sent, packets_received, packets_lost;
+
+	void add_to_packet(Uint8 type, const Uint8* p, unsigned n, std::vector<Uint8>& packet,
+			   std::vector<std::vector<Uint8> >& packets);
+	void start_packet(std::vector<Uint8>& packet);
+	void parse_fragment(net_reader& r);
+};
+
+
+
+///\brief Interface to send and receive packets, implemented by real connections and the loopback.
+class net_transport
+{
+ public:
+	virtual ~net_transport() {}
+	virtual void send_packet(const std::vector<Uint8>& packet) = 0;
+	/// fetch next received packet, returns false if there is none
+	virtual bool receive_packet(std::vector<Uint8>& packet) = 0;
+};
+
+
+
+///\brief In-memory connection of two endpoints, a stand-in for a server connection.
+/** Packets can be dropped and delayed, to test the protocol on one machine.
+*/
+class net_loopback
+{
+ public:
+	class endpoint : public net_transport
+	{
+	 public:
+		void send_packet(const std::vector<Uint8>& packet);
+		bool receive_packet(std::vector<Uint8>& packet);
+	 protected:
+		friend class net_loopback;
+		net_loopback* owner;
+		std::deque<std::vector<Uint8> >* out;
+		std::deque<std::vector<Uint8> >* in;
+	};
+
+	net_loopback();
+
+	endpoint& get_server() { return server; }
+	endpoint& get_client() { return client; }
+
+	/// drop every nth packet (0 = none)
+	void set_packet_loss(unsigned every_nth) { loss_interval = every_nth; }
+	/// swap every nth packet with the one sent before (0 = none)
+	void set_reordering(unsigned every_nth) { reorder_interval = every_nth; }
+
+	unsigned get_bytes_transferred() const { return bytes_transferred; }
+
+ protected:
+	endpoint server, client;
+	std::deque<std::vector<Uint8> > to_server, to_client;
+	unsigned loss_interval, reorder_interval;
+	unsigned packet_count, bytes_transferred;
+
+	void transfer(const std::vector<Uint8>& packet, std::deque<std::vector<Uint8> >& queue);
+
+ private:
+	net_loopback(const net_loopback& );
+	net_loopback& operator= (const net_loopback& );
+};
+
+#endif
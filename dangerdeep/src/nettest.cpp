@@ -0,0 +1,300 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// test of the binary network protocol and lockstep simulation over loopback connections
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "net_lockstep.h"
+#include <iostream>
+#include <cstdlib>
+using namespace std;
+
+static bool test_protocol()
+{
+	const unsigned nr_objects = 300, nr_fields = 8, nr_ticks = 1000;
+	net_loopback loop;
+	loop.set_packet_loss(9);
+	loop.set_reordering(13);
+	net_channel server, client;
+	net_state_encoder encoder;
+	net_state_decoder decoder;
+	map<Uint32, net_snapshot> sent;
+	net_snapshot state;
+	for (unsigned i = 0; i < nr_objects; ++i)
+		state.objects[i * 3 + 1] = net_snapshot::fields(nr_fields, rand() % 100000);
+	unsigned nr_decoded = 0, nr_wrong = 0, nr_commands = 0, full_size = 0;
+	srand(42);
+	for (Uint32 tick = 1; tick <= nr_ticks; ++tick) {
+		// some objects move, some are spawned or removed
+		for (unsigned i = 0; i < nr_objects / 5; ++i) {
+			net_snapshot::object_map::iterator it = state.objects.find((rand() % nr_objects) * 3 + 1);
+			if (it == state.objects.end())
+				continue;
+			it->second[0] += rand() % 200 - 100;
+			it->second[1] += rand() % 200 - 100;
+		}
+		if (tick % 17 == 0)
+			state.objects.erase(state.objects.begin());
+		if (tick % 23 == 0)
+			state.objects[nr_objects * 3 + tick] = net_snapshot::fields(nr_fields, tick);
+		full_size += state.objects.size() * nr_fields * 4;
+
+		// server sends state and sometimes a large command
+		net_message msg(NETMSG_state);
+		encoder.encode(tick, state, msg.data);
+		sent[tick] = state;
+		server.send(msg);
+		if (tick % 50 == 0) {
+			net_message cmd(NETMSG_command);
+			cmd.data.resize(3000, Uint8(tick));
+			server.send(cmd);
+		}
+		vector<vector<Uint8> > packets;
+		server.flush(packets);
+		for (unsigned i = 0; i < packets.size(); ++i)
+			loop.get_server().send_packet(packets[i]);
+
+		// client decodes and acknowledges
+		vector<Uint8> packet;
+		while (loop.get_client().receive_packet(packet))
+			client.receive_packet(packet);
+		while (client.receive(msg)) {
+			if (msg.type == NETMSG_state) {
+				Uint32 t;
+				net_snapshot snap;
+				if (decoder.decode(msg.data, t, snap)) {
+					++nr_decoded;
+					if (!(snap == sent[t]))
+						++nr_wrong;
+					net_message ack(NETMSG_ack);
+					net_writer(ack.data).varint(t);
+					client.send(ack);
+				}
+			} else if (msg.type == NETMSG_command) {
+				if (msg.data.size() != 3000 || msg.data[2999] != msg.data[0])
+					++nr_wrong;
+				++nr_commands;
+			}
+		}
+		packets.clear();
+		client.flush(packets);
+		for (unsigned i = 0; i < packets.size(); ++i)
+			loop.get_client().send_packet(packets[i]);
+
+		// server takes acknowledges
+		while (loop.get_server().receive_packet(packet))
+			server.receive_packet(packet);
+		while (server.receive(msg))
+			if (msg.type == NETMSG_ack)
+				encoder.acknowledge(net_reader(msg.data).varint());
+	}
+
+	cout << "ticks " << nr_ticks << ", states decoded " << nr_decoded << ", commands " << nr_commands
+	     << ", wrong " << nr_wrong << "\n";
+	cout << "packets sent " << server.get_packets_sent() << ", lost " << client.get_packets_lost()
+	     << ", bytes per tick " << server.get_bytes_sent() / nr_ticks
+	     << " (uncompressed " << full_size / nr_ticks << ")\n";
+	return nr_wrong == 0 && nr_decoded > nr_ticks / 2;
+}
+
+
+
+// deterministic simulation for the lockstep test, every player moves a point
+class point_simulation : public lockstep_simulation
+{
+ public:
+	vector<Sint32> pos, vel;
+	Uint32 tick, broken_at;
+	point_simulation(unsigned nr_players, Uint32 broken = 0)
+		: pos(nr_players * 2), vel(nr_players * 2), tick(0), broken_at(broken) {}
+	void apply_input(unsigned player, const vector<Uint8>& input) {
+		vel[player * 2] = Sint8(input[0]);
+		vel[player * 2 + 1] = Sint8(input[1]);
+	}
+	void step(double ) {
+		++tick;
+		for (unsigned i = 0; i < pos.size(); ++i)
+			pos[i] += vel[i];
+		// players influence each other, so the order of inputs matters
+		for (unsigned i = 2; i < pos.size(); ++i)
+			pos[i] += pos[i - 2] % 3;
+		if (tick == broken_at)
+			++pos[0];
+	}
+	Uint32 checksum() const {
+		state_checksum cs;
+		for (unsigned i = 0; i < pos.size(); ++i) {
+			cs.add(Uint32(pos[i]));
+			cs.add(Uint32(vel[i]));
+		}
+		return cs.get();
+	}
+	void save_state(vector<Uint8>& state) const {
+		state.clear();
+		net_writer w(state);
+		w.u32(tick);
+		for (unsigned i = 0; i < pos.size(); ++i) {
+			w.svarint(pos[i]);
+			w.svarint(vel[i]);
+		}
+	}
+	void load_state(const vector<Uint8>& state) {
+		net_reader r(state);
+		tick = r.u32();
+		for (unsigned i = 0; i < pos.size(); ++i) {
+			pos[i] = r.svarint();
+			vel[i] = r.svarint();
+		}
+	}
+};
+
+
+
+static bool test_lockstep()
+{
+	const unsigned nr_clients = 3, nr_frames = 1200;
+	const double frame_time = 1.0/60.0;
+	point_simulation server_sim(nr_clients + 1);
+	lockstep_server server(server_sim);
+	ptrvector<net_loopback> loops;
+	ptrvector<point_simulation> sims;
+	ptrvector<lockstep_client> clients;
+	for (unsigned i = 0; i < nr_clients; ++i) {
+		loops.push_back(new net_loopback());
+		loops[i]->set_packet_loss(11 + i);
+		loops[i]->set_reordering(7);
+		unsigned player = server.add_client(loops[i]->get_server());
+		// last client computes a wrong state once
+		sims.push_back(new point_simulation(nr_clients + 1, (i + 1 == nr_clients) ? 300 : 0));
+		clients.push_back(new lockstep_client(*sims[i], loops[i]->get_client(), player));
+	}
+	srand(7);
+	vector<Uint8> input(2);
+	for (unsigned f = 0; f < nr_frames; ++f) {
+		// no inputs at the end, so everything gets confirmed
+		bool inputs = f < nr_frames - 200;
+		if (inputs && rand() % 10 == 0) {
+			input[0] = Uint8(rand() % 7 - 3);
+			input[1] = Uint8(rand() % 7 - 3);
+			server.local_input(input);
+		}
+		server.advance(frame_time);
+		for (unsigned i = 0; i < nr_clients; ++i) {
+			if (inputs && rand() % 10 == 0) {
+				input[0] = Uint8(rand() % 7 - 3);
+				input[1] = Uint8(rand() % 7 - 3);
+				clients[i]->local_input(input);
+			}
+			clients[i]->advance(frame_time);
+		}
+	}
+	// let server catch up with the predictions, then all states must be confirmed
+	for (unsigned i = 0; i < nr_clients; ++i)
+		while (server.get_tick() < clients[i]->get_predicted_tick())
+			server.run_tick();
+	for (unsigned i = 0; i < nr_clients; ++i)
+		clients[i]->advance(0);
+	bool ok = true;
+	for (unsigned i = 0; i < nr_clients; ++i) {
+		const lockstep_client& c = *clients[i];
+		bool broken = (i + 1 == nr_clients);
+		cout << "client " << i + 1 << ": confirmed tick " << c.get_confirmed_tick() << " of " << server.get_tick()
+		     << ", rewinds " << c.get_rewinds() << ", checksums " << c.get_checksums_compared()
+		     << ", desyncs " << c.get_desyncs() << (broken ? " (expected)" : "") << "\n";
+		if (c.get_checksums_compared() == 0 || (c.get_desyncs() > 0) != broken)
+			ok = false;
+		// clients that are in sync must have the state of the server
+		if (!broken && (sims[i]->pos != server_sim.pos || c.get_predicted_tick() != server.get_tick()))
+			ok = false;
+	}
+	return ok;
+}
+
+
+
+static bool test_prediction_before_first_tick()
+{
+	// client runs ahead before the server has run any tick, it must go back
+	// to the initial state and catch up when the first ticks arrive.
+	const double frame_time = 1.0/60.0;
+	point_simulation server_sim(2);
+	lockstep_server server(server_sim);
+	net_loopback loop;
+	point_simulation client_sim(2);
+	unsigned player = server.add_client(loop.get_server());
+	lockstep_client client(client_sim, loop.get_client(), player);
+	vector<Uint8> input(2);
+	input[0] = 2;
+	input[1] = Uint8(-1);
+	client.local_input(input);
+	for (unsigned f = 0; f < 5; ++f)
+		client.advance(frame_time);
+	Uint32 predicted = client.get_predicted_tick();
+	for (unsigned f = 0; f < 120; ++f) {
+		server.advance(frame_time);
+		client.advance(frame_time);
+	}
+	while (server.get_tick() < client.get_predicted_tick())
+		server.run_tick();
+	client.advance(0);
+	cout << "prediction before first tick: predicted " << predicted << ", confirmed "
+	     << client.get_confirmed_tick() << " of " << server.get_tick() << ", rewinds " << client.get_rewinds() << "\n";
+	return predicted > 0 && client.get_confirmed_tick() == server.get_tick()
+		&& client.get_predicted_tick() == server.get_tick() && client_sim.pos == server_sim.pos
+		&& client.get_desyncs() == 0;
+}
+
+
+
+static bool test_right_prediction()
+{
+	// without inputs of other players every prediction is right, the client
+	// must take over its predicted states instead of going back.
+	const double frame_time = 1.0/60.0;
+	point_simulation server_sim(2);
+	lockstep_server server(server_sim);
+	net_loopback loop;
+	loop.set_packet_loss(10);
+	point_simulation client_sim(2);
+	unsigned player = server.add_client(loop.get_server());
+	lockstep_client client(client_sim, loop.get_client(), player);
+	for (unsigned f = 0; f < 600; ++f) {
+		server.advance(frame_time);
+		client.advance(frame_time);
+	}
+	while (server.get_tick() < client.get_predicted_tick())
+		server.run_tick();
+	client.advance(0);
+	cout << "right prediction: confirmed " << client.get_confirmed_tick() << " of " << server.get_tick()
+	     << ", rewinds " << client.get_rewinds() << ", checksums " << client.get_checksums_compared() << "\n";
+	return client.get_rewinds() == 0 && client.get_confirmed_tick() == server.get_tick()
+		&& client.get_checksums_compared() > 0 && client.get_desyncs() == 0;
+}
+
+
+
+int main(int, char**)
+{
+	bool ok = test_protocol();
+	ok = test_lockstep() && ok;
+	ok = test_prediction_before_first_tick() && ok;
+	ok = test_right_prediction() && ok;
+	cout << (ok ? "OK" : "FAILED") << "\n";
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// test of batched fractal noise against the per sample computation
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "fractal.h"
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+using namespace std;
+
+int main(int, char**)
+{
+	// parameters of data/maps/terrain/terrain.xml, terrain patches of 256x256
+	const int num_levels = 7, sz = 256;
+	const float coord_factor = 0.01f;
+	fractal_noise frac(0.25, 1.37657, num_levels + 1, 0.0, 3.657);
+	vector<float> x(sz), y(sz), z(sz), values(sz);
+	vector<float> heights(sz * sz);
+	vector<double> reference(sz * sz), batched(sz * sz);
+	double maxerr = 0.0, maxval = 0.0, t_scalar = 0.0, t_batched = 0.0;
+	bool ok = true;
+	for (int detail = 0; detail < num_levels; ++detail) {
+		long bl_x = 123456 >> detail, bl_y = -65432 >> detail;
+		// smooth heights like upsampled terrain data
+		for (int yy = 0; yy < sz; ++yy)
+			for (int xx = 0; xx < sz; ++xx)
+				heights[yy*sz+xx] = float(1000.0 * sin(xx * 0.05) * cos(yy * 0.03) + (rand() % 10));
+		clock_t c0 = clock();
+		for (int yy = 0; yy < sz; ++yy) {
+			for (int xx = 0; xx < sz; ++xx) {
+				float h = heights[yy*sz+xx];
+				vector3 p(((bl_x + xx) << (detail + 1)) * coord_factor,
+					  ((bl_y + yy) << (detail + 1)) * coord_factor, h * coord_factor);
+				reference[yy*sz+xx] = frac.get_value_hybrid(vector3f(p), num_levels - detail);
+			}
+		}
+		clock_t c1 = clock();
+		for (int yy = 0; yy < sz; ++yy) {
+			for (int xx = 0; xx < sz; ++xx) {
+				x[xx] = ((bl_x + xx) << (detail + 1)) * coord_factor;
+				y[xx] = ((bl_y + yy) << (detail + 1)) * coord_factor;
+				z[xx] = heights[yy*sz+xx] * coord_factor;
+			}
+			frac.get_values_hybrid(&x[0], &y[0], &z[0], &values[0], sz, num_levels - detail);
+			for (int xx = 0; xx < sz; ++xx)
+				batched[yy*sz+xx] = values[xx];
+		}
+		clock_t c2 = clock();
+		t_scalar += double(c1 - c0) / CLOCKS_PER_SEC;
+		t_batched += double(c2 - c1) / CLOCKS_PER_SEC;
+		double err = 0.0;
+		for (int i = 0; i < sz * sz; ++i) {
+			err = max(err, fabs(reference[i] - batched[i]));
+			maxval = max(maxval, fabs(reference[i]));
+		}
+		cout << "detail " << detail << " max error " << err << "\n";
+		maxerr = max(maxerr, err);
+		if (err > 1e-4)
+			ok = false;
+	}
+	cout << "max value " << maxval << " max error " << maxerr << "\n";
+	cout << "time per sample for scalar version " << t_scalar * 1e9 / (num_levels*sz*sz)
+	     << "ns, batched version " << t_batched * 1e9 / (num_levels*sz*sz) << "ns\n";
+	cout << (ok ? "OK" : "FAILED") << "\n";
+	return ok ? 0 : 1;
+}
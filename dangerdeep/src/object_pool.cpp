@@ -0,0 +1,108 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// pooled memory for frequently spawned objects
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "object_pool.h"
+#include <cstdlib>
+#include <new>
+
+// sizes are rounded up, so every object is aligned like malloc'ed memory
+static const std::size_t pool_alignment = 16;
+
+
+
+object_pool::object_pool(unsigned objects_per_page_)
+	: objects_per_page(objects_per_page_), nr_allocated(0)
+{
+}
+
+
+
+object_pool::~object_pool()
+{
+	// objects still in use can't be given back, keep their memory then.
+	if (nr_allocated > 0)
+		return;
+	for (unsigned i = 0; i < classes.size(); ++i)
+		for (unsigned j = 0; j < classes[i].pages.size(); ++j)
+			std::free(classes[i].pages[j]);
+}
+
+
+
+object_pool::size_class& object_pool::get_class(std::size_t sz)
+{
+	sz = (sz + pool_alignment - 1) & ~(pool_alignment - 1);
+	for (unsigned i = 0; i < classes.size(); ++i)
+		if (classes[i].size == sz)
+			return classes[i];
+	classes.push_back(size_class(sz));
+	return classes.back();
+}
+
+
+
+void* object_pool::allocate(std::size_t sz)
+{
+	mutex_locker ml(mtx);
+	size_class& sc = get_class(sz);
+	if (!sc.free_list) {
+		// add a new page and put all its objects to the free list, first
+		// object first, so objects are handed out in memory order.
+		char* page = static_cast<char*>(std::malloc(sc.size * objects_per_page));
+		if (!page)
+			throw std::bad_alloc();
+		sc.pages.push_back(page);
+		for (unsigned i = objects_per_page; i > 0; --i) {
+			free_entry* e = reinterpret_cast<free_entry*>(page + (i - 1) * sc.size);
+			e->next = sc.free_list;
+			sc.free_list = e;
+		}
+	}
+	free_entry* e = sc.free_list;
+	sc.free_list = e->next;
+	++nr_allocated;
+	return e;
+}
+
+
+
+void object_pool::deallocate(void* p, std::size_t sz)
+{
+	if (!p)
+		return;
+	mutex_locker ml(mtx);
+	size_class& sc = get_class(sz);
+	free_entry* e = static_cast<free_entry*>(p);
+	e->next = sc.free_list;
+	sc.free_list = e;
+	--nr_allocated;
+}
+
+
+
+std::size_t object_pool::get_capacity() const
+{
+	std::size_t c = 0;
+	for (unsigned i = 0; i < classes.size(); ++i)
+		c += classes[i].pages.size() * classes[i].size * objects_per_page;
+	return c;
+}
@@ -0,0 +1,105 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// pooled memory for frequently spawned objects
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include "mutex.h"
+#include <vector>
+#include <cstddef>
+
+///\brief Memory pool for objects of one class hierarchy.
+/** Memory is taken from pages that hold a number of objects of the same
+    size, freed objects are kept in a free list per size and reused by the
+    next allocation of that size. So objects of the same type are stored
+    close together and spawning and deleting objects does not call the
+    global allocator in the long run. Pages are never given back while the
+    program runs.
+    Classes use a pool by heiring from pooled (see below).
+    The pool is thread safe, objects are spawned in simulation threads.
+*/
+class object_pool
+{
+ public:
+	/// create pool, each page holds the given number of objects
+	object_pool(unsigned objects_per_page = 64);
+	~object_pool();
+
+	/// allocate memory for an object of given size
+	void* allocate(std::size_t sz);
+
+	/// give memory of an object back, sz must be the size given to allocate
+	void deallocate(void* p, std::size_t sz);
+
+	/// number of objects currently allocated
+	unsigned get_nr_allocated() const { return nr_allocated; }
+
+	/// number of bytes in pages
+	std::size_t get_capacity() const;
+
+ protected:
+	struct free_entry
+	{
+		free_entry* next;
+	};
+
+	struct size_class
+	{
+		std::size_t size;
+		free_entry* free_list;
+		std::vector<char*> pages;
+		size_class(std::size_t s) : size(s), free_list(0) {}
+	};
+
+	unsigned objects_per_page;
+	std::vector<size_class> classes;	// few entries, one per heir of the class
+	unsigned nr_allocated;
+	::mutex mtx;
+
+	size_class& get_class(std::size_t sz);
+
+ private:
+	object_pool(const object_pool& );
+	object_pool& operator= (const object_pool& );
+};
+
+
+
+///\brief Base class for classes whose objects are spawned and deleted often.
+/** A class C heiring from pooled<C> gets class specific operators new/delete
+    that take the memory from an object_pool of its own, so ptrvector and
+    game::spawn_* work unchanged. The sized delete gets the size of the
+    dynamic type when the destructor is virtual, so heirs of C are pooled as
+    well.
+*/
+template<class T>
+class pooled
+{
+ public:
+	static void* operator new(std::size_t sz) { return pool().allocate(sz); }
+	static void operator delete(void* p, std::size_t sz) { pool().deallocate(p, sz); }
+
+ private:
+	static object_pool& pool() { static object_pool p; return p; }
+};
+
+#endif
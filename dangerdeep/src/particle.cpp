@@ -46,7 +46,7 @@ using std::vector;
 using std::string;
 
 unsigned particle::init_count = 0;
-vector<texture*> particle::tex_smoke;
+texture* particle::tex_smoke = 0;
 texture* particle::tex_spray = 0;
 vector<texture*> particle::tex_fire;
 vector<texture*> particle::explosionbig;
@@ -57,6 +57,9 @@ texture* particle::tex_fireworks_flare = 0;
 texture* particle::tex_marker = 0;
 
 #define NR_OF_SMOKE_TEXTURES 16
+// coarsest mipmap level of the smoke atlas, an image has 8x8 texels there.
+// Coarser levels would mix neighbouring images.
+#define SMOKE_ATLAS_MAX_LEVEL 3
 #define NR_OF_FIRE_TEXTURES 64
 
 vector<float> particle::interpolate_func;
@@ -216,7 +219,8 @@ void particle::init()
 	// compute random smoke textures here.
 	// just random noise with smoke color gradients and irregular outline
 	// resolution 64x64, outline 8x8 scaled, smoke structure 8x8 or 16x16
-	tex_smoke.resize(NR_OF_SMOKE_TEXTURES);
+	// all smoke images are stored in one texture, so smoke can be drawn in one batch.
+	vector<Uint8> smokeatlas(256*256*2);
 	vector<Uint8> smoketmp(64*64*2);
 	for (unsigned i = 0; i < NR_OF_SMOKE_TEXTURES; ++i) {
 		vector<Uint8> noise = make_2d_perlin_noise(64, 2);
@@ -229,16 +233,22 @@ void particle::init()
 		osg.write((const char*)(&noise[0]), 64*64);
 */
 
+		unsigned xoff = (i % 4) * 64, yoff = (i / 4) * 64;
 		for (unsigned y = 0; y < 64; ++y) {
 			for (unsigned x = 0; x < 64; ++x) {
 				unsigned r = noise[y*64+x];
 				smoketmp[2*(y*64+x)+0] = (Uint8)r;
 				smoketmp[2*(y*64+x)+1] = (r < 64) ? 0 : r - 64;
+				unsigned ao = 2*((y + yoff)*256 + x + xoff);
+				smokeatlas[ao+0] = smoketmp[2*(y*64+x)+0];
+				smokeatlas[ao+1] = smoketmp[2*(y*64+x)+1];
 			}
 		}
-		tex_smoke[i] = new texture(smoketmp, 64, 64, GL_LUMINANCE_ALPHA,
-					   texture::LINEAR_MIPMAP_LINEAR, texture::CLAMP);
 	}
+	tex_smoke = new texture(smokeatlas, 256, 256, GL_LUMINANCE_ALPHA,
+				texture::LINEAR_MIPMAP_LINEAR, texture::CLAMP);
+	tex_smoke->set_gl_texture();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, SMOKE_ATLAS_MAX_LEVEL);
 
 	// compute spray texture here
 	for (unsigned y = 0; y < 64; ++y) {
@@ -338,8 +348,7 @@ void particle::init()
 void particle::deinit()
 {
 	if (--init_count != 0) return;
-	for (unsigned i = 0; i < tex_smoke.size(); ++i)
-		delete tex_smoke[i];
+	delete tex_smoke;
 	delete tex_spray;
 	for (unsigned i = 0; i < tex_fire.size(); ++i)
 		delete tex_fire[i];
@@ -450,218 +459,613 @@ void particle::display_all(const vector<particle*>& pts, const vector3& viewpos,
 
 
 
-// smoke
+// particle system for smoke, explosions, fire and spray
 
-smoke_particle::smoke_particle(const vector3& pos) : particle(pos), texnr(rand() % NR_OF_SMOKE_TEXTURES)
+particle_system::particle_system()
+	: rng(0x1234567)
 {
-	velocity.x = -1; // wind test, wind from NE, speed ~1.4m/s
-	velocity.y = -1;
-	velocity.z = 4.0;	// m/s
+	myworker.reset(new worker(*this));
+	myworker->start();
 }
 
 
 
-vector3 smoke_particle::get_acceleration() const
+particle_system::~particle_system()
 {
-	return vector3(0, 0, -3.0/get_life_time());
+	myworker.reset();
 }
 
 
 
-double smoke_particle::get_width() const
+unsigned particle_system::id_pool::allocate()
 {
-	// min/max size in meters
-	return 2.0 * life + 50.0 * (1.0 - life);
+	if (!free_ids.empty()) {
+		unsigned id = free_ids.back();
+		free_ids.pop_back();
+		return id;
+	}
+	return next_id++;
 }
 
 
 
-double smoke_particle::get_height() const
+void particle_system::stream::add(unsigned id, const vector3& pos, const vector3& velo, Uint8 tn)
 {
-	double h = get_width();
-	if (life > 0.9)
-		h *= (life - 0.8) * 10;
-	return h;
+	if (id >= index_of_id.size())
+		index_of_id.resize(id + 1, -1);
+	index_of_id[id] = int(life.size());
+	px.push_back(pos.x);
+	py.push_back(pos.y);
+	pz.push_back(pos.z);
+	vx.push_back(velo.x);
+	vy.push_back(velo.y);
+	vz.push_back(velo.z);
+	life.push_back(1.0);
+	texnr.push_back(tn);
+	ids.push_back(id);
 }
 
 
 
-const texture& smoke_particle::get_tex_and_col(game& gm, const colorf& light_color, colorf& col) const
+void particle_system::stream::copy_live(const stream& src, std::vector<unsigned>& freed_ids)
 {
-	col = colorf(0.5f, 0.5f, 0.5f, life) * light_color;
-	return *tex_smoke[texnr];
+	// only particles that are not faded out are copied, in the same order, so
+	// the display order of the last frame stays nearly sorted. The vectors
+	// keep their capacity, so nothing is allocated in the long run.
+	// Only ids of the old content are indexed, so reset just those.
+	for (unsigned i = 0; i < ids.size(); ++i)
+		index_of_id[ids[i]] = -1;
+	index_of_id.resize(src.index_of_id.size(), -1);
+	const unsigned n = src.life.size();
+	unsigned m = 0;
+	for (unsigned i = 0; i < n; ++i)
+		if (src.life[i] > 0.0)
+			++m;
+	px.resize(m); py.resize(m); pz.resize(m);
+	vx.resize(m); vy.resize(m); vz.resize(m);
+	life.resize(m);
+	texnr.resize(m);
+	ids.resize(m);
+	unsigned j = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		if (src.life[i] <= 0.0) {
+			freed_ids.push_back(src.ids[i]);
+			continue;
+		}
+		px[j] = src.px[i]; py[j] = src.py[i]; pz[j] = src.pz[i];
+		vx[j] = src.vx[i]; vy[j] = src.vy[i]; vz[j] = src.vz[i];
+		life[j] = src.life[i];
+		texnr[j] = src.texnr[i];
+		ids[j] = src.ids[i];
+		index_of_id[ids[j]] = int(j);
+		++j;
+	}
 }
 
 
 
-double smoke_particle::get_life_time() const
+void particle_system::stream::compact(std::vector<unsigned>& freed_ids)
 {
-	return 30.0; // seconds
+	// remove faded out particles but keep order of the others, so the
+	// display order of the last frame stays nearly sorted.
+	unsigned n = life.size();
+	unsigned j = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		if (life[i] <= 0.0) {
+			index_of_id[ids[i]] = -1;
+			freed_ids.push_back(ids[i]);
+			continue;
+		}
+		if (i != j) {
+			px[j] = px[i]; py[j] = py[i]; pz[j] = pz[i];
+			vx[j] = vx[i]; vy[j] = vy[i]; vz[j] = vz[i];
+			life[j] = life[i];
+			texnr[j] = texnr[i];
+			ids[j] = ids[i];
+			index_of_id[ids[j]] = int(j);
+		}
+		++j;
+	}
+	if (j == n)
+		return;
+	px.resize(j); py.resize(j); pz.resize(j);
+	vx.resize(j); vy.resize(j); vz.resize(j);
+	life.resize(j);
+	texnr.resize(j);
+	ids.resize(j);
 }
 
 
 
-double smoke_particle::get_produce_time()
+void particle_system::stream::integrate(double delta_t, double lifetime, double acc_z)
 {
-	return 0.6; // seconds
+	// plain loops over arrays, so they can be vectorized.
+	// acceleration is only along z for all particle types.
+	const unsigned n = life.size();
+	const double dz = acc_z * (delta_t * delta_t * 0.5);
+	const double dvz = acc_z * delta_t;
+	const double dl = delta_t / lifetime;
+	for (unsigned i = 0; i < n; ++i)
+		px[i] += vx[i] * delta_t;
+	for (unsigned i = 0; i < n; ++i)
+		py[i] += vy[i] * delta_t;
+	for (unsigned i = 0; i < n; ++i)
+		pz[i] += vz[i] * delta_t + dz;
+	for (unsigned i = 0; i < n; ++i)
+		vz[i] += dvz;
+	for (unsigned i = 0; i < n; ++i)
+		life[i] = std::max(life[i] - dl, 0.0);
 }
 
 
 
-smoke_particle_escort::smoke_particle_escort(const vector3& pos) : smoke_particle(pos)
+void particle_system::stream::swap(stream& other)
 {
+	px.swap(other.px); py.swap(other.py); pz.swap(other.pz);
+	vx.swap(other.vx); vy.swap(other.vy); vz.swap(other.vz);
+	life.swap(other.life);
+	texnr.swap(other.texnr);
+	ids.swap(other.ids);
+	index_of_id.swap(other.index_of_id);
 }
 
 
 
-double smoke_particle_escort::get_width() const
+void particle_system::view::sort_order()
 {
-	return 2.0 * life + 25.0 * (1.0 - life);
+	// insertion sort, back to front. Order changes only a bit from frame
+	// to frame, so this is nearly O(n). If the view changes too much, e.g. on
+	// switching displays, the work would be O(n^2), so use std::sort then.
+	const unsigned n = order.size();
+	const unsigned max_moves = 8 * n + 64;
+	unsigned moves = 0;
+	for (unsigned i = 1; i < n; ++i) {
+		unsigned k = order[i];
+		double d = dist[k];
+		unsigned j = i;
+		for ( ; j > 0 && dist[order[j-1]] < d; --j)
+			order[j] = order[j-1];
+		order[j] = k;
+		moves += i - j;
+		if (moves > max_moves) {
+			std::vector<std::pair<double, unsigned> > tmp(n);
+			for (unsigned m = 0; m < n; ++m)
+				tmp[m] = std::make_pair(-dist[order[m]], order[m]);
+			std::sort(tmp.begin(), tmp.end());
+			for (unsigned m = 0; m < n; ++m)
+				order[m] = tmp[m].second;
+			return;
+		}
+	}
 }
 
 
 
-double smoke_particle_escort::get_life_time() const
+unsigned particle_system::spawn(type t, const vector3& pos, const vector3& velo)
 {
-	return 15.0; // seconds
+	mutex_locker ml(command_mutex);
+	unsigned id = id_pools[t].allocate();
+	commands.push_back(command(command::spawn, t, id, pos, velo));
+	return id;
 }
 
 
 
-double smoke_particle_escort::get_produce_time()
+void particle_system::set_pos(type t, unsigned id, const vector3& pos)
 {
-	return 0.3; // seconds
+	mutex_locker ml(command_mutex);
+	commands.push_back(command(command::set_pos, t, id, pos));
 }
 
 
 
-// explosion(s)
+void particle_system::kill(type t, unsigned id)
+{
+	mutex_locker ml(command_mutex);
+	commands.push_back(command(command::kill, t, id));
+}
+
+
 
-explosion_particle::explosion_particle(const vector3& pos) : particle(pos)
+void particle_system::clear()
 {
-	extype = 0; // rnd(1); //fixme
+	sync();
+	mutex_locker ml(command_mutex);
+	for (unsigned t = 0; t < nr_of_types; ++t) {
+		front[t] = stream();
+		back[t] = stream();
+		views[t] = view();
+		id_pools[t] = id_pool();
+	}
+	commands.clear();
 }
 
 
 
-double explosion_particle::get_width() const
+void particle_system::simulate(double delta_t)
 {
-	return 20.0; //fixme: depends on type
+	sync();
+	for (unsigned t = 0; t < nr_of_types; ++t)
+		front[t].swap(back[t]);
+	myworker->work(delta_t);
 }
 
 
 
-double explosion_particle::get_height() const
+void particle_system::sync()
 {
-	return 20.0; //fixme: depends on type
+	myworker->sync();
 }
 
 
 
-const texture& explosion_particle::get_tex_and_col(game& gm, const colorf& /*light_color*/, colorf& col) const
+void particle_system::step(double delta_t)
 {
-	col = colorf(1,1,1,1);
-	unsigned f = unsigned(EXPL_FRAMES * (1.0 - life));
-	if (f < 0 || f >= EXPL_FRAMES) f = EXPL_FRAMES-1;
-	// switch on type, fixme
-	return *explosionbig[f];
+	{
+		mutex_locker ml(command_mutex);
+		step_commands.swap(commands);
+	}
+
+	// front is read only while the step runs, as it is rendered meanwhile.
+	// Particles that faded out in the last step are not copied.
+	for (unsigned t = 0; t < nr_of_types; ++t) {
+		back[t].copy_live(front[t], freed_ids);
+		return_freed_ids(type(t));
+	}
+
+	// apply commands in order, so moving or killing a particle that was
+	// spawned in the same step works.
+	for (unsigned i = 0; i < step_commands.size(); ++i) {
+		const command& c = step_commands[i];
+		stream& s = back[c.t];
+		if (c.k == command::spawn) {
+			if (c.t == smoke || c.t == smoke_escort) {
+				// wind test, wind from NE, speed ~1.4m/s, rising with 4 m/s, fixme
+				// low bits of the generator have short periods, use the high bits
+				s.add(c.id, c.pos, vector3(-1, -1, 4.0), Uint8((rng.rnd() >> 16) % NR_OF_SMOKE_TEXTURES));
+			} else {
+				s.add(c.id, c.pos, c.velo, 0);
+			}
+			continue;
+		}
+		if (c.id >= s.index_of_id.size() || s.index_of_id[c.id] < 0)
+			continue;
+		unsigned idx = unsigned(s.index_of_id[c.id]);
+		if (c.k == command::set_pos) {
+			s.px[idx] = c.pos.x;
+			s.py[idx] = c.pos.y;
+			s.pz[idx] = c.pos.z;
+		} else {
+			// removed by compact() below
+			s.life[idx] = 0.0;
+		}
+	}
+	step_commands.clear();
+
+	// remove killed particles
+	for (unsigned t = 0; t < nr_of_types; ++t) {
+		back[t].compact(freed_ids);
+		return_freed_ids(type(t));
+	}
+
+	// fire produces smoke, a smoke particle is spawned on every cycle of its life.
+	stream& fs = back[fire];
+	const double flt = get_life_time(fire);
+	for (unsigned i = 0; i < fs.life.size(); ++i) {
+		float l = myfrac(fs.life[i] * flt);
+		if (l - flt * delta_t <= 0)
+			spawn(smoke, vector3(fs.px[i], fs.py[i], fs.pz[i]));
+	}
+
+	for (unsigned t = 0; t < nr_of_types; ++t) {
+		double acc_z = (t == smoke || t == smoke_escort) ? -3.0/get_life_time(type(t)) : 0.0;
+		back[t].integrate(delta_t, get_life_time(type(t)), acc_z);
+	}
+
+	// fire burns until it is killed
+	for (unsigned i = 0; i < fs.life.size(); ++i)
+		if (fs.life[i] <= 0.0)
+			fs.life[i] += 1.0;
 }
 
 
 
-double explosion_particle::get_life_time() const
+void particle_system::return_freed_ids(type t)
 {
-	return 2.0; // seconds
+	if (!freed_ids.empty()) {
+		mutex_locker ml(command_mutex);
+		id_pools[t].free_ids.insert(id_pools[t].free_ids.end(), freed_ids.begin(), freed_ids.end());
+	}
+	freed_ids.clear();
 }
 
 
 
-// fire
+particle_system::worker::worker(particle_system& ps_)
+	: thread("particles"), ps(ps_), delta_t(0.0), done(true)
+{
+}
 
-fire_particle::fire_particle(const vector3& pos) : particle(pos)
+
+
+void particle_system::worker::request_abort()
 {
+	mutex_locker ml(mtx);
+	thread::request_abort();
+	cond.signal();
 }
 
 
 
-void fire_particle::simulate(game& gm, double delta_t)
+void particle_system::worker::loop()
 {
-	float lf = get_life_time();
-	float l = myfrac(life * lf);
-	if (l - lf * delta_t <= 0) {
-		gm.spawn_particle(new smoke_particle(position));
+	{
+		mutex_locker ml(mtx);
+		while (done && !abort_requested())
+			cond.wait(mtx);
+		if (abort_requested())
+			return;
 	}
-	particle::simulate(gm, delta_t);
-	if (life <= 0.0) {
-		life += 1.0;
+	ps.step(delta_t);
+	{
+		mutex_locker ml(mtx);
+		done = true;
+		condfini.signal();
 	}
 }
 
 
 
-double fire_particle::get_width() const
+void particle_system::worker::work(double dt)
 {
-	return 20.0; //fixme: depends on type
+	mutex_locker ml(mtx);
+	if (!done)
+		throw error("particle_system: work() called without sync before");
+	done = false;
+	delta_t = dt;
+	cond.signal();
 }
 
 
 
-double fire_particle::get_height() const
+void particle_system::worker::sync()
 {
-	return 20.0; //fixme: depends on type
+	mutex_locker ml(mtx);
+	while (!done)
+		condfini.wait(mtx);
 }
 
 
 
-const texture& fire_particle::get_tex_and_col(game& gm, const colorf& /*light_color*/, colorf& col) const
+double particle_system::get_produce_time(type t)
 {
-	col = colorf(1,1,1,1);
-	unsigned i = unsigned(tex_fire.size() * (1.0 - life));
-	return *tex_fire[i];
+	switch (t) {
+	case smoke: return 0.6; // seconds
+	case smoke_escort: return 0.3; // seconds
+	default: return 1e10;
+	}
 }
 
 
 
-double fire_particle::get_life_time() const
+double particle_system::get_life_time(type t)
 {
-	return 4.0; // seconds
+	switch (t) {
+	case smoke: return 30.0; // seconds
+	case smoke_escort: return 15.0;
+	case explosion: return 2.0;
+	case fire: return 4.0;
+	case spray: return 4.0;
+	default: return 1.0;
+	}
 }
 
 
 
-// spray
-
-spray_particle::spray_particle(const vector3& pos, const vector3& velo) : particle(pos, velo)
+double particle_system::get_width(type t, double life)
 {
+	// sizes in meters
+	switch (t) {
+	case smoke: return 2.0 * life + 50.0 * (1.0 - life);
+	case smoke_escort: return 2.0 * life + 25.0 * (1.0 - life);
+	case explosion: return 20.0; //fixme: depends on type
+	case fire: return 20.0; //fixme: depends on type
+	case spray: return (1.0 - life) * 6.0 + 2.0;
+	default: return 1.0;
+	}
 }
 
 
 
-double spray_particle::get_width() const
+double particle_system::get_height(type t, double life)
 {
-	return (1.0 - life) * 6.0 + 2.0;
+	double h = get_width(t, life);
+	if ((t == smoke || t == smoke_escort) && life > 0.9)
+		h *= (life - 0.8) * 10;
+	return h;
 }
 
 
 
-double spray_particle::get_height() const
+const texture& particle_system::get_tex_and_col(type t, unsigned idx, const colorf& light_color,
+						colorf& col, vector2f& texc0, vector2f& texc1) const
 {
-	return get_width();
+	const double life = front[t].life[idx];
+	texc0 = vector2f(0, 0);
+	texc1 = vector2f(1, 1);
+	switch (t) {
+	case smoke:
+	case smoke_escort: {
+		col = colorf(0.5f, 0.5f, 0.5f, life) * light_color;
+		unsigned tn = front[t].texnr[idx];
+		// inset by half a texel of the coarsest mipmap level, so linear
+		// filtering doesn't read the neighbouring images of the atlas
+		const float inset = 0.5f * (1 << SMOKE_ATLAS_MAX_LEVEL) / 256;
+		texc0 = vector2f((tn % 4) * 0.25f + inset, (tn / 4) * 0.25f + inset);
+		texc1 = texc0 + vector2f(0.25f - 2 * inset, 0.25f - 2 * inset);
+		return *particle::tex_smoke;
+	}
+	case explosion: {
+		col = colorf(1,1,1,1);
+		unsigned f = unsigned(EXPL_FRAMES * (1.0 - life));
+		if (f >= EXPL_FRAMES) f = EXPL_FRAMES-1;
+		// switch on type, fixme
+		return *particle::explosionbig[f];
+	}
+	case fire: {
+		col = colorf(1,1,1,1);
+		unsigned f = unsigned(particle::tex_fire.size() * (1.0 - life));
+		if (f >= particle::tex_fire.size()) f = particle::tex_fire.size()-1;
+		return *particle::tex_fire[f];
+	}
+	default:
+		col = colorf(1.0f, 1.0f, 1.0f, life) * light_color;
+		return *particle::tex_spray;
+	}
 }
 
 
 
-const texture& spray_particle::get_tex_and_col(game& gm, const colorf& light_color, colorf& col) const
+namespace {
+/// collects quads of particles with the same texture and renders them in one call
+struct particle_batch
 {
-	col = colorf(1.0f, 1.0f, 1.0f, life) * light_color;
-	return *tex_spray;
+	const texture* tex;
+	vector<vector3f> vertices;
+	vector<color> colors;
+	vector<vector2f> texcoords;
+	particle_batch() : tex(0) {}
+	void add(const texture& t, const vector3& pp, const vector3& x, const vector3& y,
+		 double w2, double hb, double ht, const colorf& col,
+		 const vector2f& texc0, const vector2f& texc1) {
+		if (tex != &t) {
+			flush();
+			tex = &t;
+		}
+		vertices.push_back(vector3f(pp - x*w2 + y*ht));
+		vertices.push_back(vector3f(pp + x*w2 + y*ht));
+		vertices.push_back(vector3f(pp + x*w2 + y*hb));
+		vertices.push_back(vector3f(pp - x*w2 + y*hb));
+		color c(col);
+		colors.push_back(c);
+		colors.push_back(c);
+		colors.push_back(c);
+		colors.push_back(c);
+		texcoords.push_back(vector2f(texc0.x, texc0.y));
+		texcoords.push_back(vector2f(texc1.x, texc0.y));
+		texcoords.push_back(vector2f(texc1.x, texc1.y));
+		texcoords.push_back(vector2f(texc0.x, texc1.y));
+	}
+	void flush() {
+		if (vertices.empty())
+			return;
+		glsl_shader_setup::default_coltex->use();
+		glsl_shader_setup::default_coltex->set_gl_texture(*tex, glsl_shader_setup::loc_ct_tex, 0);
+		glVertexPointer(3, GL_FLOAT, sizeof(vector3f), &vertices[0]);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glTexCoordPointer(2, GL_FLOAT, sizeof(vector2f), &texcoords[0]);
+		glVertexAttribPointer(glsl_shader_setup::idx_ct_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, &colors[0]);
+		glEnableVertexAttribArray(glsl_shader_setup::idx_ct_color);
+		glDrawArrays(GL_QUADS, 0, vertices.size());
+		glDisableVertexAttribArray(glsl_shader_setup::idx_ct_color);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		vertices.clear();
+		colors.clear();
+		texcoords.clear();
+	}
+};
 }
 
 
 
-double spray_particle::get_life_time() const
+void particle_system::display(const vector3& viewpos, const vector2& observer_pos, double max_view_dist,
+			      const colorf& light_color)
 {
-	return 4.0; // seconds
+	glDepthMask(GL_FALSE);
+	matrix4 mv = matrix4::get_gl(GL_MODELVIEW_MATRIX);
+	vector3 mvtrans = -mv.inverse().column3(3);
+
+	// compute distances, visibility and back to front order per stream.
+	// visibility is computed like lookout_sensor does for particles.
+	// the order of the last frame is found by particle ids, new particles
+	// are appended.
+	unsigned nr_visible = 0;
+	for (unsigned t = 0; t < nr_of_types; ++t) {
+		const stream& s = front[t];
+		view& v = views[t];
+		const unsigned n = s.life.size();
+		v.order.clear();
+		v.in_order.assign(n, 0);
+		for (unsigned i = 0; i < v.ids.size(); ++i) {
+			unsigned id = v.ids[i];
+			if (id < s.index_of_id.size() && s.index_of_id[id] >= 0) {
+				unsigned idx = unsigned(s.index_of_id[id]);
+				v.order.push_back(idx);
+				v.in_order[idx] = 1;
+			}
+		}
+		for (unsigned i = 0; i < n; ++i)
+			if (!v.in_order[i])
+				v.order.push_back(i);
+		v.dist.resize(n);
+		v.visible.resize(n);
+		for (unsigned i = 0; i < n; ++i) {
+			vector3 pp = mvtrans + vector3(s.px[i], s.py[i], s.pz[i]) - viewpos;
+			v.dist[i] = pp.square_length();
+			double dist = vector2(s.px[i] - observer_pos.x, s.py[i] - observer_pos.y).length();
+			double vis = std::max(get_width(type(t), s.life[i]) * get_height(type(t), s.life[i]), 100.0);
+			v.visible[i] = (dist < max_view_dist && (dist < 1.0 || vis/dist >= 0.05)) ? 1 : 0;
+			nr_visible += v.visible[i];
+		}
+		v.sort_order();
+		v.ids.resize(n);
+		for (unsigned i = 0; i < n; ++i)
+			v.ids[i] = s.ids[v.order[i]];
+	}
+
+	// merge the sorted streams and render runs of same texture in one batch
+	particle_batch batch;
+	batch.vertices.reserve(4 * nr_visible);
+	batch.colors.reserve(4 * nr_visible);
+	batch.texcoords.reserve(4 * nr_visible);
+	unsigned cursor[nr_of_types] = { 0 };
+	while (true) {
+		int bt = -1;
+		double bd = -1.0;
+		for (unsigned t = 0; t < nr_of_types; ++t) {
+			if (cursor[t] < views[t].order.size()) {
+				double d = views[t].dist[views[t].order[cursor[t]]];
+				if (d > bd) {
+					bd = d;
+					bt = int(t);
+				}
+			}
+		}
+		if (bt < 0)
+			break;
+		type t = type(bt);
+		const stream& s = front[t];
+		const view& v = views[t];
+		unsigned i = v.order[cursor[t]++];
+		if (!v.visible[i])
+			continue;
+		vector3 pp = vector3(s.px[i], s.py[i], s.pz[i]) - viewpos;
+		vector3 z = -(mvtrans + pp);
+		vector3 y = vector3(0, 0, 1);
+		vector3 x = y.cross(z).normal();
+		// check if we have true billboarding vs. z-aligned billboarding.
+		if (!is_z_up(t))
+			y = z.cross(x).normal();
+		double w2 = get_width(t, s.life[i])/2;
+		double ht = get_height(t, s.life[i]) * 0.5;
+		colorf col;
+		vector2f texc0, texc1;
+		const texture& tex = get_tex_and_col(t, i, light_color, col, texc0, texc1);
+		batch.add(tex, pp, x, y, w2, -ht, ht, col, texc0, texc1);
+	}
+	batch.flush();
+
+	glDepthMask(GL_TRUE);
 }
 
 
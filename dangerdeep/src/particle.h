@@ -23,7 +23,12 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #define PARTICLE_H
 
 #include "vector3.h"
+#include "vector2.h"
 #include "color.h"
+#include "mutex.h"
+#include "thread.h"
+#include "object_pool.h"
+#include "random_generator.h"
 #include <vector>
 
 class game;
@@ -31,12 +36,15 @@ class texture;
 
 // particles: smoke, water splashes, fire, explosions, spray caused by ship's bow
 // fire particles can produce smoke particles!
+// The mass particles (smoke, fire, explosions, spray) are handled by class
+// particle_system, class particle is used for special, rare particles only.
 
 typedef unsigned char Uint8;
 
 ///\brief Simulates and displays particles that are rendered as billboard images.
-class particle
+class particle : public pooled<particle>
 {
+	friend class particle_system;
 protected:
 	vector3 position;
 	vector3 velocity;
@@ -63,7 +71,7 @@ protected:
 	// particle textures (generated and stored once)
 	//fixme: why not use texture_cache here?
 	static unsigned init_count;
-	static std::vector<texture*> tex_smoke;
+	static texture* tex_smoke;	// all smoke images in one texture, 4x4 images
 	static texture* tex_spray;
 	static std::vector<texture*> tex_fire;
 	static std::vector<texture*> explosionbig;
@@ -120,75 +128,6 @@ public:
 
 
 
-class smoke_particle : public particle
-{
-	bool is_z_up() const { return false; }
-	unsigned texnr;
-	vector3 get_acceleration() const;
-public:
-	smoke_particle(const vector3& pos);//set velocity by wind, fixme
-	double get_width() const;
-	double get_height() const;
-	const texture& get_tex_and_col(game& gm, const colorf& light_color, colorf& col) const;
-	double get_life_time() const;
-	static double get_produce_time();
-};
-
-
-
-class smoke_particle_escort : public smoke_particle
-{
-public:
-	smoke_particle_escort(const vector3& pos);//set velocity by wind, fixme
-	double get_width() const;
-	double get_life_time() const;
-	static double get_produce_time();
-};
-
-
-
-class explosion_particle : public particle
-{
-	unsigned extype;	// which texture
-public:
-	// is_z_up could be false for this kind of particle
-	explosion_particle(const vector3& pos);
-	double get_width() const;
-	double get_height() const;
-	const texture& get_tex_and_col(game& gm, const colorf& light_color, colorf& col) const;
-	double get_life_time() const;
-};
-
-
-
-class fire_particle : public particle
-{
-//	unsigned firetype;	// which texture
-public:
-	// only particle where is_z_up should be true.
-	fire_particle(const vector3& pos);
-	void simulate(game& gm, double delta_t);
-	double get_width() const;
-	double get_height() const;
-	const texture& get_tex_and_col(game& gm, const colorf& light_color, colorf& col) const;
-	double get_life_time() const;
-};
-
-
-
-class spray_particle : public particle
-{
-public:
-	// is_z_up could be false for this kind of particle
-	spray_particle(const vector3& pos, const vector3& velo);
-	double get_width() const;
-	double get_height() const;
-	const texture& get_tex_and_col(game& gm, const colorf& light_color, colorf& col) const;
-	double get_life_time() const;
-};
-
-
-
 class fireworks_particle : public particle
 {
 	bool is_z_up() const { return false; }
@@ -227,4 +166,162 @@ public:
 	double get_life_time() const;
 };
 
+///\brief Simulates and displays the mass particles per type as struct of arrays.
+/** Each particle type is stored in its own stream of plain arrays, so the
+    simulation is a simple loop over arrays that the compiler can vectorize.
+    The state is double buffered. simulate() publishes the result of the
+    last step and starts the next step in a worker thread, which computes
+    the back buffer from the front buffer. So particles are simulated while
+    the front buffer is rendered and while ships are simulated, and the
+    number of particles doesn't add to the time of a simulation step.
+    The rendered state is one step behind the game.
+    The back to front order of the last frame is kept and updated with
+    insertion sort, because it changes only a bit from frame to frame.
+    Particles are rendered in batches, one draw call per run of particles with
+    the same texture.
+    Spawning, moving and killing particles is queued in a list that is
+    protected by a mutex and applied at the beginning of the next step, so
+    it is allowed from any thread.
+*/
+class particle_system
+{
+ public:
+	enum type {
+		smoke,
+		smoke_escort,
+		explosion,
+		fire,
+		spray,
+		nr_of_types
+	};
+
+	particle_system();
+	~particle_system();
+
+	/// spawn a particle, returns id of particle (never zero), unique per type
+	unsigned spawn(type t, const vector3& pos, const vector3& velo = vector3());
+
+	/// set position of particle, e.g. fire of a ship
+	void set_pos(type t, unsigned id, const vector3& pos);
+
+	/// remove particle, e.g. fire of a ship
+	void kill(type t, unsigned id);
+
+	/// remove all particles
+	void clear();
+
+	/// publish result of last step and start simulating the next step, fire spawns smoke
+	void simulate(double delta_t);
+
+	/// wait until the running step is finished, the result is published by the next simulate()
+	void sync();
+
+	/// render all particles that can be seen by an observer at given position
+	void display(const vector3& viewpos, const vector2& observer_pos, double max_view_dist,
+		     const colorf& light_color);
+
+	/// get number of particles of a type that are rendered
+	unsigned size(type t) const { return front[t].life.size(); }
+
+	/// get time between production of smoke particles of a type
+	static double get_produce_time(type t);
+
+	/// get life time in seconds of particles of a type
+	static double get_life_time(type t);
+
+ protected:
+	/// all particles of one type as struct of arrays
+	struct stream
+	{
+		std::vector<double> px, py, pz;
+		std::vector<double> vx, vy, vz;
+		std::vector<double> life;	// 0...1, 0 = faded out
+		std::vector<Uint8> texnr;
+		std::vector<unsigned> ids;
+		std::vector<int> index_of_id;	// -1 unused
+		void add(unsigned id, const vector3& pos, const vector3& velo, Uint8 texnr);
+		void copy_live(const stream& src, std::vector<unsigned>& freed_ids);
+		void compact(std::vector<unsigned>& freed_ids);
+		void integrate(double delta_t, double lifetime, double acc_z);
+		void swap(stream& other);
+	};
+
+	/// display data of one type, only used by display()
+	struct view
+	{
+		std::vector<unsigned> ids;	// particle ids in back to front order of last frame
+		std::vector<unsigned> order;
+		std::vector<double> dist;
+		std::vector<Uint8> visible;
+		std::vector<Uint8> in_order;
+		void sort_order();
+	};
+
+	/// ids of a type that can be given to new particles
+	struct id_pool
+	{
+		std::vector<unsigned> free_ids;
+		unsigned next_id;
+		id_pool() : next_id(1) {}	// id 0 is never used, so it can mean "no particle"
+		unsigned allocate();
+	};
+
+	struct command
+	{
+		enum kind { spawn, set_pos, kill };
+		kind k;
+		type t;
+		unsigned id;
+		vector3 pos;
+		vector3 velo;
+		command(kind k_, type t_, unsigned i, const vector3& p = vector3(), const vector3& v = vector3())
+			: k(k_), t(t_), id(i), pos(p), velo(v) {}
+	};
+
+	class worker : public thread
+	{
+		::mutex mtx;
+		condvar cond;
+		condvar condfini;
+		particle_system& ps;
+		double delta_t;
+		bool done;
+	public:
+		worker(particle_system& ps_);
+		void loop();
+		void request_abort();
+		void work(double dt);
+		void sync();
+	};
+
+	stream front[nr_of_types];	// result of last step, rendered
+	stream back[nr_of_types];	// computed by the worker
+	view views[nr_of_types];
+	id_pool id_pools[nr_of_types];
+	std::vector<command> commands;
+	std::vector<command> step_commands;	// commands taken by the running step
+	std::vector<unsigned> freed_ids;
+	::mutex command_mutex;	// protects commands and ids
+	random_generator rng;	// only used by step()
+
+	// computes back buffer from front buffer, run by worker
+	void step(double delta_t);
+
+	// give freed_ids back to the id pool of a type
+	void return_freed_ids(type t);
+
+	static double get_width(type t, double life);
+	static double get_height(type t, double life);
+	static bool is_z_up(type t) { return t != smoke && t != smoke_escort; }
+	const texture& get_tex_and_col(type t, unsigned idx, const colorf& light_color,
+				       colorf& col, vector2f& texc0, vector2f& texc1) const;
+
+	// stopped by the destructor before the data is destroyed
+	thread::auto_ptr<worker> myworker;
+
+ private:
+	particle_system(const particle_system& );
+	particle_system& operator= (const particle_system& );
+};
+
 #endif
@@ -28,11 +28,12 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include <memory>
 
 // same as std::list regarding the interface (partly), but handles pointers.
-template <class T>
+// The allocator is used for the list nodes only.
+template <class T, class A = std::allocator<T*> >
 class ptrlist
 {
  protected:
-	std::list<T*> data;
+	std::list<T*, A> data;
 
  private:
 	ptrlist(const ptrlist& );
@@ -102,13 +103,13 @@ class ptrlist
 
 	bool empty() const { return data.empty(); }
 
-	void swap(ptrlist<T>& other) { data.swap(other.data); }
+	void swap(ptrlist<T, A>& other) { data.swap(other.data); }
 
 	struct const_iterator
 	{
-		typename std::list<T*>::const_iterator it;
+		typename std::list<T*, A>::const_iterator it;
 
-		const_iterator(typename std::list<T*>::const_iterator i) : it(i) {}
+		const_iterator(typename std::list<T*, A>::const_iterator i) : it(i) {}
 		T& operator* () const { return *(*it); }
 		T* operator-> () const { return *it; }
 		const_iterator& operator++ () { ++it; return *this; }
@@ -122,9 +123,9 @@ class ptrlist
 
 	struct iterator
 	{
-		typename std::list<T*>::iterator it;
+		typename std::list<T*, A>::iterator it;
 
-		iterator(typename std::list<T*>::iterator i) : it(i) {}
+		iterator(typename std::list<T*, A>::iterator i) : it(i) {}
 		T& operator* () const { return *(*it); }
 		T* operator-> () const { return *it; }
 		iterator& operator++ () { ++it; return *this; }
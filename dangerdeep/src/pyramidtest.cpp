@@ -0,0 +1,219 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+// test of the tile codecs and the tile pyramid container
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "tile_pyramid.h"
+#include "lz_codec.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+using namespace std;
+
+static bool test_lz_codec()
+{
+	bool ok = true;
+	vector<Uint8> src, packed, unpacked;
+	// empty, tiny, constant, repetitive, random and mixed data
+	for (unsigned kind = 0; kind < 6; ++kind) {
+		unsigned n = (kind == 0) ? 0 : ((kind == 1) ? 7 : 70000);
+		src.resize(n);
+		for (unsigned i = 0; i < n; ++i) {
+			switch (kind) {
+			case 2: src[i] = 42; break;
+			case 3: src[i] = Uint8(i % 13 + (i / 1000) % 3); break;
+			case 5: src[i] = (i / 4096) & 1 ? Uint8(rand()) : Uint8(i / 7); break;
+			default: src[i] = Uint8(rand()); break;
+			}
+		}
+		packed.clear();
+		lz_codec::compress(src.empty() ? 0 : &src[0], n, packed);
+		unpacked.assign(n, 0xff);
+		lz_codec::decompress(packed.empty() ? 0 : &packed[0], packed.size(),
+				     unpacked.empty() ? 0 : &unpacked[0], n);
+		if (unpacked != src) {
+			cout << "lz_codec: round trip of data kind " << kind << " failed\n";
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+
+
+static void make_tile(morton_bivector<Sint16>& t, unsigned sz, const vector2i& idx)
+{
+	t.resize(sz);
+	for (unsigned y = 0; y < sz; ++y)
+		for (unsigned x = 0; x < sz; ++x)
+			t.at(x, y) = Sint16(2000.0 * sin((idx.x * sz + x) * 0.031) * cos((idx.y * sz + y) * 0.017)
+					    + rand() % 5 - 100);
+}
+
+
+
+static bool equal(const morton_bivector<Sint16>& a, const morton_bivector<Sint16>& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (unsigned y = 0; y < a.size(); ++y)
+		for (unsigned x = 0; x < a.size(); ++x)
+			if (a.at(x, y) != b.at(x, y))
+				return false;
+	return true;
+}
+
+
+
+static bool test_tile_codecs()
+{
+	bool ok = true;
+	const unsigned sz = 64;
+	morton_bivector<Sint16> t, d;
+	make_tile(t, sz, vector2i(3, 1));
+	t.at(5, 9) = tile_pyramid::no_data;
+	for (unsigned c = tile_pyramid::CODEC_NONE; c <= tile_pyramid::CODEC_LZ; ++c) {
+		vector<Uint8> packed;
+		Sint16 minh = 0, maxh = 0;
+		tile_pyramid::encode_tile(t, tile_pyramid::codec_type(c), packed, minh, maxh);
+		d.resize(sz);
+		tile_pyramid::decode_tile(&packed[0], packed.size(), tile_pyramid::codec_type(c), d);
+		Sint16 rmin = t.at(0, 0), rmax = t.at(0, 0);
+		for (unsigned y = 0; y < sz; ++y)
+			for (unsigned x = 0; x < sz; ++x)
+				if (t.at(x, y) != tile_pyramid::no_data) {
+					rmin = std::min(rmin, t.at(x, y));
+					rmax = std::max(rmax, t.at(x, y));
+				}
+		cout << "codec " << c << ": " << sz*sz*2 << " -> " << packed.size() << " bytes\n";
+		if (!equal(t, d)) {
+			cout << "codec " << c << ": tile round trip failed\n";
+			ok = false;
+		}
+		if (minh > rmin || maxh < rmax) {
+			cout << "codec " << c << ": wrong height range " << minh << "..." << maxh << "\n";
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+
+
+static bool test_pyramid(tile_pyramid::codec_type codec)
+{
+	const char* filename = "pyramidtest.pyr";
+	const unsigned sz = 32;
+	const vector2i tiles(5, 3);
+	bool ok = true;
+	vector<morton_bivector<Sint16> > level0(tiles.x * tiles.y);
+	{
+		tile_pyramid_writer w(filename, tiles, sz, codec);
+		for (int y = 0; y < tiles.y; ++y) {
+			for (int x = 0; x < tiles.x; ++x) {
+				// one tile has no data
+				if (x == 4 && y == 1)
+					continue;
+				make_tile(level0[y * tiles.x + x], sz, vector2i(x, y));
+				// some samples without data, they are skipped when averaging
+				if (x == 0 && y == 1) {
+					level0[y * tiles.x + x].at(0, 0) = tile_pyramid::no_data;
+					level0[y * tiles.x + x].at(2, 0) = tile_pyramid::no_data;
+					level0[y * tiles.x + x].at(3, 0) = tile_pyramid::no_data;
+					level0[y * tiles.x + x].at(2, 1) = tile_pyramid::no_data;
+					level0[y * tiles.x + x].at(3, 1) = tile_pyramid::no_data;
+				}
+				w.write_tile(0, vector2i(x, y), level0[y * tiles.x + x]);
+			}
+		}
+		w.build_coarser_levels();
+		w.close();
+	}
+	tile_pyramid p(filename);
+	if (p.get_tile_size() != sz || p.get_codec() != codec || p.get_nr_of_levels() != 4
+	    || !(p.get_level_tiles(0) == tiles) || !(p.get_level_tiles(3) == vector2i(1, 1))) {
+		cout << "pyramid: wrong header\n";
+		ok = false;
+	}
+	morton_bivector<Sint16> t;
+	for (int y = 0; y < tiles.y; ++y) {
+		for (int x = 0; x < tiles.x; ++x) {
+			bool exists = !(x == 4 && y == 1);
+			if (p.has_tile(0, vector2i(x, y)) != exists
+			    || (exists && (!p.read_tile(0, vector2i(x, y), t) || !equal(t, level0[y * tiles.x + x])))) {
+				cout << "pyramid: tile " << x << "," << y << " of level 0 wrong\n";
+				ok = false;
+			}
+		}
+	}
+	// level 1 sample is the average of the 2x2 level 0 samples that have data,
+	// tile data is top down, so the upper tile (2y+1) gives the first rows.
+	if (!p.read_tile(1, vector2i(0, 0), t)) {
+		cout << "pyramid: coarser tile missing\n";
+		return false;
+	}
+	unsigned h = sz / 2;
+	for (unsigned y = 0; y < sz && ok; ++y) {
+		for (unsigned x = 0; x < sz; ++x) {
+			unsigned qx = x / h, qy = y / h;
+			const morton_bivector<Sint16>& s = level0[(1 - qy) * tiles.x + qx];
+			unsigned sx = 2 * (x % h), sy = 2 * (y % h);
+			int sum = 0, n = 0;
+			for (unsigned k = 0; k < 4; ++k) {
+				Sint16 sv = s.at(sx + (k & 1), sy + (k >> 1));
+				if (sv != tile_pyramid::no_data) {
+					sum += sv;
+					++n;
+				}
+			}
+			Sint16 v = tile_pyramid::no_data;
+			if (n > 0)
+				v = Sint16(sum >= 0 ? (2*sum + n) / (2*n) : -((-2*sum + n) / (2*n)));
+			if (t.at(x, y) != v) {
+				cout << "pyramid: coarser sample " << x << "," << y << " is " << t.at(x, y)
+				     << ", should be " << v << "\n";
+				ok = false;
+				break;
+			}
+		}
+	}
+	vector<Uint8> packed;
+	if (!p.read_compressed_tile(0, vector2i(2, 2), packed) || packed.size() != p.get_tile_info(0, vector2i(2, 2)).size) {
+		cout << "pyramid: compressed tile wrong\n";
+		ok = false;
+	}
+	remove(filename);
+	return ok;
+}
+
+
+
+int main(int, char**)
+{
+	srand(17);
+	bool ok = test_lz_codec();
+	ok = test_tile_codecs() && ok;
+	for (unsigned c = tile_pyramid::CODEC_NONE; c <= tile_pyramid::CODEC_LZ; ++c)
+		ok = test_pyramid(tile_pyramid::codec_type(c)) && ok;
+	cout << (ok ? "OK" : "FAILED") << "\n";
+	return ok ? 0 : 1;
+}
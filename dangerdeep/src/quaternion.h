@@ -74,8 +74,9 @@ class quaterniont
 	// reverse operation: angle * 2 * 180
 	void angleaxis(D& angle, D& x, D& y, D& z) const { D a = acos(s); angle = D(a*360.0/M_PI); D sa = sin(a); x = v.x/sa; y = v.y/sa; z = v.z/sa; }
 	void angleaxis(D& angle, vector3t<D>& axis) const { D a = acos(s); angle = D(a*360.0/M_PI); axis = v * (D(1.0)/sin(a)); }
-	vector3t<D> rotate(const D& x, const D& y, const D& z) const { quaterniont<D> p2 = *this * vec(x, y, z) * this->conj(); return p2.v; }
-	vector3t<D> rotate(const vector3t<D>& p) const { quaterniont<D> p2 = *this * vec(p) * this->conj(); return p2.v; }
+	vector3t<D> rotate(const D& x, const D& y, const D& z) const { return rotate(vector3t<D>(x, y, z)); }
+	// q*p*conj(q) expanded, needs half of the operations of two quaternion products
+	vector3t<D> rotate(const vector3t<D>& p) const { return p * (s*s - v*v) + v * (D(2)*(v*p)) + v.cross(p) * (D(2)*s); }
 	
 	quaterniont<D> scale_rot_angle(const D& scal)
 	{
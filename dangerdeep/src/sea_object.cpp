@@ -575,25 +575,83 @@ void sea_object::simulate(double delta_time)
 	compress(visible_objects);
 	compress(radar_objects);
 
-	// check for redection jobs and eventually (re)create list of detected objects
-	if (detect_other_sea_objects()) {
-		redetect_time -= delta_time;
-		if (redetect_time <= 0) {
-			//fixme: doing this for every object leads to N^2 sensor tests per second.
-			//until now this was done for the player only leading to N*fps tests per second, which is
-			//more for a small number of objects, but less than for greater N (> 30).
-			//this can be a problem, but even with 120 ships we have 14400 sensor checks per second only
-			//and this is not much. On the other hand we need to check for each ship if it can see
-			//other ships to make the AI work correctly (like collision avoidance).
-			//We can decrease the needed cpu usage easily by increasing the redection cycles to 5 seconds
-			//or so, which is still realistic.
-			visible_objects = gm.visible_sea_objects(this);
-			radar_objects = gm.radar_sea_objects(this);
-			sonar_objects = gm.sonar_sea_objects(this);
-			redetect_time = 1.0;	// fixme: maybe make it variable, depending on the object type.
-		}
-	}
+	// redetection of other objects is scheduled by game, see game::schedule_redetection
+
+	// integrate position, orientation and momenta
+	integrate(delta_time);
+
+	// OLD COMMENT, BUT STILL HELPFUL:
+	// this leads to another model for acceleration/max_speed/turning etc.
+	// the object applies force to the screws etc. with Force = acceleration * mass.
+	// there is some drag caused by air/water opposite to the force.
+	// this drag damps the speed curve so that acceleration is zero at speed==max_speed.
+	// drag depends on speed (v or v^2).
+	// v = v0 + a * delta_t, v <= v_max, a = engine_force/mass - drag
+	// now we have: drag(v) = max_accel = engine_force/mass.
+	// and: v=v_max, hence: drag(v_max) = max_accel, max_accel is given, v_max too.
+	// so choose a drag formula: factor*v or factor*v^2 and compute factor.
+	// we have: factor*v_max^2 = max_accel => factor = max_accel/v_max^2
+	// finally: v = v0 + delta_t * (max_accel - dragfactor * v0^2)
+	// if v0 == 0 then we have maximum acceleration.
+	// acceleration lowers quadratically until we have maximum velocity.
+	// we also have side drag (limit turning speed!):
+
+	// compute force for some velocity v: find accel so that accel - dragfactor * v^2 = 0
+	// hence: accel = dragfactor * v^2, this means force is proportional to square
+	// of speed -> fuel comsumption depends ~quadratically on speed.
+	// To throttle to a given speed, apply max_accel until we have it then apply accel.
+	// In reality engine throttle could translate directly to acceleration, this means
+	// with 1/2 throttle we just use constant acceleration of 1/2*max_accel.
+	// This leads to a maximum speed determined by drag, but time until that
+	// speed is reached is much longer compared to using max_accel.
+
+	// drag: drag force is -b * v (low speeds), -b * v^2 (high speeds)
+	// b is proportional to cross section area of body.
+
+	// more difficult: change acceleration to match a certain position (or angle)
+	// s = s0 + v0 * t + a/2 * t^2, v = v0 + a * t
+	// compute a over time so that s_final = s_desired and v_final = 0, with arbitrary s0,v0.
+	// a can be 0<=a<=max_accel. three phases (in time) speed grows until max_speed,
+	// constant max speed, speed shrinks to zero (sometimes only phases 1 and 3 needed).
+	// determine phase, in phase 1 and 2 give max. acceleration, in phase 3 give zero.
+	// or even give -max_accel is phase 3 (turn rudder to opposite with full throttle
+	// to stop motion fastly)
+
+	// Screw force splits in forward force and sideward force (dependend on rudder position)
+	// so compute side drag from turn_rate
+	// compute turn_rate to maximum angular velocity, limited by ship's draught and shape.
+
+	// we store velocity/acceleration, not momentum/force/torque
+	// in reality applied force is transformed by inertia tensor, which is rotated according to
+	// orientation. we don't use mass here, so apply rotation to stored velocity/acceleration.
+	//fixme: use orientation here and compute heading from it, not vice versa!
+}
+
+
+
+bool sea_object::count_down_redetection(double delta_time)
+{
+	if (!detect_other_sea_objects() || !is_reference_ok())
+		return false;
+	redetect_time -= delta_time;
+	return redetect_time <= 0;
+}
 
+
+
+void sea_object::set_detected_objects(std::vector<sea_object*>& vis, std::vector<sea_object*>& rad,
+				      std::vector<sonar_contact>& son, double next_redetect_time)
+{
+	visible_objects.swap(vis);
+	radar_objects.swap(rad);
+	sonar_objects.swap(son);
+	redetect_time = next_redetect_time;
+}
+
+
+
+void sea_object::integrate(double delta_time)
+{
 	// get force and torque for current time.
 	vector3 force, torque;
 	compute_force_and_torque(force, torque);
@@ -660,52 +718,6 @@ void sea_object::simulate(double delta_time)
 
 	// update helper variables
 	compute_helper_values();
-
-	// OLD COMMENT, BUT STILL HELPFUL:
-	// this leads to another model for acceleration/max_speed/turning etc.
-	// the object applies force to the screws etc. with Force = acceleration * mass.
-	// there is some drag caused by air/water opposite to the force.
-	// this drag damps the speed curve so that acceleration is zero at speed==max_speed.
-	// drag depends on speed (v or v^2).
-	// v = v0 + a * delta_t, v <= v_max, a = engine_force/mass - drag
-	// now we have: drag(v) = max_accel = engine_force/mass.
-	// and: v=v_max, hence: drag(v_max) = max_accel, max_accel is given, v_max too.
-	// so choose a drag formula: factor*v or factor*v^2 and compute factor.
-	// we have: factor*v_max^2 = max_accel => factor = max_accel/v_max^2
-	// finally: v = v0 + delta_t * (max_accel - dragfactor * v0^2)
-	// if v0 == 0 then we have maximum acceleration.
-	// acceleration lowers quadratically until we have maximum velocity.
-	// we also have side drag (limit turning speed!):
-
-	// compute force for some velocity v: find accel so that accel - dragfactor * v^2 = 0
-	// hence: accel = dragfactor * v^2, this means force is proportional to square
-	// of speed -> fuel comsumption depends ~quadratically on speed.
-	// To throttle to a given speed, apply max_accel until we have it then apply accel.
-	// In reality engine throttle could translate directly to acceleration, this means
-	// with 1/2 throttle we just use constant acceleration of 1/2*max_accel.
-	// This leads to a maximum speed determined by drag, but time until that
-	// speed is reached is much longer compared to using max_accel.
-
-	// drag: drag force is -b * v (low speeds), -b * v^2 (high speeds)
-	// b is proportional to cross section area of body.
-
-	// more difficult: change acceleration to match a certain position (or angle)
-	// s = s0 + v0 * t + a/2 * t^2, v = v0 + a * t
-	// compute a over time so that s_final = s_desired and v_final = 0, with arbitrary s0,v0.
-	// a can be 0<=a<=max_accel. three phases (in time) speed grows until max_speed,
-	// constant max speed, speed shrinks to zero (sometimes only phases 1 and 3 needed).
-	// determine phase, in phase 1 and 2 give max. acceleration, in phase 3 give zero.
-	// or even give -max_accel is phase 3 (turn rudder to opposite with full throttle
-	// to stop motion fastly)
-
-	// Screw force splits in forward force and sideward force (dependend on rudder position)
-	// so compute side drag from turn_rate
-	// compute turn_rate to maximum angular velocity, limited by ship's draught and shape.
-
-	// we store velocity/acceleration, not momentum/force/torque
-	// in reality applied force is transformed by inertia tensor, which is rotated according to
-	// orientation. we don't use mass here, so apply rotation to stored velocity/acceleration.
-	//fixme: use orientation here and compute heading from it, not vice versa!
 }
 
 
@@ -793,23 +805,23 @@ vector2 sea_object::get_engine_noise_source () const
 
 
 
-void sea_object::display(const texture *caustic_map) const
+void sea_object::display(const texture *caustic_map, unsigned lod) const
 {
 	if (mymodel) {
 //		cout << "render with skin layout = " << skin_name << "\n";
 		mymodel->set_layout(skin_name);
-		mymodel->display(caustic_map);
+		mymodel->display(caustic_map, lod);
 	}
 }
 
 
 
-void sea_object::display_mirror_clip() const
+void sea_object::display_mirror_clip(unsigned lod) const
 {
 	if (mymodel) {
 //		cout << "renderMC with skin layout = " << skin_name << "\n";
 		mymodel->set_layout(skin_name);
-		mymodel->display_mirror_clip();
+		mymodel->display_mirror_clip(lod);
 	}
 }
 
@@ -221,6 +221,10 @@ protected:
 	///@param T the torque in world space, default (0, 0, 0).
 	virtual void compute_force_and_torque(vector3& F, vector3& T) const;
 
+	/// integrate rigid body state over one time step, called by simulate().
+	/// overload to replace the rigid body model by a cheaper one.
+	virtual void integrate(double delta_time);
+
 	/// recomputes *_velocity, heading etc.
 	void compute_helper_values();
 
@@ -370,8 +374,9 @@ public:
 	virtual double get_noise_factor () const { return 0; }
 	virtual vector2 get_engine_noise_source () const;
 
-	virtual void display(const texture *caustic_map=NULL) const;
-	virtual void display_mirror_clip() const;
+	/// display model with given level of detail (see model::get_lod_for_screen_size)
+	virtual void display(const texture *caustic_map=NULL, unsigned lod = 0) const;
+	virtual void display_mirror_clip(unsigned lod = 0) const;
 	double get_bounding_radius() const { return size3d.x+size3d.y; }	// fixme: could be computed more exact
 	virtual void set_skin_layout(const std::string& layout);
 
@@ -382,6 +387,17 @@ public:
 	virtual const std::vector<sea_object*>& get_radar_objects() const { return radar_objects; }
 	virtual const std::vector<sonar_contact>& get_sonar_objects() const { return sonar_objects; }
 
+	/// count down time until next redetection of other objects.
+	/// @returns true if the object detects other objects and redetection is due.
+	bool count_down_redetection(double delta_time);
+	/// time left until redetection, negative if overdue.
+	double get_redetect_time() const { return redetect_time; }
+	/// time between redetections of other objects, may depend on type.
+	virtual double get_redetect_interval() const { return 1.0; }
+	/// store new lists of detected objects, swaps contents with the given lists.
+	void set_detected_objects(std::vector<sea_object*>& vis, std::vector<sea_object*>& rad,
+				  std::vector<sonar_contact>& son, double next_redetect_time);
+
 	// check for a vector of pointers if the objects are still alive
 	// and remove entries of dead objects (do not delete the objects itself!)
 	// and compress the vector afterwars.
@@ -390,6 +406,7 @@ public:
 
 	/// get reference to model of this object, throws error if no model
 	class model& get_model() const;
+	bool has_model() const { return mymodel != 0; }
 
 	/// get minimum and maximum voxel index covering a point (polygon) set
 	///@returns number of voxels covered
@@ -171,8 +171,10 @@ ship::ship(game& gm_, const xml_elem& parent)
 	  max_speed_forward(10),
 	  max_speed_reverse(0),
 	  fuel_level(0),
+	  previous_positions(TRAIL_LENGTH),
 	  flooding_speed(0),
 	  max_flooded_mass(0),
+	  far_physics(false),
 	  myfire(0),		
 	  gun_manning_is_changing(false),
 	  maximum_gun_range(0.0)
@@ -286,7 +288,7 @@ void ship::sink()
 	flooding_speed += 40000; // 40 tons per second
 	sea_object::set_inactive();
 	if (myfire) {
-		myfire->kill();
+		gm.get_particle_system().kill(particle_system::fire, myfire);
 		myfire = 0;
 	}
 }
@@ -296,11 +298,10 @@ void ship::sink()
 void ship::ignite()
 {
 	if (myfire) {
-		myfire->kill();
+		gm.get_particle_system().kill(particle_system::fire, myfire);
 		myfire = 0;
 	}
-	myfire = new fire_particle(get_pos());
-	gm.spawn_particle(myfire);
+	myfire = gm.spawn_particle(particle_system::fire, get_pos());
 }
 
 
@@ -330,10 +331,9 @@ void ship::remember_position(double t)
 	// do NOT remember position if it is closer than 5m to the last position.
 	// problem is that for non-moving objects all positions are identical.
 	vector2 p = get_pos().xy();
-	if (previous_positions.empty() || previous_positions.front().pos.square_distance(p) >= 25.0) {
-		previous_positions.push_front(prev_pos(p, get_heading().direction(), t, get_speed()));
-		if (previous_positions.size() > TRAIL_LENGTH)
-			previous_positions.pop_back();
+	if (previous_positions.empty() || previous_positions.front_pos().square_distance(p) >= 25.0) {
+		// buffer drops oldest position when TRAIL_LENGTH is reached
+		previous_positions.push_front(p, get_heading().direction(), t, get_speed());
 	}
 }	
 
@@ -427,7 +427,7 @@ void ship::load(const xml_elem& parent)
 		fiss >> flooded_mass[j];
 
 	// fixme load that
-	//list<prev_pos> previous_positions;
+	//trail_buffer previous_positions;
 	//class particle* myfire;
 
 	//fixme: load per gun data
@@ -504,7 +504,7 @@ void ship::save(xml_elem& parent) const
 	esink.add_child_text(foss.str());
 
 	// fixme save that
-	//list<prev_pos> previous_positions;
+	//trail_buffer previous_positions;
 	//class particle* myfire;
 
 	//fixme: save per gun data
@@ -628,7 +628,7 @@ void ship::simulate(double delta_time)
 
 	// adjust fire pos if burning
 	if (myfire) {
-		myfire->set_pos(get_pos() + vector3(0, 0, 12));
+		gm.get_particle_system().set_pos(particle_system::fire, myfire, get_pos() + vector3(0, 0, 12));
 	}
 
 	if (causes_spray()) {
@@ -640,8 +640,8 @@ void ship::simulate(double delta_time)
 				vector3 forward = velocity.normal();
 				vector3 sideward = forward.cross(vector3(0, 0, 1)).normal() * 2.0;//speed 2.0 m/s
 				vector3 spawnpos = get_pos() + forward * (get_length() * 0.5);
-				gm.spawn_particle(new spray_particle(spawnpos, sideward));
-				gm.spawn_particle(new spray_particle(spawnpos, -sideward));
+				gm.spawn_particle(particle_system::spray, spawnpos, sideward);
+				gm.spawn_particle(particle_system::spray, spawnpos, -sideward);
 			}
 		}
 	}
@@ -649,22 +649,14 @@ void ship::simulate(double delta_time)
 	// smoke particle generation logic
 	if (is_alive()) {
 		for (list<pair<unsigned, vector3> >::iterator it = smoke.begin(); it != smoke.end(); ++it) {
-			double produce_time = 1e10;
-			switch (it->first) {
-			case 1: produce_time = smoke_particle::get_produce_time(); break;
-			case 2: produce_time = smoke_particle_escort::get_produce_time(); break;
-			}
+			particle_system::type pt = (it->first == 2) ? particle_system::smoke_escort : particle_system::smoke;
+			double produce_time = (it->first == 1 || it->first == 2) ? particle_system::get_produce_time(pt) : 1e10;
 			double t = myfmod(gm.get_time(), produce_time);
 			if (t + delta_time >= produce_time) {
-				particle* p = 0;
 				// handle orientation here!
 				// maybe add some random offset, but it don't seems necessary
 				vector3 ppos = position + orientation.rotate(it->second);
-				switch (it->first) {
-				case 1: p = new smoke_particle(ppos); break;
-				case 2: p = new smoke_particle_escort(ppos); break;
-				}
-				gm.spawn_particle(p);
+				gm.spawn_particle(pt, ppos);
 			}
 		}
 	}
@@ -703,6 +695,63 @@ void ship::simulate(double delta_time)
 }
 
 
+void ship::integrate(double delta_time)
+{
+	if (far_physics)
+		integrate_kinematic(delta_time);
+	else
+		sea_object::integrate(delta_time);
+}
+
+
+
+void ship::integrate_kinematic(double delta_time)
+{
+	// move with velocity of last step, like the rigid body model does.
+	position += velocity * delta_time;
+
+	// forward speed: throttle acceleration minus quadratic drag,
+	// see compute_force_and_torque.
+	double v = local_velocity.y;
+	if (max_speed_forward > 0) {
+		double drag_factor = max_accel_forward / (max_speed_forward*max_speed_forward);
+		v += (get_throttle_accel() - drag_factor * v * fabs(v)) * delta_time;
+	}
+
+	// turn_rate is angle change per meter of forward motion at full rudder.
+	// turn velocity is mathematical CCW, rudder to the right turns clockwise.
+	double tv = -rudder.angle / rudder.max_angle * turn_rate * v;
+	orientation = quaternion::rot(tv * delta_time, 0, 0, 1) * orientation;
+	if (fabs(orientation.square_length() - 1.0) > 1e-8)
+		orientation.normalize();
+
+	linear_momentum = orientation.rotate(vector3(0, v, 0)) * mass;
+	angular_momentum = orientation.rotate(inertia_tensor * vector3(0, 0, tv * (M_PI/180.0)));
+	compute_helper_values();
+}
+
+
+
+void ship::set_far_physics(bool f)
+{
+	if (f == far_physics)
+		return;
+	far_physics = f;
+	if (far_physics) {
+		// keep only heading, forward speed and turn velocity
+		double v = local_velocity.y;
+		double tv = turn_velocity;
+		orientation = quaternion::rot(-heading.value(), 0, 0, 1);
+		linear_momentum = orientation.rotate(vector3(0, v, 0)) * mass;
+		angular_momentum = orientation.rotate(inertia_tensor * vector3(0, 0, tv * (M_PI/180.0)));
+		compute_helper_values();
+	}
+	// on promotion the rigid body model continues from the upright state,
+	// buoyancy lets the ship settle into the waves again.
+}
+
+
+
 //#include "global_data.h"
 void ship::steering_logic()
 {
@@ -865,11 +914,12 @@ void ship::compute_force_and_torque(vector3& F, vector3& T) const
 	   we need to know per-voxel-lift force. That is voxel volume in
 	   cubic meters by 1000kg by 9,81m/s^2, as each cubic meter of water gives
 	   9,81kN lift force.
-	   It would be much more efficient to store the relative position of the
-	   voxel in integer numbers and compute the delta-vectors depending
-	   on transformation (orientation included) to avoid a matrix-vector
-	   multiplication per voxel. then use linear combination of the
-	   delta vectors by relative position to get real word position.
+	   The relative position of the voxels is stored in integer numbers,
+	   we compute the delta-vectors depending on transformation (orientation
+	   included) to avoid a matrix-vector multiplication per voxel and use a
+	   linear combination of the delta vectors by relative position to get
+	   real word position. Voxel data is stored as struct of arrays and
+	   processed in blocks of 8 voxels, so the compiler can vectorize it.
 	*/
 
 	// fixme: add linear drag with small factor, to hinder small
@@ -881,11 +931,10 @@ void ship::compute_force_and_torque(vector3& F, vector3& T) const
 	//        should be done frequently...
 
 	double lift_force_sum = 0; // = -GRAVITY * mass;
-	//double debug_liftforcesum=0,debug_gravityforcesum=0;
 	vector3 dr_torque;
-	const std::vector<model::voxel>& voxel_data = mymodel->get_voxel_data();
+	const model::voxel_arrays& voxels = mymodel->get_voxel_arrays();
 	const vector3f& voxel_size = mymodel->get_voxel_size();
-	const float voxel_radius = mymodel->get_voxel_radius();
+	const float voxel_radius_rcp = 1.0f / mymodel->get_voxel_radius();
 	// Note! voxel_vol is volume of voxel measure from model file. However this
 	// may not be the exact volume of the model (with historical accuary),
 	// thus we use the stored tonnage from the spec file as the volume,
@@ -897,47 +946,52 @@ void ship::compute_force_and_torque(vector3& F, vector3& T) const
 	const double volume_scale = /*(tonnage == 0) ? 1.0 :*/ spec_volume / model_volume;
 	const float voxel_vol = voxel_size.x * voxel_size.y * voxel_size.z
 		* volume_scale;
-	const double voxel_vol_force = voxel_vol * GRAVITY * 1000.0; // 1000kg per cubic meter
+	const float voxel_vol_force = voxel_vol * GRAVITY * 1000.0; // 1000kg per cubic meter
 	const matrix4f transmat = orientation.rotmat4() * mymodel->get_base_mesh_transformation()
 		* matrix4f::diagonal(voxel_size);
-	double vol_below_water=0;
-	const double gravity_force = mass * -GRAVITY;
-	//fixme: split loop to two cores to speed up physics a tiny bit
-	//takes 21-23ms for 1000 times, so whole loop has ca.
-	//52500-57500 cycles. cpu usage is rather low, at
-	//30% at 60fps vsync, so total cpu time is
-	//750,000,000 cycles, and this loop 7/1000 per cent
-	//of full cpu time, so multicore wont help much here,
-	//most cpu time is spent elsewhere
-	for (unsigned i = 0; i < voxel_data.size(); ++i) {
-		// instead of a per-voxel matrix-vector multiplication we could
-		// transform all other vectors to mesh-vertex-space and skip
-		// the matrix multiplication here, then later re-transform the
-		// resulting force-vectors back to model space.
-		// we know here that transmat only has non-projective part
-		// so mul4vec3xlat is sufficient.
-		vector3f p = transmat.mul4vec3xlat(voxel_data[i].relative_position);
-		//std::cout << "i=" << i << " voxeldata " << voxel_data[i].relative_position << " p=" << p << "\n";
-		float wh = gm.compute_water_height(vector2(position.x + p.x, position.y + p.y));
-		//std::cout << "i=" << i << " p=" << p << " wh=" << wh << "\n";
-		double voxel_below_water = std::max(std::min((p.z + position.z - wh) / voxel_radius, 1.0), -1.0);
-		if (voxel_below_water < 1.0 /*p.z + position.z < wh*/) {
+	// position of voxel is origin + x * dx + y * dy + z * dz
+	// we know here that transmat only has non-projective part.
+	const vector3f origin = transmat.mul4vec3xlat(voxels.grid_offset);
+	const vector3f dx = transmat.column3(0), dy = transmat.column3(1), dz = transmat.column3(2);
+	const float gravity_force = mass * -GRAVITY;
+	const float posz = position.z;
+	const vector2 posxy = position.xy();
+	const unsigned nr_voxels = voxels.size();
+	const unsigned block_size = 8;
+	float px[block_size], py[block_size], pz[block_size], wh[block_size];
+	for (unsigned b = 0; b < nr_voxels; b += block_size) {
+		const unsigned n = std::min(block_size, nr_voxels - b);
+		const short* gx = &voxels.grid_x[b];
+		const short* gy = &voxels.grid_y[b];
+		const short* gz = &voxels.grid_z[b];
+		for (unsigned k = 0; k < n; ++k) {
+			float fx = gx[k], fy = gy[k], fz = gz[k];
+			px[k] = origin.x + fx * dx.x + fy * dy.x + fz * dz.x;
+			py[k] = origin.y + fx * dx.y + fy * dy.y + fz * dz.y;
+			pz[k] = origin.z + fx * dx.z + fy * dy.z + fz * dz.z;
+		}
+		gm.compute_water_heights(posxy, px, py, wh, n);
+		// sum of lift force and gravity per voxel, acting along z-axis only,
+		// so torque is p.cross(0, 0, f) = (p.y * f, -p.x * f, 0)
+		const float* pov = &voxels.part_of_volume[b];
+		const float* rm = &voxels.relative_mass[b];
+		const float* fm = &flooded_mass[b];
+		float fsum = 0, txsum = 0, tysum = 0;
+		for (unsigned k = 0; k < n; ++k) {
 			// voxels partly below water must be computed or torque is severely wrong
-			double submerged_part = 1.0 - (voxel_below_water + 1.0) * 0.5;
-			double lift_force = voxel_data[i].part_of_volume * voxel_vol_force * submerged_part;
-			vol_below_water += voxel_data[i].part_of_volume * submerged_part;
-			lift_force_sum += lift_force;
-			//debug_liftforcesum+=lift_force;
-			vector3 lift_torque = p.cross(vector3(0, 0, lift_force));
-			dr_torque += lift_torque;
-			//std::cout << "i=" << i << " subm=" << submerged_part << " vdw=" << voxel_data[i].part_of_volume << " lift_force=" << lift_force << " lift_torque=" << lift_torque << "\n";
+			float voxel_below_water = std::max(std::min((pz[k] + posz - wh[k]) * voxel_radius_rcp, 1.0f), -1.0f);
+			float submerged_part = 1.0f - (voxel_below_water + 1.0f) * 0.5f;
+			float lift_force = pov[k] * voxel_vol_force * submerged_part;
+			// add part because of flooding
+			float relative_gravity_force = gravity_force * rm[k] + fm[k] * float(-GRAVITY);
+			float f = lift_force + relative_gravity_force;
+			fsum += f;
+			txsum += py[k] * f;
+			tysum -= px[k] * f;
 		}
-		double relative_gravity_force = gravity_force * voxel_data[i].relative_mass;
-		// add part because of flooding
-		relative_gravity_force += flooded_mass[i] * -GRAVITY;
-		lift_force_sum += relative_gravity_force;
-		//debug_gravityforcesum+=relative_gravity_force;
-		dr_torque += p.cross(vector3(0, 0, relative_gravity_force));
+		lift_force_sum += fsum;
+		dr_torque.x += txsum;
+		dr_torque.y += tysum;
 	}
 //	std::cout << "mass=" << mass << " lift_force_sum=" << lift_force_sum << " grav=" << -GRAVITY*mass << "\n";
 //	std::cout << "vol below water=" << vol_below_water << " of " << voxel_data.size() << "\n";
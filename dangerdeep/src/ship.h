@@ -26,6 +26,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include <map>
 #include "sea_object.h"
 #include "bv_tree.h"
+#include "trail_buffer.h"
 
 class game;
 
@@ -70,17 +71,6 @@ class ship : public sea_object
 	// maximum trail record length
 	static const unsigned TRAIL_LENGTH = 60;
 
-	// all data for a previous position
-	struct prev_pos {
-		vector2 pos;	// (center) pos of ship
-		vector2 dir;	// direction (heading) of ship
-		double time;	// absolute time when position was recorded
-		double speed;	// speed of ship when position was recorded
-		prev_pos(const vector2& p, const vector2& d, double t, double s)
-			: pos(p), dir(d), time(t), speed(s) {}
-		// add xml load/save functions here, fixme
-	};
-
  protected:
 	unsigned tonnage;	// in BRT, created after values from spec file, must get stored!
 
@@ -147,7 +137,7 @@ class ship : public sea_object
 	// sonar / underwater sound specific constants, read from spec file
 	noise_signature noise_sign;
 
-	std::list<prev_pos> previous_positions;
+	trail_buffer previous_positions;	// add xml load/save here, fixme
 
 	shipclass myclass;	// read from spec file, e.g. warship/merchant/escort/...
 
@@ -165,6 +155,17 @@ class ship : public sea_object
 
 	void compute_force_and_torque(vector3& F, vector3& T) const; // drag must be already included!
 
+	/// physics level of detail, when set only the kinematic model is used.
+	bool far_physics;
+
+	/// full rigid body simulation or kinematic model, depending on far_physics.
+	void integrate(double delta_time);
+
+	/// cheap course/speed model for ships far away from the player: speed
+	/// follows throttle with the same drag law as the full model, heading
+	/// follows rudder with turn_rate, no buoyancy, pitch or roll.
+	void integrate_kinematic(double delta_time);
+
 	/// implementation of the steering logic: helmsman simulation, or simpler model for torpedoes.
 	virtual void steering_logic();
 	/// return the acceleration factor for computing torque (depends on rudder area etc.)
@@ -192,8 +193,8 @@ class ship : public sea_object
 	// smoke, list of smoke generators. Give type and relative position for each generator
 	std::list<std::pair<unsigned, vector3> > smoke;
 
-	// pointer to fire particle (0 means ship is not burning)
-	particle* myfire;
+	// id of fire particle (0 means ship is not burning)
+	unsigned myfire;
 	
 	virtual bool causes_spray() const { return true; }
 	
@@ -280,8 +281,19 @@ public:
 
 	virtual shipclass get_class() const { return myclass; }
 
+	// merchants need their sensors for collision avoidance only, check less often.
+	virtual double get_redetect_interval() const { return (myclass == MERCHANT) ? 2.0 : 1.0; }
+
 	virtual void simulate(double delta_time);
 
+	/** switch between full rigid body physics and kinematic model.
+	    State is continued seamlessly: on demotion pitch and roll are dropped,
+	    heading, forward speed and turn velocity are kept, and the kinematic
+	    state is a valid rigid body state for promotion.
+	*/
+	void set_far_physics(bool f);
+	bool has_far_physics() const { return far_physics; }
+
 	virtual void sink();
 
 	virtual void ignite();
@@ -301,7 +313,7 @@ public:
 	virtual void set_throttle(int thr);
 
 	virtual void remember_position(double t);
-	virtual const std::list<prev_pos>& get_previous_positions() const { return previous_positions; }
+	virtual const trail_buffer& get_previous_positions() const { return previous_positions; }
 
 	virtual bool has_smoke() const { return !smoke.empty(); }
 
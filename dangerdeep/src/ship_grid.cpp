@@ -0,0 +1,131 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// spatial index of ships for torpedo/shell queries
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "ship_grid.h"
+#include <algorithm>
+#include <cmath>
+
+/* Each entry is referenced by every cell that its bounding circle's bbox
+   touches. The references are kept in one vector sorted by cell, so a query
+   is a binary search per touched cell and needs no per-cell containers.
+   Convoys have some dozen ships and cells are larger than ships, so each
+   entry is referenced by one to four cells normally.
+*/
+
+ship_grid::ship_grid(double cellsize_)
+	: cellsize(cellsize_)
+{
+}
+
+
+
+void ship_grid::clear()
+{
+	entries.clear();
+	cells.clear();
+}
+
+
+
+int ship_grid::cell_coord(double v) const
+{
+	return int(floor(v / cellsize));
+}
+
+
+
+void ship_grid::add(ship* s, category c, const vector2& center, double radius)
+{
+	entries.push_back(entry(s, c, center, radius));
+}
+
+
+
+void ship_grid::build()
+{
+	cells.clear();
+	for (unsigned i = 0; i < entries.size(); ++i) {
+		const entry& e = entries[i];
+		int x0 = cell_coord(e.center.x - e.radius), x1 = cell_coord(e.center.x + e.radius);
+		int y0 = cell_coord(e.center.y - e.radius), y1 = cell_coord(e.center.y + e.radius);
+		for (int y = y0; y <= y1; ++y)
+			for (int x = x0; x <= x1; ++x)
+				cells.push_back(cell_ref(x, y, i));
+	}
+	std::sort(cells.begin(), cells.end());
+}
+
+
+
+void ship_grid::collect_cells(const vector2& minv, const vector2& maxv, unsigned mask,
+			      arena_vector<unsigned>::type& indices) const
+{
+	int x0 = cell_coord(minv.x), x1 = cell_coord(maxv.x);
+	int y0 = cell_coord(minv.y), y1 = cell_coord(maxv.y);
+	for (int y = y0; y <= y1; ++y) {
+		// all cells of a row are consecutive in the sorted vector
+		std::vector<cell_ref>::const_iterator it =
+			std::lower_bound(cells.begin(), cells.end(), cell_ref(x0, y, 0));
+		for ( ; it != cells.end() && it->y == y && it->x <= x1; ++it)
+			if (entries[it->idx].cat & mask)
+				indices.push_back(it->idx);
+	}
+	// entries spanning several cells are found multiple times
+	std::sort(indices.begin(), indices.end());
+	indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+}
+
+
+
+void ship_grid::query_circle(const vector2& center, double radius, unsigned mask,
+			     result_list& result) const
+{
+	arena_vector<unsigned>::type indices;
+	collect_cells(center - vector2(radius, radius), center + vector2(radius, radius), mask, indices);
+	for (unsigned i = 0; i < indices.size(); ++i) {
+		const entry& e = entries[indices[i]];
+		double r = radius + e.radius;
+		if (e.center.square_distance(center) <= r*r)
+			result.push_back(e.s);
+	}
+}
+
+
+
+void ship_grid::query_segment(const vector2& a, const vector2& b, double radius, unsigned mask,
+			      result_list& result) const
+{
+	vector2 minv(std::min(a.x, b.x) - radius, std::min(a.y, b.y) - radius);
+	vector2 maxv(std::max(a.x, b.x) + radius, std::max(a.y, b.y) + radius);
+	arena_vector<unsigned>::type indices;
+	collect_cells(minv, maxv, mask, indices);
+	vector2 d = b - a;
+	double dl = d.square_length();
+	for (unsigned i = 0; i < indices.size(); ++i) {
+		const entry& e = entries[indices[i]];
+		// distance of circle center to closest point on segment
+		double t = (dl > 1e-8) ? std::max(0.0, std::min(1.0, ((e.center - a) * d) / dl)) : 0.0;
+		double r = radius + e.radius;
+		if (e.center.square_distance(a + d * t) <= r*r)
+			result.push_back(e.s);
+	}
+}
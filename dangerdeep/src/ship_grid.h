@@ -0,0 +1,108 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// spatial index of ships for torpedo/shell queries
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#ifndef SHIP_GRID_H
+#define SHIP_GRID_H
+
+#include "vector2.h"
+#include "arena.h"
+#include <vector>
+
+class ship;
+
+///\brief A uniform 2d grid over the xy plane holding bounding circles of ships.
+/** The grid is rebuilt once per simulation step and is read-only while objects
+    are simulated, so it can be queried from several threads at once.
+    Query results are stored in arena vectors, as they are only needed
+    during the step.
+    Queries are conservative prefilters: they return every ship whose bounding
+    circle overlaps the query shape, in insertion order, so that the exact
+    (bv_tree) tests done afterwards give the same results as testing all ships.
+*/
+class ship_grid
+{
+ public:
+	/// categories of entries, can be or'ed to masks for queries
+	enum category {
+		ships = 1,
+		submarines = 2,
+		torpedoes = 4,
+		all = 7
+	};
+
+	/// create grid with given cell size in meters
+	ship_grid(double cellsize = 512.0);
+
+	/// remove all entries
+	void clear();
+
+	/// add a ship with its bounding circle, call build() after adding all ships
+	void add(ship* s, category c, const vector2& center, double radius);
+
+	/// sort entries to cells, must be called after add() and before queries
+	void build();
+
+	typedef arena_vector<ship*>::type result_list;
+
+	/// collect all ships of categories in mask whose circles overlap the given circle
+	void query_circle(const vector2& center, double radius, unsigned mask,
+			  result_list& result) const;
+
+	/// collect all ships of categories in mask whose circles are hit by the
+	/// segment a->b widened by radius
+	void query_segment(const vector2& a, const vector2& b, double radius, unsigned mask,
+			   result_list& result) const;
+
+	/// get number of entries
+	unsigned size() const { return entries.size(); }
+
+ protected:
+	struct entry
+	{
+		ship* s;
+		vector2 center;
+		double radius;
+		unsigned cat;
+		entry(ship* s_, unsigned c, const vector2& ct, double r)
+			: s(s_), center(ct), radius(r), cat(c) {}
+	};
+
+	struct cell_ref
+	{
+		int x, y;
+		unsigned idx;
+		cell_ref(int x_ = 0, int y_ = 0, unsigned i = 0) : x(x_), y(y_), idx(i) {}
+		bool operator< (const cell_ref& o) const {
+			return (y < o.y) || (y == o.y && (x < o.x || (x == o.x && idx < o.idx)));
+		}
+	};
+
+	double cellsize;
+	std::vector<entry> entries;
+	std::vector<cell_ref> cells;	// sorted by cell, then entry index
+
+	int cell_coord(double v) const;
+	void collect_cells(const vector2& minv, const vector2& maxv, unsigned mask,
+			   arena_vector<unsigned>::type& indices) const;
+};
+
+#endif
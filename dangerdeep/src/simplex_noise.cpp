@@ -1,4 +1,11 @@
 #include "simplex_noise.h"
+#include <algorithm>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 std::vector<Uint8> simplex_noise::noise_map2D(vector2i size, unsigned ocatves, float persistence, float coord_factor)
 {
@@ -208,6 +215,176 @@ double simplex_noise::interpolate3D(const vector3& coord)
 	return 32.0*(n0 + n1 + n2 + n3);
 }
 
+void simplex_noise::noise_row(const float* x, const float* y, const float* z, double scale,
+			      float* result, unsigned n)
+{
+	// Samples are processed in blocks of B. The first pass computes the simplex
+	// cells and offsets, the second one looks up the hashed gradients of the
+	// corners and the third one computes the corner contributions in float.
+	// The first pass uses SSE2 and the third one SSE when the compiler has them,
+	// which is always the case on x86-64, USE_SSE is not needed.
+	// Neighboring samples of a row often lie in the same simplex, so the
+	// gradients of the previous sample are reused.
+	const unsigned B = 64;
+	int ci[B], cj[B], ck[B], oc[B];
+	float x0[B], y0[B], z0[B];
+	float o1x[B], o1y[B], o1z[B], o2x[B], o2y[B], o2z[B];
+	float g[4][3][B];
+	int li = 0x7fffffff, lj = 0, lk = 0, lorder = -1;
+	const float* lg[4] = { 0, 0, 0, 0 };
+	for (unsigned b = 0; b < n; b += B) {
+		unsigned m = std::min(B, n - b);
+		const float* bx = x + b;
+		const float* by = y + b;
+		const float* bz = z + b;
+		// cell computation is done in double like interpolate3D,
+		// to keep precision for large coordinates
+		unsigned s = 0;
+#ifdef __SSE2__
+		// two samples at once, same computation as the loop below
+		const __m128d one = _mm_set1_pd(1.0), f3 = _mm_set1_pd(F3), g3 = _mm_set1_pd(G3);
+		const __m128d sc = _mm_set1_pd(scale), zerod = _mm_setzero_pd();
+		for ( ; s + 2 <= m; s += 2) {
+			__m128d cx = _mm_mul_pd(_mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double*)(bx + s)))), sc);
+			__m128d cy = _mm_mul_pd(_mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double*)(by + s)))), sc);
+			__m128d cz = _mm_mul_pd(_mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double*)(bz + s)))), sc);
+			__m128d sk = _mm_mul_pd(_mm_add_pd(cx, _mm_add_pd(cy, cz)), f3);
+			__m128d fx = _mm_add_pd(cx, sk), fy = _mm_add_pd(cy, sk), fz = _mm_add_pd(cz, sk);
+			// int(f) - (f > 0 ? 0 : 1) is the same as int(f - 1) for f <= 0
+			fx = _mm_sub_pd(fx, _mm_and_pd(_mm_cmple_pd(fx, zerod), one));
+			fy = _mm_sub_pd(fy, _mm_and_pd(_mm_cmple_pd(fy, zerod), one));
+			fz = _mm_sub_pd(fz, _mm_and_pd(_mm_cmple_pd(fz, zerod), one));
+			__m128i i = _mm_cvttpd_epi32(fx), j = _mm_cvttpd_epi32(fy), k = _mm_cvttpd_epi32(fz);
+			__m128d di = _mm_cvtepi32_pd(i), dj = _mm_cvtepi32_pd(j), dk = _mm_cvtepi32_pd(k);
+			__m128d t = _mm_mul_pd(_mm_add_pd(di, _mm_add_pd(dj, dk)), g3);
+			__m128d dx = _mm_sub_pd(cx, _mm_sub_pd(di, t));
+			__m128d dy = _mm_sub_pd(cy, _mm_sub_pd(dj, t));
+			__m128d dz = _mm_sub_pd(cz, _mm_sub_pd(dk, t));
+			_mm_storel_epi64((__m128i*)(ci + s), i);
+			_mm_storel_epi64((__m128i*)(cj + s), j);
+			_mm_storel_epi64((__m128i*)(ck + s), k);
+			_mm_storel_pi((__m64*)(x0 + s), _mm_cvtpd_ps(dx));
+			_mm_storel_pi((__m64*)(y0 + s), _mm_cvtpd_ps(dy));
+			_mm_storel_pi((__m64*)(z0 + s), _mm_cvtpd_ps(dz));
+			__m128d xy = _mm_cmpge_pd(dx, dy), xz = _mm_cmpge_pd(dx, dz), yz = _mm_cmpge_pd(dy, dz);
+			__m128d xyz = _mm_and_pd(xy, xz), xyxz = _mm_or_pd(xy, xz);
+			int mm = _mm_movemask_pd(xy) | (_mm_movemask_pd(xz) << 2) | (_mm_movemask_pd(yz) << 4);
+			oc[s] = mm & 0x15;
+			oc[s+1] = (mm >> 1) & 0x15;
+			_mm_storel_pi((__m64*)(o1x + s), _mm_cvtpd_ps(_mm_and_pd(xyz, one)));
+			_mm_storel_pi((__m64*)(o1y + s), _mm_cvtpd_ps(_mm_and_pd(_mm_andnot_pd(xy, yz), one)));
+			_mm_storel_pi((__m64*)(o1z + s), _mm_cvtpd_ps(_mm_andnot_pd(_mm_or_pd(yz, xyz), one)));
+			_mm_storel_pi((__m64*)(o2x + s), _mm_cvtpd_ps(_mm_and_pd(xyxz, one)));
+			_mm_storel_pi((__m64*)(o2y + s), _mm_cvtpd_ps(_mm_andnot_pd(_mm_andnot_pd(yz, xy), one)));
+			_mm_storel_pi((__m64*)(o2z + s), _mm_cvtpd_ps(_mm_andnot_pd(_mm_and_pd(yz, xyxz), one)));
+		}
+#endif
+		for ( ; s < m; ++s) {
+			double cx = bx[s]*scale, cy = by[s]*scale, cz = bz[s]*scale;
+			double sk = (cx+cy+cz)*F3;
+			double fx = cx+sk, fy = cy+sk, fz = cz+sk;
+			int i = int(fx) - (fx > 0 ? 0 : 1);
+			int j = int(fy) - (fy > 0 ? 0 : 1);
+			int k = int(fz) - (fz > 0 ? 0 : 1);
+			double t = (i+j+k)*G3;
+			double dx = cx-(i-t), dy = cy-(j-t), dz = cz-(k-t);
+			ci[s] = i; cj[s] = j; ck[s] = k;
+			x0[s] = float(dx); y0[s] = float(dy); z0[s] = float(dz);
+			// offsets of second and third corner, same as the order cases of interpolate3D.
+			// The order must be determined in double precision, as the noise is not
+			// continuous at all simplex borders.
+			bool xy = dx >= dy, xz = dx >= dz, yz = dy >= dz;
+			oc[s] = int(xy) + 4*int(xz) + 16*int(yz);
+			o1x[s] = float(xy && xz);
+			o1y[s] = float(!xy && yz);
+			o1z[s] = float((xy && !yz && !xz) || (!xy && !yz));
+			o2x[s] = float(xy || xz);
+			o2y[s] = float(!xy || yz);
+			o2z[s] = float(!yz || (!xy && !xz));
+		}
+		for (unsigned s = 0; s < m; ++s) {
+			if (ci[s] != li || cj[s] != lj || ck[s] != lk || oc[s] != lorder) {
+				int i1 = int(o1x[s]), j1 = int(o1y[s]), k1 = int(o1z[s]);
+				int i2 = int(o2x[s]), j2 = int(o2y[s]), k2 = int(o2z[s]);
+				int ii = ci[s] & 255;
+				int jj = cj[s] & 255;
+				int kk = ck[s] & 255;
+				lg[0] = grad3f[perm[ii+perm[jj+perm[kk]]] % 12];
+				lg[1] = grad3f[perm[ii+i1+perm[jj+j1+perm[kk+k1]]] % 12];
+				lg[2] = grad3f[perm[ii+i2+perm[jj+j2+perm[kk+k2]]] % 12];
+				lg[3] = grad3f[perm[ii+1+perm[jj+1+perm[kk+1]]] % 12];
+				li = ci[s]; lj = cj[s]; lk = ck[s]; lorder = oc[s];
+			}
+			for (unsigned c = 0; c < 4; ++c) {
+				g[c][0][s] = lg[c][0];
+				g[c][1][s] = lg[c][1];
+				g[c][2][s] = lg[c][2];
+			}
+		}
+		// corner offsets of the unskewed simplex relative to the first corner
+		static const float co[4] = { 0.0f, float(G3), float(2.0*G3), float(-1.0 + 3.0*G3) };
+		float* r = result + b;
+#ifdef __SSE__
+		// four samples at once, the blocks are padded, so the last samples
+		// of a block are computed into a temporary array.
+		float rtmp[B];
+		for (unsigned s = m; s < ((m + 3) & ~3U); ++s) {
+			x0[s] = y0[s] = z0[s] = 1.0f;
+			o1x[s] = o1y[s] = o1z[s] = o2x[s] = o2y[s] = o2z[s] = 0.0f;
+			for (unsigned c = 0; c < 4; ++c)
+				g[c][0][s] = g[c][1][s] = g[c][2][s] = 0.0f;
+		}
+		const __m128 zero = _mm_setzero_ps(), c06 = _mm_set1_ps(0.6f), c32 = _mm_set1_ps(32.0f);
+		for (unsigned s = 0; s < m; s += 4) {
+			__m128 sum = zero;
+			for (unsigned c = 0; c < 4; ++c) {
+				__m128 off = _mm_set1_ps(co[c]);
+				__m128 ax = _mm_add_ps(_mm_loadu_ps(x0 + s), off);
+				__m128 ay = _mm_add_ps(_mm_loadu_ps(y0 + s), off);
+				__m128 az = _mm_add_ps(_mm_loadu_ps(z0 + s), off);
+				if (c == 1) {
+					ax = _mm_sub_ps(ax, _mm_loadu_ps(o1x + s));
+					ay = _mm_sub_ps(ay, _mm_loadu_ps(o1y + s));
+					az = _mm_sub_ps(az, _mm_loadu_ps(o1z + s));
+				} else if (c == 2) {
+					ax = _mm_sub_ps(ax, _mm_loadu_ps(o2x + s));
+					ay = _mm_sub_ps(ay, _mm_loadu_ps(o2y + s));
+					az = _mm_sub_ps(az, _mm_loadu_ps(o2z + s));
+				}
+				__m128 tc = _mm_sub_ps(c06, _mm_add_ps(_mm_mul_ps(ax, ax),
+								       _mm_add_ps(_mm_mul_ps(ay, ay), _mm_mul_ps(az, az))));
+				tc = _mm_max_ps(tc, zero);
+				tc = _mm_mul_ps(tc, tc);
+				__m128 d = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(g[c][0] + s), ax),
+						      _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(g[c][1] + s), ay),
+								 _mm_mul_ps(_mm_loadu_ps(g[c][2] + s), az)));
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_mul_ps(tc, tc), d));
+			}
+			_mm_storeu_ps(rtmp + s, _mm_mul_ps(sum, c32));
+		}
+		for (unsigned s = 0; s < m; ++s)
+			r[s] = rtmp[s];
+#else
+		for (unsigned s = 0; s < m; ++s) {
+			float sum = 0.0f;
+			for (unsigned c = 0; c < 4; ++c) {
+				float ax = x0[s] + co[c], ay = y0[s] + co[c], az = z0[s] + co[c];
+				if (c == 1) {
+					ax -= o1x[s]; ay -= o1y[s]; az -= o1z[s];
+				} else if (c == 2) {
+					ax -= o2x[s]; ay -= o2y[s]; az -= o2z[s];
+				}
+				float tc = 0.6f - ax*ax - ay*ay - az*az;
+				tc = (tc < 0.0f) ? 0.0f : tc;
+				tc *= tc;
+				sum += tc * tc * (g[c][0][s]*ax + g[c][1][s]*ay + g[c][2][s]*az);
+			}
+			r[s] = 32.0f * sum;
+		}
+#endif
+	}
+}
+
 double simplex_noise::interpolate4D(const vector4& coord)
 {
 	// The skewing and unskewing factors are hairy again for the 4D case
@@ -342,6 +519,10 @@ const int simplex_noise::grad3[12][3] = {{1,1,0},{-1,1,0},{1,-1,0},{-1,-1,0},
 										 {1,0,1},{-1,0,1},{1,0,-1},{-1,0,-1},
 										 {0,1,1},{0,-1,1},{0,1,-1},{0,-1,-1}};
 
+const float simplex_noise::grad3f[12][3] = {{1,1,0},{-1,1,0},{1,-1,0},{-1,-1,0},
+											{1,0,1},{-1,0,1},{1,0,-1},{-1,0,-1},
+											{0,1,1},{0,-1,1},{0,1,-1},{0,-1,-1}};
+
 const int simplex_noise::grad4[36][4] = {{0,1,1,1}, {0,1,1,-1}, {0,1,-1,1}, {0,1,-1,-1},
 										 {0,-1,1,1}, {0,-1,1,-1}, {0,-1,-1,1}, {0,-1,-1,-1},
 										 {1,0,1,1}, {1,0,1,-1}, {1,0,-1,1}, {1,0,-1,-1},
@@ -31,6 +31,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 class simplex_noise {
 protected:
 	static const int grad3[12][3];
+	static const float grad3f[12][3];	// grad3 for noise_row
 	static const int grad4[36][4];
 	static const int perm[512];
 	static const int simplex4D[64][4];
@@ -58,6 +59,11 @@ public:
 	static double noise(vector3 coord, unsigned ocatves = 1, float persistence = 1.0);
 	static double noise(vector4 coord, unsigned ocatves = 1, float persistence = 1.0);
 	
+	/// compute 3D noise (one octave) for n samples (x[i], y[i], z[i]) * scale at once.
+	/// Gives the same values as noise(vector3) within float precision.
+	static void noise_row(const float* x, const float* y, const float* z, double scale,
+			      float* result, unsigned n);
+
 	static std::vector<Uint8> noise_map2D(vector2i size, unsigned ocatves = 1, float persistence = 1.0, float coord_factor = 0.01);
 
 };
@@ -57,6 +57,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "credits.h"
 #include "log.h"
 #include "faulthandler.h"
+#include "alloc_counter.h"
 #include "mymain.cpp"
 
 #ifndef WIN32
@@ -391,6 +392,9 @@ game::run_state game__exec(game& gm, user_interface& ui)
 	double fpstime = 0;
 	double totaltime = 0;
 	double measuretime = 5;	// seconds
+	// heap traffic of simulation and display, when counting is compiled in
+	unsigned long sim_allocs = 0, sim_steps = 0, max_step_allocs = 0;
+	unsigned long last_allocs = alloc_counter::get_count();
 
 	ui.resume_all_sound();
 	
@@ -418,16 +422,20 @@ game::run_state game__exec(game& gm, user_interface& ui)
 		
 		// next simulation step
 		if (!ui.paused()) {
+			unsigned long allocs_before = alloc_counter::get_count();
 			for (unsigned j = 0; j < time_scale; ++j) {
 				gm.simulate(time_scale == 1 ? delta_time : (1.0/30.0));
+				max_step_allocs = std::max(max_step_allocs, gm.get_last_step_allocations());
 				// evaluate events of game, because they are cleared
 				// by next call of game::simulate and new ones are
 				// generated
-				const ptrlist<event>& events = gm.get_events();
-				for (ptrlist<event>::const_iterator it = events.begin(); it != events.end(); ++it) {
+				const game::event_list& events = gm.get_events();
+				for (game::event_list::const_iterator it = events.begin(); it != events.end(); ++it) {
 					it->evaluate(ui);
 				}
 			}
+			sim_allocs += alloc_counter::get_count() - allocs_before;
+			sim_steps += time_scale;
 		}
 
 		// fixme: make use of game::job interface, 3600/256 = 14.25 secs job period
@@ -439,6 +447,18 @@ game::run_state game__exec(game& gm, user_interface& ui)
 		if (totaltime - fpstime >= measuretime) {
 			fpstime = totaltime;
 			log_info("fps " << (frames - lastframes)/measuretime);
+			log_info("models per frame: triangles " << model::get_nr_of_rendered_triangles()/(frames - lastframes)
+				 << ", draw calls " << model::get_nr_of_draw_calls()/(frames - lastframes)
+				 << ", state setups " << model::get_nr_of_state_setups()/(frames - lastframes));
+			model::reset_render_statistics();
+			if (alloc_counter::enabled()) {
+				unsigned long allocs = alloc_counter::get_count();
+				log_info("heap allocations per frame " << double(allocs - last_allocs)/(frames - lastframes)
+					 << ", per simulation step " << (sim_steps ? double(sim_allocs)/sim_steps : 0.0)
+					 << ", max. in one step " << max_step_allocs);
+				last_allocs = allocs;
+				sim_allocs = sim_steps = max_step_allocs = 0;
+			}
 			lastframes = frames;
 		}
 		
@@ -1982,6 +2002,12 @@ int mymain(list<string>& args)
 	params.hint_texture_compression = mycfg.geti("hint_texture_compression");
 	params.vertical_sync = mycfg.getb("vsync");
 	texture::use_compressed_textures = mycfg.getb("use_compressed_textures");
+	if (texture::use_compressed_textures) {
+		// textures compressed on first load are stored here
+		string texcachedirectory = configdirectory + "texcache/";
+		if (is_directory(texcachedirectory) || make_dir(texcachedirectory))
+			texture::cache_directory = texcachedirectory;
+	}
 	texture::use_anisotropic_filtering = mycfg.getb("use_ani_filtering");
 	texture::anisotropic_level = mycfg.getf("anisotropic_level");
 	system::create_instance(new class system(params));
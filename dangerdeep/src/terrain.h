@@ -37,6 +37,10 @@
 #include "fractal.h"
 #include "cfg.h"
 #include "global_data.h"
+#include "thread.h"
+#include "filehelper.h"
+#include "error.h"
+#include "tile_pyramid.h"
 
 #define M 714025
 #define IA 1366
@@ -48,7 +52,8 @@ private:
     terrain();
 
 protected:
-    tile_cache<T> m_tile_cache;
+    std::vector<tile_cache<T> > m_tile_caches;	// one per pyramid level, only level 0 without pyramid
+    std::auto_ptr<tile_pyramid> m_pyramid;
     int num_levels;
     long int resolution, min_height, max_height, tile_size;
     vector2l bounds;
@@ -66,9 +71,71 @@ protected:
 		double uni();
 		double gauss_noise();
 		bivector<float> generate_patch(int detail, const vector2i& coord_bl, const vector2i& coord_sz);
+		void add_noise_rows(bivector<float>& patch, int detail, const vector2i& coord_bl,
+				    unsigned row_start, unsigned row_add) const;
+
+		// adds noise to every row_add'th row of a patch, starting at row_start, while
+		// the caller and the other workers do the remaining rows.
+		// The workers are kept for all patches, work() and sync() hand over each patch.
+		class noise_worker : public thread
+		{
+			::mutex mtx;
+			condvar cond;
+			condvar condfini;
+			const terrain& ter;
+			const unsigned row_start;
+			const unsigned row_add;
+			bivector<float>* patch;
+			int detail;
+			vector2i coord_bl;
+			bool done;
+		public:
+			noise_worker(const terrain& t, unsigned rs, unsigned ra)
+				: thread("terrnoise"), ter(t), row_start(rs), row_add(ra), patch(0), detail(0), done(true) {}
+			void loop()
+			{
+				{
+					mutex_locker ml(mtx);
+					while (done && !abort_requested())
+						cond.wait(mtx);
+					if (abort_requested())
+						return;
+				}
+				ter.add_noise_rows(*patch, detail, coord_bl, row_start, row_add);
+				mutex_locker ml(mtx);
+				done = true;
+				condfini.signal();
+			}
+			void request_abort()
+			{
+				mutex_locker ml(mtx);
+				thread::request_abort();
+				cond.signal();
+			}
+			void work(bivector<float>& p, int d, const vector2i& bl)
+			{
+				mutex_locker ml(mtx);
+				patch = &p;
+				detail = d;
+				coord_bl = bl;
+				done = false;
+				cond.signal();
+			}
+			void sync()
+			{
+				mutex_locker ml(mtx);
+				while (!done)
+					condfini.wait(mtx);
+			}
+		};
+
+		// one worker per extra cpu core, stopped in the destructor before the data
+		// they use is destroyed
+		std::vector<noise_worker*> m_noise_workers;
 public:
 
     terrain(const std::string&, const std::string&, unsigned);
+    ~terrain();
     void compute_heights(int, const vector2i&, const vector2i&, float*, unsigned = 0, unsigned = 0, bool = true);
 
     void get_min_max_height(double& minh, double& maxh) const {
@@ -127,13 +194,39 @@ terrain<T>::terrain(const std::string& header_file, const std::string& data_dir,
 
     tex_stretch_factor = cfg::instance().getf("terrain_texture_resolution") / 100.0;
 
-    m_tile_cache = tile_cache<T > (data_dir, bounds.y, bounds.x, tile_size, 0, 300000);
+    // read tiles from the pyramid container if map_precompute has created one
+    std::string pyramid_file = data_dir + "terrain.pyr";
+    if (is_file(pyramid_file)) {
+        m_pyramid.reset(new tile_pyramid(pyramid_file));
+        if (m_pyramid->get_tile_size() != unsigned(tile_size))
+            throw error(pyramid_file + " has wrong tile size");
+        for (unsigned level = 0; level < m_pyramid->get_nr_of_levels(); ++level) {
+            int f = 1 << level;
+            m_tile_caches.push_back(tile_cache<T > (*m_pyramid, level, (bounds.y + f - 1) / f,
+                                                   (bounds.x + f - 1) / f, 0, 300000));
+        }
+    } else {
+        m_tile_caches.push_back(tile_cache<T > (data_dir, bounds.y, bounds.x, tile_size, 0, 300000));
+    }
 
 		noise_map.resize(vector2i(256, 256));
 
 		for(int y=0; y<noise_map.size().y; y++)
 			for(int x=0; x<noise_map.size().x; x++)
 				noise_map.at(x,y) = gauss_noise();
+
+		int nr_workers = cfg::instance().geti("cpucores") - 1;
+		for (int i = 0; i < nr_workers; ++i) {
+			m_noise_workers.push_back(new noise_worker(*this, i + 1, nr_workers + 1));
+			m_noise_workers.back()->start();
+		}
+}
+
+template <class T>
+terrain<T>::~terrain()
+{
+	for (unsigned i = 0; i < m_noise_workers.size(); ++i)
+		m_noise_workers[i]->destruct();
 }
 
 template <class T>
@@ -158,7 +251,6 @@ template <class T>
 bivector<float> terrain<T>::generate_patch(int detail, const vector2i& coord_bl, const vector2i& coord_sz) 
 {
     bivector<float> patch;
-		double noise, scale = noise_scale/(1.0/(float)detail);
 
     if (detail < (num_levels - 1)) {
         // upsample from the next coarser level
@@ -168,22 +260,47 @@ bivector<float> terrain<T>::generate_patch(int detail, const vector2i& coord_bl,
         vector2i coord2_sz = coord2_tr - coord2_bl + vector2i(1, 1);
         vector2i offset(2 + (coord_bl.x & 1), 2 + (coord_bl.y & 1));
 
-        patch = generate_patch(detail + 1, coord2_bl, coord2_sz).smooth_upsampled(true).sub_area(offset, coord_sz);
+        generate_patch(detail + 1, coord2_bl, coord2_sz).smooth_upsampled(offset, coord_sz, patch, true);
 				//patch = upsampled(generate_patch(detail + 1, coord2_bl, coord2_sz), true, coord_bl,  detail).sub_area(offset, coord_sz);
 
     } else if (detail == (num_levels - 1)) { // coarsest level - read from file
         patch.resize(coord_sz);
 
-        for (int y = 0; y < coord_sz.y; y++) {
-            for (int x = 0; x < coord_sz.x; x++) {
-                vector2f coord = vector2f(((float) ((coord_bl.x + x) << detail)) * sample_spacing, ((float) ((coord_bl.y + y) << detail)) * sample_spacing);
-                vector2f coord_geo = transform_real_to_geo(coord);
-
-                coord_geo *= (float) resolution;
-
-                patch[vector2i(x, y)] = m_tile_cache.get_value(vector2i(coord_geo.x + origin.x, coord_geo.y + origin.y));
-
-            }
+        // The geo coordinates of a row of samples have the same latitude and the
+        // longitude is linear in x, so the projection is computed once per row.
+        // The needed data rows are read as a block and resampled bilinearly.
+        float step = float(1 << detail) * sample_spacing;
+
+        // Read from the finest pyramid level whose sample distance is not larger
+        // than the distance of the patch samples, so the map isn't undersampled.
+        // The level is chosen once per patch, so the patch has no seams.
+        // A sample of level n is the average of 2^n*2^n samples of level 0,
+        // its center is (2^n-1)/2 level 0 samples away from their first sample.
+        unsigned level = 0;
+        if (coord_sz.x > 0 && coord_sz.y > 0) {
+            double xf0, xf1;
+            float pos_y0 = float(coord_bl.y << detail) * sample_spacing;
+            double gy0 = transform_real_to_geo_row(pos_y0, xf0) * resolution;
+            double gy1 = transform_real_to_geo_row(pos_y0 + step, xf1) * resolution;
+            double d = std::min(step * xf0 * resolution, fabs(gy1 - gy0));
+            while (level + 1 < m_tile_caches.size() && d >= double(2 << level))
+                ++level;
+        }
+        tile_cache<T>& cache = m_tile_caches[level];
+        const double level_scale = 1.0 / (1 << level);
+        const double level_offset = ((1 << level) - 1) * 0.5;
+
+        for (int y = 0; y < coord_sz.y && coord_sz.x > 0; y++) {
+            double x_factor;
+            float pos_y = float((coord_bl.y + y) << detail) * sample_spacing;
+            double gy = transform_real_to_geo_row(pos_y, x_factor) * resolution + origin.y;
+            double gx0 = float(coord_bl.x << detail) * sample_spacing * x_factor * resolution + origin.x;
+            double gdx = step * x_factor * resolution;
+            // tile_cache flips y, so the offset has the opposite sign
+            gy = (gy + level_offset) * level_scale;
+            gx0 = (gx0 - level_offset) * level_scale;
+            gdx *= level_scale;
+            cache.get_bilinear_row(gx0, gdx, gy, coord_sz.x, patch.data_ptr() + y * coord_sz.x);
         }
 
     } else throw ("terrain::generate_patch(): invalid detail level requested.");
@@ -191,21 +308,48 @@ bivector<float> terrain<T>::generate_patch(int detail, const vector2i& coord_bl,
 
 		if(detail==-1) return patch;
     
-    for (int y = 0; y < coord_sz.y; ++y) {
-        for (int x = 0; x < coord_sz.x; ++x) {
-            vector2l coord(coord_bl.x+x, coord_bl.y+y);
-						vector3 point((coord.x << (detail + 1))*noise_coord_factor, (coord.y << (detail + 1))*noise_coord_factor, patch.at(x, y)*noise_coord_factor);
-
-            noise = frac->get_value_hybrid(vector3f(point), num_levels-detail) * scale;
-						if((patch.at(x,y) <= 0.0) && (noise>0.0)) noise *= -1.0;
-						if((patch.at(x,y) >= 0.0) && (noise<0.0)) noise *= -1.0;
-            patch.at(x, y) += noise;
-       }
+    // add noise detail, rows are split between this and the worker threads for larger patches
+    if (!m_noise_workers.empty() && coord_sz.x * coord_sz.y >= 64*64) {
+        for (unsigned i = 0; i < m_noise_workers.size(); ++i)
+            m_noise_workers[i]->work(patch, detail, coord_bl);
+        add_noise_rows(patch, detail, coord_bl, 0, m_noise_workers.size() + 1);
+        for (unsigned i = 0; i < m_noise_workers.size(); ++i)
+            m_noise_workers[i]->sync();
+    } else {
+        add_noise_rows(patch, detail, coord_bl, 0, 1);
     }
 
     return patch;
 }
 
+template <class T>
+void terrain<T>::add_noise_rows(bivector<float>& patch, int detail, const vector2i& coord_bl,
+				unsigned row_start, unsigned row_add) const
+{
+    double scale = noise_scale/(1.0/(float)detail);
+    int w = patch.size().x;
+    if (w == 0) return;
+    std::vector<float> px(w), py(w), pz(w), noise(w);
+
+    for (int y = int(row_start); y < patch.size().y; y += int(row_add)) {
+        float* row = patch.data_ptr() + y * w;
+        for (int x = 0; x < w; ++x) {
+            vector2l coord(coord_bl.x+x, coord_bl.y+y);
+            px[x] = (coord.x << (detail + 1))*noise_coord_factor;
+            py[x] = (coord.y << (detail + 1))*noise_coord_factor;
+            pz[x] = row[x]*noise_coord_factor;
+        }
+        frac->get_values_hybrid(&px[0], &py[0], &pz[0], &noise[0], w, num_levels-detail);
+        for (int x = 0; x < w; ++x) {
+            // noise has the sign of the height, so coast lines are kept
+            float n = noise[x] * scale;
+            if ((row[x] <= 0.0f) && (n > 0.0f)) n = -n;
+            if ((row[x] >= 0.0f) && (n < 0.0f)) n = -n;
+            row[x] += n;
+        }
+    }
+}
+
 template <class T>
 double terrain<T>::gauss_noise() {
 	double fac, r, v1, v2;
@@ -35,6 +35,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "vector3.h"
 #include "texture.h"
 #include "primitives.h"
+#include "dxt_compressor.h"
+#include "datadirs.h"
+#include "filehelper.h"
 #include "log.h"
 #include <vector>
 #include <iostream>
@@ -44,6 +47,10 @@ using namespace std;
 
 #undef  MEMMEASURE
 
+#ifndef GL_COMPRESSED_RED_GREEN_RGTC2_EXT
+#define GL_COMPRESSED_RED_GREEN_RGTC2_EXT 0x8DBD
+#endif
+
 
 #ifdef MEMMEASURE
 unsigned texture::mem_used = 0;
@@ -55,6 +62,7 @@ int texture::size_non_power_2 = -1;
 bool texture::use_compressed_textures = false;
 bool texture::use_anisotropic_filtering = false;
 float texture::anisotropic_level = 0.0f;
+string texture::cache_directory;
 
 bool texture::size_non_power_two()
 {
@@ -252,6 +260,16 @@ void texture::sdl_init(SDL_Surface* teximage, unsigned sx, unsigned sy, unsigned
 	gl_width = tw;
 	gl_height = th;
 
+	vector<Uint8> data = sdl_get_data(teximage, sx, sy, sw, sh, tw, th, rgb2grey, format, get_name());
+	init(data, makenormalmap, detailh);
+}
+
+
+
+vector<Uint8> texture::sdl_get_data(SDL_Surface* teximage, unsigned sx, unsigned sy, unsigned sw,
+				    unsigned sh, unsigned tw, unsigned th, bool rgb2grey, int& format,
+				    const string& name)
+{
 	SDL_LockSurface(teximage);
 
 	const SDL_PixelFormat& fmt = *(teximage->format);
@@ -274,10 +292,10 @@ void texture::sdl_init(SDL_Surface* teximage, unsigned sx, unsigned sy, unsigned
 		//old color table code, does not work
 		//glEnable(GL_COLOR_TABLE);
 		if (bpp != 1)
-			throw texerror(get_name(), "only 8bit palette files supported");
+			throw texerror(name, "only 8bit palette files supported");
 		int ncol = fmt.palette->ncolors;
 		if (ncol > 256)
-			throw texerror(get_name(), "max. 256 colors in palette supported");
+			throw texerror(name, "max. 256 colors in palette supported");
 		bool usealpha = (teximage->flags & SDL_SRCCOLORKEY);
 
 		// check for greyscale images (GL_LUMINANCE), fixme: add also LUMINANCE_ALPHA!
@@ -416,7 +434,7 @@ void texture::sdl_init(SDL_Surface* teximage, unsigned sx, unsigned sy, unsigned
 		}
 	}
 	SDL_UnlockSurface(teximage);
-	init(data, makenormalmap, detailh);
+	return data;
 }
 	
 
@@ -574,76 +592,103 @@ void texture::init(const vector<Uint8>& data, bool makenormalmap, float detailh)
 }
 
 #define MAKEFOURCC(ch0, ch1, ch2, ch3) ((int32_t)(int8_t)(ch0) | ((int32_t)(int8_t)(ch1) << 8) | ((int32_t)(int8_t)(ch2) << 16) | ((int32_t)(int8_t)(ch3) << 24 ))
+void texture::set_compressed_format(dds_data& target, int fmt)
+{
+	// one mapping for cache files that are written and loaded
+	switch (dxt_compressor::format(fmt)) {
+	case dxt_compressor::BC1:
+		target.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		break;
+	case dxt_compressor::BC3:
+		target.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		break;
+	case dxt_compressor::BC5:
+		target.format = GL_COMPRESSED_RED_GREEN_RGTC2_EXT;
+		break;
+	}
+	target.components = dxt_compressor::nr_of_components(dxt_compressor::format(fmt));
+}
+
+
+
+int texture::format_of_components(unsigned components)
+{
+	return (components == 3) ? GL_RGB : ((components == 2) ? GL_LUMINANCE_ALPHA : GL_RGBA);
+}
+
+
+
 void texture::load_dds(const std::string& filename, dds_data& target)
 {
     DDSHEAD header;
 	std::ifstream file;
-    int factor;
-    int bufferSize;
+    int block_size;
 
     // Open the file
-    file.open(filename.c_str());
+    file.open(filename.c_str(), std::ios::in | std::ios::binary);
 
     if(!file.good())
 		throw error("couldn't find, or failed to load " + filename);
 
     file.read((char*)&header, sizeof(header));
 
-    if(std::string((char*)header.Signature, 4) != "DDS ")
+    if(!file.good() || std::string((char*)header.Signature, 4) != "DDS ")
 		throw error("not a valid .dds file: " + filename);
 
     //
     // This .dds loader supports the loading of compressed formats DXT1, DXT3 
-    // and DXT5.
+    // and DXT5, and ATI2 (BC5, two channels).
+    // The formats that dxt_compressor writes are mapped like in cache_init.
     //
-    target.components = 4;
-
     switch( SDL_SwapLE32(header.FourCC) )
     {
         case MAKEFOURCC('D','X','T','1'):
             // DXT1's compression ratio is 8:1
-            target.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-            target.components = 3;
-            factor = 2;
+            set_compressed_format(target, dxt_compressor::BC1);
             break;
 
         case MAKEFOURCC('D','X','T','3'):
             // DXT3's compression ratio is 4:1
             target.format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
-            factor = 4;
+            target.components = 4;
             break;
 
         case MAKEFOURCC('D','X','T','5'):
             // DXT5's compression ratio is 4:1
-            target.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-            factor = 4;
+            set_compressed_format(target, dxt_compressor::BC3);
+            break;
+
+        case MAKEFOURCC('A','T','I','2'):
+            // BC5's compression ratio is 2:1 (of two channels)
+            set_compressed_format(target, dxt_compressor::BC5);
             break;
 
         default:
 			throw error("no supported compression type on file: " + filename);
     }
+    block_size = (target.format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
+
+    target.width      = SDL_SwapLE32(header.Width);
+    target.height     = SDL_SwapLE32(header.Height);
+    target.numMipMaps = std::max(int(SDL_SwapLE32(header.MipMapCount)), 1);
 
     // How big will the buffer need to be to load all of the pixel data 
     // including mip-maps?
-
-    if( SDL_SwapLE32(header.LinearSize) == 0 )
-		throw error("linear size in dds file is 0: " + filename);
-
-    if( header.MipMapCount > 1 )
-        bufferSize = SDL_SwapLE32(header.LinearSize) * factor;
-    else
-        bufferSize = SDL_SwapLE32(header.LinearSize);
+    int bufferSize = 0;
+    for (int i = 0, w = target.width, h = target.height; i < target.numMipMaps; ++i) {
+        bufferSize += ((w+3)/4) * ((h+3)/4) * block_size;
+        w = std::max(w/2, 1);
+        h = std::max(h/2, 1);
+    }
 
     target.pixels.resize(bufferSize);
 
 	file.read((char*)&target.pixels[0], bufferSize);
+	if (!file.good())
+		throw error("dds file is truncated: " + filename);
 
     // Close the file
     file.close();
-
-    target.width      = SDL_SwapLE32(header.Width);
-    target.height     = SDL_SwapLE32(header.Height);
-    target.numMipMaps = SDL_SwapLE32(header.MipMapCount);
 }
 #undef MAKEFOURCC
 
@@ -751,6 +796,9 @@ texture::texture(const string& filename, mapping_mode mapping_, clamping_mode cl
 	clamping = clamp;
 	texfilename = filename;
 
+	if (use_compressed_textures && !makenormalmap && !rgb2grey && cache_init(filename))
+		return;
+
 	sdl_image teximage(filename);
 	sdl_init(teximage.get_SDL_Surface(), 0, 0, teximage->w, teximage->h, makenormalmap, detailh, rgb2grey);
 }	
@@ -869,19 +917,28 @@ texture::texture(const std::string& filename, bool dummy, mapping_mode mapping_,
 	mapping = mapping_;
 	clamping = clamp;
 	
+	texfilename = filename;
+	dds_data image_data;
+	load_dds(filename, image_data);
+	// format of uncompressed data, for information purposes
+	format = format_of_components(image_data.components);
+	dds_init(image_data);
+}
+
+
+
+void texture::dds_init(const dds_data& image_data)
+{
 	// error checks.
 	if (mapping < 0 || mapping >= NR_OF_MAPPING_MODES)
 		throw texerror(get_name(), "illegal mapping mode!");
 	if (clamping < 0 || clamping >= NR_OF_CLAMPING_MODES)
 		throw texerror(get_name(), "illegal clamping mode!");
-	
-	dds_data image_data;
-	load_dds(filename, image_data);
-	
+
 	width = gl_width = image_data.width;
 	height = gl_height = image_data.height;
-	
-    int block_size;
+
+	int block_size;
 
 	if( image_data.format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT )
 		block_size = 8;
@@ -900,17 +957,21 @@ texture::texture(const std::string& filename, bool dummy, mapping_mode mapping_,
 	if(use_anisotropic_filtering)
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropic_level);
 
+	// without mipmapping only the base level is needed. Limit level count so
+	// that files with incomplete mipmap chains still give complete textures.
+	int nr_levels = do_mipmapping[mapping] ? image_data.numMipMaps : 1;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, nr_levels - 1);
+
 	int m_size, m_offset = 0, m_width = width, m_height = height;
 
 	// Load the mip-map levels
-	for(int i = 0; i < image_data.numMipMaps; ++i) {
+	for(int i = 0; i < nr_levels; ++i) {
 		if( m_width  == 0 ) m_width  = 1;
 		if( m_height == 0 ) m_height = 1;
 
 		m_size = ((m_width+3)/4) * ((m_height+3)/4) * block_size;
 
-		glTexImage2D(GL_TEXTURE_2D, i,  image_data.format, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
-		glCompressedTexSubImage2DARB(GL_TEXTURE_2D,i, 0, 0, m_width, m_height, image_data.format, m_size, &image_data.pixels[m_offset]);
+		glCompressedTexImage2DARB(GL_TEXTURE_2D, i, image_data.format, m_width, m_height, 0, m_size, &image_data.pixels[m_offset]);
 
 		m_offset += m_size;
 
@@ -920,6 +981,101 @@ texture::texture(const std::string& filename, bool dummy, mapping_mode mapping_,
 	}
 }
 
+
+
+string texture::get_cache_filename(const string& filename)
+{
+	// make name unique by using the path relative to the data directory
+	string name = filename;
+	const string& datadir = get_data_dir();
+	if (name.compare(0, datadir.length(), datadir) == 0)
+		name = name.substr(datadir.length());
+	for (string::size_type i = 0; i < name.length(); ++i)
+		if (name[i] == '/' || name[i] == '\\' || name[i] == ':' || name[i] == '|')
+			name[i] = '_';
+	return name + ".dds";
+}
+
+
+
+time_t texture::get_source_modification_time(const string& filename)
+{
+	// the jpg+png combination depends on two source files
+	string::size_type st = filename.rfind(".");
+	if (st != string::npos && filename.substr(st) == ".jpg|png")
+		return std::max(get_file_modification_time(filename.substr(0, st) + ".jpg"),
+				get_file_modification_time(filename.substr(0, st) + ".png"));
+	return get_file_modification_time(filename);
+}
+
+
+
+bool texture::cache_init(const string& filename)
+{
+	// only plain 2d color textures can be cached, generated normal maps
+	// need the source data and there must be driver support.
+	if (dimension != GL_TEXTURE_2D || !sys().extension_supported("GL_EXT_texture_compression_s3tc"))
+		return false;
+
+	time_t srctime = get_source_modification_time(filename);
+	string cachename = get_cache_filename(filename);
+
+	// prefer precomputed files, then files generated on earlier runs
+	string candidates[2] = { get_data_dir() + "texcache/" + cachename,
+				 cache_directory.empty() ? string() : cache_directory + cachename };
+	for (unsigned i = 0; i < 2; ++i) {
+		if (candidates[i].empty()) continue;
+		time_t cachetime = get_file_modification_time(candidates[i]);
+		if (cachetime == 0 || cachetime < srctime) continue;
+		try {
+			dds_data image_data;
+			load_dds(candidates[i], image_data);
+			format = format_of_components(image_data.components);
+			dds_init(image_data);
+			return true;
+		}
+		catch (std::exception& e) {
+			log_warning("Ignoring broken texture cache file: " << e.what());
+		}
+	}
+
+	if (cache_directory.empty())
+		return false;
+
+	// compress the image now and store it for next time
+	sdl_image teximage(filename);
+	unsigned w = teximage->w, h = teximage->h;
+	if (!size_non_power_two() && ((w & (w-1)) != 0 || (h & (h-1)) != 0)) {
+		// would need padding, which would change the texture size
+		return false;
+	}
+	vector<Uint8> data = sdl_get_data(teximage.get_SDL_Surface(), 0, 0, w, h, w, h, false,
+					 format, get_name());
+	unsigned bpp = get_bpp();
+
+	dxt_compressor::format fmt = dxt_compressor::choose_format(bpp);
+	dds_data image_data;
+	image_data.width = w;
+	image_data.height = h;
+	set_compressed_format(image_data, fmt);
+	unsigned nr_levels = 0;
+	image_data.pixels = dxt_compressor::compress_mipmapped(data, w, h, bpp, fmt, nr_levels);
+	image_data.numMipMaps = nr_levels;
+	try {
+		dxt_compressor::write_dds(cache_directory + cachename, image_data.pixels, w, h, nr_levels, fmt);
+		log_info("Stored compressed texture \"" << filename << "\" in cache");
+	}
+	catch (std::exception& e) {
+		log_warning("Could not write texture cache file: " << e.what());
+	}
+	// same information as when the file is loaded next time
+	format = format_of_components(image_data.components);
+	dds_init(image_data);
+	return true;
+}
+
+
+
 texture::~texture()
 {
 #ifdef MEMMEASURE
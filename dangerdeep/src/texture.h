@@ -42,6 +42,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include <list>
 #include <string>
 #include <memory>
+#include <ctime>
 
 #include "error.h"
 #include "vector3.h"
@@ -116,6 +117,9 @@ public:
 	static bool use_compressed_textures;
 	static bool use_anisotropic_filtering;
 	static float anisotropic_level;
+	/// directory where DDS files compressed on first load are stored, empty means don't write any.
+	/// Precomputed files are searched in get_data_dir() + "texcache/" as well.
+	static std::string cache_directory;
 
 private:
 	texture& operator=(const texture& other);
@@ -136,6 +140,7 @@ protected:
 	void sdl_init(SDL_Surface* teximage, unsigned sx, unsigned sy, unsigned sw, unsigned sh,
 		      bool makenormalmap = false, float detailh = 1.0f, bool rgb2grey = false);
 
+
 	void sdl_rgba_init(SDL_Surface* teximagergb, SDL_Surface* teximagea);
 
 	// copy data to OpenGL, set parameters
@@ -199,6 +204,19 @@ __declspec( align( 1 ) )
 	
 	void load_dds(const std::string& filename, dds_data& target);
 
+	// set OpenGL format and components of data in given dxt_compressor::format
+	static void set_compressed_format(dds_data& target, int fmt);
+
+	// OpenGL format of uncompressed data with given number of components
+	static int format_of_components(unsigned components);
+
+	// upload compressed data of all mipmap levels to OpenGL, set parameters
+	void dds_init(const dds_data& image_data);
+
+	// try to load texture from DDS cache, compress and store it on first load.
+	// returns false if caching is not possible, texture is not initialized then.
+	bool cache_init(const std::string& filename);
+
 
 public:
 	class texerror : public error
@@ -283,6 +301,18 @@ public:
 
 	static unsigned get_max_size();
 
+	/// get name of DDS file that caches the compressed version of an image file
+	static std::string get_cache_filename(const std::string& filename);
+
+	/// get modification time of an image file, the latest of both files for "x.jpg|png"
+	static time_t get_source_modification_time(const std::string& filename);
+
+	/// convert sub-area of SDL surface to plain texel data of size tw*th (tw,th >= sw,sh),
+	/// gives GL format of data (GL_RGB, GL_LUMINANCE...) in "format". Needs no GL context.
+	static std::vector<Uint8> sdl_get_data(SDL_Surface* teximage, unsigned sx, unsigned sy,
+					       unsigned sw, unsigned sh, unsigned tw, unsigned th,
+					       bool rgb2grey, int& format, const std::string& name);
+
 	///> returns if texture sizes other than powers of two are allowed. call after GL init.
 	static bool size_non_power_two();
 
@@ -24,11 +24,11 @@
 #include <SDL.h>
 #include "time.h"
 #include "vector2.h"
-#include "system.h"
 #include "bzip.h"
 #include "bitstream.h"
 #include "morton_bivector.h"
 #include "log.h"
+#include "tile_pyramid.h"
 
 template<class T>
 class tile
@@ -40,7 +40,11 @@ public:
 	tile() : data(1) {};
 	
 	void load(const char *filename, vector2i& _bottom_left, unsigned size);
+	/* loads tile from a level of a tile pyramid file, tile index is bottom left / tile size */
+	void load(const tile_pyramid& pyramid, unsigned level, vector2i& _bottom_left);
 	T get_value(vector2i coord);
+	/* copies n values of a row starting at coord to dest, coord.x+n must not exceed the tile */
+	void get_row(vector2i coord, unsigned n, T* dest);
 
 	/* simple getters */
   	unsigned long get_last_access() const { return last_access; };
@@ -56,7 +60,7 @@ protected:
 
 template<class T>
 tile<T>::tile(const char *filename, vector2i& _bottom_left, unsigned size) 
-: data(size, -200), bottom_left(_bottom_left), last_access(sys().millisec())
+: data(size, tile_pyramid::no_data), bottom_left(_bottom_left), last_access(SDL_GetTicks())
 {
 	std::ifstream file;
 	file.open(filename);
@@ -77,9 +81,9 @@ tile<T>::tile(const char *filename, vector2i& _bottom_left, unsigned size)
 template<class T>
 void tile<T>::load(const char *filename, vector2i& _bottom_left, unsigned size)
 {
-	data.resize(size, -200);
+	data.resize(size, tile_pyramid::no_data);
 	bottom_left = _bottom_left;
-	last_access = sys().millisec();
+	last_access = SDL_GetTicks();
 	
 	std::ifstream file;
 	file.open(filename);
@@ -97,6 +101,29 @@ void tile<T>::load(const char *filename, vector2i& _bottom_left, unsigned size)
 	}
 }
 
+template<class T>
+void tile<T>::load(const tile_pyramid& pyramid, unsigned level, vector2i& _bottom_left)
+{
+	unsigned size = pyramid.get_tile_size();
+	bottom_left = _bottom_left;
+	last_access = SDL_GetTicks();
+
+	morton_bivector<Sint16> buffer;
+	if (pyramid.read_tile(level, vector2i(bottom_left.x / int(size), bottom_left.y / int(size)), buffer)) {
+		data.resize(size);
+		const Sint16* src = buffer.data_ptr();
+		T* dst = data.data_ptr();
+		for (unsigned i = 0; i < size*size; ++i)
+			dst[i] = T(src[i]);
+	} else {
+		data.resize(size, tile_pyramid::no_data);
+		std::stringstream msg;
+		msg << "No data in tile pyramid for tile ";
+		msg << bottom_left;
+		log_warning(msg.str());
+	}
+}
+
 template<class T>
 tile<T>::tile(const tile<T>& other) 
 	: data(other.get_data()), bottom_left(other.get_bottom_left()), last_access(other.get_last_access())
@@ -106,8 +133,16 @@ tile<T>::tile(const tile<T>& other)
 template<class T>
 T tile<T>::get_value(vector2i coord) 
 {
-	last_access = sys().millisec();
+	last_access = SDL_GetTicks();
 	coord.y = data.size()-coord.y-1;
 	return data.at(coord);
 }
+
+template<class T>
+void tile<T>::get_row(vector2i coord, unsigned n, T* dest) 
+{
+	last_access = SDL_GetTicks();
+	coord.y = data.size()-coord.y-1;
+	data.get_row(coord.x, coord.y, n, dest);
+}
 #endif
@@ -23,9 +23,11 @@
 #include <map>
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include <vector>
+#include <cmath>
 #include "tile.h"
 #include "vector2.h"
-#include "system.h"
 
 /* A simple tile cache.
  * 
@@ -46,6 +48,8 @@ public:
 		int 			tile_size;
 		unsigned int 	slots;
 		unsigned long 	expire;
+		const tile_pyramid* pyramid;
+		unsigned		level;
 	};
 	
 	/* The compare function for the std::map */
@@ -84,15 +88,44 @@ public:
 		configuration.tile_size = tile_size;
 		configuration.slots = slots;
 		configuration.expire = expire;
+		configuration.pyramid = 0;
+		configuration.level = 0;
+	};
 
+	/* Constructs a tile_cache object that reads tiles from a level of a tile pyramid file
+	 * instead of single tile files. The pyramid must exist as long as the cache.
+	 * 
+	 * overall_rows/overall_cols: size of the image at that level
+	 */
+	tile_cache(const tile_pyramid& pyramid, unsigned level, int overall_rows, int overall_cols,
+				unsigned int slots, unsigned long expire) 
+	{
+		configuration.overall_rows = overall_rows;
+		configuration.overall_cols = overall_cols;
+		configuration.tile_size = pyramid.get_tile_size();
+		configuration.slots = slots;
+		configuration.expire = expire;
+		configuration.pyramid = &pyramid;
+		configuration.level = level;
 	};
-	tile_cache() {};
+	tile_cache() { configuration.pyramid = 0; configuration.level = 0; };
 	/* Returns a value from the corresponding tile. If the tile isn't in the cache it's added to it.
 	 * 
 	 * coord: should be clear. Note that it takes global coordinates, no tile local coordinates!
 	 */
   	T get_value(vector2i coord);
 
+	/* Copies n consecutive values of a row starting at global coordinates coord to dest.
+	 * Each touched tile is looked up only once, so this is much faster than get_value
+	 * for many values.
+	 */
+	void get_row(vector2i coord, unsigned n, T* dest);
+
+	/* Resamples n values of a row bilinearly, value i is at global coordinates (x0 + i*dx, y).
+	 * The two needed rows are read once with get_row.
+	 */
+	void get_bilinear_row(double x0, double dx, double y, unsigned n, float* dest);
+
 	/* Removes all tiles from cache */
   	void flush();
 	
@@ -101,7 +134,13 @@ protected:
 	std::map<vector2i, tile<T>, coord_compare> tile_list;
 	/* holds all configuration related variables */
 	config_type configuration;
+	/* rows read by get_bilinear_row, kept to avoid reallocation */
+	std::vector<T> bilinear_rows[2];
 	
+	/* returns the tile with given bottom left corner, loads it if it isn't in the cache */
+	tile<T>& get_tile(const vector2i& tile_coord);
+	/* wraps global coordinates (y already flipped) to the image size */
+	inline void wrap_coord(vector2i& coord) const;
 	/* removes the least recently used tile from cache */
 	inline void free_slot();
 	/* removes all expired tiles from cache */
@@ -113,44 +152,104 @@ protected:
 template<class T>
 T tile_cache<T>::get_value(vector2i coord) 
 {
-	T return_value;
 	coord.y = configuration.overall_rows-coord.y;
-	
-	/* wrap coordinates if needed */
-	if (coord.x >= configuration.overall_cols) coord.x-= configuration.overall_cols;
-	if (coord.y >= configuration.overall_rows) coord.y-= configuration.overall_rows;
-	if (coord.x < 0) coord.x+= configuration.overall_cols;
-	if (coord.y < 0) coord.y+= configuration.overall_rows;
+	wrap_coord(coord);
 
 	vector2i tile_coord = coord_to_tile(coord);
+	T return_value = get_tile(tile_coord).get_value(coord-tile_coord);
+	erase_expired();
 
-	tile_list_iterator it = tile_list.find(tile_coord);
+	return return_value;
+}
 
-	if(it != tile_list.end()) return_value = it->second.get_value(coord-tile_coord);
-	else {
-		if (configuration.slots>0 && tile_list.size()>=configuration.slots) 
-			free_slot();
+template<class T>
+void tile_cache<T>::get_row(vector2i coord, unsigned n, T* dest) 
+{
+	coord.y = configuration.overall_rows-coord.y;
+	wrap_coord(coord);
 
-		std::stringstream filename;
-		filename << configuration.tile_folder;
-		filename << tile_coord.y;
-		filename << "_";
-		filename << tile_coord.x;
-		filename << ".bz2";
+	while (n > 0) {
+		vector2i tile_coord = coord_to_tile(coord);
+		/* copy up to the end of the tile or the image */
+		int end_x = std::min(tile_coord.x + configuration.tile_size, configuration.overall_cols);
+		unsigned m = std::min(n, unsigned(end_x - coord.x));
+		get_tile(tile_coord).get_row(coord-tile_coord, m, dest);
+		dest += m;
+		n -= m;
+		coord.x += m;
+		if (coord.x >= configuration.overall_cols) coord.x -= configuration.overall_cols;
+	}
+	erase_expired();
+}
+
+template<class T>
+void tile_cache<T>::get_bilinear_row(double x0, double dx, double y, unsigned n, float* dest)
+{
+	if (n == 0) return;
+	int iy = int(floor(y));
+	float fy = float(y - iy);
+	int ix_min = int(floor(x0));
+	int ix_max = int(floor(x0 + dx * (n - 1))) + 1;
+	unsigned m = unsigned(ix_max - ix_min + 1);
+	bilinear_rows[0].resize(m);
+	bilinear_rows[1].resize(m);
+	get_row(vector2i(ix_min, iy), m, &bilinear_rows[0][0]);
+	get_row(vector2i(ix_min, iy + 1), m, &bilinear_rows[1][0]);
+	const T* row0 = &bilinear_rows[0][0];
+	const T* row1 = &bilinear_rows[1][0];
+	for (unsigned x = 0; x < n; ++x) {
+		double gx = x0 + dx * x;
+		int ix = int(floor(gx));
+		float fx = float(gx - ix);
+		unsigned i = unsigned(ix - ix_min);
+		float h0 = row0[i] * (1.0f - fx) + row0[i + 1] * fx;
+		float h1 = row1[i] * (1.0f - fx) + row1[i + 1] * fx;
+		dest[x] = h0 * (1.0f - fy) + h1 * fy;
+	}
+}
+
+template<class T>
+tile<T>& tile_cache<T>::get_tile(const vector2i& tile_coord) 
+{
+	tile_list_iterator it = tile_list.find(tile_coord);
+	if (it != tile_list.end()) return it->second;
+
+	if (configuration.slots>0 && tile_list.size()>=configuration.slots) 
+		free_slot();
 
+	vector2i bottom_left = tile_coord;
+	if (configuration.pyramid) {
 		std::pair<tile_list_iterator, bool> p = tile_list.insert(std::pair<vector2i, tile<T> >(tile_coord, tile<T>()));
-		p.first->second.load(filename.str().c_str(), tile_coord, configuration.tile_size);
-		return_value = p.first->second.get_value(coord-tile_coord);
+		p.first->second.load(*configuration.pyramid, configuration.level, bottom_left);
+		return p.first->second;
 	}
-	erase_expired();
 
-	return return_value;
+	std::stringstream filename;
+	filename << configuration.tile_folder;
+	filename << tile_coord.y;
+	filename << "_";
+	filename << tile_coord.x;
+	filename << ".bz2";
+
+	std::pair<tile_list_iterator, bool> p = tile_list.insert(std::pair<vector2i, tile<T> >(tile_coord, tile<T>()));
+	p.first->second.load(filename.str().c_str(), bottom_left, configuration.tile_size);
+	return p.first->second;
+}
+
+template<class T>
+inline void tile_cache<T>::wrap_coord(vector2i& coord) const
+{
+	/* wrap coordinates if needed */
+	if (coord.x >= configuration.overall_cols) coord.x-= configuration.overall_cols;
+	if (coord.y >= configuration.overall_rows) coord.y-= configuration.overall_rows;
+	if (coord.x < 0) coord.x+= configuration.overall_cols;
+	if (coord.y < 0) coord.y+= configuration.overall_rows;
 }
 
 template<class T>
 inline void tile_cache<T>::free_slot() 
 {
-	unsigned long min = sys().millisec();
+	unsigned long min = SDL_GetTicks();
 	vector2i min_key;
 	for (tile_list_iterator it = tile_list.begin(); it != tile_list.end(); it++) {
 		if (it->second.get_last_access()<=min) {
@@ -165,7 +264,7 @@ template<class T>
 inline void tile_cache<T>::erase_expired() 
 {
 	if (configuration.expire>0) {
-		long time = sys().millisec();
+		long time = SDL_GetTicks();
 		for (tile_list_iterator it = tile_list.begin(); it != tile_list.end();)
 			if (time-it->second.get_last_access() >= configuration.expire) {
 				tile_list.erase(it++);
@@ -0,0 +1,534 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// multiresolution container file for height map tiles
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "tile_pyramid.h"
+#include "lz_codec.h"
+#include "bzip.h"
+#include "error.h"
+#include <sstream>
+#include <string.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char magic[8] = { 'D', 'F', 'T', 'D', 'P', 'Y', 'R', '1' };
+const unsigned dir_entry_size = 16;
+
+inline void put_u32(Uint8* p, Uint32 v)
+{
+	for (unsigned i = 0; i < 4; ++i)
+		p[i] = Uint8(v >> (8*i));
+}
+
+inline Uint32 get_u32(const Uint8* p)
+{
+	return p[0] | (Uint32(p[1]) << 8) | (Uint32(p[2]) << 16) | (Uint32(p[3]) << 24);
+}
+
+void put_entry(Uint8* p, const tile_pyramid::tile_info& ti)
+{
+	put_u32(p, Uint32(ti.offset));
+	put_u32(p + 4, Uint32(ti.offset >> 32));
+	put_u32(p + 8, ti.size);
+	p[12] = Uint8(Uint16(ti.min_height));
+	p[13] = Uint8(Uint16(ti.min_height) >> 8);
+	p[14] = Uint8(Uint16(ti.max_height));
+	p[15] = Uint8(Uint16(ti.max_height) >> 8);
+}
+
+tile_pyramid::tile_info get_entry(const Uint8* p)
+{
+	tile_pyramid::tile_info ti;
+	ti.offset = get_u32(p) | (Uint64(get_u32(p + 4)) << 32);
+	ti.size = get_u32(p + 8);
+	ti.min_height = Sint16(p[12] | (p[13] << 8));
+	ti.max_height = Sint16(p[14] | (p[15] << 8));
+	return ti;
+}
+
+std::vector<unsigned> compute_level_first(const std::vector<vector2i>& levels)
+{
+	std::vector<unsigned> first(levels.size());
+	unsigned n = 0;
+	for (unsigned i = 0; i < levels.size(); ++i) {
+		first[i] = n;
+		n += levels[i].x * levels[i].y;
+	}
+	return first;
+}
+
+}
+
+
+
+// tile loaders pass it by reference
+const Sint16 tile_pyramid::no_data;
+
+
+
+std::vector<vector2i> tile_pyramid::compute_levels(const vector2i& tiles)
+{
+	std::vector<vector2i> levels;
+	vector2i t = tiles;
+	levels.push_back(t);
+	while (t.x > 1 || t.y > 1) {
+		t = vector2i((t.x + 1) / 2, (t.y + 1) / 2);
+		levels.push_back(t);
+	}
+	return levels;
+}
+
+
+
+Uint64 tile_pyramid::header_size(const std::vector<vector2i>& levels)
+{
+	Uint64 n = 0;
+	for (unsigned i = 0; i < levels.size(); ++i)
+		n += levels[i].x * levels[i].y;
+	return sizeof(magic) + 3*4 + levels.size() * 2*4 + n * dir_entry_size;
+}
+
+
+
+void tile_pyramid::encode_tile(const morton_bivector<Sint16>& data, codec_type c,
+			       std::vector<Uint8>& out, Sint16& minh, Sint16& maxh)
+{
+	unsigned n = data.size() * data.size();
+	const Sint16* src = data.data_ptr();
+	std::vector<Uint8> planes(2 * n);
+	Sint16 prev = 0;
+	minh = maxh = src[0];
+	for (unsigned i = 0; i < n; ++i) {
+		Uint16 d = Uint16(src[i] - prev);
+		prev = src[i];
+		planes[i] = Uint8(d);
+		planes[n + i] = Uint8(d >> 8);
+		minh = std::min(minh, src[i]);
+		maxh = std::max(maxh, src[i]);
+	}
+	out.clear();
+	switch (c) {
+	case CODEC_NONE:
+		out.swap(planes);
+		break;
+	case CODEC_BZIP2: {
+		std::ostringstream os;
+		bzip_ostream bout(&os);
+		bout.write((const char*)&planes[0], planes.size());
+		bout.close();
+		std::string s = os.str();
+		out.assign(s.begin(), s.end());
+		break;
+	}
+	case CODEC_LZ:
+		lz_codec::compress(&planes[0], planes.size(), out);
+		break;
+	default:
+		throw error("tile_pyramid: unknown codec");
+	}
+}
+
+
+
+void tile_pyramid::decode_tile(const Uint8* src, unsigned n, codec_type c,
+			       morton_bivector<Sint16>& dest)
+{
+	unsigned nr = dest.size() * dest.size();
+	std::vector<Uint8> planes(2 * nr);
+	switch (c) {
+	case CODEC_NONE:
+		if (n != planes.size())
+			throw error("tile_pyramid: invalid tile size");
+		memcpy(&planes[0], src, n);
+		break;
+	case CODEC_BZIP2: {
+		std::istringstream is(std::string((const char*)src, n));
+		bzip_istream bin(&is);
+		bin.read((char*)&planes[0], planes.size());
+		if (unsigned(bin.gcount()) != planes.size())
+			throw error("tile_pyramid: truncated tile");
+		bin.close();
+		break;
+	}
+	case CODEC_LZ:
+		lz_codec::decompress(src, n, &planes[0], planes.size());
+		break;
+	default:
+		throw error("tile_pyramid: unknown codec");
+	}
+	Sint16* d = dest.data_ptr();
+	Sint16 prev = 0;
+	for (unsigned i = 0; i < nr; ++i) {
+		prev = Sint16(prev + Sint16(planes[i] | (planes[nr + i] << 8)));
+		d[i] = prev;
+	}
+}
+
+
+
+tile_pyramid::tile_pyramid(const std::string& filename)
+	: tile_size(0), codec(CODEC_NONE), mapped(0), mapped_size(0)
+#ifndef WIN32
+	, fd(-1)
+#endif
+{
+#ifdef WIN32
+	file.open(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!file.good())
+		throw file_read_error(filename);
+	file.seekg(0, std::ios::end);
+	mapped_size = file.tellg();
+	file.seekg(0, std::ios::beg);
+	// read fixed part of header, the rest is read below
+	header_data.resize(std::min(Uint64(sizeof(magic) + 3*4), mapped_size));
+	file.read((char*)&header_data[0], header_data.size());
+	mapped = &header_data[0];
+#else
+	fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw file_read_error(filename);
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		throw file_read_error(filename);
+	}
+	mapped_size = st.st_size;
+	void* m = mmap(0, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (m == MAP_FAILED) {
+		::close(fd);
+		throw file_read_error(filename);
+	}
+	mapped = (const Uint8*)m;
+#endif
+	try {
+		read_directory(filename);
+	}
+	catch (...) {
+#ifndef WIN32
+		munmap((void*)mapped, mapped_size);
+		::close(fd);
+#endif
+		throw;
+	}
+}
+
+
+
+void tile_pyramid::read_directory(const std::string& filename)
+{
+	if (mapped_size < sizeof(magic) + 3*4 || memcmp(mapped, magic, sizeof(magic)) != 0)
+		throw error(filename + " is no tile pyramid file");
+	tile_size = get_u32(mapped + 8);
+	unsigned nr_levels = get_u32(mapped + 12);
+	codec = codec_type(get_u32(mapped + 16));
+	if (tile_size == 0 || (tile_size & (tile_size - 1)) != 0 || nr_levels == 0 || nr_levels > 32)
+		throw error(filename + ": invalid tile pyramid header");
+	unsigned levels_start = sizeof(magic) + 3*4;
+#ifdef WIN32
+	header_data.resize(levels_start + nr_levels * 2*4);
+	file.read((char*)&header_data[levels_start], nr_levels * 2*4);
+	mapped = &header_data[0];
+#endif
+	const Uint8* p = mapped + levels_start;
+	for (unsigned i = 0; i < nr_levels; ++i, p += 8)
+		level_tiles.push_back(vector2i(get_u32(p), get_u32(p + 4)));
+	level_first = compute_level_first(level_tiles);
+	Uint64 hs = header_size(level_tiles);
+	if (hs > mapped_size)
+		throw error(filename + ": truncated tile pyramid directory");
+	unsigned dir_start = levels_start + nr_levels * 2*4;
+	unsigned nr_tiles = (hs - dir_start) / dir_entry_size;
+#ifdef WIN32
+	header_data.resize(hs);
+	file.read((char*)&header_data[dir_start], hs - dir_start);
+	mapped = &header_data[0];
+#endif
+	p = mapped + dir_start;
+	directory.reserve(nr_tiles);
+	for (unsigned i = 0; i < nr_tiles; ++i, p += dir_entry_size) {
+		directory.push_back(get_entry(p));
+		if (directory.back().offset + directory.back().size > mapped_size)
+			throw error(filename + ": tile data beyond end of file");
+	}
+}
+
+
+
+tile_pyramid::~tile_pyramid()
+{
+#ifndef WIN32
+	munmap((void*)mapped, mapped_size);
+	::close(fd);
+#endif
+}
+
+
+
+unsigned tile_pyramid::tile_index(unsigned level, const vector2i& idx) const
+{
+	const vector2i& t = get_level_tiles(level);
+	if (idx.x < 0 || idx.y < 0 || idx.x >= t.x || idx.y >= t.y)
+		throw error("tile_pyramid: tile index out of range");
+	return level_first[level] + idx.y * t.x + idx.x;
+}
+
+
+
+const tile_pyramid::tile_info& tile_pyramid::get_tile_info(unsigned level, const vector2i& idx) const
+{
+	return directory[tile_index(level, idx)];
+}
+
+
+
+bool tile_pyramid::has_tile(unsigned level, const vector2i& idx) const
+{
+	if (level >= level_tiles.size())
+		return false;
+	const vector2i& t = level_tiles[level];
+	if (idx.x < 0 || idx.y < 0 || idx.x >= t.x || idx.y >= t.y)
+		return false;
+	return get_tile_info(level, idx).size > 0;
+}
+
+
+
+bool tile_pyramid::read_tile(unsigned level, const vector2i& idx, morton_bivector<Sint16>& dest) const
+{
+	if (!has_tile(level, idx))
+		return false;
+	const tile_info& ti = get_tile_info(level, idx);
+	dest.resize(tile_size);
+#ifdef WIN32
+	std::vector<Uint8> buf(ti.size);
+	{
+		mutex_locker ml(file_mutex);
+		file.seekg(ti.offset);
+		file.read((char*)&buf[0], ti.size);
+	}
+	decode_tile(&buf[0], ti.size, codec, dest);
+#else
+	decode_tile(mapped + ti.offset, ti.size, codec, dest);
+#endif
+	return true;
+}
+
+
+
+bool tile_pyramid::read_compressed_tile(unsigned level, const vector2i& idx, std::vector<Uint8>& dest) const
+{
+	if (!has_tile(level, idx))
+		return false;
+	const tile_info& ti = get_tile_info(level, idx);
+	dest.resize(ti.size);
+#ifdef WIN32
+	mutex_locker ml(file_mutex);
+	file.seekg(ti.offset);
+	file.read((char*)&dest[0], ti.size);
+#else
+	memcpy(&dest[0], mapped + ti.offset, ti.size);
+#endif
+	return true;
+}
+
+
+
+tile_pyramid_writer::tile_pyramid_writer(const std::string& filename, const vector2i& tiles,
+					 unsigned tile_size_, tile_pyramid::codec_type codec_)
+	: tile_size(tile_size_), codec(codec_), level_tiles(tile_pyramid::compute_levels(tiles)),
+	  level_first(compute_level_first(level_tiles)), closed(false)
+{
+	directory.resize(level_first.back() + level_tiles.back().x * level_tiles.back().y);
+	file.open(filename.c_str(), std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!file.good())
+		throw error(std::string("can't create ") + filename);
+	// header and directory are written at the end, reserve space for them
+	end_offset = tile_pyramid::header_size(level_tiles);
+	std::vector<char> zeros(end_offset);
+	file.write(&zeros[0], zeros.size());
+}
+
+
+
+tile_pyramid_writer::~tile_pyramid_writer()
+{
+	try {
+		close();
+	}
+	catch (std::exception& ) {
+	}
+}
+
+
+
+void tile_pyramid_writer::write_tile(unsigned level, const vector2i& idx, const morton_bivector<Sint16>& data)
+{
+	if (unsigned(data.size()) != tile_size)
+		throw error("tile_pyramid_writer: wrong tile size");
+	std::vector<Uint8> compressed;
+	Sint16 minh, maxh;
+	tile_pyramid::encode_tile(data, codec, compressed, minh, maxh);
+	write_compressed_tile(level, idx, compressed, minh, maxh);
+}
+
+
+
+void tile_pyramid_writer::write_compressed_tile(unsigned level, const vector2i& idx, const std::vector<Uint8>& data,
+						Sint16 minh, Sint16 maxh)
+{
+	const vector2i& t = get_level_tiles(level);
+	if (idx.x < 0 || idx.y < 0 || idx.x >= t.x || idx.y >= t.y)
+		throw error("tile_pyramid_writer: tile index out of range");
+	mutex_locker ml(file_mutex);
+	tile_pyramid::tile_info& ti = directory[level_first[level] + idx.y * t.x + idx.x];
+	ti.min_height = minh;
+	ti.max_height = maxh;
+	ti.offset = end_offset;
+	ti.size = data.size();
+	file.seekp(end_offset);
+	file.write((const char*)&data[0], data.size());
+	if (!file.good())
+		throw error("tile_pyramid_writer: write failed");
+	end_offset += data.size();
+}
+
+
+
+bool tile_pyramid_writer::read_tile(unsigned level, const vector2i& idx, morton_bivector<Sint16>& dest)
+{
+	const vector2i& t = get_level_tiles(level);
+	if (idx.x < 0 || idx.y < 0 || idx.x >= t.x || idx.y >= t.y)
+		return false;
+	std::vector<Uint8> buf;
+	{
+		mutex_locker ml(file_mutex);
+		const tile_pyramid::tile_info& ti = directory[level_first[level] + idx.y * t.x + idx.x];
+		if (ti.size == 0)
+			return false;
+		buf.resize(ti.size);
+		file.seekg(ti.offset);
+		file.read((char*)&buf[0], ti.size);
+		if (!file.good())
+			throw error("tile_pyramid_writer: read back failed");
+	}
+	dest.resize(tile_size);
+	tile_pyramid::decode_tile(&buf[0], buf.size(), codec, dest);
+	return true;
+}
+
+
+
+bool tile_pyramid_writer::compute_coarser_tile(unsigned level, const vector2i& idx, morton_bivector<Sint16>& dest)
+{
+	morton_bivector<Sint16> src;
+	unsigned h = tile_size / 2;
+	bool any = false;
+	dest.resize(tile_size);
+	// tile data is top down, so the upper source tile (2*y+1) gives the first rows
+	for (unsigned q = 0; q < 4; ++q) {
+		unsigned qx = q & 1, qy = q >> 1;
+		bool found = read_tile(level - 1, vector2i(2*idx.x + qx, 2*idx.y + 1 - qy), src);
+		any = any || found;
+		for (unsigned y = 0; y < h; ++y) {
+			for (unsigned x = 0; x < h; ++x) {
+				// average of the samples that have data, rounded
+				int sum = 0, n = 0;
+				for (unsigned k = 0; found && k < 4; ++k) {
+					Sint16 s = src.at(2*x + (k & 1), 2*y + (k >> 1));
+					if (s != tile_pyramid::no_data) {
+						sum += s;
+						++n;
+					}
+				}
+				Sint16 v = tile_pyramid::no_data;
+				if (n > 0)
+					v = Sint16(sum >= 0 ? (2*sum + n) / (2*n) : -((-2*sum + n) / (2*n)));
+				dest.at(qx*h + x, qy*h + y) = v;
+			}
+		}
+	}
+	return any;
+}
+
+
+
+void tile_pyramid_writer::build_coarser_levels()
+{
+	morton_bivector<Sint16> dst;
+	for (unsigned level = 1; level < level_tiles.size(); ++level) {
+		const vector2i& t = level_tiles[level];
+		for (int ty = 0; ty < t.y; ++ty)
+			for (int tx = 0; tx < t.x; ++tx)
+				if (compute_coarser_tile(level, vector2i(tx, ty), dst))
+					write_tile(level, vector2i(tx, ty), dst);
+	}
+}
+
+
+
+void tile_pyramid_writer::write_directory()
+{
+	std::vector<Uint8> header(tile_pyramid::header_size(level_tiles));
+	memcpy(&header[0], magic, sizeof(magic));
+	put_u32(&header[8], tile_size);
+	put_u32(&header[12], level_tiles.size());
+	put_u32(&header[16], codec);
+	Uint8* p = &header[20];
+	for (unsigned i = 0; i < level_tiles.size(); ++i, p += 8) {
+		put_u32(p, level_tiles[i].x);
+		put_u32(p + 4, level_tiles[i].y);
+	}
+	for (unsigned i = 0; i < directory.size(); ++i, p += dir_entry_size)
+		put_entry(p, directory[i]);
+	file.seekp(0);
+	file.write((const char*)&header[0], header.size());
+}
+
+
+
+void tile_pyramid_writer::flush()
+{
+	mutex_locker ml(file_mutex);
+	write_directory();
+	file.flush();
+	if (!file.good())
+		throw error("tile_pyramid_writer: writing directory failed");
+}
+
+
+
+void tile_pyramid_writer::close()
+{
+	mutex_locker ml(file_mutex);
+	if (closed)
+		return;
+	closed = true;
+	write_directory();
+	file.close();
+	if (file.fail())
+		throw error("tile_pyramid_writer: writing directory failed");
+}
@@ -0,0 +1,190 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// multiresolution container file for height map tiles
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#ifndef TILE_PYRAMID_H
+#define TILE_PYRAMID_H
+
+#include <SDL_types.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "vector2.h"
+#include "morton_bivector.h"
+#include "mutex.h"
+
+///\brief Read access to a container file with all mipmap levels of a tiled height map.
+/** The file holds a header, a directory with offset, compressed size and height
+    range of every tile of every level and the compressed tile data.
+    Level 0 is the full resolution, each coarser level has half the resolution,
+    down to a level that fits into one tile. All tiles have the same size.
+    Tile indices count from the bottom left like the tile coordinates of tile_cache,
+    tile samples are stored in morton order and top down like the tile files.
+    The file is memory mapped, so tiles can be read without file access overhead,
+    from several threads at once. Where there is no mmap (WIN32) file reads
+    are serialized.
+    File layout, all numbers little endian:
+    - "DFTDPYR1", tile size, number of levels, codec (Uint32 each)
+    - per level: number of tiles in x and y (Uint32)
+    - per tile of level 0...n, row by row: offset (Uint64), size (Uint32), min/max height (Sint16)
+    - compressed data. Before compression samples are replaced by the difference to their
+      predecessor and split in planes of low and high bytes, which compresses much better.
+*/
+class tile_pyramid
+{
+ public:
+	/// compression of tiles
+	enum codec_type {
+		CODEC_NONE,
+		CODEC_BZIP2,
+		CODEC_LZ	// see lz_codec
+	};
+
+	/// directory entry of a tile
+	struct tile_info
+	{
+		Uint64 offset;
+		Uint32 size;	// zero when there is no data for the tile
+		Sint16 min_height, max_height;
+		tile_info() : offset(0), size(0), min_height(0), max_height(0) {}
+	};
+
+	/// value of samples that have no data
+	static const Sint16 no_data = -9999;
+
+	/// open container file
+	///@note throws error if the file can't be read or is no valid container
+	tile_pyramid(const std::string& filename);
+	~tile_pyramid();
+
+	unsigned get_tile_size() const { return tile_size; }
+	unsigned get_nr_of_levels() const { return level_tiles.size(); }
+	codec_type get_codec() const { return codec; }
+	/// get number of tiles of a level
+	const vector2i& get_level_tiles(unsigned level) const { return level_tiles.at(level); }
+	/// get number of samples of a level
+	vector2i get_level_size(unsigned level) const { return get_level_tiles(level) * int(tile_size); }
+	/// get directory entry of tile, idx must be inside the level
+	const tile_info& get_tile_info(unsigned level, const vector2i& idx) const;
+	/// check if there is data for a tile
+	bool has_tile(unsigned level, const vector2i& idx) const;
+	/// decompress tile to dest (resized to tile size), returns false if there is no data for it
+	bool read_tile(unsigned level, const vector2i& idx, morton_bivector<Sint16>& dest) const;
+	/// get compressed data of tile as stored in the file, returns false if there is no data for it
+	bool read_compressed_tile(unsigned level, const vector2i& idx, std::vector<Uint8>& dest) const;
+
+	/// compute number of tiles of all levels for given number of tiles of level 0
+	static std::vector<vector2i> compute_levels(const vector2i& tiles);
+	/// delta code and compress tile data, computes the height range as well
+	static void encode_tile(const morton_bivector<Sint16>& data, codec_type c,
+				std::vector<Uint8>& out, Sint16& minh, Sint16& maxh);
+	/// decompress and undo delta coding, dest must have the tile size already
+	static void decode_tile(const Uint8* src, unsigned n, codec_type c,
+				morton_bivector<Sint16>& dest);
+	/// size of the file header and directory
+	static Uint64 header_size(const std::vector<vector2i>& levels);
+
+ protected:
+	unsigned tile_size;
+	codec_type codec;
+	std::vector<vector2i> level_tiles;
+	std::vector<unsigned> level_first;	// directory index of first tile of level
+	std::vector<tile_info> directory;
+	const Uint8* mapped;
+	Uint64 mapped_size;
+#ifdef WIN32
+	mutable std::ifstream file;	// no mmap, tiles are read from file
+	mutable ::mutex file_mutex;	// serializes seek and read
+	std::vector<Uint8> header_data;
+#else
+	int fd;
+#endif
+
+	unsigned tile_index(unsigned level, const vector2i& idx) const;
+	void read_directory(const std::string& filename);
+
+ private:
+	tile_pyramid(const tile_pyramid& );
+	tile_pyramid& operator= (const tile_pyramid& );
+};
+
+
+
+///\brief Creates tile_pyramid container files.
+/** Level 0 tiles are written in any order, coarser levels are computed from
+    them afterwards by averaging 2x2 samples. The tiles are read back from the
+    file for that, so the whole map never needs to be in memory.
+    All methods can be called from several threads at once, file access is
+    serialized, compression is not.
+*/
+class tile_pyramid_writer
+{
+ public:
+	/// create file for a map of given number of tiles at level 0
+	///@note throws error if the file can't be created
+	tile_pyramid_writer(const std::string& filename, const vector2i& tiles, unsigned tile_size,
+			    tile_pyramid::codec_type codec);
+	~tile_pyramid_writer();
+
+	/// store a tile (tile_size * tile_size samples)
+	void write_tile(unsigned level, const vector2i& idx, const morton_bivector<Sint16>& data);
+	/// store a tile that is already compressed with tile_pyramid::encode_tile
+	void write_compressed_tile(unsigned level, const vector2i& idx, const std::vector<Uint8>& data,
+				   Sint16 minh, Sint16 maxh);
+	/// read back a tile, returns false if it has not been written
+	bool read_tile(unsigned level, const vector2i& idx, morton_bivector<Sint16>& dest);
+	/// compute a tile from the four tiles of the next finer level, which must have been
+	/// written before. Returns false if none of them exists.
+	bool compute_coarser_tile(unsigned level, const vector2i& idx, morton_bivector<Sint16>& dest);
+	/// compute tiles of all coarser levels from level 0
+	void build_coarser_levels();
+	/// write header and directory of the tiles written so far, so that the file
+	/// is valid even if the program is interrupted afterwards
+	void flush();
+	/// write directory and close file, called by destructor if not done before
+	void close();
+
+	unsigned get_nr_of_levels() const { return level_tiles.size(); }
+	const vector2i& get_level_tiles(unsigned level) const { return level_tiles.at(level); }
+	/// get total number of compressed bytes of tile data written so far
+	Uint64 get_data_size() const { return end_offset - tile_pyramid::header_size(level_tiles); }
+	/// get tile codec
+	tile_pyramid::codec_type get_codec() const { return codec; }
+
+ protected:
+	std::fstream file;
+	unsigned tile_size;
+	tile_pyramid::codec_type codec;
+	std::vector<vector2i> level_tiles;
+	std::vector<unsigned> level_first;
+	std::vector<tile_pyramid::tile_info> directory;
+	Uint64 end_offset;
+	bool closed;
+	::mutex file_mutex;
+
+	void write_directory();
+
+ private:
+	tile_pyramid_writer(const tile_pyramid_writer& );
+	tile_pyramid_writer& operator= (const tile_pyramid_writer& );
+};
+
+#endif
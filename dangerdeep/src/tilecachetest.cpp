@@ -0,0 +1,210 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+// test of the row access of tiles, tile_cache and the geo coordinate transformation
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#include "global_data.h"
+#include "tile_cache.h"
+#include "tile_pyramid.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+using namespace std;
+
+// directory for the test files, so nothing is written to the working directory
+static string get_temp_dir()
+{
+#ifdef WIN32
+	const char* dir = getenv("TEMP");
+	return string(dir ? dir : ".") + "\\";
+#else
+	const char* dir = getenv("TMPDIR");
+	return string(dir ? dir : "/tmp") + "/";
+#endif
+}
+
+static bool test_geo_rows()
+{
+	// the row version must give the same coordinates as the per sample version
+	unsigned nr_wrong = 0;
+	double maxerr = 0;
+	for (int iy = -100; iy <= 100; ++iy) {
+		float pos_y = iy * 80000.0f + 17.0f;
+		double x_factor;
+		float gy = transform_real_to_geo_row(pos_y, x_factor);
+		for (int ix = -50; ix <= 50; ++ix) {
+			vector2f pos(ix * 400000.0f + 3.0f, pos_y);
+			vector2f geo = transform_real_to_geo(pos);
+			double ex = fabs(pos.x * x_factor - geo.x), ey = fabs(gy - geo.y);
+			maxerr = std::max(maxerr, std::max(ex, ey));
+			if (ex > 1e-5 * std::max(1.0, fabs(double(geo.x))) || ey > 1e-5 * std::max(1.0, fabs(double(geo.y))))
+				++nr_wrong;
+		}
+	}
+	cout << "geo rows: max. difference " << maxerr << ", wrong " << nr_wrong << "\n";
+	return nr_wrong == 0;
+}
+
+
+
+// compare get_row with get_value for rows starting at x, crossing tile and image borders
+static unsigned compare_rows(tile_cache<Sint16>& cache, int x, int y, unsigned n)
+{
+	vector<Sint16> row(n);
+	cache.get_row(vector2i(x, y), n, &row[0]);
+	unsigned nr_wrong = 0;
+	for (unsigned i = 0; i < n; ++i)
+		if (row[i] != cache.get_value(vector2i(x + int(i), y)))
+			++nr_wrong;
+	return nr_wrong;
+}
+
+
+
+// the coarsest terrain level is computed like terrain::generate_patch does it, with one
+// geo transformation per row and get_bilinear_row. It is compared with the former per
+// sample computation, transform_real_to_geo and get_value for each sample, filtered
+// bilinearly as well.
+static unsigned compare_coarse_patch(tile_cache<Sint16>& cache, unsigned level, int detail,
+				     const vector2i& coord_bl, const vector2i& coord_sz, double& maxerr)
+{
+	// one sample per arc minute, origin in the middle of the image
+	const float sample_spacing = 50.0f;
+	const double resolution = 60.0;
+	const vector2i origin(80, 48);
+	const double level_scale = 1.0 / (1 << level);
+	const double level_offset = ((1 << level) - 1) * 0.5;
+	const float step = float(1 << detail) * sample_spacing;
+	vector<float> row(coord_sz.x);
+	unsigned nr_wrong = 0;
+	for (int y = 0; y < coord_sz.y; ++y) {
+		double x_factor;
+		float pos_y = float((coord_bl.y + y) << detail) * sample_spacing;
+		double gy = transform_real_to_geo_row(pos_y, x_factor) * resolution + origin.y;
+		double gx0 = float(coord_bl.x << detail) * sample_spacing * x_factor * resolution + origin.x;
+		double gdx = step * x_factor * resolution;
+		cache.get_bilinear_row((gx0 - level_offset) * level_scale, gdx * level_scale,
+				       (gy + level_offset) * level_scale, coord_sz.x, &row[0]);
+		for (int x = 0; x < coord_sz.x; ++x) {
+			vector2f pos(float((coord_bl.x + x) << detail) * sample_spacing, pos_y);
+			vector2f geo = transform_real_to_geo(pos);
+			double sx = (geo.x * resolution + origin.x - level_offset) * level_scale;
+			double sy = (geo.y * resolution + origin.y + level_offset) * level_scale;
+			int ix = int(floor(sx)), iy = int(floor(sy));
+			double fx = sx - ix, fy = sy - iy;
+			double h0 = cache.get_value(vector2i(ix, iy)) * (1.0 - fx) + cache.get_value(vector2i(ix + 1, iy)) * fx;
+			double h1 = cache.get_value(vector2i(ix, iy + 1)) * (1.0 - fx) + cache.get_value(vector2i(ix + 1, iy + 1)) * fx;
+			double err = fabs(h0 * (1.0 - fy) + h1 * fy - row[x]);
+			maxerr = std::max(maxerr, err);
+			// the sample positions differ by float precision only
+			if (err > 0.5)
+				++nr_wrong;
+		}
+	}
+	return nr_wrong;
+}
+
+
+
+static bool test_tile_rows()
+{
+	const string filename = get_temp_dir() + "tilecachetest.pyr";
+	const int sz = 32;
+	const vector2i tiles(5, 3);
+	{
+		tile_pyramid_writer w(filename, tiles, sz, tile_pyramid::CODEC_LZ);
+		morton_bivector<Sint16> t(sz);
+		for (int ty = 0; ty < tiles.y; ++ty) {
+			for (int tx = 0; tx < tiles.x; ++tx) {
+				for (int y = 0; y < sz; ++y)
+					for (int x = 0; x < sz; ++x)
+						t.at(x, y) = Sint16((ty * sz + y) * 200 + tx * sz + x);
+				w.write_tile(0, vector2i(tx, ty), t);
+			}
+		}
+		w.build_coarser_levels();
+	}
+	tile_pyramid pyramid(filename);
+	bool ok = true;
+
+	// tile, every start and length inside the tile
+	{
+		tile<Sint16> tl;
+		vector2i bl(2 * sz, sz);
+		tl.load(pyramid, 0, bl);
+		vector<Sint16> row(sz);
+		unsigned nr_wrong = 0;
+		for (int y = 0; y < sz; ++y)
+			for (int x = 0; x < sz; ++x) {
+				tl.get_row(vector2i(x, y), sz - x, &row[0]);
+				for (int i = 0; i < sz - x; ++i)
+					if (row[i] != tl.get_value(vector2i(x + i, y)))
+						++nr_wrong;
+			}
+		cout << "tile rows: wrong " << nr_wrong << "\n";
+		ok = ok && nr_wrong == 0;
+	}
+
+	// cache of level 0 and 1, with few slots, so tiles are reloaded while a row is read
+	for (unsigned level = 0; level < 2; ++level) {
+		int rows = tiles.y * sz >> level, cols = tiles.x * sz >> level;
+		tile_cache<Sint16> cache(pyramid, level, rows, cols, 2, 0);
+		unsigned nr_wrong = 0;
+		// rows across tile borders, the right image border and from left of the image
+		const int xs[] = { 0, 1, sz - 1, sz, cols / 2 + 3, cols - sz - 1, cols - 1, -1, -sz, -cols };
+		const int ys[] = { 0, 1, sz - 1, sz, rows / 2, rows - 1, rows, -1, rows + sz };
+		for (unsigned i = 0; i < sizeof(xs)/sizeof(int); ++i)
+			for (unsigned j = 0; j < sizeof(ys)/sizeof(int); ++j)
+				for (unsigned n = 1; n <= unsigned(cols + 3); n += 7)
+					if (xs[i] + int(n) < 2 * cols)
+						nr_wrong += compare_rows(cache, xs[i], ys[j], n);
+		cout << "cache rows of level " << level << ": wrong " << nr_wrong << "\n";
+		ok = ok && nr_wrong == 0;
+
+		// patches of the coarsest terrain level, also across the image borders
+		double maxerr = 0;
+		nr_wrong = 0;
+		const int bls[][2] = { { 0, 0 }, { -20, -10 }, { -70, 25 }, { 60, -40 } };
+		for (unsigned i = 0; i < sizeof(bls)/sizeof(bls[0]); ++i)
+			for (int detail = 4; detail <= 6; ++detail)
+				nr_wrong += compare_coarse_patch(cache, level, detail, vector2i(bls[i][0], bls[i][1]),
+								 vector2i(37, 23), maxerr);
+		cout << "coarse patch of level " << level << ": max. difference " << maxerr
+		     << ", wrong " << nr_wrong << "\n";
+		ok = ok && nr_wrong == 0;
+	}
+	remove(filename.c_str());
+	return ok;
+}
+
+
+
+int main(int, char**)
+{
+	// tiles use the SDL timer
+	SDL_Init(SDL_INIT_TIMER);
+	bool ok = test_geo_rows();
+	ok = test_tile_rows() && ok;
+	cout << (ok ? "OK" : "FAILED") << "\n";
+	SDL_Quit();
+	return ok ? 0 : 1;
+}
@@ -17,7 +17,8 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
-/* Splits the ETOPO1 cell-centered float binary file into tiles */
+/* Splits the ETOPO1 cell-centered float binary file into tiles, either as single
+   files or as a tile pyramid container with all coarser levels */
 
 #include <SDL.h>
 #include <fstream>
@@ -25,12 +26,18 @@
 #include <stdlib.h>
 #include <string>
 #include <list>
+#include <map>
+#include <cstdio>
 
 #include "../vector2.h"
 #include "../morton_bivector.h"
 #include "../mymain.cpp"
 #include "../bzip.h"
 #include "../terrain.h"
+#include "../tile_pyramid.h"
+#include "../thread.h"
+#include "../error.h"
+#include "../filehelper.h"
 
 inline void print_tile(morton_bivector<Sint16>& tile) 
 {
@@ -44,34 +51,401 @@ inline void print_tile(morton_bivector<Sint16>& tile)
 	std::cout << std::endl;
 }
 
-inline void load_tile(ifstream& file, morton_bivector<Sint16>& tile, vector2i tl, vector2i map_size, vector2i padded_size)
+inline void load_tile(ifstream& file, morton_bivector<Sint16>& tile, vector2i tl, vector2i map_size, vector2i padded_size,
+		      std::vector<float>& buffer)
 {
 	// from tl to br ...
-	
-	float buffer = 0.0;
-	for(int y=0; y<tile.size(); y++) {	
-		for(int x=0; x<tile.size(); x++) {
-			
-			vector2i pos(tl.x+x, tl.y+y);
-			if((padded_size.x-pos.x)>map_size.x || (padded_size.y-pos.y)>map_size.y) tile.at(x,y) = -9999;
-			else {
-				file.seekg(((pos.y*map_size.x)+pos.x)*sizeof(float));
-				file.read((char*)&buffer, sizeof(buffer));
-				tile.at(x,y) = (Sint16)buffer;
-			}  
+	// samples left of/above the map are padding, the others are read row by row.
+	// the file offset is computed from the unpadded position like before.
+	int n = tile.size();
+	int x0 = std::max(padded_size.x - map_size.x - tl.x, 0);
+	buffer.resize(n);
+	std::vector<Sint16> row(n);
+	for(int y=0; y<n; y++) {
+		int nr = 0;
+		int pos_y = tl.y + y;
+		if ((padded_size.y - pos_y) <= map_size.y && x0 < n) {
+			file.clear();
+			file.seekg(((Uint64(pos_y)*map_size.x)+tl.x+x0)*sizeof(float));
+			file.read((char*)&buffer[x0], (n-x0)*sizeof(float));
+			nr = file.gcount() / sizeof(float);
+		}
+		for(int x=0; x<n; x++) {
+			// samples beyond the end of the file have no data as well
+			row[x] = (x >= x0 && x-x0 < nr) ? Sint16(buffer[x]) : tile_pyramid::no_data;
 		}
+		tile.set_row(0, y, n, &row[0]);
 	}
 }
 
-int mymain(list<string>& args)
+/// 32bit FNV-1a checksum
+static Uint32 checksum(const void* data, unsigned size)
+{
+	const Uint8* p = (const Uint8*)data;
+	Uint32 h = 2166136261U;
+	for (unsigned i = 0; i < size; ++i)
+		h = (h ^ p[i]) * 16777619U;
+	return h;
+}
+
+/// checksums of tiles written by previous runs, so that tiles which are up to date can be skipped.
+/** Every finished tile is appended to the file at once, so an interrupted run can be resumed.
+    Later lines override earlier ones, the file is rewritten compacted at the end.
+*/
+class manifest
 {
+ public:
+	struct entry
+	{
+		Uint32 source;		// checksum of uncompressed tile data
+		Uint32 size;		// compressed size
+		Uint32 output;		// checksum of compressed data
+		entry(Uint32 s = 0, Uint32 sz = 0, Uint32 o = 0) : source(s), size(sz), output(o) {}
+	};
 
+	/// read file, entries are dropped when it was written with different parameters
+	manifest(const std::string& filename_, const std::string& header_)
+		: filename(filename_), header(header_)
+	{
+		std::ifstream in(filename.c_str());
+		std::string line;
+		if (!std::getline(in, line) || line != header)
+			return;
+		while (std::getline(in, line)) {
+			std::istringstream iss(line);
+			std::string name;
+			entry e;
+			iss >> name >> std::hex >> e.source >> std::dec >> e.size >> std::hex >> e.output;
+			if (!iss.fail())
+				entries[name] = e;
+		}
+	}
+
+	/// look up tile, returns false if unknown
+	bool find(const std::string& name, entry& e) {
+		mutex_locker ml(mtx);
+		std::map<std::string, entry>::const_iterator it = entries.find(name);
+		if (it == entries.end())
+			return false;
+		e = it->second;
+		return true;
+	}
+
+	/// store entry of finished tile
+	void update(const std::string& name, const entry& e) {
+		mutex_locker ml(mtx);
+		entries[name] = e;
+		if (!out.is_open()) {
+			// start new file with all old entries that are still valid
+			save();
+			out.open(filename.c_str(), std::ios::app);
+		}
+		write_entry(out, name, e);
+		out.flush();
+	}
+
+	/// write compacted file
+	void save() {
+		mutex_locker ml(mtx);
+		if (out.is_open())
+			out.close();
+		std::ofstream o(filename.c_str());
+		o << header << "\n";
+		for (std::map<std::string, entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+			write_entry(o, it->first, it->second);
+	}
+
+	bool empty() const { return entries.empty(); }
+
+ protected:
+	std::string filename, header;
+	std::map<std::string, entry> entries;
+	std::ofstream out;
+	::mutex mtx;
+
+	static void write_entry(std::ostream& o, const std::string& name, const entry& e) {
+		o << name << " " << std::hex << e.source << " " << std::dec << e.size << " "
+		  << std::hex << e.output << std::dec << "\n";
+	}
+};
+
+/// shared state of all threads computing tiles
+class precompute
+{
+ public:
 	std::string infile, outdir;
+	vector2i map_size, padded_size;
+	unsigned tile_size;
+	tile_pyramid::codec_type codec;
+	tile_pyramid_writer* pyramid;	// when writing a container instead of files
+	const tile_pyramid* old_pyramid;	// container of previous run to take unchanged tiles from
+	manifest* mf;
+
+	struct job
+	{
+		unsigned level;
+		vector2i idx;	// tile index, counts from bottom left
+		vector2i pos;	// top left sample of level 0 tiles
+		bool copy;	// level 0 tile outside the clip rectangle, taken from old_pyramid
+		job(unsigned l = 0, const vector2i& i = vector2i(), const vector2i& p = vector2i(), bool c = false)
+			: level(l), idx(i), pos(p), copy(c) {}
+	};
+
+	precompute() : tile_size(0), codec(tile_pyramid::CODEC_BZIP2), pyramid(0), old_pyramid(0), mf(0),
+		       current_level(0), nr_total(0), nr_done(0), total_done(0), total_skipped(0), bytes_in(0), bytes_out(0), start_time(0), last_print(0) {}
+
+	/// set up jobs of a level, level 0 tiles inside the clip rectangle, all tiles for coarser levels.
+	/// Level 0 tiles outside the clip rectangle are copied from old_pyramid.
+	void add_jobs(unsigned level, const vector2i& start, const vector2i& end);
+
+	/// get next job, returns false when all jobs are done
+	bool next_job(job& j) {
+		mutex_locker ml(job_mutex);
+		if (jobs.empty())
+			return false;
+		j = jobs.front();
+		jobs.pop_front();
+		return true;
+	}
+
+	/// compute a tile. Each thread has its own file stream and buffers.
+	void process(const job& j, std::ifstream& in, morton_bivector<Sint16>& tile, std::vector<float>& rowbuf);
+
+	/// print progress at most once per second, flushes the container as well
+	void print_progress(bool force);
+	/// print final statistics
+	void print_summary();
+
+ protected:
+	std::list<job> jobs;
+	::mutex job_mutex;
+	unsigned current_level;
+	std::vector<std::vector<char> > changed;	// per level and tile, if tile was rewritten
+	unsigned nr_total, nr_done;	// of current level
+	unsigned total_done, total_skipped;
+	Uint64 bytes_in, bytes_out;
+	Uint32 start_time, last_print;
+	::mutex stats_mutex;
+
+	std::string tile_name(const vector2i& pos) const;
+	bool reuse_tile(const job& j, const manifest::entry& e, Sint16& minh, Sint16& maxh,
+			std::vector<Uint8>& data);
+	void tile_finished(bool skipped, unsigned in, unsigned out);
+};
+
+/// thread that processes jobs in parallel to the main thread
+class precompute_worker : public thread
+{
+	precompute& pc;
+	std::ifstream in;
+	morton_bivector<Sint16> tile;
+	std::vector<float> rowbuf;
+
+	void loop() {
+		precompute::job j;
+		if (pc.next_job(j))
+			pc.process(j, in, tile, rowbuf);
+		else
+			request_abort();
+	}
+
+ public:
+	precompute_worker(precompute& pc_) : thread("mapprecomp"), pc(pc_) {
+		in.open(pc.infile.c_str(), std::ios::in | std::ios::binary);
+		if (in.fail())
+			throw error(std::string("Could not open file ") + pc.infile);
+	}
+};
+
+void precompute::add_jobs(unsigned level, const vector2i& start, const vector2i& end)
+{
+	mutex_locker ml(job_mutex);
+	current_level = level;
+	if (level == 0) {
+		for (int y = 0; y < padded_size.y; y += tile_size)
+			for (int x = 0; x < padded_size.x; x += tile_size) {
+				bool inside = x >= start.x && x < end.x && y >= start.y && y < end.y;
+				if (!inside && !old_pyramid)
+					continue;
+				// tile index counts from bottom left like the file names
+				jobs.push_back(job(0, vector2i(x/tile_size, (padded_size.y-int(tile_size)-y)/tile_size),
+						   vector2i(x, y), !inside));
+			}
+	} else {
+		const vector2i& t = pyramid->get_level_tiles(level);
+		for (int y = 0; y < t.y; ++y)
+			for (int x = 0; x < t.x; ++x)
+				jobs.push_back(job(level, vector2i(x, y)));
+	}
+	vector2i t(padded_size.x/int(tile_size), padded_size.y/int(tile_size));
+	if (pyramid)
+		t = pyramid->get_level_tiles(level);
+	changed.resize(level + 1);
+	changed[level].resize(t.x * t.y, 0);
+	mutex_locker ml2(stats_mutex);
+	nr_total = jobs.size();
+	nr_done = 0;
+	if (level == 0)
+		start_time = last_print = SDL_GetTicks();
+}
+
+std::string precompute::tile_name(const vector2i& pos) const
+{
+	// bottom left corner...
+	std::ostringstream name;
+	name << padded_size.y-int(tile_size)-pos.y << "_" << pos.x;
+	if (!pyramid)
+		name << ".bz2";
+	return name.str();
+}
+
+bool precompute::reuse_tile(const job& j, const manifest::entry& e, Sint16& minh, Sint16& maxh,
+			    std::vector<Uint8>& data)
+{
+	if (pyramid) {
+		if (!old_pyramid || !old_pyramid->read_compressed_tile(j.level, j.idx, data))
+			return false;
+		const tile_pyramid::tile_info& ti = old_pyramid->get_tile_info(j.level, j.idx);
+		minh = ti.min_height;
+		maxh = ti.max_height;
+	} else {
+		std::ifstream f((outdir + tile_name(j.pos)).c_str(), std::ios::in | std::ios::binary);
+		if (f.fail())
+			return false;
+		data.resize(e.size + 1);
+		f.read((char*)&data[0], data.size());
+		data.resize(f.gcount());
+	}
+	return j.level > 0 || (data.size() == e.size && checksum(&data[0], data.size()) == e.output);
+}
+
+void precompute::process(const job& j, std::ifstream& in, morton_bivector<Sint16>& tile, std::vector<float>& rowbuf)
+{
+	std::vector<Uint8> data;
+	Sint16 minh = 0, maxh = 0;
+	unsigned tile_bytes = tile_size*tile_size*sizeof(Sint16);
+	tile.resize(tile_size);
+	if (j.level > 0) {
+		// coarser tiles are unchanged when all their source tiles are
+		const vector2i& tf = pyramid->get_level_tiles(j.level - 1);
+		bool src_changed = false;
+		for (int y = 2*j.idx.y; y < std::min(2*j.idx.y + 2, tf.y); ++y)
+			for (int x = 2*j.idx.x; x < std::min(2*j.idx.x + 2, tf.x); ++x)
+				src_changed = src_changed || changed[j.level - 1][y*tf.x + x];
+		if (!src_changed && reuse_tile(j, manifest::entry(), minh, maxh, data)) {
+			pyramid->write_compressed_tile(j.level, j.idx, data, minh, maxh);
+			tile_finished(true, 0, data.size());
+			return;
+		}
+		if (!pyramid->compute_coarser_tile(j.level, j.idx, tile)) {
+			tile_finished(false, 0, 0);
+			return;
+		}
+		tile_pyramid::encode_tile(tile, codec, data, minh, maxh);
+		pyramid->write_compressed_tile(j.level, j.idx, data, minh, maxh);
+		changed[j.level][j.idx.y * pyramid->get_level_tiles(j.level).x + j.idx.x] = 1;
+		tile_finished(false, tile_bytes, data.size());
+		return;
+	}
+
+	std::string name = tile_name(j.pos);
+	manifest::entry e;
+	if (j.copy) {
+		// keep result of the last run, the container is rewritten completely
+		if (mf->find(name, e) && reuse_tile(j, e, minh, maxh, data))
+			pyramid->write_compressed_tile(0, j.idx, data, minh, maxh);
+		tile_finished(true, 0, data.size());
+		return;
+	}
+
+	load_tile(in, tile, j.pos, map_size, padded_size, rowbuf);
+	Uint32 source = checksum(tile.data_ptr(), tile_bytes);
+	if (mf->find(name, e) && e.source == source && reuse_tile(j, e, minh, maxh, data)) {
+		if (pyramid)
+			pyramid->write_compressed_tile(0, j.idx, data, minh, maxh);
+		tile_finished(true, 0, data.size());
+		return;
+	}
+
+	if (pyramid) {
+		tile_pyramid::encode_tile(tile, codec, data, minh, maxh);
+		pyramid->write_compressed_tile(0, j.idx, data, minh, maxh);
+		mf->update(name, manifest::entry(source, data.size(), checksum(&data[0], data.size())));
+	} else {
+		std::ostringstream oss;
+		bzip_ostream bout(&oss);
+		bout.write((char *)tile.data_ptr(), tile_bytes);
+		bout.close();
+		std::string compressed = oss.str();
+		std::ofstream file((outdir + name).c_str(), std::ios::out | std::ios::binary);
+		file.write(compressed.data(), compressed.size());
+		file.close();
+		if (file.fail())
+			throw error(std::string("Can't write ") + outdir + name);
+		data.assign(compressed.begin(), compressed.end());
+		mf->update(name, manifest::entry(source, data.size(), checksum(&data[0], data.size())));
+	}
+	changed[0][j.idx.y * (padded_size.x / int(tile_size)) + j.idx.x] = 1;
+	tile_finished(false, tile_bytes, data.size());
+}
+
+void precompute::tile_finished(bool skipped, unsigned in, unsigned out)
+{
+	{
+		mutex_locker ml(stats_mutex);
+		++nr_done;
+		++total_done;
+		if (skipped)
+			++total_skipped;
+		bytes_in += in;
+		bytes_out += out;
+	}
+	print_progress(false);
+}
+
+void precompute::print_progress(bool force)
+{
+	mutex_locker ml(stats_mutex);
+	Uint32 t = SDL_GetTicks();
+	if (!force && t - last_print < 1000)
+		return;
+	last_print = t;
+	double secs = std::max(t - start_time, 1U) / 1000.0;
+	std::cout << "level " << current_level << ": " << nr_done << "/" << nr_total << " tiles, "
+		  << total_skipped << " up to date, " << (bytes_in / 1048576.0) / secs << " MB/s" << std::endl;
+	if (pyramid)
+		pyramid->flush();
+}
+
+void precompute::print_summary()
+{
+	mutex_locker ml(stats_mutex);
+	double secs = std::max(SDL_GetTicks() - start_time, 1U) / 1000.0;
+	std::cout << total_done << " tiles (" << total_done - total_skipped << " computed, "
+		  << total_skipped << " up to date) in " << secs << " s, " << total_done / secs << " tiles/s" << std::endl;
+	std::cout << "compressed " << bytes_in / 1024 << " kb -> " << bytes_out / 1024 << " kb";
+	if (bytes_out > 0)
+		std::cout << " (ratio " << double(bytes_in) / bytes_out << ")";
+	std::cout << ", " << (bytes_in / 1048576.0) / secs << " MB/s" << std::endl;
+}
+
+int mymain(list<string>& args)
+{
+
+	std::string infile, outdir, pyramid_file;
+	tile_pyramid::codec_type codec = tile_pyramid::CODEC_BZIP2;
 	long rows = 10800;
 	long cols = 21600;
 	long sqr_size = 512;
 	bool clip = false;
 	vector2i clip_tl, clip_br;
+#ifdef WIN32
+	unsigned nr_threads = 2;
+#else
+	unsigned nr_threads = std::max(long(sysconf(_SC_NPROCESSORS_ONLN)), 1L);
+#endif
+	unsigned memory_mb = 256;
+	bool force = false;
 	
 	for (std::list<std::string>::iterator it = args.begin(); it != args.end(); ++it) {
 		if(*it == "--help") {
@@ -81,9 +455,16 @@ int mymain(list<string>& args)
 						<< "\t--help\t\t\tshow this"																			<< std::endl
 						<< "\t--infile <file>\t\tthe input file"																<< std::endl
 						<< "\t--outdir <dir>\t\tthe output directory"															<< std::endl
+						<< "\t--pyramid <file>\twrite all tiles and coarser levels to one container file"						<< std::endl
+						<< "\t\t\t\tinstead of single files, use <map dir>/terrain.pyr for the game"					<< std::endl
+						<< "\t--codec <c>\t\tcompression of the container, bzip2 (default), lz or none."						<< std::endl
+						<< "\t\t\t\tlz compresses less, but decompresses much faster"									<< std::endl
 						<< "\t--mapsize X*Y\t\tspecifies map resolution"														<< std::endl
 						<< "\t\t\t\tDefault: 21600*10800"																		<< std::endl
 						<< "\t--tile_size x\t\tthe size for each tile in coarsest level. needs to be power of 2"				<< std::endl
+						<< "\t--threads n\t\tnumber of threads, default: number of cpus"									<< std::endl
+						<< "\t--memory MB\t\tmemory budget, limits the number of threads. Default: 256"						<< std::endl
+						<< "\t--force\t\t\trecompute tiles that are up to date"												<< std::endl
 						<< "\t--clip X1,Y1 X2,Y2\tonly computes a clipped region of the map."									<< std::endl
 						<< "\t\t\t\tthe first X,Y pair are the top left coords, the second pair are the bottom right coords."	<< std::endl
 						<< "\t\t\t\tNOTE: the coordinates have to fit the tile size!"											<< std::endl;
@@ -114,12 +495,45 @@ int mymain(list<string>& args)
 				outdir = *it2;
 			}
 		}
+		if(*it == "--pyramid") {
+			list<string>::iterator it2 = it; ++it2;
+			if (it2 != args.end()) {
+				pyramid_file = *it2;
+			}
+		}
+		if(*it == "--codec") {
+			list<string>::iterator it2 = it; ++it2;
+			if (it2 != args.end()) {
+				if (*it2 == "bzip2") codec = tile_pyramid::CODEC_BZIP2;
+				else if (*it2 == "lz") codec = tile_pyramid::CODEC_LZ;
+				else if (*it2 == "none") codec = tile_pyramid::CODEC_NONE;
+				else {
+					std::cout << "Wrong value for --codec" << std::endl;
+					return -1;
+				}
+			}
+		}
 		if(*it == "--tile_size") {
 			list<string>::iterator it2 = it; ++it2;
 			if (it2 != args.end()) {
 				sqr_size = atol((*it2).c_str());
 			}
 		}
+		if(*it == "--threads") {
+			list<string>::iterator it2 = it; ++it2;
+			if (it2 != args.end()) {
+				nr_threads = std::max(atoi(it2->c_str()), 1);
+			}
+		}
+		if(*it == "--memory") {
+			list<string>::iterator it2 = it; ++it2;
+			if (it2 != args.end()) {
+				memory_mb = atoi(it2->c_str());
+			}
+		}
+		if(*it == "--force") {
+			force = true;
+		}
 		if(*it == "--clip") {
 			list<string>::iterator it2 = it; ++it2;
 			if (it2 != args.end()) {
@@ -141,7 +555,7 @@ int mymain(list<string>& args)
 	}
 	ifstream instream;
 	
-	instream.open(infile.c_str());
+	instream.open(infile.c_str(), std::ios::in | std::ios::binary);
 	if(instream.fail()) {
 		std::cerr << "Could not open file " << infile << std::endl;
 		return(-1);
@@ -183,6 +597,13 @@ int mymain(list<string>& args)
 		end_x = padded_cols;
 		end_y = padded_rows;
 	}
+
+	// each thread needs the tile, its compressed data and a row of input,
+	// bzip2 needs about 8 MB for compression on top
+	unsigned thread_memory = sqr_size*(sizeof(float) + sqr_size*3*sizeof(Sint16))
+		+ ((pyramid_file.empty() || codec == tile_pyramid::CODEC_BZIP2) ? 8 << 20 : 0);
+	unsigned max_threads = std::max(unsigned((Uint64(memory_mb) << 20) / thread_memory), 1U);
+	nr_threads = std::min(nr_threads, max_threads);
 	
 	std::cout << "start precomputing with:" << std::endl;
 	std::cout << "\tinfile: " << infile << std::endl;
@@ -195,40 +616,93 @@ int mymain(list<string>& args)
 	std::cout << "\tclip_br: " << clip_br << std::endl;
 	std::cout << "\tstart: " << vector2i(sqr_x_start, sqr_y_start) << std::endl;
 	std::cout << "\tend: " << vector2i(padded_cols, padded_rows) << std::endl;
-	morton_bivector<Sint16> tile;
-	
-	for (unsigned sqr_y=sqr_y_start; sqr_y<end_y; sqr_y+=sqr_size) {
-		for (unsigned sqr_x=sqr_x_start; sqr_x<end_x; sqr_x+=sqr_size) {
-
-			std::ofstream file;
-			stringstream filename, textname, normname;
-			
-			tile.resize(sqr_size);
-			
-			load_tile(instream, tile, vector2i(sqr_x, sqr_y), vector2i(cols, rows), vector2i(padded_cols, padded_rows));
-		
-			//bottom left corner...
-			filename << outdir;
-			filename << padded_rows-sqr_size-sqr_y;
-			filename << "_";
-			filename << sqr_x;
-			filename << ".bz2";
-			
-			std::cout << filename.str() << std::endl;
-
-			file.open(filename.str().c_str());
-			if(file.fail()) {
-				std::cerr << "Can't open " << filename.str() << " for output" << std::endl;
-				return(-1);
+	std::cout << "\tthreads: " << nr_threads << std::endl;
+	if (!pyramid_file.empty())
+		std::cout << "\tpyramid: " << pyramid_file << std::endl;
+
+	// tiles of the last run are taken from the manifest and the old output
+	std::ostringstream header;
+	header << "map_precompute " << (pyramid_file.empty() ? "files" : "pyramid") << " " << cols << "*" << rows
+	       << " " << sqr_size << " " << int(codec);
+	std::string manifest_file = pyramid_file.empty() ? outdir + "manifest.txt" : pyramid_file + ".manifest";
+	if (force)
+		unlink(manifest_file.c_str());
+	manifest mf(manifest_file, header.str());
+	std::auto_ptr<tile_pyramid> old_pyramid;
+	std::auto_ptr<tile_pyramid_writer> pyramid;
+	std::string old_pyramid_file = pyramid_file + ".old";
+	bool have_old_file = false;
+	if (!pyramid_file.empty()) {
+		vector2i tiles(padded_cols/sqr_size, padded_rows/sqr_size);
+		if (!mf.empty() && is_file(pyramid_file) && rename(pyramid_file.c_str(), old_pyramid_file.c_str()) == 0) {
+			have_old_file = true;
+			try {
+				old_pyramid.reset(new tile_pyramid(old_pyramid_file));
+				if (old_pyramid->get_tile_size() != unsigned(sqr_size) || old_pyramid->get_codec() != codec
+				    || !(old_pyramid->get_level_tiles(0) == tiles))
+					old_pyramid.reset();
+			}
+			catch (std::exception& e) {
+				std::cerr << "Can't use " << old_pyramid_file << ": " << e.what() << std::endl;
 			}
-			
-			bzip_ostream bout(&file);
-			bout.write((char *)tile.data_ptr(), tile.size()*tile.size()*sizeof(Sint16));
-			bout.close();
+		}
+		pyramid.reset(new tile_pyramid_writer(pyramid_file, tiles, sqr_size, codec));
+	}
+
+	precompute pc;
+	pc.infile = infile;
+	pc.outdir = outdir;
+	pc.map_size = vector2i(cols, rows);
+	pc.padded_size = vector2i(padded_cols, padded_rows);
+	pc.tile_size = sqr_size;
+	pc.codec = codec;
+	pc.pyramid = pyramid.get();
+	pc.old_pyramid = old_pyramid.get();
+	pc.mf = &mf;
 
-			file.close();
+	// coarser levels are computed from the finer level, so levels are done one after another
+	morton_bivector<Sint16> tile;
+	std::vector<float> rowbuf;
+	unsigned nr_levels = pyramid.get() ? pyramid->get_nr_of_levels() : 1;
+	for (unsigned level = 0; level < nr_levels; ++level) {
+		pc.add_jobs(level, vector2i(sqr_x_start, sqr_y_start), vector2i(end_x, end_y));
+		std::vector<precompute_worker*> workers;
+		try {
+			for (unsigned i = 1; i < nr_threads; ++i) {
+				workers.push_back(new precompute_worker(pc));
+				workers.back()->start();
+			}
+			precompute::job j;
+			while (pc.next_job(j))
+				pc.process(j, instream, tile, rowbuf);
+		}
+		catch (...) {
+			for (unsigned i = 0; i < workers.size(); ++i) {
+				try { workers[i]->destruct(); }
+				catch (...) {}
+			}
+			throw;
 		}
+		// all jobs are taken, wait for the workers to finish theirs
+		std::string worker_error;
+		for (unsigned i = 0; i < workers.size(); ++i) {
+			try { workers[i]->join(); }
+			catch (std::exception& e) { worker_error = e.what(); }
+		}
+		if (!worker_error.empty())
+			throw error(worker_error);
+		pc.print_progress(true);
+	}
+
+	if (pyramid.get()) {
+		pyramid->close();
+		std::cout << "container data size " << pyramid->get_data_size() / 1024 << " kb" << std::endl;
 	}
+	old_pyramid.reset();
+	if (have_old_file)
+		unlink(old_pyramid_file.c_str());
+	mf.save();
+	pc.print_summary();
 	std::cout << "complete" << std::endl;
 	return 0;
 	 
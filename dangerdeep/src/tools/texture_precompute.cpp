@@ -0,0 +1,172 @@
+/*
+ * Danger from the Deep - Open source submarine simulation
+ * Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Compresses PNG/JPG textures and images to DDS files (BC1/BC3/BC5 with mipmaps)
+   that class texture loads instead of the source images */
+
+#include <SDL.h>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <list>
+
+#include "../oglext/OglExt.h"
+#include "../mymain.cpp"
+#include "../texture.h"
+#include "../dxt_compressor.h"
+#include "../datadirs.h"
+#include "../filehelper.h"
+
+static unsigned bpp_of_format(int format)
+{
+	switch (format) {
+	case GL_LUMINANCE: return 1;
+	case GL_LUMINANCE_ALPHA: return 2;
+	case GL_RGB: return 3;
+	default: return 4;
+	}
+}
+
+// normal maps are named x_normal.png or x_normal.jpg, RGB holds the normal
+static bool is_normal_map(const std::string& filename, unsigned bpp)
+{
+	std::string::size_type st = filename.rfind(".");
+	return bpp == 3 && st != std::string::npos && st >= 7
+		&& filename.substr(st - 7, 7) == "_normal";
+}
+
+static bool compress_file(const std::string& filename, const std::string& outdir, bool force,
+			  bool use_bc5, unsigned& bytes_in, unsigned& bytes_out)
+{
+	std::string outname = outdir + texture::get_cache_filename(filename);
+	if (!force && get_file_modification_time(outname) >= texture::get_source_modification_time(filename))
+		return false;
+
+	sdl_image img(filename);
+	unsigned w = img->w, h = img->h;
+	int format = 0;
+	std::vector<Uint8> data = texture::sdl_get_data(img.get_SDL_Surface(), 0, 0, w, h, w, h,
+							false, format, filename);
+	unsigned bpp = bpp_of_format(format);
+	dxt_compressor::format fmt = dxt_compressor::choose_format(bpp);
+	if (use_bc5 && is_normal_map(filename, bpp))
+		fmt = dxt_compressor::BC5;
+	unsigned nr_levels = 0;
+	std::vector<Uint8> compressed = dxt_compressor::compress_mipmapped(data, w, h, bpp, fmt, nr_levels);
+	dxt_compressor::write_dds(outname, compressed, w, h, nr_levels, fmt);
+	bytes_in += data.size();
+	bytes_out += compressed.size();
+	std::cout << outname << " (" << w << "x" << h << ", " << nr_levels << " levels)" << std::endl;
+	return true;
+}
+
+static void compress_directory(const std::string& dir, const std::string& outdir, bool force,
+			       bool use_bc5, unsigned& nr_files, unsigned& bytes_in, unsigned& bytes_out)
+{
+	directory d(dir);
+	for (std::string f = d.read(); !f.empty(); f = d.read()) {
+		std::string::size_type st = f.rfind(".");
+		if (st == std::string::npos) continue;
+		std::string ext = f.substr(st);
+		if (ext != ".png" && ext != ".jpg") continue;
+		std::list<std::string> names;
+		names.push_back(dir + f);
+		// a jpg with a png of the same name is also loaded as "x.jpg|png", color with alpha
+		std::string basename = dir + f.substr(0, st);
+		if (ext == ".jpg" && is_file(basename + ".png"))
+			names.push_back(basename + ".jpg|png");
+		for (std::list<std::string>::iterator it = names.begin(); it != names.end(); ++it) {
+			try {
+				if (compress_file(*it, outdir, force, use_bc5, bytes_in, bytes_out))
+					++nr_files;
+			}
+			catch (std::exception& e) {
+				std::cerr << "Skipping " << *it << ": " << e.what() << std::endl;
+			}
+		}
+	}
+}
+
+int mymain(list<string>& args)
+{
+	std::string datadir, outdir;
+	bool force = false;
+	bool use_bc5 = false;
+
+	for (std::list<std::string>::iterator it = args.begin(); it != args.end(); ++it) {
+		if(*it == "--help") {
+			std::cout   << "*** Danger from the Deep texture compressor ***"					<< std::endl
+						<< "usage: texture_precompute [options]\n"					<< std::endl
+						<< "options:"								<< std::endl
+						<< "\t--help\t\t\tshow this"						<< std::endl
+						<< "\t--datadir <dir>\t\tthe data directory with textures/ and images/"	<< std::endl
+						<< "\t--outdir <dir>\t\tthe output directory"				<< std::endl
+						<< "\t\t\t\tDefault: <datadir>/texcache/"				<< std::endl
+						<< "\t--force\t\t\trecompress files that are up to date"		<< std::endl
+						<< "\t--bc5\t\t\tstore normal maps (x_normal.png/jpg) as BC5, only XY."	<< std::endl
+						<< "\t\t\t\tNOTE: shaders must reconstruct Z!"				<< std::endl;
+			return 0;
+		}
+		if(*it == "--datadir") {
+			list<string>::iterator it2 = it; ++it2;
+			if (it2 != args.end()) {
+				datadir = *it2;
+			}
+		}
+		if(*it == "--outdir") {
+			list<string>::iterator it2 = it; ++it2;
+			if (it2 != args.end()) {
+				outdir = *it2;
+			}
+		}
+		if(*it == "--force") {
+			force = true;
+		}
+		if(*it == "--bc5") {
+			use_bc5 = true;
+		}
+	}
+
+	if (!datadir.empty()) {
+		if (datadir[datadir.length()-1] != '/')
+			datadir += "/";
+		set_data_dir(datadir);
+	}
+	if (outdir.empty())
+		outdir = get_data_dir() + "texcache/";
+	if (outdir[outdir.length()-1] != '/')
+		outdir += "/";
+	if (!is_directory(outdir) && !make_dir(outdir)) {
+		std::cerr << "Can't create output directory " << outdir << std::endl;
+		return -1;
+	}
+
+	std::cout << "start precomputing with:" << std::endl;
+	std::cout << "\tdatadir: " << get_data_dir() << std::endl;
+	std::cout << "\toutdir: " << outdir << std::endl;
+
+	unsigned nr_files = 0, bytes_in = 0, bytes_out = 0;
+	compress_directory(get_texture_dir(), outdir, force, use_bc5, nr_files, bytes_in, bytes_out);
+	compress_directory(get_image_dir(), outdir, force, use_bc5, nr_files, bytes_in, bytes_out);
+
+	std::cout << "complete, " << nr_files << " files compressed, " << bytes_in/1024 << " kb -> "
+		  << bytes_out/1024 << " kb" << std::endl;
+	return 0;
+}
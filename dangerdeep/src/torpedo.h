@@ -24,6 +24,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #define TORPEDO_H
 
 #include "ship.h"
+#include "object_pool.h"
 
 /*
 description and info is per language and class-wide.
@@ -72,7 +73,7 @@ Pi: angle of impact? unsure
 ///\brief Represents a torpedo with simulation of it.
 /** Different types of prupulsion or warheads are possible.
     Torpedo attributes are defined via specification XML file. */
-class torpedo : public ship
+class torpedo : public ship, public pooled<torpedo>
 {
  public:
 	/// data about a torpedo fuse
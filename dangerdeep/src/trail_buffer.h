@@ -0,0 +1,108 @@
+/*
+Danger from the Deep - Open source submarine simulation
+Copyright (C) 2003-2006  Thorsten Jordan, Luis Barrancos and others.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// history of previous positions of a ship
+// subsim (C)+(W) Thorsten Jordan. SEE LICENSE
+
+#ifndef TRAIL_BUFFER_H
+#define TRAIL_BUFFER_H
+
+#include "vector2.h"
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+///\brief Ring buffer of previous positions of a ship with fixed capacity.
+/** Position, direction, time and speed are stored in separate arrays.
+    New entries are written in front of the older ones, so the history is
+    available as at most two contiguous spans, newest entry first, that can
+    be streamed without traversing lists or allocating memory.
+*/
+class trail_buffer
+{
+ public:
+	/// a contiguous part of the history, newest entry first
+	struct span
+	{
+		const vector2* pos;	// (center) pos of ship
+		const vector2* dir;	// direction (heading) of ship
+		const double* time;	// absolute time when position was recorded
+		const double* speed;	// speed of ship when position was recorded
+		unsigned size;
+		span() : pos(0), dir(0), time(0), speed(0), size(0) {}
+	};
+
+	/// create buffer that can hold given number of entries
+	trail_buffer(unsigned capacity)
+		: positions(capacity), directions(capacity), times(capacity), speeds(capacity),
+		  first(0), count(0)
+	{
+		if (capacity == 0)
+			throw std::invalid_argument("trail_buffer capacity must not be zero");
+	}
+
+	/// add newest entry, oldest entry is dropped if buffer is full
+	void push_front(const vector2& p, const vector2& d, double t, double s) {
+		first = (first == 0) ? capacity() - 1 : first - 1;
+		positions[first] = p;
+		directions[first] = d;
+		times[first] = t;
+		speeds[first] = s;
+		if (count < capacity())
+			++count;
+	}
+
+	/// remove all entries
+	void clear() { first = 0; count = 0; }
+
+	unsigned size() const { return count; }
+	bool empty() const { return count == 0; }
+	unsigned capacity() const { return positions.size(); }
+
+	/// get position of newest entry, buffer must not be empty
+	const vector2& front_pos() const { return positions[first]; }
+
+	/// get number of spans (0...2) that hold the history
+	unsigned get_nr_of_spans() const { return (count == 0) ? 0 : ((first + count > capacity()) ? 2 : 1); }
+
+	/// get span 0 (newest entries) or 1 (oldest entries, if buffer wraps)
+	span get_span(unsigned nr) const {
+		span s;
+		unsigned n0 = std::min(count, capacity() - first);
+		unsigned begin = (nr == 0) ? first : 0;
+		s.size = (nr == 0) ? n0 : count - n0;
+		if (s.size > 0) {
+			s.pos = &positions[begin];
+			s.dir = &directions[begin];
+			s.time = &times[begin];
+			s.speed = &speeds[begin];
+		}
+		return s;
+	}
+
+ protected:
+	std::vector<vector2> positions;
+	std::vector<vector2> directions;
+	std::vector<double> times;
+	std::vector<double> speeds;
+	unsigned first;	// index of newest entry
+	unsigned count;
+};
+
+#endif
@@ -516,7 +516,7 @@ void water::draw_foam_for_ship(const game& gm, const ship* shp, const vector3& v
 	double tm = gm.get_time();
 
 	// draw foam caused by trail.
-	const list<ship::prev_pos>& prevposn = shp->get_previous_positions();
+	const trail_buffer& prevposn = shp->get_previous_positions();
 	// can render strip of quads only when more than one position is stored.
 	if (prevposn.empty())
 		return;
@@ -537,45 +537,42 @@ void water::draw_foam_for_ship(const game& gm, const ship* shp, const vector3& v
 	foamtrail.vertices[1] = vector3f(pr.x, pr.y, -viewpos.z);
 
 	// iterate over stored positions, compute normal for trail for each position and width
-	list<ship::prev_pos>::const_iterator pit = prevposn.begin();
-	//double dist = 0;
-// 	cout << "new trail\n";
-// 	int ctr=0;
 	unsigned pitc = 2;
-	while (pit != prevposn.end()) {
-		vector2 p = pit->pos + (pit->dir * (sl*0.5)) - viewpos.xy();
-		vector2 nrml = pit->dir.orthogonal();
-		// amount of foam (density) depends on time (age). foam vanishs after 30seconds
-		double age = tm - pit->time;
-		double foamamount = fmax(0.0, 1.0 - age * (1.0/30));
-		// width of foam trail depends on speed and time.
-		// "young" foam is growing to max. width, max. width is determined by speed
-		// width is speed in m/s * 2, gives ca. 34m wide foam on each side with 34kts.
-		double maxwidth = pit->speed * 2.0;
-		double foamwidth = (1.0 - 1.0/(age * 0.25 + 1.0)) * maxwidth;
-// 		cout << "[" << ctr++ << "] age=" << age << " amt=" << foamamount << " maxw=" << maxwidth
-// 		     << " fw=" << foamwidth << "\n";
-		++pit;	// now pit points to next point
-		if (pit == prevposn.end()) {
-			// amount is always zero on last point, to blend smoothly
-			foamamount = 0;
+	unsigned remaining = prevposn.size();
+	for (unsigned s = 0; s < prevposn.get_nr_of_spans(); ++s) {
+		trail_buffer::span sp = prevposn.get_span(s);
+		for (unsigned i = 0; i < sp.size; ++i) {
+			vector2 p = sp.pos[i] + (sp.dir[i] * (sl*0.5)) - viewpos.xy();
+			vector2 nrml = sp.dir[i].orthogonal();
+			// amount of foam (density) depends on time (age). foam vanishs after 30seconds
+			double age = tm - sp.time[i];
+			double foamamount = fmax(0.0, 1.0 - age * (1.0/30));
+			// width of foam trail depends on speed and time.
+			// "young" foam is growing to max. width, max. width is determined by speed
+			// width is speed in m/s * 2, gives ca. 34m wide foam on each side with 34kts.
+			double maxwidth = sp.speed[i] * 2.0;
+			double foamwidth = (1.0 - 1.0/(age * 0.25 + 1.0)) * maxwidth;
+			if (--remaining == 0) {
+				// amount is always zero on last point, to blend smoothly
+				foamamount = 0;
+			}
+			// move p to viewer space
+			vector2 pl = p - nrml * foamwidth;
+			vector2 pr = p + nrml * foamwidth;
+			col.a = Uint8(foamamount*255);
+			foamtrail.colors[pitc] = col;
+			foamtrail.colors[pitc+1] = col;
+			//y-coord depends on total length somehow, rather on distance between two points.
+			//but it should be fix for any position on the foam, or the edge of the foam
+			//will "jump", an ugly effect - we use a workaround here to use time as fake
+			//distance and take mod 3600 to keep fix y coords.
+			double yc = myfmod((tm - age) * 0.1, 3600);
+			foamtrail.texcoords[pitc] = vector2f(0, yc);
+			foamtrail.texcoords[pitc+1] = vector2f(1, yc);
+			foamtrail.vertices[pitc] = vector3f(pl.x, pl.y, -viewpos.z);
+			foamtrail.vertices[pitc+1] = vector3f(pr.x, pr.y, -viewpos.z);
+			pitc += 2;
 		}
-		// move p to viewer space
-		vector2 pl = p - nrml * foamwidth;
-		vector2 pr = p + nrml * foamwidth;
-		col.a = Uint8(foamamount*255);
-		foamtrail.colors[pitc] = col;
-		foamtrail.colors[pitc+1] = col;
-		//y-coord depends on total length somehow, rather on distance between two points.
-		//but it should be fix for any position on the foam, or the edge of the foam
-		//will "jump", an ugly effect - we use a workaround here to use time as fake
-		//distance and take mod 3600 to keep fix y coords.
-		double yc = myfmod((tm - age) * 0.1, 3600);
-		foamtrail.texcoords[pitc] = vector2f(0, yc);
-		foamtrail.texcoords[pitc+1] = vector2f(1, yc);
-		foamtrail.vertices[pitc] = vector3f(pl.x, pl.y, -viewpos.z);
-		foamtrail.vertices[pitc+1] = vector3f(pr.x, pr.y, -viewpos.z);
-		pitc += 2;
 	}
 	foamtrail.render();
 }
@@ -980,6 +977,15 @@ float water::get_height(const vector2& pos) const
 
 
 
+void water::get_heights(const vector2& origin, const float* x, const float* y, float* heights,
+			unsigned n) const
+{
+	for (unsigned i = 0; i < n; ++i)
+		heights[i] = get_height(vector2(origin.x + x[i], origin.y + y[i]));
+}
+
+
+
 vector3f water::get_wave_normal_at(unsigned x, unsigned y) const
 {
 	unsigned x1 = (x + wave_resolution - 1) & (wave_resolution-1);
@@ -227,6 +227,8 @@ public:
 	// give absolute position of viewer as viewpos, but modelview matrix without translational component!
 	void display(const vector3& viewpos, double max_view_dist, bool under_water = false) const;
 	float get_height(const vector2& pos) const;
+	/// compute heights for n positions origin + (x[i], y[i]) at once
+	void get_heights(const vector2& origin, const float* x, const float* y, float* heights, unsigned n) const;
 	// give f as multiplier for difference to (0,0,1)
 	vector3f get_normal(const vector2& pos, double f = 1.0) const;
 	static float exact_fresnel(float x);
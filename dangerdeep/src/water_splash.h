@@ -24,9 +24,10 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 #include "sea_object.h"
 #include "bspline.h"
+#include "object_pool.h"
 #include <vector>
 
-class water_splash : public sea_object
+class water_splash : public sea_object, public pooled<water_splash>
 {
  private:
 	water_splash();
@@ -52,7 +53,7 @@ class water_splash : public sea_object
 	water_splash(game& gm, const vector3& pos, double risetime = 0.4, double riseheight = 25.0);
 	void simulate(double delta_time);
 	void display() const;
-	void display_mirror_clip() const;
+	void display_mirror_clip(unsigned lod = 0) const;
 	void compute_force_and_torque(vector3& F, vector3& T) const {} // static object, no acceleration
 };
 